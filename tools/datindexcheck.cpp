@@ -0,0 +1,221 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * DAT index check.
+ *
+ * Writes synthetic VTABLE/FTABLE files for the base game, ROM2 and ROM4
+ * into a scratch folder and checks how xiloader::datindex resolves them:
+ * file numbers past every table, files no table holds, paths that do not
+ * fit the buffer, and files several VTABLEs claim. Builds on Windows and Linux:
+ *
+ *      g++ -std=c++14 -O2 -I xiloader tools/datindexcheck.cpp xiloader/datindex.cpp xiloader/mappedfile.cpp -o datindexcheck
+ *
+ * Usage:
+ *
+ *      datindexcheck [scratch folder]
+ *
+ * Exits with 0 if every check passed, 1 otherwise.
+ */
+
+#include "datindex.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define SEPARATOR   "\\"
+#else
+#include <sys/stat.h>
+#define SEPARATOR   "/"
+#endif
+
+static int s_Failed = 0;
+
+#define CHECK(condition)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            s_Failed++;                                                         \
+        }                                                                       \
+    } while (0)
+
+/**
+ * @brief Creates a folder; an existing folder is fine.
+ */
+static void makefolder(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+/**
+ * @brief Writes a VTABLE and an FTABLE.
+ *
+ * @param vpath     The path of the VTABLE.
+ * @param fpath     The path of the FTABLE.
+ * @param vtable    One byte per file number; nonzero if the ROM holds the file.
+ * @param ftable    One location per file number; may cover fewer file numbers than the VTABLE.
+ */
+static void writetables(const std::string& vpath, const std::string& fpath, const std::vector<uint8_t>& vtable, const std::vector<uint16_t>& ftable)
+{
+    auto file = fopen(vpath.c_str(), "wb");
+    if (file != nullptr)
+    {
+        fwrite(vtable.data(), 1, vtable.size(), file);
+        fclose(file);
+    }
+
+    /* FTABLE entries are little endian.. */
+    file = fopen(fpath.c_str(), "wb");
+    if (file != nullptr)
+    {
+        for (auto location : ftable)
+        {
+            uint8_t entry[2] = { static_cast<uint8_t>(location), static_cast<uint8_t>(location >> 8) };
+            fwrite(entry, 1, sizeof(entry), file);
+        }
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Checks the path of a file number.
+ */
+static void checkpath(const xiloader::datindex& index, uint32_t fileNo, const std::string& expected)
+{
+    char buffer[512];
+    auto length = index.path(fileNo, buffer, sizeof(buffer));
+    CHECK(length == expected.size());
+    CHECK(expected == (length != 0 ? buffer : ""));
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
+    std::string root = argc > 1 ? argv[1] : "datindexcheck";
+#else
+    std::string root = argc > 1 ? argv[1] : "/tmp/datindexcheck";
+#endif
+    makefolder(root);
+    makefolder(root + SEPARATOR "ROM2");
+    makefolder(root + SEPARATOR "ROM3");
+    makefolder(root + SEPARATOR "ROM4");
+    root += SEPARATOR;
+
+    /* Base game: 16 file numbers; 0, 2 and 5 are held.. */
+    std::vector<uint8_t> vtable(16, 0);
+    std::vector<uint16_t> ftable(16, 0);
+    vtable[0] = 1; ftable[0] = 0x0001;          // ROM/0/1.DAT
+    vtable[2] = 1; ftable[2] = 0x0085;          // ROM/1/5.DAT
+    vtable[5] = 1; ftable[5] = 0x0102;          // ROM/2/2.DAT
+    writetables(root + "VTABLE.DAT", root + "FTABLE.DAT", vtable, ftable);
+
+    /* ROM2: 32 file numbers; 5 again, 20 and 25.. */
+    vtable.assign(32, 0);
+    ftable.assign(32, 0);
+    vtable[5] = 2; ftable[5] = 0x0203;          // ROM2/4/3.DAT; the base game holds it first
+    vtable[20] = 2; ftable[20] = 0x0187;        // ROM2/3/7.DAT
+    vtable[25] = 2; ftable[25] = 0x0010;        // ROM2/0/16.DAT
+    writetables(root + "ROM2" SEPARATOR "VTABLE2.DAT", root + "ROM2" SEPARATOR "FTABLE2.DAT", vtable, ftable);
+
+    /* ROM3 is not installed: its folder exists, its tables do not.. */
+    remove((root + "ROM3" SEPARATOR "VTABLE3.DAT").c_str());
+    remove((root + "ROM3" SEPARATOR "FTABLE3.DAT").c_str());
+
+    /* ROM4: a 48 byte VTABLE, but an FTABLE of only 40 file numbers.. */
+    vtable.assign(48, 0);
+    ftable.assign(40, 0);
+    vtable[5] = 4; ftable[5] = 0x0300;          // ROM4/6/0.DAT; held first by the base game
+    vtable[25] = 4; ftable[25] = 0x0301;        // ROM4/6/1.DAT; held first by ROM2
+    vtable[30] = 4; ftable[30] = 0x7FFF;        // ROM4/255/127.DAT
+    vtable[45] = 4;                             // Past the end of the FTABLE
+    writetables(root + "ROM4" SEPARATOR "VTABLE4.DAT", root + "ROM4" SEPARATOR "FTABLE4.DAT", vtable, ftable);
+
+    xiloader::datindex index;
+    CHECK(!index.open(nullptr));
+    CHECK(!index.open(""));
+    CHECK(!index.open((root + "ROM3").c_str()));
+    CHECK(index.open(root.c_str()));
+    CHECK(index.count() == 40);
+
+    /* Files of a single table.. */
+    uint32_t rom = 0, location = 0;
+    CHECK(index.lookup(0, &rom, &location) && rom == 1 && location == 0x0001);
+    CHECK(index.lookup(20, &rom, &location) && rom == 2 && location == 0x0187);
+    CHECK(index.lookup(30, &rom, &location) && rom == 4 && location == 0x7FFF);
+    checkpath(index, 0, root + "ROM" SEPARATOR "0" SEPARATOR "1.DAT");
+    checkpath(index, 2, root + "ROM" SEPARATOR "1" SEPARATOR "5.DAT");
+    checkpath(index, 20, root + "ROM2" SEPARATOR "3" SEPARATOR "7.DAT");
+    checkpath(index, 30, root + "ROM4" SEPARATOR "255" SEPARATOR "127.DAT");
+
+    /* Files several VTABLEs claim resolve to the lowest ROM.. */
+    CHECK(index.lookup(5, &rom, &location) && rom == 1 && location == 0x0102);
+    CHECK(index.lookup(25, &rom, &location) && rom == 2 && location == 0x0010);
+    checkpath(index, 5, root + "ROM" SEPARATOR "2" SEPARATOR "2.DAT");
+    checkpath(index, 25, root + "ROM2" SEPARATOR "0" SEPARATOR "16.DAT");
+
+    /* Files no table holds, including one past the end of its FTABLE.. */
+    for (uint32_t fileNo : { 1u, 15u, 16u, 31u, 39u })
+    {
+        CHECK(!index.lookup(fileNo, &rom, &location));
+        checkpath(index, fileNo, "");
+    }
+
+    /* File numbers past every table.. */
+    for (uint32_t fileNo : { 40u, 45u, 47u, 48u, 65535u, 0xFFFFFFFFu })
+    {
+        CHECK(!index.lookup(fileNo, &rom, &location));
+        checkpath(index, fileNo, "");
+    }
+
+    /* Paths that do not fit the buffer, down to no buffer at all.. */
+    auto expected = root + "ROM2" SEPARATOR "3" SEPARATOR "7.DAT";
+    std::vector<char> buffer(expected.size() + 1);
+    CHECK(index.path(20, buffer.data(), buffer.size()) == expected.size() && expected == buffer.data());
+    CHECK(index.path(20, buffer.data(), expected.size()) == 0);
+    CHECK(index.path(20, buffer.data(), 1) == 0);
+    CHECK(index.path(20, nullptr, 0) == 0);
+
+    /* A closed index holds nothing.. */
+    index.close();
+    CHECK(index.count() == 0);
+    CHECK(!index.lookup(0, &rom, &location));
+
+    if (s_Failed != 0)
+    {
+        fprintf(stderr, "%d checks failed.\n", s_Failed);
+        return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * Console logger benchmark.
+ *
+ * Measures the cost of xiloader::console::output with the legacy renderer
+ * (three flushed writes per line), the single-write renderer on the calling
+ * thread, and the asynchronous logger ring.
+ * Redirect stdout to a file or NUL to measure the logger rather than the
+ * console window; the results are printed to stderr.
+ */
+
+#include "console.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+bool g_Hide = false;
+
+using benchclock = std::chrono::steady_clock;
+
+/**
+ * @brief Replicates the synchronous console::output path the logger replaced.
+ */
+template<typename... Args>
+static void output_sync(xiloader::color c, char const* format, Args... args)
+{
+    char buffer[1024];
+    ::snprintf(buffer, sizeof buffer, format, args...);
+
+    auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    xiloader::console::emit(static_cast<uint16_t>(c), timestamp, buffer);
+}
+
+/**
+ * @brief Replicates the console renderer before single-write lines: prefix,
+ * message and newline went out as three separately flushed writes.
+ */
+template<typename... Args>
+static void output_legacy(xiloader::color c, char const* format, Args... args)
+{
+    char buffer[1024];
+    ::snprintf(buffer, sizeof buffer, format, args...);
+
+    auto rawtime = ::time(nullptr);
+    ::tm timeinfo;
+#ifdef _WIN32
+    ::localtime_s(&timeinfo, &rawtime);
+#else
+    ::localtime_r(&rawtime, &timeinfo);
+#endif
+    char prefix[64];
+    ::strftime(prefix, sizeof prefix, "[%m/%d/%y %H:%M:%S] ", &timeinfo);
+
+    auto attr = static_cast<int>(c);
+    auto code = ((attr & 8) ? 90 : 30) + ((attr & 4) ? 1 : 0) + ((attr & 2) ? 2 : 0) + ((attr & 1) ? 4 : 0);
+
+    std::cout << "\x1b[93m" << prefix << std::flush;
+    std::cout << "\x1b[" << code << "m" << buffer << "\x1b[0m" << std::flush;
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Converts a duration to fractional seconds.
+ */
+static double seconds(benchclock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+}
+
+int main(int argc, char* argv[])
+{
+    auto lines = argc > 1 ? atoi(argv[1]) : 100000;
+    if (lines <= 0)
+        lines = 100000;
+
+    /* Legacy: three writes per line on the calling thread.. */
+    auto start = benchclock::now();
+    for (auto x = 0; x < lines; x++)
+        output_legacy(xiloader::color::debug, "Resolving host: %s (%d)", "ffxi00.pol.com", x);
+    auto legacyTime = seconds(benchclock::now() - start);
+
+    /* Before: format and print on the calling thread.. */
+    start = benchclock::now();
+    for (auto x = 0; x < lines; x++)
+        output_sync(xiloader::color::debug, "Resolving host: %s (%d)", "ffxi00.pol.com", x);
+    auto syncTime = seconds(benchclock::now() - start);
+
+    /* After: queue into the logger and let the writer thread print.. */
+    xiloader::console::output(xiloader::color::debug, "warming up logger");
+    xiloader::console::flush();
+
+    start = benchclock::now();
+    for (auto x = 0; x < lines; x++)
+        xiloader::console::output(xiloader::color::debug, "Resolving host: %s (%d)", "ffxi00.pol.com", x);
+    auto pushTime = seconds(benchclock::now() - start);
+    xiloader::console::flush();
+    auto asyncTime = seconds(benchclock::now() - start);
+
+    auto dropped = xiloader::logger::dropped();
+
+    fprintf(stderr, "lines               : %d\n", lines);
+    fprintf(stderr, "legacy (3 writes)   : %.0f lines/s, %.1f ns per call\n", lines / legacyTime, legacyTime * 1e9 / lines);
+    fprintf(stderr, "before (sync)       : %.0f lines/s, %.1f ns per call\n", lines / syncTime, syncTime * 1e9 / lines);
+    fprintf(stderr, "after  (caller)     : %.0f lines/s, %.1f ns per call\n", lines / pushTime, pushTime * 1e9 / lines);
+    fprintf(stderr, "after  (end-to-end) : %.0f lines/s\n", (lines - dropped) / asyncTime);
+    fprintf(stderr, "dropped             : %u\n", dropped);
+
+    xiloader::logger::stop();
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * DAT mirror sync tool.
+ *
+ * Writes the block signature index of a mirror folder, or brings an
+ * installation up to date with one, reading only the blocks that differ;
+ * xiloader --sync performs the same update on the installed client. Builds
+ * on Windows and Linux:
+ *
+ *      g++ -std=c++14 -O2 -pthread -I xiloader tools/xidatsync.cpp xiloader/datsync.cpp xiloader/datmanifest.cpp xiloader/datindex.cpp xiloader/mappedfile.cpp xiloader/console.cpp xiloader/logger.cpp xiloader/logformat.cpp -o xidatsync
+ *
+ * Usage:
+ *
+ *      xidatsync --index <mirror folder>
+ *      xidatsync <mirror folder> <install folder>
+ */
+
+#include "console.h"
+#include "datsync.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && !strcmp(argv[1], "--index"))
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!xiloader::datsync::index(argv[2]))
+        {
+            fprintf(stderr, "%s: unable to index the mirror\n", argv[2]);
+            return 1;
+        }
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s written in %.1f s.\n", DATSYNC_INDEX, elapsed);
+        return 0;
+    }
+
+    if (argc != 3 || argv[1][0] == '-')
+    {
+        fprintf(stderr, "usage: xidatsync --index <mirror folder>\n       xidatsync <mirror folder> <install folder>\n");
+        return 1;
+    }
+
+    auto result = xiloader::datsync::run(argv[1], argv[2]);
+    xiloader::console::flush();
+    return result;
+}
@@ -0,0 +1,98 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * DAT manifest tool.
+ *
+ * Writes the manifest of a known good FINAL FANTASY XI installation, or
+ * verifies an installation against one; xiloader --verify-install performs
+ * the same check on the installed client. Builds on Windows and Linux:
+ *
+ *      g++ -std=c++14 -O2 -pthread -I xiloader tools/xidatverify.cpp xiloader/datmanifest.cpp xiloader/datindex.cpp xiloader/mappedfile.cpp xiloader/console.cpp xiloader/logger.cpp xiloader/logformat.cpp -o xidatverify
+ *
+ * Usage:
+ *
+ *      xidatverify [--write] <install folder> <manifest>
+ */
+
+#include "console.h"
+#include "datmanifest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    auto write = false;
+    std::vector<const char*> paths;
+
+    for (auto x = 1; x < argc; ++x)
+    {
+        if (!strcmp(argv[x], "--write"))
+            write = true;
+        else
+            paths.push_back(argv[x]);
+    }
+
+    if (paths.size() != 2)
+    {
+        fprintf(stderr, "usage: xidatverify [--write] <install folder> <manifest>\n");
+        return 1;
+    }
+
+    if (!write)
+    {
+        auto result = xiloader::datmanifest::check(paths[0], paths[1]);
+        xiloader::console::flush();
+        return result;
+    }
+
+    /* List the files through the install's own tables and hash them all.. */
+    std::vector<xiloader::datfile> files;
+    if (!xiloader::datmanifest::scan(paths[0], files))
+    {
+        fprintf(stderr, "%s: unable to read VTABLE.DAT/FTABLE.DAT\n", paths[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto bad = xiloader::datmanifest::verify(paths[0], files, true);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& entry : files)
+    {
+        if (entry.Status != xiloader::datstatus::ok)
+            fprintf(stderr, "%s: unable to read\n", entry.Path.c_str());
+    }
+
+    if (bad != 0 || !xiloader::datmanifest::save(paths[1], files))
+    {
+        fprintf(stderr, "%s: manifest not written\n", paths[1]);
+        return 1;
+    }
+
+    printf("%u files hashed in %.1f s.\n", static_cast<uint32_t>(files.size()), elapsed);
+    return 0;
+}
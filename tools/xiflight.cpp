@@ -0,0 +1,202 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * Flight recorder reader.
+ *
+ * Prints the events held by a loader's flight recorder file. The file can be
+ * read while the game is running (the loader is never paused) or after the
+ * process crashed or hung. Builds on Windows and Linux:
+ *
+ *      g++ -std=c++14 -O2 -I xiloader tools/xiflight.cpp xiloader/mappedfile.cpp -o xiflight
+ *
+ * Usage:
+ *
+ *      xiflight [--follow] <xiloader.<pid>.flight>
+ */
+
+#include "flightrecorder.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Copy of a slot taken while the loader may still be writing.
+ */
+struct snapshot
+{
+    uint32_t index;
+    uint32_t thread;
+    int64_t timestamp;
+    uint64_t value;
+    uint16_t event;
+    char text[FLIGHT_TEXT_SIZE];
+};
+
+/**
+ * @brief Formats a timestamp (microseconds since the unix epoch) as local time.
+ */
+static std::string timestring(int64_t timestamp)
+{
+    auto rawtime = static_cast<time_t>(timestamp / 1000000);
+    tm timeinfo;
+#ifdef _WIN32
+    localtime_s(&timeinfo, &rawtime);
+#else
+    localtime_r(&rawtime, &timeinfo);
+#endif
+
+    char buffer[64];
+    auto length = strftime(buffer, sizeof buffer, "%m/%d/%y %H:%M:%S", &timeinfo);
+    snprintf(buffer + length, sizeof(buffer) - length, ".%06d", static_cast<int>(timestamp % 1000000));
+    return buffer;
+}
+
+/**
+ * @brief Copies a slot, discarding it if it was empty or changed during the copy.
+ */
+static bool readslot(const xiloader::flightslot* slot, snapshot* copy)
+{
+    auto before = slot->sequence.load(std::memory_order_acquire);
+    if (before == 0)
+        return false;
+
+    copy->thread = slot->thread;
+    copy->timestamp = slot->timestamp;
+    copy->value = slot->value;
+    copy->event = slot->event;
+    memcpy(copy->text, slot->text, sizeof(copy->text));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (slot->sequence.load(std::memory_order_relaxed) != before)
+        return false;
+
+    copy->index = before - 1;
+    copy->text[FLIGHT_TEXT_SIZE - 1] = '\0';
+    return true;
+}
+
+/**
+ * @brief Prints the events numbered [first, last) that are still held by the ring.
+ *
+ * @return The number of events that were overwritten or torn.
+ */
+static uint32_t dump(const xiloader::flightheader* header, uint32_t first, uint32_t last)
+{
+    auto slots = reinterpret_cast<const xiloader::flightslot*>(reinterpret_cast<const uint8_t*>(header) + header->headersize);
+
+    /* Only the newest slotcount events can still be in the ring.. */
+    if (last - first > header->slotcount)
+        first = last - header->slotcount;
+
+    std::vector<snapshot> events;
+    events.reserve(last - first);
+    for (auto index = first; index != last; index++)
+    {
+        snapshot copy;
+        if (readslot(&slots[index & (header->slotcount - 1)], &copy) && copy.index == index)
+            events.push_back(copy);
+    }
+
+    for (auto& e : events)
+    {
+        printf("%s  #%-8u  thread %-8u  %-10s  %-12llu  %s\n",
+            timestring(e.timestamp).c_str(), e.index, e.thread,
+            xiloader::flightrecorder::name(static_cast<xiloader::flightevent>(e.event)),
+            static_cast<unsigned long long>(e.value), e.text);
+    }
+    fflush(stdout);
+
+    return (last - first) - static_cast<uint32_t>(events.size());
+}
+
+int main(int argc, char* argv[])
+{
+    auto follow = false;
+    const char* path = nullptr;
+
+    for (auto x = 1; x < argc; ++x)
+    {
+        if (!strcmp(argv[x], "--follow"))
+            follow = true;
+        else
+            path = argv[x];
+    }
+
+    if (path == nullptr)
+    {
+        fprintf(stderr, "usage: xiflight [--follow] <xiloader.<pid>.flight>\n");
+        return 1;
+    }
+
+    xiloader::mappedfile file;
+    if (!file.open(path, false) || file.size() < sizeof(xiloader::flightheader))
+    {
+        fprintf(stderr, "%s: unable to open\n", path);
+        return 1;
+    }
+
+    auto header = reinterpret_cast<const xiloader::flightheader*>(file.data());
+    if (memcmp(header->magic, FLIGHT_MAGIC, sizeof(header->magic)) != 0 || header->version != FLIGHT_VERSION ||
+        header->slotsize != sizeof(xiloader::flightslot) || header->slotcount == 0 || (header->slotcount & (header->slotcount - 1)) != 0 ||
+        file.size() < header->headersize + static_cast<size_t>(header->slotcount) * header->slotsize)
+    {
+        fprintf(stderr, "%s: not a flight recorder file\n", path);
+        return 1;
+    }
+
+    printf("process %u, recording since %s\n", header->processid, timestring(header->created).c_str());
+
+    auto head = header->head.load(std::memory_order_acquire);
+    auto lost = dump(header, 0, head);
+
+    /* Follow new events until the loader records its clean shutdown.. */
+    while (follow)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto current = header->head.load(std::memory_order_acquire);
+        if (current == head)
+            continue;
+
+        /* Give writers that just claimed a slot time to finish it.. */
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        lost += dump(header, head, current);
+
+        auto last = reinterpret_cast<const xiloader::flightslot*>(file.data() + header->headersize) + ((current - 1) & (header->slotcount - 1));
+        if (last->event == static_cast<uint16_t>(xiloader::flightevent::stop))
+            break;
+        head = current;
+    }
+
+    if (lost != 0)
+        fprintf(stderr, "%u event(s) overwritten or incomplete\n", lost);
+    return 0;
+}
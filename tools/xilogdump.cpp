@@ -0,0 +1,263 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * Binary log decoder.
+ *
+ * Turns the .xlog files written by the loader's binary log sink back into
+ * text or JSON lines. Builds on Windows and Linux:
+ *
+ *      g++ -std=c++14 -O2 -I xiloader tools/xilogdump.cpp xiloader/logformat.cpp xiloader/mappedfile.cpp -o xilogdump
+ *
+ * Usage:
+ *
+ *      xilogdump [--json] <file.xlog>...
+ */
+
+#include "logfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Obtains the name of a log level.
+ */
+static const char* levelname(uint8_t level)
+{
+    static const char* names[] = { "trace", "debug", "info", "warning", "error" };
+    return level < sizeof(names) / sizeof(names[0]) ? names[level] : "unknown";
+}
+
+/**
+ * @brief Formats a timestamp (microseconds since the unix epoch) as local time.
+ */
+static std::string timestring(int64_t timestamp, bool iso)
+{
+    auto rawtime = static_cast<time_t>(timestamp / 1000000);
+    tm timeinfo;
+#ifdef _WIN32
+    localtime_s(&timeinfo, &rawtime);
+#else
+    localtime_r(&rawtime, &timeinfo);
+#endif
+
+    char buffer[64];
+    auto length = strftime(buffer, sizeof buffer, iso ? "%Y-%m-%dT%H:%M:%S" : "%m/%d/%y %H:%M:%S", &timeinfo);
+    snprintf(buffer + length, sizeof(buffer) - length, ".%03d", static_cast<int>((timestamp / 1000) % 1000));
+    return buffer;
+}
+
+/**
+ * @brief Escapes a string for use inside a JSON string literal.
+ */
+static std::string jsonescape(const std::string& value)
+{
+    std::string output;
+    output.reserve(value.size() + 8);
+
+    for (auto c : value)
+    {
+        switch (c)
+        {
+        case '"': output += "\\\""; break;
+        case '\\': output += "\\\\"; break;
+        case '\n': output += "\\n"; break;
+        case '\r': output += "\\r"; break;
+        case '\t': output += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escape[8];
+                snprintf(escape, sizeof escape, "\\u%04x", c);
+                output += escape;
+            }
+            else
+            {
+                output += c;
+            }
+            break;
+        }
+    }
+    return output;
+}
+
+/**
+ * @brief Checks that a payload holds only well-formed, position independent arguments.
+ */
+static bool validpayload(const uint8_t* payload, size_t size)
+{
+    for (size_t offset = 0; offset < size;)
+    {
+        switch (static_cast<xiloader::logarg>(payload[offset++]))
+        {
+        case xiloader::logarg::int32:
+        case xiloader::logarg::uint32:
+            offset += 4;
+            break;
+        case xiloader::logarg::int64:
+        case xiloader::logarg::uint64:
+        case xiloader::logarg::float64:
+        case xiloader::logarg::pointer:
+            offset += 8;
+            break;
+        case xiloader::logarg::string:
+        {
+            if (offset + 2 > size)
+                return false;
+            uint16_t count = 0;
+            memcpy(&count, payload + offset, sizeof(count));
+            offset += sizeof(count) + count;
+            break;
+        }
+        default:
+            return false;
+        }
+
+        if (offset > size)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes a single log file.
+ */
+static void decode(const std::string& path, const xiloader::mappedfile& file, bool json)
+{
+    auto data = file.data();
+    auto header = reinterpret_cast<const xiloader::logfileheader*>(data);
+
+    size_t end = header->headersize + static_cast<size_t>(header->used);
+    if (end > file.size())
+        end = file.size();
+
+    std::unordered_map<uint32_t, std::string> formats;
+    std::string message;
+
+    for (size_t offset = header->headersize; offset < end;)
+    {
+        auto type = static_cast<xiloader::logfilerecord>(data[offset]);
+
+        if (type == xiloader::logfilerecord::format)
+        {
+            xiloader::logfileformat definition;
+            if (offset + sizeof(definition) > end)
+                break;
+            memcpy(&definition, data + offset, sizeof(definition));
+            if (offset + sizeof(definition) + definition.length > end)
+                break;
+
+            formats[definition.id].assign(reinterpret_cast<const char*>(data + offset + sizeof(definition)), definition.length);
+            offset += sizeof(definition) + definition.length;
+            continue;
+        }
+
+        if (type != xiloader::logfilerecord::entry)
+            break;
+
+        xiloader::logfileentry entry;
+        if (offset + sizeof(entry) > end)
+            break;
+        memcpy(&entry, data + offset, sizeof(entry));
+        if (offset + sizeof(entry) + entry.size > end)
+            break;
+
+        auto payload = data + offset + sizeof(entry);
+        offset += sizeof(entry) + entry.size;
+
+        auto format = formats.find(entry.format);
+        message.clear();
+        if (format == formats.end() || !validpayload(payload, entry.size))
+            message = "<corrupt record>";
+        else
+            xiloader::logformatter::render(format->second.c_str(), payload, entry.size, entry.argc, message);
+
+        if (json)
+        {
+            printf("{\"file\":\"%s\",\"pid\":%u,\"timestamp\":%lld,\"time\":\"%s\",\"level\":\"%s\",\"color\":%u,\"format\":\"%s\",\"message\":\"%s\"}\n",
+                jsonescape(path).c_str(), header->processid, static_cast<long long>(entry.timestamp), timestring(entry.timestamp, true).c_str(),
+                levelname(entry.level), entry.color, jsonescape(format == formats.end() ? std::string() : format->second).c_str(), jsonescape(message).c_str());
+        }
+        else
+        {
+            printf("[%s] %-7s %s\n", timestring(entry.timestamp, false).c_str(), levelname(entry.level), message.c_str());
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    auto json = false;
+    std::vector<std::string> paths;
+
+    for (auto x = 1; x < argc; ++x)
+    {
+        if (!strcmp(argv[x], "--json"))
+            json = true;
+        else
+            paths.push_back(argv[x]);
+    }
+
+    if (paths.empty())
+    {
+        fprintf(stderr, "usage: xilogdump [--json] <file.xlog>...\n");
+        return 1;
+    }
+
+    /* Map every file and order them by their rotation sequence.. */
+    std::vector<std::pair<std::string, std::unique_ptr<xiloader::mappedfile>>> files;
+    for (auto& path : paths)
+    {
+        std::unique_ptr<xiloader::mappedfile> file(new xiloader::mappedfile());
+        if (!file->open(path.c_str(), false) || file->size() < sizeof(xiloader::logfileheader))
+        {
+            fprintf(stderr, "%s: unable to open\n", path.c_str());
+            continue;
+        }
+
+        auto header = reinterpret_cast<const xiloader::logfileheader*>(file->data());
+        if (memcmp(header->magic, LOGFILE_MAGIC, sizeof(header->magic)) != 0 || header->version != LOGFILE_VERSION || header->headersize < sizeof(xiloader::logfileheader))
+        {
+            fprintf(stderr, "%s: not a binary log file\n", path.c_str());
+            continue;
+        }
+
+        files.emplace_back(path, std::move(file));
+    }
+
+    std::sort(files.begin(), files.end(), [](const std::pair<std::string, std::unique_ptr<xiloader::mappedfile>>& a, const std::pair<std::string, std::unique_ptr<xiloader::mappedfile>>& b)
+    {
+        return reinterpret_cast<const xiloader::logfileheader*>(a.second->data())->sequence < reinterpret_cast<const xiloader::logfileheader*>(b.second->data())->sequence;
+    });
+
+    for (auto& file : files)
+        decode(file.first, *file.second, json);
+
+    return files.empty() ? 1 : 0;
+}
@@ -0,0 +1,582 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+/*
+ * Lobby relay daemon.
+ *
+ * Runs on a LAN gateway and relays the account (54231), data (54230) and
+ * lobby (54001) connections of every LAN client to the game server, so the
+ * clients point --server at the gateway instead of each running the hairpin
+ * fix and resolving the server themselves. One thread serves every session
+ * with epoll; buffers are allocated once per session slot and reused, and
+ * a full buffer stops reading from its side until the other side drains it.
+ * The zone traffic of the clients can be relayed as well with --udp, using
+ * the loader's batched UDP relay. Builds on Linux:
+ *
+ *      g++ -std=c++14 -O2 -pthread -I xiloader tools/xirelay.cpp xiloader/udprelay.cpp -o xirelay
+ *
+ * Usage:
+ *
+ *      xirelay --server <host> [--bind <address>] [--ports 54001,54230,54231] [--max <sessions>] [--udp <ports>] [--stats <seconds>]
+ *
+ * Every port is relayed to the same port on the server. A status line is
+ * printed every --stats seconds and on SIGUSR1; SIGINT or SIGTERM stops it.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udprelay.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Bytes buffered per direction of a session. */
+#define RELAY_BUFFER            8192
+
+/* Events taken from epoll per wait. */
+#define RELAY_MAX_EVENTS        512
+
+/* Interval, in seconds, between lookups of the server address. */
+#define RELAY_RESOLVE_INTERVAL  60
+
+/* Marks the epoll data of a listening socket. */
+#define RELAY_LISTENER          (1ull << 63)
+
+/**
+ * @brief A relayed port.
+ */
+struct relaylistener
+{
+    int fd;
+    uint16_t port;
+};
+
+/**
+ * @brief A relayed connection; side 0 is the LAN client, side 1 the server.
+ *
+ * Buffer[side] holds the bytes read from Fd[side] that still have to be
+ * written to the other side.
+ */
+struct relaysession
+{
+    int Fd[2];
+    uint32_t Events[2];
+    std::unique_ptr<uint8_t[]> Buffer[2];
+    uint32_t Offset[2];
+    uint32_t Length[2];
+    bool Eof[2];
+    bool Connected;
+    bool Active;
+};
+
+static volatile sig_atomic_t s_Stop = 0;
+static volatile sig_atomic_t s_Report = 0;
+static std::atomic<uint32_t> s_Address(INADDR_NONE);
+
+static std::vector<relaysession> s_Sessions;
+static std::vector<uint32_t> s_Free;
+static std::vector<uint32_t> s_Closed;
+static int s_Epoll = -1;
+static uint32_t s_Active = 0;
+static uint64_t s_Accepted = 0, s_Refused = 0, s_Failed = 0;
+static uint64_t s_Upstream = 0, s_Downstream = 0;
+static std::vector<std::unique_ptr<xiloader::udprelay>> s_UdpRelays;
+
+/**
+ * @brief Resolves the server to an IPv4 address.
+ *
+ * @return The address in network byte order, INADDR_NONE on failure.
+ */
+static uint32_t resolve(const char* host)
+{
+    struct addrinfo hints;
+    memset(&hints, 0x00, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* info = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &info) != 0)
+        return INADDR_NONE;
+
+    auto address = reinterpret_cast<struct sockaddr_in*>(info->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(info);
+    return address;
+}
+
+/**
+ * @brief Updates the epoll interest of one side of a session to what it can do now.
+ */
+static void watch(uint32_t index, int side)
+{
+    auto& session = s_Sessions[index];
+    auto other = 1 - side;
+
+    uint32_t events = 0;
+    if (!session.Eof[side] && session.Offset[side] + session.Length[side] < RELAY_BUFFER && (side == 0 || session.Connected))
+        events |= EPOLLIN | EPOLLRDHUP;
+    if ((side == 1 && !session.Connected) || session.Length[other] > 0)
+        events |= EPOLLOUT;
+
+    if (events == session.Events[side])
+        return;
+
+    struct epoll_event event;
+    memset(&event, 0x00, sizeof(event));
+    event.events = events;
+    event.data.u64 = (static_cast<uint64_t>(index) << 1) | static_cast<uint64_t>(side);
+    epoll_ctl(s_Epoll, EPOLL_CTL_MOD, session.Fd[side], &event);
+    session.Events[side] = events;
+}
+
+/**
+ * @brief Closes a session; its slot is reused after the current batch of events.
+ */
+static void finish(uint32_t index)
+{
+    auto& session = s_Sessions[index];
+    if (!session.Active)
+        return;
+
+    for (auto side = 0; side < 2; side++)
+    {
+        if (session.Fd[side] >= 0)
+            close(session.Fd[side]);
+        session.Fd[side] = -1;
+    }
+
+    session.Active = false;
+    s_Active--;
+    s_Closed.push_back(index);
+}
+
+/**
+ * @brief Writes the bytes buffered from one side to the other side.
+ *
+ * @return False if the session failed, true otherwise.
+ */
+static bool flush(uint32_t index, int from)
+{
+    auto& session = s_Sessions[index];
+    auto to = 1 - from;
+
+    /* What the client sends early waits for the server connection.. */
+    if (to == 1 && !session.Connected)
+        return true;
+
+    while (session.Length[from] > 0)
+    {
+        auto sent = send(session.Fd[to], session.Buffer[from].get() + session.Offset[from], session.Length[from], MSG_NOSIGNAL);
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        session.Offset[from] += static_cast<uint32_t>(sent);
+        session.Length[from] -= static_cast<uint32_t>(sent);
+        (from == 0 ? s_Upstream : s_Downstream) += static_cast<uint64_t>(sent);
+    }
+
+    /* Pass a half close on once everything before it was delivered.. */
+    session.Offset[from] = 0;
+    if (session.Eof[from])
+        shutdown(session.Fd[to], SHUT_WR);
+    return true;
+}
+
+/**
+ * @brief Reads what one side sent and passes it on.
+ *
+ * @return False if the session failed, true otherwise.
+ */
+static bool readside(uint32_t index, int side)
+{
+    auto& session = s_Sessions[index];
+
+    while (!session.Eof[side] && session.Offset[side] + session.Length[side] < RELAY_BUFFER)
+    {
+        auto tail = session.Offset[side] + session.Length[side];
+        auto received = recv(session.Fd[side], session.Buffer[side].get() + tail, RELAY_BUFFER - tail, 0);
+        if (received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+            return false;
+        }
+
+        if (received == 0)
+            session.Eof[side] = true;
+        session.Length[side] += static_cast<uint32_t>(received);
+
+        if (!flush(index, side))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Accepts every pending client of a port and starts its server connection.
+ */
+static void accept(const relaylistener& listener, uint32_t limit)
+{
+    for (;;)
+    {
+        auto client = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0)
+            return;
+
+        auto address = s_Address.load();
+        if (s_Active >= limit || address == INADDR_NONE)
+        {
+            close(client);
+            s_Refused++;
+            continue;
+        }
+
+        struct sockaddr_in remote;
+        memset(&remote, 0x00, sizeof(remote));
+        remote.sin_family = AF_INET;
+        remote.sin_port = htons(listener.port);
+        remote.sin_addr.s_addr = address;
+
+        auto server = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (server < 0 || (connect(server, reinterpret_cast<struct sockaddr*>(&remote), sizeof(remote)) < 0 && errno != EINPROGRESS))
+        {
+            if (server >= 0)
+                close(server);
+            close(client);
+            s_Failed++;
+            continue;
+        }
+
+        /* The protocol is request and answer; small writes must not wait on Nagle.. */
+        int enable = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        setsockopt(server, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+
+        uint32_t index;
+        if (!s_Free.empty())
+        {
+            index = s_Free.back();
+            s_Free.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(s_Sessions.size());
+            s_Sessions.emplace_back();
+            s_Sessions[index].Buffer[0].reset(new uint8_t[RELAY_BUFFER]);
+            s_Sessions[index].Buffer[1].reset(new uint8_t[RELAY_BUFFER]);
+        }
+
+        auto& session = s_Sessions[index];
+        session.Fd[0] = client;
+        session.Fd[1] = server;
+        session.Connected = false;
+        session.Active = true;
+        for (auto side = 0; side < 2; side++)
+        {
+            session.Offset[side] = 0;
+            session.Length[side] = 0;
+            session.Eof[side] = false;
+            session.Events[side] = 0;
+
+            struct epoll_event event;
+            memset(&event, 0x00, sizeof(event));
+            event.data.u64 = (static_cast<uint64_t>(index) << 1) | static_cast<uint64_t>(side);
+            epoll_ctl(s_Epoll, EPOLL_CTL_ADD, session.Fd[side], &event);
+        }
+
+        s_Active++;
+        s_Accepted++;
+        watch(index, 0);
+        watch(index, 1);
+    }
+}
+
+/**
+ * @brief Handles the readiness of one side of a session.
+ */
+static void handle(uint32_t index, int side, uint32_t events)
+{
+    auto& session = s_Sessions[index];
+    if (!session.Active)
+        return;
+
+    auto ok = true;
+    if (side == 1 && !session.Connected)
+    {
+        if ((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) == 0)
+            return;
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(session.Fd[1], SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+        {
+            s_Failed++;
+            finish(index);
+            return;
+        }
+        session.Connected = true;
+    }
+
+    if (events & EPOLLOUT)
+        ok = flush(index, 1 - side);
+    if (ok && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+        ok = readside(index, side);
+
+    /* Done once both sides closed and everything was delivered, or when a side failed.. */
+    if ((events & (EPOLLERR | EPOLLHUP)) && !session.Eof[side])
+        ok = false;
+    if (!ok || (session.Eof[0] && session.Eof[1] && session.Length[0] == 0 && session.Length[1] == 0))
+    {
+        finish(index);
+        return;
+    }
+
+    watch(index, 0);
+    watch(index, 1);
+}
+
+/**
+ * @brief Prints the status line.
+ */
+static void report(void)
+{
+    printf("relay active=%u accepted=%llu refused=%llu failed=%llu up=%llu down=%llu\n", s_Active, static_cast<unsigned long long>(s_Accepted),
+        static_cast<unsigned long long>(s_Refused), static_cast<unsigned long long>(s_Failed), static_cast<unsigned long long>(s_Upstream),
+        static_cast<unsigned long long>(s_Downstream));
+
+    if (s_UdpRelays.empty())
+    {
+        fflush(stdout);
+        return;
+    }
+
+    xiloader::udprelaystats total;
+    memset(&total, 0x00, sizeof(total));
+    for (auto& relay : s_UdpRelays)
+    {
+        xiloader::udprelaystats stats;
+        relay->stats(&stats);
+        total.Packets += stats.Packets;
+        total.Bytes += stats.Bytes;
+        total.Dropped += stats.Dropped;
+        total.Flows += stats.Flows;
+        total.LatencyTotal += stats.LatencyTotal;
+        total.LatencyMax = stats.LatencyMax > total.LatencyMax ? stats.LatencyMax : total.LatencyMax;
+    }
+
+    printf("udp flows=%u packets=%llu bytes=%llu dropped=%llu avg=%.1fus max=%.1fus\n", total.Flows, static_cast<unsigned long long>(total.Packets),
+        static_cast<unsigned long long>(total.Bytes), static_cast<unsigned long long>(total.Dropped),
+        total.Packets ? total.LatencyTotal / 1000.0 / total.Packets : 0.0, total.LatencyMax / 1000.0);
+    fflush(stdout);
+}
+
+static void onsignal(int signal)
+{
+    if (signal == SIGUSR1)
+        s_Report = 1;
+    else
+        s_Stop = 1;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* host = nullptr;
+    const char* bind = "0.0.0.0";
+    std::string ports = "54001,54230,54231";
+    std::string udp;
+    uint32_t limit = 8192;
+    int interval = 60;
+
+    for (auto x = 1; x < argc; ++x)
+    {
+        if (!strcmp(argv[x], "--server") && x + 1 < argc)
+            host = argv[++x];
+        else if (!strcmp(argv[x], "--bind") && x + 1 < argc)
+            bind = argv[++x];
+        else if (!strcmp(argv[x], "--ports") && x + 1 < argc)
+            ports = argv[++x];
+        else if (!strcmp(argv[x], "--max") && x + 1 < argc)
+            limit = static_cast<uint32_t>(atoi(argv[++x]));
+        else if (!strcmp(argv[x], "--udp") && x + 1 < argc)
+            udp = argv[++x];
+        else if (!strcmp(argv[x], "--stats") && x + 1 < argc)
+            interval = atoi(argv[++x]);
+        else
+        {
+            host = nullptr;
+            break;
+        }
+    }
+
+    if (host == nullptr)
+    {
+        fprintf(stderr, "usage: xirelay --server <host> [--bind <address>] [--ports 54001,54230,54231] [--max <sessions>] [--udp <ports>] [--stats <seconds>]\n");
+        return 1;
+    }
+
+    /* Two descriptors per session, plus the listeners.. */
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < static_cast<rlim_t>(limit) * 2 + 64)
+        fprintf(stderr, "warning: the descriptor limit (%llu) allows fewer than %u sessions\n", static_cast<unsigned long long>(files.rlim_cur), limit);
+
+    s_Address = resolve(host);
+    if (s_Address.load() == INADDR_NONE)
+    {
+        fprintf(stderr, "%s: unable to resolve\n", host);
+        return 1;
+    }
+
+    s_Epoll = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<relaylistener> listeners;
+    for (size_t start = 0; start < ports.size();)
+    {
+        auto end = ports.find(',', start);
+        if (end == std::string::npos)
+            end = ports.size();
+        auto port = atoi(ports.substr(start, end - start).c_str());
+        start = end + 1;
+
+        struct sockaddr_in local;
+        memset(&local, 0x00, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_port = htons(static_cast<uint16_t>(port));
+        local.sin_addr.s_addr = inet_addr(bind);
+
+        int enable = 1;
+        auto fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        if (port <= 0 || port > 0xFFFF || ::bind(fd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local)) < 0 || listen(fd, SOMAXCONN) < 0)
+        {
+            fprintf(stderr, "%s:%d: unable to listen: %s\n", bind, port, strerror(errno));
+            return 1;
+        }
+
+        listeners.push_back(relaylistener{ fd, static_cast<uint16_t>(port) });
+    }
+
+    /* The zone servers are reached over UDP; relay those ports on their own threads.. */
+    for (size_t start = 0; start < udp.size();)
+    {
+        auto end = udp.find(',', start);
+        if (end == std::string::npos)
+            end = udp.size();
+        auto port = atoi(udp.substr(start, end - start).c_str());
+        start = end + 1;
+
+        std::unique_ptr<xiloader::udprelay> relay(new xiloader::udprelay());
+        if (port <= 0 || port > 0xFFFF || !relay->open(inet_addr(bind), static_cast<uint16_t>(port), s_Address.load(), static_cast<uint16_t>(port)))
+        {
+            fprintf(stderr, "%s:%d: unable to relay udp\n", bind, port);
+            return 1;
+        }
+
+        s_UdpRelays.push_back(std::move(relay));
+    }
+
+    for (size_t x = 0; x < listeners.size(); x++)
+    {
+        struct epoll_event event;
+        memset(&event, 0x00, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = RELAY_LISTENER | x;
+        epoll_ctl(s_Epoll, EPOLL_CTL_ADD, listeners[x].fd, &event);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onsignal);
+    signal(SIGTERM, onsignal);
+    signal(SIGUSR1, onsignal);
+
+    /* Follow address changes of the server without blocking the relay.. */
+    std::thread resolver([host]()
+    {
+        for (auto waited = 0; !s_Stop; waited++)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (waited % RELAY_RESOLVE_INTERVAL != RELAY_RESOLVE_INTERVAL - 1)
+                continue;
+
+            auto address = resolve(host);
+            if (address != INADDR_NONE)
+                s_Address = address;
+        }
+    });
+
+    printf("relay listening on %s port %s for %s\n", bind, ports.c_str(), host);
+    fflush(stdout);
+
+    struct epoll_event events[RELAY_MAX_EVENTS];
+    auto next = std::chrono::steady_clock::now() + std::chrono::seconds(interval);
+    while (!s_Stop)
+    {
+        auto count = epoll_wait(s_Epoll, events, RELAY_MAX_EVENTS, 1000);
+        for (auto x = 0; x < count; x++)
+        {
+            auto data = events[x].data.u64;
+            if (data & RELAY_LISTENER)
+                accept(listeners[static_cast<size_t>(data & ~RELAY_LISTENER)], limit);
+            else
+                handle(static_cast<uint32_t>(data >> 1), static_cast<int>(data & 1), events[x].events);
+        }
+
+        /* Slots are reused only after the batch; it may still hold events of a closed session.. */
+        s_Free.insert(s_Free.end(), s_Closed.begin(), s_Closed.end());
+        s_Closed.clear();
+
+        if (s_Report || (interval > 0 && std::chrono::steady_clock::now() >= next))
+        {
+            s_Report = 0;
+            next = std::chrono::steady_clock::now() + std::chrono::seconds(interval);
+            report();
+        }
+    }
+
+    resolver.join();
+    report();
+    s_UdpRelays.clear();
+    return 0;
+}
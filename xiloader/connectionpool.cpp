@@ -0,0 +1,249 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "connectionpool.h"
+#include "network.h"
+#include "scheduler.h"
+
+#include <thread>
+
+namespace xiloader
+{
+    /**
+     * @brief Determines if an idle connection is still usable.
+     *
+     * A healthy idle connection has nothing to read; readability means the
+     * server closed it, reset it or sent data nobody asked for.
+     *
+     * @param sock      The socket to check.
+     *
+     * @return True if the socket can be used, false otherwise.
+     */
+    static bool idle(SOCKET sock)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+
+        timeval zero = { 0, 0 };
+        return select(0, &readable, NULL, NULL, &zero) == 0;
+    }
+
+    connectionpool::connectionpool()
+        : m_Spare(INVALID_SOCKET), m_Connecting(false), m_Enabled(false), m_Generation(0), m_Alive(std::make_shared<bool>(true))
+    {}
+
+    connectionpool::~connectionpool()
+    {
+        close();
+
+        /* Wait for a background connect still using the pool.. */
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_Connected.wait(lock, [this]() { return !m_Connecting; });
+        }
+
+        /* Queued refreshes skip a released pool; wait for one that is already checking.. */
+        std::weak_ptr<bool> alive = m_Alive;
+        m_Alive.reset();
+        while (!alive.expired())
+            std::this_thread::yield();
+    }
+
+    /**
+     * @brief Sets the server the pool connects to and starts pre-warming.
+     *
+     * @param address       The numeric server address.
+     * @param port          The server port.
+     */
+    void connectionpool::open(const std::string& address, const char* port)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Address = address;
+            m_Port = port;
+            m_Enabled = true;
+            if (m_Connecting || m_Spare != INVALID_SOCKET)
+                return;
+            m_Connecting = true;
+        }
+
+        xiloader::scheduler::post([this]() { connect(); });
+    }
+
+    /**
+     * @brief Closes the spare connection and stops pre-warming.
+     */
+    void connectionpool::close()
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        m_Enabled = false;
+        m_Generation++;
+        if (m_Spare != INVALID_SOCKET)
+        {
+            closesocket(m_Spare);
+            m_Spare = INVALID_SOCKET;
+        }
+    }
+
+    /**
+     * @brief Connects a new spare socket; runs on the scheduler.
+     */
+    void connectionpool::connect()
+    {
+        std::string address, port;
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            address = m_Address;
+            port = m_Port;
+        }
+
+        auto sock = xiloader::network::Connect(address.c_str(), port.c_str(), false);
+
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Connecting = false;
+            if (sock != INVALID_SOCKET)
+            {
+                if (m_Enabled)
+                {
+                    /* A refresh replaces the older spare.. */
+                    if (m_Spare != INVALID_SOCKET)
+                        closesocket(m_Spare);
+
+                    m_Spare = sock;
+                    m_Created = std::chrono::steady_clock::now();
+                    m_Generation++;
+                    schedule(CONNECTIONPOOL_REFRESH);
+                }
+                else
+                    closesocket(sock);
+            }
+            else if (m_Enabled && m_Spare != INVALID_SOCKET)
+            {
+                /* The refresh failed; retry while the old spare is still good, drop it once it is not.. */
+                auto age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_Created).count();
+                if (age < CONNECTIONPOOL_MAX_IDLE)
+                    schedule(CONNECTIONPOOL_WAIT);
+                else
+                {
+                    closesocket(m_Spare);
+                    m_Spare = INVALID_SOCKET;
+                    m_Generation++;
+                }
+            }
+
+            /* Notify under the lock; the destructor may be waiting to release the pool.. */
+            m_Connected.notify_all();
+        }
+    }
+
+    /**
+     * @brief Replaces the spare connection before it idles out; runs on the scheduler.
+     *
+     * @param generation    The generation of the spare to replace; a newer spare is left alone.
+     */
+    void connectionpool::refresh(uint64_t generation)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            if (!m_Enabled || m_Generation != generation || m_Connecting)
+                return;
+            m_Connecting = true;
+        }
+
+        /* The old spare stays available until the new one is connected.. */
+        connect();
+    }
+
+    /**
+     * @brief Queues the replacement of the current spare; the lock must be held.
+     *
+     * @param delay         The time to wait, in milliseconds.
+     */
+    void connectionpool::schedule(uint32_t delay)
+    {
+        std::weak_ptr<bool> alive = m_Alive;
+        auto generation = m_Generation;
+        xiloader::scheduler::post([this, alive, generation]()
+        {
+            auto token = alive.lock();
+            if (token)
+                refresh(generation);
+        }, delay);
+    }
+
+    /**
+     * @brief Takes the spare connection and starts connecting the next one.
+     *
+     * Waits briefly for a spare that is still connecting; a spare that was
+     * closed by the server or idled too long is discarded.
+     *
+     * @return The connected socket, INVALID_SOCKET if no spare is available.
+     */
+    SOCKET connectionpool::acquire()
+    {
+        auto sock = INVALID_SOCKET;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            if (!m_Enabled)
+                return INVALID_SOCKET;
+
+            /* A connect already in flight is ahead of a fresh one; a refresh leaves the spare usable.. */
+            m_Connected.wait_for(lock, std::chrono::milliseconds(CONNECTIONPOOL_WAIT), [this]() { return !m_Connecting || m_Spare != INVALID_SOCKET; });
+
+            if (m_Spare != INVALID_SOCKET)
+            {
+                auto age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_Created).count();
+                if (age < CONNECTIONPOOL_MAX_IDLE && idle(m_Spare))
+                    sock = m_Spare;
+                else
+                    closesocket(m_Spare);
+                m_Spare = INVALID_SOCKET;
+                m_Generation++;
+            }
+
+            /* Pre-warm the connection for the next request.. */
+            if (m_Connecting)
+                return sock;
+            m_Connecting = true;
+        }
+
+        xiloader::scheduler::post([this]() { connect(); });
+        return sock;
+    }
+
+    /**
+     * @brief Determines if the pool serves the given port.
+     *
+     * @param port          The port to check.
+     *
+     * @return True if the pool is open for the port, false otherwise.
+     */
+    bool connectionpool::serves(const char* port)
+    {
+        std::lock_guard<std::mutex> guard(m_Lock);
+        return m_Enabled && m_Port == port;
+    }
+
+}; // namespace xiloader
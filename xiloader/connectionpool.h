@@ -0,0 +1,134 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_CONNECTIONPOOL_H_INCLUDED__
+#define __XILOADER_CONNECTIONPOOL_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <WinSock2.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/* Idle time after which a spare connection is replaced rather than used. */
+#define CONNECTIONPOOL_MAX_IDLE     30000
+
+/* Idle time after which the spare connection is replaced in the background. */
+#define CONNECTIONPOOL_REFRESH      25000
+
+/* Time to wait for a spare connection that is still connecting. */
+#define CONNECTIONPOOL_WAIT         3000
+
+namespace xiloader
+{
+    /**
+     * @brief Keeps one spare, already connected socket to a server.
+     *
+     * The account server handles a single request per connection, so every
+     * menu action needs a new connection. The pool connects the next one in
+     * the background while the user is busy, which keeps the TCP handshake
+     * off the user's wait. A spare about to idle out is replaced in the
+     * background, so one is ready however long the user stays on a menu.
+     */
+    class connectionpool
+    {
+        std::string m_Address;
+        std::string m_Port;
+        std::mutex m_Lock;
+        std::condition_variable m_Connected;
+        SOCKET m_Spare;
+        std::chrono::steady_clock::time_point m_Created;
+        bool m_Connecting;
+        bool m_Enabled;
+        uint64_t m_Generation;
+        std::shared_ptr<bool> m_Alive;
+
+        connectionpool(const connectionpool&) = delete;
+        connectionpool& operator=(const connectionpool&) = delete;
+
+        /**
+         * @brief Connects a new spare socket; runs on the scheduler.
+         */
+        void connect();
+
+        /**
+         * @brief Replaces the spare connection before it idles out; runs on the scheduler.
+         *
+         * @param generation    The generation of the spare to replace; a newer spare is left alone.
+         */
+        void refresh(uint64_t generation);
+
+        /**
+         * @brief Queues the replacement of the current spare; the lock must be held.
+         *
+         * @param delay         The time to wait, in milliseconds.
+         */
+        void schedule(uint32_t delay);
+
+    public:
+        connectionpool();
+        ~connectionpool();
+
+        /**
+         * @brief Sets the server the pool connects to and starts pre-warming.
+         *
+         * @param address       The numeric server address.
+         * @param port          The server port.
+         */
+        void open(const std::string& address, const char* port);
+
+        /**
+         * @brief Closes the spare connection and stops pre-warming.
+         */
+        void close();
+
+        /**
+         * @brief Takes the spare connection and starts connecting the next one.
+         *
+         * Waits briefly for a spare that is still connecting; a spare that was
+         * closed by the server or idled too long is discarded.
+         *
+         * @return The connected socket, INVALID_SOCKET if no spare is available.
+         */
+        SOCKET acquire();
+
+        /**
+         * @brief Determines if the pool serves the given port.
+         *
+         * @param port          The port to check.
+         *
+         * @return True if the pool is open for the port, false otherwise.
+         */
+        bool serves(const char* port);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_CONNECTIONPOOL_H_INCLUDED__
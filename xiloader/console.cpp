@@ -23,16 +23,96 @@ This file is part of DarkStar-server source code.
 
 #include "console.h"
 
+#include <cstdio>
+
+#ifdef _WIN32
 #include <ShObjIdl.h>
 
 /* Global Externs */
 extern bool g_Hide;
 
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+#else
+#include <unistd.h>
+#endif
+
 namespace xiloader
 {
+    /**
+     * @brief Log sink that prints formatted records to the console.
+     */
+    class consolesink : public xiloader::logsink
+    {
+    public:
+        consolesink()
+            : logsink(static_cast<xiloader::loglevel>(XILOADER_LOG_LEVEL), true)
+        {}
+
+        void write(const xiloader::logrecord* record, const std::string& message) override
+        {
+            xiloader::console::emit(record->color, record->timestamp, message);
+        }
+    };
+
+    /**
+     * @brief Console output modes.
+     */
+    enum class consolemode
+    {
+        plain,      // Output is redirected; write text without colors.
+        terminal,   // The console understands virtual terminal sequences.
+        attributes  // Legacy console; colors need the attribute API.
+    };
+
+    /**
+     * @brief Determines (once) how colored output is written.
+     *
+     * @return The console output mode.
+     */
+    static consolemode mode()
+    {
+        static consolemode current = []()
+        {
+#ifdef _WIN32
+            auto stdout_handle = ::GetStdHandle(STD_OUTPUT_HANDLE);
+            ::DWORD flags = 0;
+            if (!::GetConsoleMode(stdout_handle, &flags))
+                return consolemode::plain;
+            if ((flags & ENABLE_VIRTUAL_TERMINAL_PROCESSING) || ::SetConsoleMode(stdout_handle, flags | ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+                return consolemode::terminal;
+            return consolemode::attributes;
+#else
+            return ::isatty(STDOUT_FILENO) ? consolemode::terminal : consolemode::plain;
+#endif
+        }();
+        return current;
+    }
+
+    /**
+     * @brief Appends the escape sequence selecting a console color.
+     *
+     * @param line      The line to append the sequence to.
+     * @param c         The console color (Windows attribute bits).
+     */
+    static void appendcolor(std::string& line, uint16_t c)
+    {
+        /* Windows attributes order the bits blue, green, red; ANSI orders them red, green, blue.. */
+        auto ansi = ((c & FOREGROUND_RED) ? 1 : 0) | ((c & FOREGROUND_GREEN) ? 2 : 0) | ((c & FOREGROUND_BLUE) ? 4 : 0);
+        auto base = (c & FOREGROUND_INTENSITY) ? 90 : 30;
+
+        char sequence[16];
+        auto length = snprintf(sequence, sizeof sequence, "\x1b[%dm", base + ansi);
+        line.append(sequence, length);
+    }
+
+#ifdef _WIN32
     /**
      * @brief Prints a text fragment with the specified color to the console.
-     * 
+     *
+     * Used only when the console does not support virtual terminal sequences.
+     *
      * @param c         The color to print the fragment with.
      * @param message   The fragment to print.
      */
@@ -43,9 +123,120 @@ namespace xiloader
         ::GetConsoleScreenBufferInfo(stdout_handle, &info);
         auto attributes = info.wAttributes & 0xFFF0 | static_cast<::WORD>(c);
         ::SetConsoleTextAttribute(stdout_handle, static_cast<::WORD>(attributes));
-        std::cout << message;
+        write(message);
         ::SetConsoleTextAttribute(stdout_handle, info.wAttributes);
     }
+#endif
+
+    /**
+     * @brief Writes a complete line to standard output with a single write call.
+     *
+     * @param line      The line to write.
+     */
+    void console::write(std::string const& line)
+    {
+#ifdef _WIN32
+        ::DWORD written = 0;
+        ::WriteFile(::GetStdHandle(STD_OUTPUT_HANDLE), line.data(), static_cast<::DWORD>(line.size()), &written, NULL);
+#else
+        auto data = line.data();
+        auto remaining = line.size();
+        while (remaining > 0)
+        {
+            auto written = ::write(STDOUT_FILENO, data, remaining);
+            if (written <= 0)
+                break;
+            data += written;
+            remaining -= static_cast<size_t>(written);
+        }
+#endif
+    }
+
+    /**
+     * @brief Writes a formatted message and its timestamp to the console.
+     *
+     * The colored line is built in one buffer with virtual terminal escape
+     * sequences and written at once; consoles without VT support fall back
+     * to the attribute API.
+     *
+     * @param c         The color to print the message with.
+     * @param timestamp The time the message was logged, in microseconds since the unix epoch.
+     * @param message   The formatted message to print.
+     */
+    void console::emit(uint16_t c, int64_t timestamp, std::string const& message)
+    {
+        static ::time_t lastSecond = -1;
+        static char prefix[64] = { 0 };
+        static std::string line;
+
+#ifdef _WIN32
+        static const char newline[] = "\r\n";
+#else
+        static const char newline[] = "\n";
+#endif
+
+        /* Format the timestamp; only once per second as it rarely changes.. */
+        auto rawtime = static_cast<::time_t>(timestamp / 1000000);
+        if (rawtime != lastSecond)
+        {
+            ::tm timeinfo;
+#ifdef _WIN32
+            ::localtime_s(&timeinfo, &rawtime);
+#else
+            ::localtime_r(&rawtime, &timeinfo);
+#endif
+            ::strftime(prefix, sizeof prefix, "[%m/%d/%y %H:%M:%S] ", &timeinfo);
+            lastSecond = rawtime;
+        }
+
+        switch (mode())
+        {
+        case consolemode::terminal:
+            line.clear();
+            appendcolor(line, static_cast<uint16_t>(xiloader::color::lightyelllow));
+            line.append(prefix);
+            appendcolor(line, c);
+            line.append(message);
+            line.append("\x1b[0m");
+            line.append(newline);
+            write(line);
+            break;
+
+        case consolemode::plain:
+            line.assign(prefix);
+            line.append(message);
+            line.append(newline);
+            write(line);
+            break;
+
+        case consolemode::attributes:
+#ifdef _WIN32
+            print(xiloader::color::lightyelllow, prefix);
+            print(static_cast<xiloader::color>(c), message);
+            write(newline);
+#endif
+            break;
+        }
+    }
+
+    /**
+     * @brief Obtains the sink that writes log records to the console.
+     *
+     * @return The console sink.
+     */
+    xiloader::logsink* console::sink()
+    {
+        static consolesink sink;
+        return &sink;
+    }
+
+    /**
+     * @brief Blocks until every queued message has been printed.
+     */
+    void console::flush()
+    {
+        xiloader::logger::flush();
+    }
 
     /**
      * @brief Shows or hides the console based on the provided argument.
@@ -54,6 +245,7 @@ namespace xiloader
      */
     void console::visible(bool visible)
     {
+#ifdef _WIN32
         if (!g_Hide)
             return;
 
@@ -82,6 +274,9 @@ namespace xiloader
 
         // Adjust the window's visibility
         ::ShowWindow(console, visible ? SW_SHOW : SW_HIDE);
+#else
+        (void)visible;
+#endif
     }
 
     /**
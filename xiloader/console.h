@@ -28,10 +28,22 @@ This file is part of DarkStar-server source code.
 #pragma once
 #endif
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+/* Console attribute bits; the color codes below use the Windows values on every platform. */
+#define FOREGROUND_BLUE         0x0001
+#define FOREGROUND_GREEN        0x0002
+#define FOREGROUND_RED          0x0004
+#define FOREGROUND_INTENSITY    0x0008
+#endif
+
 #include <iostream>
 #include <string>
 #include <ctime>
+#include <tuple>
+
+#include "logger.h"
 
 namespace xiloader
 {
@@ -92,12 +104,21 @@ namespace xiloader
 
         /**
          * @brief Prints a text fragment with the specified color to the console.
-         * 
+         *
+         * Used only when the console does not support virtual terminal sequences.
+         *
          * @param c         The color to print the fragment with.
          * @param message   The fragment to print.
          */
         static void print(xiloader::color c, std::string const& message);
 
+        /**
+         * @brief Writes a complete line to standard output with a single write call.
+         *
+         * @param line      The line to write.
+         */
+        static void write(std::string const& line);
+
     public:
 
         /**
@@ -122,29 +143,54 @@ namespace xiloader
         template<typename... Args>
         static void output(xiloader::color c, char const* format, Args... args)
         {
-            /* Get the current timestamp */
-            ::__time32_t rawtime;
-            ::_time32(&rawtime);
-
-            ::tm timeinfo;
-            ::_localtime32_s(&timeinfo, &rawtime);
-
-            /* Format the timestamp */
-            char timestamp[256];
-            ::strftime(timestamp, sizeof timestamp, "[%m/%d/%y %H:%M:%S] ", &timeinfo);
+            log(xiloader::loglevel::info, c, format, args...);
+        }
 
-            /* Output the timestamp */
-            print(xiloader::color::lightyelllow, timestamp);
+        /**
+         * @brief Logs the given message at the given level with the specific color.
+         *
+         * Prefer the XILOADER_DEBUG/INFO/WARNING/ERROR macros, which check the
+         * format at compile time and drop levels below XILOADER_LOG_LEVEL.
+         *
+         * @param level     The level of the message.
+         * @param c         The color to print the message with.
+         * @param format    The format of the message to print.
+         * @param args      The arguments to fill the format.
+         */
+        template<typename... Args>
+        static void log(xiloader::loglevel level, xiloader::color c, char const* format, Args... args)
+        {
+            /* Queue the message; the logger thread formats and prints it.. */
+            xiloader::logger::push(level, static_cast<uint16_t>(c), format, args...);
+        }
 
-            /* Parse the incoming message */
-            char buffer[1024];
-            ::snprintf(buffer, sizeof buffer, format, args...);
-            /* Output the message */
+        /**
+         * @brief Obtains the sink that writes log records to the console.
+         *
+         * @return The console sink.
+         */
+        static xiloader::logsink* sink();
 
-            print(c, buffer);
+        /**
+         * @brief Writes a formatted message and its timestamp to the console.
+         *
+         * The colored line is built in one buffer with virtual terminal escape
+         * sequences and written at once; consoles without VT support fall back
+         * to the attribute API.
+         *
+         * @param c         The color to print the message with.
+         * @param timestamp The time the message was logged, in microseconds since the unix epoch.
+         * @param message   The formatted message to print.
+         */
+        static void emit(uint16_t c, int64_t timestamp, std::string const& message);
 
-            std::cout << std::endl;
-        }
+        /**
+         * @brief Blocks until every queued message has been printed.
+         *
+         * Must be called before writing to std::cout directly so prompts do not
+         * overtake messages still waiting in the logger.
+         */
+        static void flush();
 
         /**
          * @brief Hides the console window.
@@ -159,4 +205,47 @@ namespace xiloader
 
 }; // namespace xiloader
 
+/**
+ * @brief Rejects, at compile time, a format whose conversions do not match its arguments.
+ */
+#define XILOADER_LOG_CHECK(format, ...) \
+    static_assert(xiloader::logformat<decltype(std::make_tuple(__VA_ARGS__))>::valid(format), "Log format does not match its arguments: " format)
+
+/**
+ * @brief Logs a message at the given level; the format is checked at compile time.
+ */
+#define XILOADER_LOG(level, c, format, ...) \
+    do \
+    { \
+        XILOADER_LOG_CHECK(format, ##__VA_ARGS__); \
+        xiloader::console::log(level, c, format, ##__VA_ARGS__); \
+    } while (0)
+
+/* Level macros; levels below XILOADER_LOG_LEVEL keep the format check but generate no code. */
+#if XILOADER_LOG_LEVEL <= XILOADER_LEVEL_TRACE
+#define XILOADER_TRACE(c, format, ...) XILOADER_LOG(xiloader::loglevel::trace, c, format, ##__VA_ARGS__)
+#else
+#define XILOADER_TRACE(c, format, ...) do { XILOADER_LOG_CHECK(format, ##__VA_ARGS__); } while (0)
+#endif
+
+#if XILOADER_LOG_LEVEL <= XILOADER_LEVEL_DEBUG
+#define XILOADER_DEBUG(c, format, ...) XILOADER_LOG(xiloader::loglevel::debug, c, format, ##__VA_ARGS__)
+#else
+#define XILOADER_DEBUG(c, format, ...) do { XILOADER_LOG_CHECK(format, ##__VA_ARGS__); } while (0)
+#endif
+
+#if XILOADER_LOG_LEVEL <= XILOADER_LEVEL_INFO
+#define XILOADER_INFO(c, format, ...) XILOADER_LOG(xiloader::loglevel::info, c, format, ##__VA_ARGS__)
+#else
+#define XILOADER_INFO(c, format, ...) do { XILOADER_LOG_CHECK(format, ##__VA_ARGS__); } while (0)
+#endif
+
+#if XILOADER_LOG_LEVEL <= XILOADER_LEVEL_WARNING
+#define XILOADER_WARNING(format, ...) XILOADER_LOG(xiloader::loglevel::warning, xiloader::color::warning, format, ##__VA_ARGS__)
+#else
+#define XILOADER_WARNING(format, ...) do { XILOADER_LOG_CHECK(format, ##__VA_ARGS__); } while (0)
+#endif
+
+#define XILOADER_ERROR(format, ...) XILOADER_LOG(xiloader::loglevel::error, xiloader::color::error, format, ##__VA_ARGS__)
+
 #endif // __XILOADER_CONSOLE_H_INCLUDED__
@@ -0,0 +1,491 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "datcache.h"
+#include "console.h"
+#include "flightrecorder.h"
+#include "prefetcher.h"
+#include "zonetrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace xiloader
+{
+    /* IFxFileManager vtable slots; IUnknown takes the first three. */
+    enum fxslot
+    {
+        FXSLOT_READ = 5,
+        FXSLOT_READA = 6,
+        FXSLOT_READM = 7,
+        FXSLOT_READEX = 8,
+        FXSLOT_WRITE = 9,
+        FXSLOT_GETFILESIZE = 11,
+        FXSLOT_FINISHEDCHECK = 13,
+        FXSLOT_FINISHEDCHECKB = 14,
+        FXSLOT_WAIT = 15,
+    };
+
+    typedef HRESULT (__stdcall * fxread_t)(IFxFileManager* This, unsigned short FileNo, unsigned char* pBufAddr);
+    typedef HRESULT (__stdcall * fxreadm_t)(IFxFileManager* This, _FX_FILE_DATA* FileData, unsigned int FileDataNum);
+    typedef HRESULT (__stdcall * fxreadex_t)(IFxFileManager* This, unsigned short FileNo, unsigned long StartOffset, void* CtrlFunc);
+    typedef HRESULT (__stdcall * fxwrite_t)(IFxFileManager* This, unsigned short FileNo, unsigned long WriteLength, unsigned char* pBufAddr);
+    typedef HRESULT (__stdcall * fxgetfilesize_t)(IFxFileManager* This, unsigned short FileNo, unsigned long* FileLength);
+    typedef HRESULT (__stdcall * fxfinishedcheck_t)(IFxFileManager* This, unsigned short FileNo, unsigned char* bFinishedFlg);
+    typedef HRESULT (__stdcall * fxfinishedcheckb_t)(IFxFileManager* This, unsigned char* pBufAddr, unsigned char* bFinishedFlg);
+    typedef HRESULT (__stdcall * fxwait_t)(IFxFileManager* This);
+
+    /**
+     * @brief Cached contents of a single DAT file.
+     */
+    typedef struct datentry_t
+    {
+        std::vector<unsigned char> Data;            // The file contents.
+        std::list<unsigned short>::iterator Age;    // Position in the LRU list.
+    } datentry;
+
+    /**
+     * @brief A read served from the cache that the game has not checked for completion yet.
+     */
+    typedef struct datserved_t
+    {
+        unsigned short FileNo;  // The file number.
+        unsigned char* Buffer;  // The game buffer.
+    } datserved;
+
+    /* The original file manager functions. */
+    static fxread_t Real_FxRead = nullptr;
+    static fxread_t Real_FxReadA = nullptr;
+    static fxreadm_t Real_FxReadM = nullptr;
+    static fxreadex_t Real_FxReadEx = nullptr;
+    static fxwrite_t Real_FxWrite = nullptr;
+    static fxgetfilesize_t Real_FxGetFileSize = nullptr;
+    static fxfinishedcheck_t Real_FxFinishedCheck = nullptr;
+    static fxfinishedcheckb_t Real_FxFinishedCheckB = nullptr;
+    static fxwait_t Real_FxWait = nullptr;
+
+    /* Cache state; every member is guarded by s_Lock. */
+    static std::mutex s_Lock;
+    static std::unordered_map<unsigned short, datentry> s_Entries;
+    static std::list<unsigned short> s_Ages; // Most recently used first.
+    static std::unordered_map<unsigned short, unsigned char*> s_Pending; // Reads the game is performing.
+    static std::vector<datserved> s_Served; // Cached reads not yet checked, by file number or by buffer.
+    static uint64_t s_Size = 0;
+    static uint64_t s_Capacity = static_cast<uint64_t>(DATCACHE_CAPACITY) * 1024 * 1024;
+    static std::atomic<uint64_t> s_Hits(0);
+    static std::atomic<uint64_t> s_Misses(0);
+
+    /**
+     * @brief Removes a file from the cache; the lock must be held.
+     *
+     * @param fileNo    The file number.
+     */
+    static void drop(unsigned short fileNo)
+    {
+        auto entry = s_Entries.find(fileNo);
+        if (entry == s_Entries.end())
+            return;
+
+        s_Size -= entry->second.Data.size();
+        s_Ages.erase(entry->second.Age);
+        s_Entries.erase(entry);
+    }
+
+    /**
+     * @brief Forgets the served reads of a file or a buffer; the lock must be held.
+     *
+     * A real read into either must never be reported finished on behalf of an
+     * earlier cached one.
+     *
+     * @param fileNo    The file number.
+     * @param buffer    The game buffer; may be nullptr.
+     */
+    static void unserve(unsigned short fileNo, unsigned char* buffer)
+    {
+        s_Served.erase(std::remove_if(s_Served.begin(), s_Served.end(), [fileNo, buffer](const datserved& served)
+        {
+            return served.FileNo == fileNo || (buffer != nullptr && served.Buffer == buffer);
+        }), s_Served.end());
+    }
+
+    /**
+     * @brief Copies a cached file into a game buffer; the lock must be held.
+     *
+     * @param fileNo    The file number.
+     * @param buffer    The game buffer.
+     *
+     * @return True if the file was cached, false otherwise.
+     */
+    static bool serve(unsigned short fileNo, unsigned char* buffer)
+    {
+        auto entry = s_Entries.find(fileNo);
+        if (entry == s_Entries.end())
+            return false;
+
+        memcpy(buffer, entry->second.Data.data(), entry->second.Data.size());
+        s_Ages.splice(s_Ages.begin(), s_Ages, entry->second.Age);
+
+        /* The game still checks the read for completion; answer that ourselves.. */
+        unserve(fileNo, buffer);
+        s_Served.push_back(datserved{ fileNo, buffer });
+        s_Pending.erase(fileNo);
+        s_Hits++;
+        return true;
+    }
+
+    /**
+     * @brief Keeps the contents of a finished read.
+     *
+     * @param manager   The file manager that performed the read.
+     * @param fileNo    The file number.
+     */
+    static void capture(IFxFileManager* manager, unsigned short fileNo)
+    {
+        unsigned char* buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            auto pending = s_Pending.find(fileNo);
+            if (pending == s_Pending.end())
+                return;
+
+            buffer = pending->second;
+            s_Pending.erase(pending);
+        }
+
+        unsigned long length = 0;
+        if (FAILED(Real_FxGetFileSize(manager, fileNo, &length)) || length == 0)
+            return;
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (length > s_Capacity / DATCACHE_MAX_SHARE || s_Entries.count(fileNo) != 0)
+            return;
+
+        /* Evict the least recently used files until the new one fits.. */
+        while (s_Size + length > s_Capacity && !s_Ages.empty())
+            drop(s_Ages.back());
+
+        s_Ages.push_front(fileNo);
+        auto& entry = s_Entries[fileNo];
+        entry.Data.assign(buffer, buffer + length);
+        entry.Age = s_Ages.begin();
+        s_Size += length;
+    }
+
+    /**
+     * @brief Serves a whole-file read from the cache, or records it for capture.
+     *
+     * @param manager   The file manager.
+     * @param fileNo    The file number.
+     * @param buffer    The game buffer.
+     * @param real      The original read function.
+     *
+     * @return The result of the read.
+     */
+    static HRESULT read(IFxFileManager* manager, unsigned short fileNo, unsigned char* buffer, fxread_t real)
+    {
+        xiloader::prefetcher::observe(fileNo);
+        xiloader::zonetrace::datread();
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            if (s_Capacity != 0 && buffer != nullptr)
+            {
+                if (serve(fileNo, buffer))
+                    return S_OK;
+                s_Pending[fileNo] = buffer;
+            }
+            unserve(fileNo, buffer);
+        }
+
+        s_Misses++;
+        return real(manager, fileNo, buffer);
+    }
+
+    /**
+     * @brief FxRead interposer.
+     */
+    static HRESULT __stdcall Mine_FxRead(IFxFileManager* This, unsigned short FileNo, unsigned char* pBufAddr)
+    {
+        return read(This, FileNo, pBufAddr, Real_FxRead);
+    }
+
+    /**
+     * @brief FxReadA interposer.
+     */
+    static HRESULT __stdcall Mine_FxReadA(IFxFileManager* This, unsigned short FileNo, unsigned char* pBufAddr)
+    {
+        return read(This, FileNo, pBufAddr, Real_FxReadA);
+    }
+
+    /**
+     * @brief FxReadM interposer; only the files that are not cached are read.
+     */
+    static HRESULT __stdcall Mine_FxReadM(IFxFileManager* This, _FX_FILE_DATA* FileData, unsigned int FileDataNum)
+    {
+        std::vector<_FX_FILE_DATA> misses;
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            for (unsigned int x = 0; x < FileDataNum; x++)
+            {
+                xiloader::prefetcher::observe(FileData[x].FileNo);
+                xiloader::zonetrace::datread();
+                if (s_Capacity != 0 && FileData[x].pBufAddr != nullptr)
+                {
+                    if (serve(FileData[x].FileNo, FileData[x].pBufAddr))
+                        continue;
+                    s_Pending[FileData[x].FileNo] = FileData[x].pBufAddr;
+                }
+                unserve(FileData[x].FileNo, FileData[x].pBufAddr);
+                misses.push_back(FileData[x]);
+            }
+        }
+
+        if (misses.empty())
+            return S_OK;
+
+        s_Misses += misses.size();
+        return Real_FxReadM(This, misses.data(), static_cast<unsigned int>(misses.size()));
+    }
+
+    /**
+     * @brief FxReadEx interposer; partial reads stream through a callback and are never cached.
+     */
+    static HRESULT __stdcall Mine_FxReadEx(IFxFileManager* This, unsigned short FileNo, unsigned long StartOffset, void* CtrlFunc)
+    {
+        xiloader::prefetcher::observe(FileNo);
+        xiloader::zonetrace::datread();
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            unserve(FileNo, nullptr);
+        }
+
+        s_Misses++;
+        return Real_FxReadEx(This, FileNo, StartOffset, CtrlFunc);
+    }
+
+    /**
+     * @brief FxWrite interposer; the written file is dropped from the cache.
+     */
+    static HRESULT __stdcall Mine_FxWrite(IFxFileManager* This, unsigned short FileNo, unsigned long WriteLength, unsigned char* pBufAddr)
+    {
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            drop(FileNo);
+            s_Pending.erase(FileNo);
+            unserve(FileNo, pBufAddr);
+        }
+
+        return Real_FxWrite(This, FileNo, WriteLength, pBufAddr);
+    }
+
+    /**
+     * @brief FxFinishedCheck interposer; cached reads are always finished.
+     */
+    static HRESULT __stdcall Mine_FxFinishedCheck(IFxFileManager* This, unsigned short FileNo, unsigned char* bFinishedFlg)
+    {
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            auto served = std::find_if(s_Served.begin(), s_Served.end(), [FileNo](const datserved& entry) { return entry.FileNo == FileNo; });
+            if (served != s_Served.end())
+            {
+                s_Served.erase(served);
+                *bFinishedFlg = 1;
+                return S_OK;
+            }
+        }
+
+        auto ret = Real_FxFinishedCheck(This, FileNo, bFinishedFlg);
+        if (SUCCEEDED(ret) && *bFinishedFlg != 0)
+            capture(This, FileNo);
+
+        return ret;
+    }
+
+    /**
+     * @brief FxFinishedCheckB interposer; cached reads are always finished.
+     */
+    static HRESULT __stdcall Mine_FxFinishedCheckB(IFxFileManager* This, unsigned char* pBufAddr, unsigned char* bFinishedFlg)
+    {
+        unsigned short fileNo = 0;
+        auto pending = false;
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            auto served = std::find_if(s_Served.begin(), s_Served.end(), [pBufAddr](const datserved& entry) { return entry.Buffer == pBufAddr; });
+            if (served != s_Served.end())
+            {
+                s_Served.erase(served);
+                *bFinishedFlg = 1;
+                return S_OK;
+            }
+
+            for (auto& entry : s_Pending)
+            {
+                if (entry.second == pBufAddr)
+                {
+                    fileNo = entry.first;
+                    pending = true;
+                    break;
+                }
+            }
+        }
+
+        auto ret = Real_FxFinishedCheckB(This, pBufAddr, bFinishedFlg);
+        if (SUCCEEDED(ret) && *bFinishedFlg != 0 && pending)
+            capture(This, fileNo);
+
+        return ret;
+    }
+
+    /**
+     * @brief FxWait interposer; every read the game performed has finished once it returns.
+     */
+    static HRESULT __stdcall Mine_FxWait(IFxFileManager* This)
+    {
+        auto ret = Real_FxWait(This);
+
+        std::vector<unsigned short> finished;
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            for (auto& entry : s_Pending)
+                finished.push_back(entry.first);
+            s_Served.clear();
+        }
+
+        if (SUCCEEDED(ret))
+        {
+            for (auto fileNo : finished)
+                capture(This, fileNo);
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Replaces a single vtable slot.
+     *
+     * @param vtable        The vtable.
+     * @param slot          The slot to replace.
+     * @param replacement   The interposer.
+     * @param original      Receives the original function.
+     *
+     * @return True on success, false otherwise.
+     */
+    template<typename T>
+    static bool patch(void** vtable, fxslot slot, T replacement, T* original)
+    {
+        /* A relaunched game shares the vtable that is already patched.. */
+        if (vtable[slot] == reinterpret_cast<void*>(replacement))
+            return true;
+
+        DWORD protect = 0;
+        if (!::VirtualProtect(&vtable[slot], sizeof(void*), PAGE_READWRITE, &protect))
+            return false;
+
+        *original = reinterpret_cast<T>(vtable[slot]);
+        vtable[slot] = reinterpret_cast<void*>(replacement);
+        ::VirtualProtect(&vtable[slot], sizeof(void*), protect, &protect);
+        return true;
+    }
+
+    /**
+     * @brief Sets the size of the cache; 0 disables caching, reads are still observed for prefetching.
+     *
+     * @param megabytes     The capacity in megabytes.
+     */
+    void datcache::capacity(uint32_t megabytes)
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        s_Capacity = static_cast<uint64_t>(megabytes) * 1024 * 1024;
+        while (s_Size > s_Capacity && !s_Ages.empty())
+            drop(s_Ages.back());
+    }
+
+    /**
+     * @brief Interposes the vtable of the game's file manager.
+     *
+     * @param manager       The file manager of an FFXiEntry instance.
+     *
+     * @return True if the cache is in place, false otherwise.
+     */
+    bool datcache::attach(IFxFileManager* manager)
+    {
+        if (manager == nullptr)
+            return false;
+
+        /* The completion checks go first so no cached read is ever reported to the game as unknown.. */
+        auto vtable = *reinterpret_cast<void***>(manager);
+        Real_FxGetFileSize = reinterpret_cast<fxgetfilesize_t>(vtable[FXSLOT_GETFILESIZE]);
+        auto patched = patch(vtable, FXSLOT_FINISHEDCHECK, Mine_FxFinishedCheck, &Real_FxFinishedCheck)
+            && patch(vtable, FXSLOT_FINISHEDCHECKB, Mine_FxFinishedCheckB, &Real_FxFinishedCheckB)
+            && patch(vtable, FXSLOT_WAIT, Mine_FxWait, &Real_FxWait)
+            && patch(vtable, FXSLOT_WRITE, Mine_FxWrite, &Real_FxWrite)
+            && patch(vtable, FXSLOT_READEX, Mine_FxReadEx, &Real_FxReadEx)
+            && patch(vtable, FXSLOT_READM, Mine_FxReadM, &Real_FxReadM)
+            && patch(vtable, FXSLOT_READA, Mine_FxReadA, &Real_FxReadA)
+            && patch(vtable, FXSLOT_READ, Mine_FxRead, &Real_FxRead);
+
+        if (!patched)
+        {
+            XILOADER_WARNING("Failed to interpose the DAT file manager, error code: %u", ::GetLastError());
+            return false;
+        }
+
+        xiloader::flightrecorder::record(xiloader::flightevent::patch, reinterpret_cast<uintptr_t>(vtable), "dat cache");
+        return true;
+    }
+
+    /**
+     * @brief Obtains the number of reads served from the cache.
+     *
+     * @return The hit count.
+     */
+    uint64_t datcache::hits()
+    {
+        return s_Hits.load();
+    }
+
+    /**
+     * @brief Obtains the number of reads that went to disk.
+     *
+     * @return The miss count.
+     */
+    uint64_t datcache::misses()
+    {
+        return s_Misses.load();
+    }
+
+    /**
+     * @brief Obtains the number of bytes held by the cache.
+     *
+     * @return The cache size in bytes.
+     */
+    uint64_t datcache::size()
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        return s_Size;
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,96 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_DATCACHE_H_INCLUDED__
+#define __XILOADER_DATCACHE_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "defines.h"
+
+/* Default size of the DAT cache, in megabytes. */
+#define DATCACHE_CAPACITY       128
+
+/* Largest single DAT file kept, as a fraction of the capacity. */
+#define DATCACHE_MAX_SHARE      4
+
+namespace xiloader
+{
+    /**
+     * @brief In-memory LRU cache of the DAT files the game reads through IFxFileManager.
+     *
+     * The FxRead family of the file manager is interposed through its vtable.
+     * Reads of a file number that is cached are copied straight into the
+     * game buffer and report finished at once; other reads go to the game,
+     * and their data is kept once the game sees them finish. Writes drop the
+     * file from the cache. Every read is also reported to the prefetcher.
+     * The vtable is shared by every file manager of the module, so the
+     * cache also covers relaunched games.
+     */
+    class datcache
+    {
+    public:
+
+        /**
+         * @brief Sets the size of the cache; 0 disables caching, reads are still observed for prefetching.
+         *
+         * @param megabytes     The capacity in megabytes.
+         */
+        static void capacity(uint32_t megabytes);
+
+        /**
+         * @brief Interposes the vtable of the game's file manager.
+         *
+         * @param manager       The file manager of an FFXiEntry instance.
+         *
+         * @return True if the cache is in place, false otherwise.
+         */
+        static bool attach(IFxFileManager* manager);
+
+        /**
+         * @brief Obtains the number of reads served from the cache.
+         *
+         * @return The hit count.
+         */
+        static uint64_t hits();
+
+        /**
+         * @brief Obtains the number of reads that went to disk.
+         *
+         * @return The miss count.
+         */
+        static uint64_t misses();
+
+        /**
+         * @brief Obtains the number of bytes held by the cache.
+         *
+         * @return The cache size in bytes.
+         */
+        static uint64_t size();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_DATCACHE_H_INCLUDED__
@@ -0,0 +1,158 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "datindex.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#define DATINDEX_SEPARATOR      "\\"
+#else
+#define DATINDEX_SEPARATOR      "/"
+#endif
+
+namespace xiloader
+{
+    /**
+     * @brief Maps the tables of an installation.
+     *
+     * @param folder    The FINAL FANTASY XI install folder.
+     *
+     * @return True if at least the base tables were mapped, false otherwise.
+     */
+    bool datindex::open(const char* folder)
+    {
+        close();
+        if (folder == nullptr || *folder == '\0')
+            return false;
+
+        std::string root(folder);
+        if (root.back() != '\\' && root.back() != '/')
+            root += DATINDEX_SEPARATOR;
+
+        for (uint32_t rom = 1; rom <= DATINDEX_MAX_ROMS; rom++)
+        {
+            char vpath[32], fpath[32];
+            if (rom == 1)
+            {
+                snprintf(vpath, sizeof(vpath), "VTABLE.DAT");
+                snprintf(fpath, sizeof(fpath), "FTABLE.DAT");
+            }
+            else
+            {
+                snprintf(vpath, sizeof(vpath), "ROM%u" DATINDEX_SEPARATOR "VTABLE%u.DAT", rom, rom);
+                snprintf(fpath, sizeof(fpath), "ROM%u" DATINDEX_SEPARATOR "FTABLE%u.DAT", rom, rom);
+            }
+
+            /* Expansions that are not installed have no tables.. */
+            mappedfile vtable;
+            auto& ftable = m_Tables[rom - 1];
+            if (!vtable.open((root + vpath).c_str(), false) || !ftable.open((root + fpath).c_str(), false))
+            {
+                ftable.close();
+                if (rom == 1)
+                    return false;
+                continue;
+            }
+
+            /* Merge the VTABLE; a file number only counts if the FTABLE covers it too.. */
+            auto entries = std::min(vtable.size(), ftable.size() / sizeof(uint16_t));
+            if (m_Roms.size() < entries)
+                m_Roms.resize(entries, 0);
+
+            auto data = vtable.data();
+            for (size_t x = 0; x < entries; x++)
+            {
+                if (data[x] != 0 && m_Roms[x] == 0)
+                    m_Roms[x] = static_cast<uint8_t>(rom);
+            }
+        }
+
+        m_Folder = root;
+        return true;
+    }
+
+    /**
+     * @brief Unmaps the tables.
+     */
+    void datindex::close()
+    {
+        for (auto& table : m_Tables)
+            table.close();
+
+        m_Roms.clear();
+        m_Folder.clear();
+    }
+
+    /**
+     * @brief Locates a DAT file.
+     *
+     * @param fileNo    The file number.
+     * @param rom       Receives the ROM number, 1 for the base game.
+     * @param location  Receives the location within the ROM folder.
+     *
+     * @return True if the installation holds the file, false otherwise.
+     */
+    bool datindex::lookup(uint32_t fileNo, uint32_t* rom, uint32_t* location) const
+    {
+        if (fileNo >= m_Roms.size() || m_Roms[fileNo] == 0)
+            return false;
+
+        /* FTABLE entries are little endian, like the platforms the game runs on.. */
+        auto& ftable = m_Tables[m_Roms[fileNo] - 1];
+        auto entry = ftable.data() + fileNo * sizeof(uint16_t);
+
+        *rom = m_Roms[fileNo];
+        *location = static_cast<uint32_t>(entry[0]) | (static_cast<uint32_t>(entry[1]) << 8);
+        return true;
+    }
+
+    /**
+     * @brief Builds the path of a DAT file.
+     *
+     * @param fileNo    The file number.
+     * @param buffer    Receives the null terminated path.
+     * @param size      The size of the buffer.
+     *
+     * @return The length of the path, 0 if the file is unknown or the buffer is too small.
+     */
+    size_t datindex::path(uint32_t fileNo, char* buffer, size_t size) const
+    {
+        uint32_t rom = 0, location = 0;
+        if (!lookup(fileNo, &rom, &location))
+            return 0;
+
+        int length = 0;
+        if (rom == 1)
+            length = snprintf(buffer, size, "%sROM" DATINDEX_SEPARATOR "%u" DATINDEX_SEPARATOR "%u.DAT", m_Folder.c_str(), location >> 7, location & 0x7F);
+        else
+            length = snprintf(buffer, size, "%sROM%u" DATINDEX_SEPARATOR "%u" DATINDEX_SEPARATOR "%u.DAT", m_Folder.c_str(), rom, location >> 7, location & 0x7F);
+
+        if (length <= 0 || static_cast<size_t>(length) >= size)
+            return 0;
+
+        return static_cast<size_t>(length);
+    }
+
+}; // namespace xiloader
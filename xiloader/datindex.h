@@ -0,0 +1,117 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_DATINDEX_H_INCLUDED__
+#define __XILOADER_DATINDEX_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "mappedfile.h"
+
+#include <string>
+#include <vector>
+
+/* Number of ROM folders; ROM holds the base game, ROM2 to ROM9 the expansions. */
+#define DATINDEX_MAX_ROMS       9
+
+namespace xiloader
+{
+    /**
+     * @brief Maps DAT file numbers onto their paths in a FINAL FANTASY XI installation.
+     *
+     * Every ROM folder has a VTABLE, one byte per file number that is nonzero
+     * when the folder holds the file, and an FTABLE, one 16-bit location per
+     * file number. A location names the DAT as ROMn/<location / 128>/<location % 128>.DAT.
+     * The base tables live in the install folder itself, the expansion tables
+     * as ROMn/VTABLEn.DAT and ROMn/FTABLEn.DAT. The FTABLEs are memory-mapped;
+     * the VTABLEs are merged into one byte per file number when opened, so a
+     * lookup is two array reads and allocates nothing.
+     */
+    class datindex
+    {
+        std::string m_Folder;
+        mappedfile m_Tables[DATINDEX_MAX_ROMS];
+        std::vector<uint8_t> m_Roms; // ROM number of every file number, 0 if none.
+
+        datindex(const datindex&) = delete;
+        datindex& operator=(const datindex&) = delete;
+
+    public:
+        datindex() = default;
+
+        /**
+         * @brief Maps the tables of an installation.
+         *
+         * @param folder    The FINAL FANTASY XI install folder.
+         *
+         * @return True if at least the base tables were mapped, false otherwise.
+         */
+        bool open(const char* folder);
+
+        /**
+         * @brief Unmaps the tables.
+         */
+        void close();
+
+        /**
+         * @brief Locates a DAT file.
+         *
+         * @param fileNo    The file number.
+         * @param rom       Receives the ROM number, 1 for the base game.
+         * @param location  Receives the location within the ROM folder.
+         *
+         * @return True if the installation holds the file, false otherwise.
+         */
+        bool lookup(uint32_t fileNo, uint32_t* rom, uint32_t* location) const;
+
+        /**
+         * @brief Builds the path of a DAT file.
+         *
+         * @param fileNo    The file number.
+         * @param buffer    Receives the null terminated path.
+         * @param size      The size of the buffer.
+         *
+         * @return The length of the path, 0 if the file is unknown or the buffer is too small.
+         */
+        size_t path(uint32_t fileNo, char* buffer, size_t size) const;
+
+        /**
+         * @brief Obtains the number of file numbers the tables cover.
+         *
+         * @return The file number count.
+         */
+        uint32_t count() const { return static_cast<uint32_t>(m_Roms.size()); }
+
+        /**
+         * @brief Obtains the install folder the tables were mapped from.
+         *
+         * @return The folder, empty if nothing is mapped.
+         */
+        const std::string& folder() const { return m_Folder; }
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_DATINDEX_H_INCLUDED__
@@ -0,0 +1,469 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "datmanifest.h"
+#include "console.h"
+#include "datindex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_set>
+
+/* XXH64 primes. */
+#define XXH_PRIME64_1   0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2   0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3   0x165667B19E3779F9ULL
+#define XXH_PRIME64_4   0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5   0x27D4EB2F165667C5ULL
+
+namespace xiloader
+{
+    /* XXH64 helpers. */
+    static uint64_t rotl(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static uint64_t read64(const uint8_t* data)
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static uint32_t read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static uint64_t accumulate(uint64_t lane, uint64_t input)
+    {
+        lane += input * XXH_PRIME64_2;
+        return rotl(lane, 31) * XXH_PRIME64_1;
+    }
+
+    static uint64_t merge(uint64_t hash, uint64_t lane)
+    {
+        hash ^= accumulate(0, lane);
+        return hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    xxh64::xxh64()
+        : m_PendingSize(0), m_Total(0)
+    {
+        m_Lanes[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+        m_Lanes[1] = XXH_PRIME64_2;
+        m_Lanes[2] = 0;
+        m_Lanes[3] = 0 - XXH_PRIME64_1;
+    }
+
+    /**
+     * @brief Consumes a single 32 byte stripe.
+     *
+     * @param data      The stripe.
+     */
+    void xxh64::stripe(const uint8_t* data)
+    {
+        m_Lanes[0] = accumulate(m_Lanes[0], read64(data + 0));
+        m_Lanes[1] = accumulate(m_Lanes[1], read64(data + 8));
+        m_Lanes[2] = accumulate(m_Lanes[2], read64(data + 16));
+        m_Lanes[3] = accumulate(m_Lanes[3], read64(data + 24));
+    }
+
+    /**
+     * @brief Adds data to the hash.
+     *
+     * @param data      The data.
+     * @param size      The size of the data.
+     */
+    void xxh64::update(const uint8_t* data, size_t size)
+    {
+        m_Total += size;
+
+        /* Complete a stripe left over from the previous update.. */
+        if (m_PendingSize != 0)
+        {
+            auto fill = std::min(size, sizeof(m_Pending) - m_PendingSize);
+            memcpy(m_Pending + m_PendingSize, data, fill);
+            m_PendingSize += fill;
+            data += fill;
+            size -= fill;
+
+            if (m_PendingSize < sizeof(m_Pending))
+                return;
+
+            stripe(m_Pending);
+            m_PendingSize = 0;
+        }
+
+        for (; size >= 32; data += 32, size -= 32)
+            stripe(data);
+
+        memcpy(m_Pending, data, size);
+        m_PendingSize = size;
+    }
+
+    /**
+     * @brief Obtains the hash of the data added so far.
+     *
+     * @return The XXH64 hash.
+     */
+    uint64_t xxh64::digest() const
+    {
+        uint64_t hash;
+        if (m_Total >= 32)
+        {
+            hash = rotl(m_Lanes[0], 1) + rotl(m_Lanes[1], 7) + rotl(m_Lanes[2], 12) + rotl(m_Lanes[3], 18);
+            for (auto lane : m_Lanes)
+                hash = merge(hash, lane);
+        }
+        else
+        {
+            hash = XXH_PRIME64_5;
+        }
+        hash += m_Total;
+
+        auto data = m_Pending;
+        auto size = m_PendingSize;
+        for (; size >= 8; data += 8, size -= 8)
+        {
+            hash ^= accumulate(0, read64(data));
+            hash = rotl(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        }
+        if (size >= 4)
+        {
+            hash ^= read32(data) * XXH_PRIME64_1;
+            hash = rotl(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+            data += 4;
+            size -= 4;
+        }
+        for (; size > 0; data++, size--)
+        {
+            hash ^= *data * XXH_PRIME64_5;
+            hash = rotl(hash, 11) * XXH_PRIME64_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= XXH_PRIME64_2;
+        hash ^= hash >> 29;
+        hash *= XXH_PRIME64_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    /**
+     * @brief Joins the install folder and a manifest path.
+     *
+     * @param folder    The install folder.
+     * @param path      The path relative to the folder.
+     *
+     * @return The full path.
+     */
+    static std::string join(const char* folder, const std::string& path)
+    {
+        std::string full(folder);
+        if (!full.empty() && full.back() != '\\' && full.back() != '/')
+            full += '/';
+        return full + path;
+    }
+
+    /**
+     * @brief Hashes a single file.
+     *
+     * @param path      The path of the file.
+     * @param size      Receives the size of the file.
+     * @param hash      Receives the XXH64 hash of the file.
+     * @param buffer    Scratch buffer of DATMANIFEST_CHUNK bytes.
+     *
+     * @return True on success, false if the file could not be read.
+     */
+    bool datmanifest::hash(const std::string& path, uint64_t* size, uint64_t* hash, std::vector<char>& buffer)
+    {
+        /* Read straight into our buffer; the stream's own buffer would only add a copy.. */
+        std::ifstream file;
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        file.open(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        xxh64 state;
+        *size = 0;
+        while (file)
+        {
+            file.read(buffer.data(), buffer.size());
+            auto length = static_cast<size_t>(file.gcount());
+            state.update(reinterpret_cast<const uint8_t*>(buffer.data()), length);
+            *size += length;
+        }
+
+        if (!file.eof())
+            return false;
+
+        *hash = state.digest();
+        return true;
+    }
+
+    /**
+     * @brief Hashes a block of memory.
+     *
+     * @param data      The data to hash.
+     * @param size      The size of the data.
+     *
+     * @return The XXH64 hash of the data.
+     */
+    uint64_t datmanifest::hash(const void* data, size_t size)
+    {
+        xxh64 state;
+        state.update(static_cast<const uint8_t*>(data), size);
+        return state.digest();
+    }
+
+    /**
+     * @brief Lists the DAT files of an installation, using its VTABLE/FTABLE index.
+     *
+     * @param folder    The FINAL FANTASY XI install folder.
+     * @param files     Receives the files, sorted by path; sizes and hashes are not filled.
+     *
+     * @return True on success, false if the tables could not be read.
+     */
+    bool datmanifest::scan(const char* folder, std::vector<datfile>& files)
+    {
+        files.clear();
+
+        datindex index;
+        if (!index.open(folder))
+            return false;
+
+        /* The tables themselves come first; expansions that are not installed have none.. */
+        std::vector<std::string> paths = { "VTABLE.DAT", "FTABLE.DAT" };
+        for (auto rom = 2; rom <= DATINDEX_MAX_ROMS; rom++)
+        {
+            auto vtable = "ROM" + std::to_string(rom) + "/VTABLE" + std::to_string(rom) + ".DAT";
+            auto ftable = "ROM" + std::to_string(rom) + "/FTABLE" + std::to_string(rom) + ".DAT";
+            if (std::ifstream(join(folder, vtable)).is_open() && std::ifstream(join(folder, ftable)).is_open())
+            {
+                paths.push_back(vtable);
+                paths.push_back(ftable);
+            }
+        }
+
+        /* Every file number the tables know of; several may share a file.. */
+        auto tables = paths.size();
+        auto prefix = index.folder().size();
+        std::unordered_set<std::string> seen;
+        char buffer[512];
+        for (uint32_t fileNo = 0; fileNo < index.count(); fileNo++)
+        {
+            if (index.path(fileNo, buffer, sizeof(buffer)) == 0)
+                continue;
+
+            std::string path(buffer + prefix);
+            std::replace(path.begin(), path.end(), '\\', '/');
+            if (seen.insert(path).second)
+                paths.push_back(path);
+        }
+
+        /* Sorted paths keep the files of a folder together on disk.. */
+        std::sort(paths.begin() + tables, paths.end());
+        for (auto& path : paths)
+            files.push_back(datfile{ path, 0, 0, datstatus::ok });
+
+        return true;
+    }
+
+    /**
+     * @brief Reads a manifest.
+     *
+     * @param path      The path of the manifest.
+     * @param files     Receives the files.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool datmanifest::load(const char* path, std::vector<datfile>& files)
+    {
+        files.clear();
+
+        std::ifstream file(path);
+        std::string line;
+        if (!std::getline(file, line) || line.compare(0, strlen(DATMANIFEST_HEADER), DATMANIFEST_HEADER) != 0)
+            return false;
+
+        while (std::getline(file, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            /* <hash> <size> <path>; the path may contain spaces.. */
+            char* end = nullptr;
+            auto hash = strtoull(line.c_str(), &end, 16);
+            if (end != line.c_str() + 16 || *end != ' ')
+                return false;
+
+            auto sizeStart = end + 1;
+            auto size = strtoull(sizeStart, &end, 10);
+            if (end == sizeStart || *end != ' ' || end[1] == '\0')
+                return false;
+
+            files.push_back(datfile{ std::string(end + 1), size, hash, datstatus::ok });
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Writes a manifest.
+     *
+     * @param path      The path of the manifest.
+     * @param files     The files.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool datmanifest::save(const char* path, const std::vector<datfile>& files)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open())
+            return false;
+
+        file << DATMANIFEST_HEADER << "\n";
+        for (auto& entry : files)
+        {
+            char line[48];
+            snprintf(line, sizeof(line), "%016llx %llu ", static_cast<unsigned long long>(entry.Hash), static_cast<unsigned long long>(entry.Size));
+            file << line << entry.Path << "\n";
+        }
+
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Hashes the files of an installation on every core.
+     *
+     * @param folder    The install folder the paths are relative to.
+     * @param files     The files; compared with their sizes and hashes, or given them.
+     * @param update    "true" to store the sizes and hashes, "false" to compare with them.
+     *
+     * @return The number of files that are missing or differ.
+     */
+    uint32_t datmanifest::verify(const char* folder, std::vector<datfile>& files, bool update)
+    {
+        std::atomic<size_t> next(0);
+        std::atomic<uint32_t> bad(0);
+
+        /* Hashing is long running; it gets threads of its own rather than the scheduler.. */
+        auto work = [&]()
+        {
+            std::vector<char> buffer(DATMANIFEST_CHUNK);
+            for (auto x = next.fetch_add(1); x < files.size(); x = next.fetch_add(1))
+            {
+                auto& entry = files[x];
+                uint64_t size = 0, hash = 0;
+                if (!datmanifest::hash(join(folder, entry.Path), &size, &hash, buffer))
+                {
+                    entry.Status = datstatus::missing;
+                }
+                else if (update)
+                {
+                    entry.Size = size;
+                    entry.Hash = hash;
+                    entry.Status = datstatus::ok;
+                }
+                else if (size != entry.Size)
+                    entry.Status = datstatus::resized;
+                else if (hash != entry.Hash)
+                    entry.Status = datstatus::changed;
+                else
+                    entry.Status = datstatus::ok;
+
+                if (entry.Status != datstatus::ok)
+                    bad++;
+            }
+        };
+
+        auto count = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+        std::vector<std::thread> threads;
+        for (uint32_t x = 1; x < count; x++)
+            threads.emplace_back(work);
+
+        work();
+        for (auto& thread : threads)
+            thread.join();
+
+        return bad.load();
+    }
+
+    /**
+     * @brief Verifies an installation against a manifest and prints a report.
+     *
+     * @param folder    The FINAL FANTASY XI install folder.
+     * @param manifest  The path of the manifest.
+     *
+     * @return 0 if every file is intact, 1 otherwise.
+     */
+    int datmanifest::check(const char* folder, const char* manifest)
+    {
+        static const char* statusNames[] = { "ok", "missing", "resized", "changed" };
+
+        std::vector<datfile> files;
+        if (!datmanifest::load(manifest, files))
+        {
+            XILOADER_ERROR("Failed to read the DAT manifest: %s", manifest);
+            return 1;
+        }
+
+        if (folder == nullptr || *folder == '\0')
+        {
+            XILOADER_ERROR("Failed to locate the FINAL FANTASY XI install folder.");
+            return 1;
+        }
+
+        xiloader::console::output(xiloader::color::info, "Verifying %u files in %s..", static_cast<uint32_t>(files.size()), folder);
+
+        auto start = std::chrono::steady_clock::now();
+        auto bad = datmanifest::verify(folder, files, false);
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t bytes = 0;
+        for (auto& entry : files)
+        {
+            bytes += entry.Size;
+            if (entry.Status != datstatus::ok)
+                xiloader::console::output(xiloader::color::error, "%s: %s", statusNames[static_cast<int>(entry.Status)], entry.Path.c_str());
+        }
+
+        auto megabytes = static_cast<double>(bytes) / (1024 * 1024);
+        xiloader::console::output(bad == 0 ? xiloader::color::success : xiloader::color::error, "%u of %u files bad; %.0f MB checked in %.1f s (%.0f MB/s).",
+            bad, static_cast<uint32_t>(files.size()), megabytes, elapsed, elapsed > 0 ? megabytes / elapsed : 0.0);
+        return bad == 0 ? 0 : 1;
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,183 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_DATMANIFEST_H_INCLUDED__
+#define __XILOADER_DATMANIFEST_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* First line of a manifest file. */
+#define DATMANIFEST_HEADER      "# xiloader dat manifest 1"
+
+/* Size of a single read while hashing. */
+#define DATMANIFEST_CHUNK       (1024 * 1024)
+
+namespace xiloader
+{
+    /**
+     * @brief Result of checking a single file against the manifest.
+     */
+    enum class datstatus : uint8_t
+    {
+        ok = 0,
+        missing = 1,    // The file could not be read.
+        resized = 2,    // The file size differs from the manifest.
+        changed = 3,    // The file contents differ from the manifest.
+    };
+
+    /**
+     * @brief Manifest entry of a single file.
+     */
+    typedef struct datfile_t
+    {
+        std::string Path;   // Relative to the install folder, with forward slashes.
+        uint64_t Size;      // The size of the file in bytes.
+        uint64_t Hash;      // The XXH64 hash of the file contents.
+        datstatus Status;   // The result of the last check.
+    } datfile;
+
+    /**
+     * @brief Streaming XXH64 hash, seed 0.
+     */
+    class xxh64
+    {
+        uint64_t m_Lanes[4];
+        uint8_t m_Pending[32];
+        size_t m_PendingSize;
+        uint64_t m_Total;
+
+        void stripe(const uint8_t* data);
+
+    public:
+        xxh64();
+
+        /**
+         * @brief Adds data to the hash.
+         *
+         * @param data      The data.
+         * @param size      The size of the data.
+         */
+        void update(const uint8_t* data, size_t size);
+
+        /**
+         * @brief Obtains the hash of the data added so far.
+         *
+         * @return The XXH64 hash.
+         */
+        uint64_t digest() const;
+    };
+
+    /**
+     * @brief DAT installation manifests: listing, hashing and verification.
+     *
+     * A manifest is a text file holding one "<hash> <size> <path>" line per
+     * file, the hash as 16 hex digits. Files are hashed with XXH64 in large
+     * sequential reads, one file per thread on every core.
+     */
+    class datmanifest
+    {
+    public:
+
+        /**
+         * @brief Hashes a single file.
+         *
+         * @param path      The path of the file.
+         * @param size      Receives the size of the file.
+         * @param hash      Receives the XXH64 hash of the file.
+         * @param buffer    Scratch buffer of DATMANIFEST_CHUNK bytes.
+         *
+         * @return True on success, false if the file could not be read.
+         */
+        static bool hash(const std::string& path, uint64_t* size, uint64_t* hash, std::vector<char>& buffer);
+
+        /**
+         * @brief Hashes a block of memory.
+         *
+         * @param data      The data to hash.
+         * @param size      The size of the data.
+         *
+         * @return The XXH64 hash of the data.
+         */
+        static uint64_t hash(const void* data, size_t size);
+
+        /**
+         * @brief Lists the DAT files of an installation, using its VTABLE/FTABLE index.
+         *
+         * @param folder    The FINAL FANTASY XI install folder.
+         * @param files     Receives the files, sorted by path; sizes and hashes are not filled.
+         *
+         * @return True on success, false if the tables could not be read.
+         */
+        static bool scan(const char* folder, std::vector<datfile>& files);
+
+        /**
+         * @brief Reads a manifest.
+         *
+         * @param path      The path of the manifest.
+         * @param files     Receives the files.
+         *
+         * @return True on success, false otherwise.
+         */
+        static bool load(const char* path, std::vector<datfile>& files);
+
+        /**
+         * @brief Writes a manifest.
+         *
+         * @param path      The path of the manifest.
+         * @param files     The files.
+         *
+         * @return True on success, false otherwise.
+         */
+        static bool save(const char* path, const std::vector<datfile>& files);
+
+        /**
+         * @brief Hashes the files of an installation on every core.
+         *
+         * @param folder    The install folder the paths are relative to.
+         * @param files     The files; compared with their sizes and hashes, or given them.
+         * @param update    "true" to store the sizes and hashes, "false" to compare with them.
+         *
+         * @return The number of files that are missing or differ.
+         */
+        static uint32_t verify(const char* folder, std::vector<datfile>& files, bool update);
+
+        /**
+         * @brief Verifies an installation against a manifest and prints a report.
+         *
+         * @param folder    The FINAL FANTASY XI install folder.
+         * @param manifest  The path of the manifest.
+         *
+         * @return 0 if every file is intact, 1 otherwise.
+         */
+        static int check(const char* folder, const char* manifest);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_DATMANIFEST_H_INCLUDED__
@@ -0,0 +1,597 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "datsync.h"
+#include "console.h"
+#include "datmanifest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+/* Signature index identification. */
+#define DATSYNC_MAGIC           "XISY"
+#define DATSYNC_VERSION         1
+
+namespace xiloader
+{
+    /**
+     * @brief Runs a job for every item on one thread per core.
+     *
+     * @param count     The number of items.
+     * @param job       The job; receives the item index and a scratch buffer of DATMANIFEST_CHUNK bytes.
+     */
+    static void parallel(size_t count, const std::function<void(size_t, std::vector<char>&)>& job)
+    {
+        std::atomic<size_t> next(0);
+        auto work = [&]()
+        {
+            std::vector<char> buffer(DATMANIFEST_CHUNK);
+            for (auto x = next.fetch_add(1); x < count; x = next.fetch_add(1))
+                job(x, buffer);
+        };
+
+        auto workers = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+        std::vector<std::thread> threads;
+        for (uint32_t x = 1; x < workers; x++)
+            threads.emplace_back(work);
+
+        work();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    /**
+     * @brief Joins a folder and a relative path.
+     *
+     * @param folder    The folder.
+     * @param path      The path relative to the folder.
+     *
+     * @return The full path.
+     */
+    static std::string join(const char* folder, const std::string& path)
+    {
+        std::string full(folder);
+        if (!full.empty() && full.back() != '\\' && full.back() != '/')
+            full += '/';
+        return full + path;
+    }
+
+    /**
+     * @brief Reads a whole file.
+     *
+     * @param path      The path of the file.
+     * @param data      Receives the contents.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool readfile(const std::string& path, std::vector<uint8_t>& data)
+    {
+        data.clear();
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+            return false;
+
+        auto size = static_cast<size_t>(file.tellg());
+        data.resize(size);
+        file.seekg(0);
+        return size == 0 || file.read(reinterpret_cast<char*>(data.data()), size).gcount() == static_cast<std::streamsize>(size);
+    }
+
+    /**
+     * @brief Creates the folders leading up to a file.
+     *
+     * @param path      The path of the file.
+     */
+    static void makefolders(const std::string& path)
+    {
+        for (size_t x = 1; x < path.size(); x++)
+        {
+            if (path[x] != '/' && path[x] != '\\')
+                continue;
+
+            /* Existing folders simply fail.. */
+            auto folder = path.substr(0, x);
+#ifdef _WIN32
+            _mkdir(folder.c_str());
+#else
+            mkdir(folder.c_str(), 0755);
+#endif
+        }
+    }
+
+    /**
+     * @brief Replaces a file with another, atomically.
+     *
+     * @param from      The new file.
+     * @param to        The file to replace.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool replace(const std::string& from, const std::string& to)
+    {
+#ifdef _WIN32
+        return ::MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+
+    /**
+     * @brief Determines if a path names a VTABLE or FTABLE file.
+     *
+     * @param path      The relative path.
+     *
+     * @return True for a table, false otherwise.
+     */
+    static bool istable(const std::string& path)
+    {
+        auto slash = path.rfind('/');
+        auto name = slash == std::string::npos ? path : path.substr(slash + 1);
+        return name.compare(0, 6, "VTABLE") == 0 || name.compare(0, 6, "FTABLE") == 0;
+    }
+
+    /**
+     * @brief Computes the rsync rolling checksum of a block.
+     *
+     * @param data      The block.
+     * @param size      The size of the block.
+     * @param a         Receives the byte sum.
+     * @param b         Receives the weighted byte sum.
+     */
+    static void weaksum(const uint8_t* data, size_t size, uint32_t* a, uint32_t* b)
+    {
+        *a = 0;
+        *b = 0;
+        for (size_t x = 0; x < size; x++)
+        {
+            *a += data[x];
+            *b += static_cast<uint32_t>(size - x) * data[x];
+        }
+    }
+
+    /**
+     * @brief Combines the two halves of the rolling checksum.
+     */
+    static uint32_t weak(uint32_t a, uint32_t b)
+    {
+        return (a & 0xFFFF) | (b << 16);
+    }
+
+    /**
+     * @brief Computes the signatures of a single file.
+     *
+     * @param path          The path of the file.
+     * @param signature     Receives the size, hash and block signatures.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool sign(const std::string& path, datsignature& signature)
+    {
+        std::vector<uint8_t> data;
+        if (!readfile(path, data))
+            return false;
+
+        signature.Size = data.size();
+        signature.Hash = datmanifest::hash(data.data(), data.size());
+        signature.BlockSize = DATSYNC_BLOCK;
+        signature.Weak.clear();
+        signature.Strong.clear();
+
+        for (size_t offset = 0; offset < data.size(); offset += DATSYNC_BLOCK)
+        {
+            auto length = std::min<size_t>(DATSYNC_BLOCK, data.size() - offset);
+            uint32_t a, b;
+            weaksum(data.data() + offset, length, &a, &b);
+            signature.Weak.push_back(weak(a, b));
+            signature.Strong.push_back(datmanifest::hash(data.data() + offset, length));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Finds the mirror blocks a local file already holds, at any offset.
+     *
+     * @param signature     The signatures of the mirror file.
+     * @param data          The local file.
+     *
+     * @return The local offset of every mirror block, -1 for blocks that must be fetched.
+     */
+    static std::vector<int64_t> match(const datsignature& signature, const std::vector<uint8_t>& data)
+    {
+        std::vector<int64_t> found(signature.Weak.size(), -1);
+
+        /* Only whole blocks are matched; a short last block is always fetched.. */
+        size_t size = signature.BlockSize;
+        auto whole = static_cast<size_t>(signature.Size / size);
+        if (whole == 0 || data.size() < size)
+            return found;
+
+        /* A 16-bit tag table rules out most offsets before the hash lookup.. */
+        std::vector<uint8_t> tags(0x10000, 0);
+        std::unordered_multimap<uint32_t, uint32_t> blocks;
+        blocks.reserve(whole);
+        for (uint32_t x = 0; x < whole; x++)
+        {
+            blocks.emplace(signature.Weak[x], x);
+            tags[(signature.Weak[x] ^ (signature.Weak[x] >> 16)) & 0xFFFF] = 1;
+        }
+
+        uint32_t a, b;
+        weaksum(data.data(), size, &a, &b);
+        for (size_t offset = 0;;)
+        {
+            auto sum = weak(a, b);
+            auto matched = false;
+            if (tags[(sum ^ (sum >> 16)) & 0xFFFF] != 0)
+            {
+                auto range = blocks.equal_range(sum);
+                if (range.first != range.second)
+                {
+                    auto strong = datmanifest::hash(data.data() + offset, size);
+                    for (auto block = range.first; block != range.second; ++block)
+                    {
+                        if (found[block->second] < 0 && signature.Strong[block->second] == strong)
+                        {
+                            found[block->second] = static_cast<int64_t>(offset);
+                            matched = true;
+                        }
+                    }
+                }
+            }
+
+            /* Continue after a matched block, else roll the window one byte.. */
+            if (matched)
+            {
+                offset += size;
+                if (offset + size > data.size())
+                    break;
+                weaksum(data.data() + offset, size, &a, &b);
+                continue;
+            }
+
+            if (offset + size >= data.size())
+                break;
+
+            uint32_t out = data[offset];
+            uint32_t in = data[offset + size];
+            a += in - out;
+            b += a - static_cast<uint32_t>(size) * out;
+            offset++;
+        }
+
+        return found;
+    }
+
+    /**
+     * @brief Brings a single file up to date with the mirror.
+     *
+     * @param mirror        The mirror folder.
+     * @param target        The install folder.
+     * @param signature     The signatures of the mirror file.
+     * @param buffer        Scratch buffer for mirror reads.
+     * @param fetched       Receives the bytes read from the mirror.
+     * @param reused        Receives the bytes taken from the local file.
+     *
+     * @return 1 if the file was rewritten, 0 if it was up to date, -1 on failure.
+     */
+    static int syncfile(const char* mirror, const char* target, const datsignature& signature, std::vector<char>& buffer, uint64_t* fetched, uint64_t* reused)
+    {
+        auto local = join(target, signature.Path);
+
+        std::vector<uint8_t> data;
+        readfile(local, data);
+        if (data.size() == signature.Size && datmanifest::hash(data.data(), data.size()) == signature.Hash)
+            return 0;
+
+        auto found = match(signature, data);
+
+        /* Rebuild the file next to the old one; the mirror is only read for missing blocks.. */
+        auto temporary = local + DATSYNC_TEMP;
+        makefolders(local);
+
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        std::ifstream source;
+        xxh64 state;
+        auto ok = output.is_open();
+
+        for (size_t block = 0; ok && block < found.size();)
+        {
+            auto offset = static_cast<uint64_t>(block) * signature.BlockSize;
+            if (found[block] >= 0)
+            {
+                auto length = static_cast<size_t>(std::min<uint64_t>(signature.BlockSize, signature.Size - offset));
+                auto bytes = data.data() + found[block];
+                output.write(reinterpret_cast<const char*>(bytes), length);
+                state.update(bytes, length);
+                *reused += length;
+                block++;
+                continue;
+            }
+
+            /* Fetch a run of missing blocks in one sequential read.. */
+            auto end = block;
+            while (end < found.size() && found[end] < 0)
+                end++;
+            auto remaining = std::min<uint64_t>(static_cast<uint64_t>(end) * signature.BlockSize, signature.Size) - offset;
+
+            if (!source.is_open())
+                source.open(join(mirror, signature.Path), std::ios::binary);
+            source.seekg(static_cast<std::streamoff>(offset));
+
+            while (ok && remaining > 0)
+            {
+                auto length = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+                ok = source.read(buffer.data(), length).gcount() == static_cast<std::streamsize>(length);
+                output.write(buffer.data(), length);
+                state.update(reinterpret_cast<const uint8_t*>(buffer.data()), length);
+                *fetched += length;
+                remaining -= length;
+            }
+            block = end;
+        }
+
+        output.close();
+        ok = ok && !output.fail() && state.digest() == signature.Hash;
+        if (!ok || !replace(temporary, local))
+        {
+            remove(temporary.c_str());
+            return -1;
+        }
+
+        return 1;
+    }
+
+    /**
+     * @brief Writes the signature index of a mirror.
+     *
+     * @param path          The path of the index.
+     * @param signatures    The signatures.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool save(const std::string& path, const std::vector<datsignature>& signatures)
+    {
+        auto temporary = path + DATSYNC_TEMP;
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                return false;
+
+            uint32_t version = DATSYNC_VERSION;
+            auto count = static_cast<uint32_t>(signatures.size());
+            file.write(DATSYNC_MAGIC, 4);
+            file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+            file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+            for (auto& signature : signatures)
+            {
+                auto length = static_cast<uint16_t>(signature.Path.size());
+                auto blocks = static_cast<uint32_t>(signature.Weak.size());
+                file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                file.write(signature.Path.data(), length);
+                file.write(reinterpret_cast<const char*>(&signature.Size), sizeof(signature.Size));
+                file.write(reinterpret_cast<const char*>(&signature.Hash), sizeof(signature.Hash));
+                file.write(reinterpret_cast<const char*>(&signature.BlockSize), sizeof(signature.BlockSize));
+                file.write(reinterpret_cast<const char*>(&blocks), sizeof(blocks));
+                file.write(reinterpret_cast<const char*>(signature.Weak.data()), blocks * sizeof(uint32_t));
+                file.write(reinterpret_cast<const char*>(signature.Strong.data()), blocks * sizeof(uint64_t));
+            }
+
+            if (!file)
+                return false;
+        }
+
+        return replace(temporary, path);
+    }
+
+    /**
+     * @brief Computes the signatures of a mirror and writes its index.
+     *
+     * @param mirror    The mirror folder; lists its files through its VTABLE/FTABLE index.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool datsync::index(const char* mirror)
+    {
+        std::vector<datfile> files;
+        if (!datmanifest::scan(mirror, files))
+            return false;
+
+        std::vector<datsignature> signatures(files.size());
+        std::atomic<uint32_t> failed(0);
+        parallel(files.size(), [&](size_t x, std::vector<char>&)
+        {
+            signatures[x].Path = files[x].Path;
+            if (!sign(join(mirror, files[x].Path), signatures[x]))
+                failed++;
+        });
+
+        return failed.load() == 0 && save(join(mirror, DATSYNC_INDEX), signatures);
+    }
+
+    /**
+     * @brief Reads the signature index of a mirror.
+     *
+     * @param mirror        The mirror folder.
+     * @param signatures    Receives the signatures.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool datsync::load(const char* mirror, std::vector<datsignature>& signatures)
+    {
+        signatures.clear();
+
+        std::ifstream file(join(mirror, DATSYNC_INDEX), std::ios::binary);
+        char magic[4] = { 0 };
+        uint32_t version = 0, count = 0;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || memcmp(magic, DATSYNC_MAGIC, sizeof(magic)) != 0 || version != DATSYNC_VERSION)
+            return false;
+
+        for (uint32_t x = 0; x < count; x++)
+        {
+            datsignature signature;
+            uint16_t length = 0;
+            uint32_t blocks = 0;
+            file.read(reinterpret_cast<char*>(&length), sizeof(length));
+            signature.Path.resize(length);
+            file.read(&signature.Path[0], length);
+            file.read(reinterpret_cast<char*>(&signature.Size), sizeof(signature.Size));
+            file.read(reinterpret_cast<char*>(&signature.Hash), sizeof(signature.Hash));
+            file.read(reinterpret_cast<char*>(&signature.BlockSize), sizeof(signature.BlockSize));
+            file.read(reinterpret_cast<char*>(&blocks), sizeof(blocks));
+
+            /* The block count follows from the size; anything else is a damaged index.. */
+            if (!file || length == 0 || signature.BlockSize == 0 || blocks != (signature.Size + signature.BlockSize - 1) / signature.BlockSize)
+                return false;
+
+            signature.Weak.resize(blocks);
+            signature.Strong.resize(blocks);
+            file.read(reinterpret_cast<char*>(signature.Weak.data()), blocks * sizeof(uint32_t));
+            file.read(reinterpret_cast<char*>(signature.Strong.data()), blocks * sizeof(uint64_t));
+            if (!file)
+                return false;
+
+            signatures.push_back(std::move(signature));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Brings an installation up to date with a mirror.
+     *
+     * @param mirror    The mirror folder.
+     * @param target    The install folder to update.
+     * @param stats     Receives the outcome.
+     *
+     * @return True if every file is up to date, false otherwise.
+     */
+    bool datsync::sync(const char* mirror, const char* target, datsyncstats* stats)
+    {
+        memset(stats, 0x00, sizeof(datsyncstats));
+
+        std::vector<datsignature> signatures;
+        if (!datsync::load(mirror, signatures))
+            return false;
+
+        std::atomic<uint32_t> updated(0), failed(0);
+        std::atomic<uint64_t> fetched(0), reused(0);
+        auto job = [&](const std::vector<const datsignature*>& files)
+        {
+            parallel(files.size(), [&](size_t x, std::vector<char>& buffer)
+            {
+                uint64_t fileFetched = 0, fileReused = 0;
+                auto result = syncfile(mirror, target, *files[x], buffer, &fileFetched, &fileReused);
+                if (result < 0)
+                    failed++;
+                else if (result > 0)
+                    updated++;
+                fetched += fileFetched;
+                reused += fileReused;
+            });
+        };
+
+        /* The tables go last, and only if every file they point to is in place.. */
+        std::vector<const datsignature*> files, tables;
+        for (auto& signature : signatures)
+            (istable(signature.Path) ? tables : files).push_back(&signature);
+
+        job(files);
+        if (failed.load() == 0)
+            job(tables);
+        else
+            failed += static_cast<uint32_t>(tables.size());
+
+        stats->Files = static_cast<uint32_t>(signatures.size());
+        stats->Updated = updated.load();
+        stats->Failed = failed.load();
+        stats->Fetched = fetched.load();
+        stats->Reused = reused.load();
+        return stats->Failed == 0;
+    }
+
+    /**
+     * @brief Brings an installation up to date with a mirror and prints a report.
+     *
+     * Folders without a VTABLE.DAT are refused, so a wrong folder is never overwritten.
+     *
+     * @param mirror    The mirror folder.
+     * @param target    The install folder to update.
+     *
+     * @return 0 if every file is up to date, 1 otherwise.
+     */
+    int datsync::run(const char* mirror, const char* target)
+    {
+        if (target == nullptr || *target == '\0')
+        {
+            XILOADER_ERROR("Failed to locate the FINAL FANTASY XI install folder.");
+            return 1;
+        }
+
+        if (!std::ifstream(join(target, "VTABLE.DAT")).is_open())
+        {
+            XILOADER_ERROR("%s is not a FINAL FANTASY XI install folder (no VTABLE.DAT); not syncing.", target);
+            return 1;
+        }
+
+        xiloader::console::output(xiloader::color::info, "Syncing %s from %s..", target, mirror);
+
+        datsyncstats stats;
+        auto start = std::chrono::steady_clock::now();
+        auto synced = datsync::sync(mirror, target, &stats);
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (stats.Files == 0)
+        {
+            XILOADER_ERROR("Failed to read the mirror index %s; create it with xidatsync --index.", DATSYNC_INDEX);
+            return 1;
+        }
+
+        if (!synced)
+            XILOADER_ERROR("Failed to update %u files; the mirror index may be out of date.", stats.Failed);
+
+        xiloader::console::output(synced ? xiloader::color::success : xiloader::color::error, "%u of %u files updated; %.1f MB fetched, %.1f MB reused in %.1f s.",
+            stats.Updated, stats.Files, static_cast<double>(stats.Fetched) / (1024 * 1024), static_cast<double>(stats.Reused) / (1024 * 1024), elapsed);
+        return synced ? 0 : 1;
+    }
+
+}; // namespace xiloader
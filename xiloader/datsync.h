@@ -0,0 +1,133 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_DATSYNC_H_INCLUDED__
+#define __XILOADER_DATSYNC_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Name of the block signature index kept in the mirror folder. */
+#define DATSYNC_INDEX           "xiloader.sync"
+
+/* Block size the files are compared in. */
+#define DATSYNC_BLOCK           4096
+
+/* Suffix of the temporary file a DAT is rebuilt in. */
+#define DATSYNC_TEMP            ".xisync"
+
+namespace xiloader
+{
+    /**
+     * @brief Block signatures of a single mirror file.
+     */
+    typedef struct datsignature_t
+    {
+        std::string Path;               // Relative to the mirror folder, with forward slashes.
+        uint64_t Size;                  // The size of the file in bytes.
+        uint64_t Hash;                  // The XXH64 hash of the whole file.
+        uint32_t BlockSize;             // The size of every block but the last.
+        std::vector<uint32_t> Weak;     // The rolling checksum of every block.
+        std::vector<uint64_t> Strong;   // The XXH64 hash of every block.
+    } datsignature;
+
+    /**
+     * @brief Outcome of a sync.
+     */
+    typedef struct datsyncstats_t
+    {
+        uint32_t Files;     // The files compared.
+        uint32_t Updated;   // The files rewritten.
+        uint32_t Failed;    // The files that could not be updated.
+        uint64_t Fetched;   // The bytes read from the mirror.
+        uint64_t Reused;    // The bytes of updated files taken from the local copy.
+    } datsyncstats;
+
+    /**
+     * @brief Delta sync of DAT files from a mirror, rsync style.
+     *
+     * The mirror is a plain folder, typically a network share, that only
+     * serves reads. Its block signatures are computed once into the
+     * DATSYNC_INDEX file next to the files. A sync reads the index, rolls the
+     * weak checksum over every local file to find the mirror blocks it
+     * already holds anywhere in it, and reads only the missing blocks from
+     * the mirror. Files are rebuilt into temporary files that replace the old
+     * ones with an atomic rename once their hash is verified; the VTABLE and
+     * FTABLE files are replaced last. Files are synced in parallel, one per
+     * thread on every core.
+     */
+    class datsync
+    {
+    public:
+
+        /**
+         * @brief Computes the signatures of a mirror and writes its index.
+         *
+         * @param mirror    The mirror folder; lists its files through its VTABLE/FTABLE index.
+         *
+         * @return True on success, false otherwise.
+         */
+        static bool index(const char* mirror);
+
+        /**
+         * @brief Reads the signature index of a mirror.
+         *
+         * @param mirror        The mirror folder.
+         * @param signatures    Receives the signatures.
+         *
+         * @return True on success, false otherwise.
+         */
+        static bool load(const char* mirror, std::vector<datsignature>& signatures);
+
+        /**
+         * @brief Brings an installation up to date with a mirror.
+         *
+         * @param mirror    The mirror folder.
+         * @param target    The install folder to update.
+         * @param stats     Receives the outcome.
+         *
+         * @return True if every file is up to date, false otherwise.
+         */
+        static bool sync(const char* mirror, const char* target, datsyncstats* stats);
+
+        /**
+         * @brief Brings an installation up to date with a mirror and prints a report.
+         *
+         * Folders without a VTABLE.DAT are refused, so a wrong folder is never overwritten.
+         *
+         * @param mirror    The mirror folder.
+         * @param target    The install folder to update.
+         *
+         * @return 0 if every file is up to date, 1 otherwise.
+         */
+        static int run(const char* mirror, const char* target);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_DATSYNC_H_INCLUDED__
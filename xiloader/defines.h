@@ -51,6 +51,13 @@ This file is part of DarkStar-server source code.
 #define POLFUNC_REGISTRY_KEY    0x016F
 #define POLFUNC_INSTALL_FOLDER  0x007D
 
+/* Loader Exit Codes */
+#define XILOADER_EXIT_SUCCESS       0   // The game ran and exited normally.
+#define XILOADER_EXIT_ERROR         1   // The loader or the game failed to start.
+#define XILOADER_EXIT_CONNECT       2   // The server could not be resolved, reached or did not answer.
+#define XILOADER_EXIT_LOGIN         3   // The server rejected the credentials.
+#define XILOADER_EXIT_CREDENTIALS   4   // Headless mode was requested without usable credentials.
+
 namespace xiloader
 {
     /* PolCore COM Class ID Definitions */
@@ -0,0 +1,392 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "diagnostics.h"
+#include "functions.h"
+#include "network.h"
+#include "scheduler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+/* Registry key Windows records the DirectPlay optional feature under. */
+#define DIAGNOSTICS_DIRECTPLAY_KEY  "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Component Based Servicing\\Notifications\\OptionalFeatures\\DirectPlay"
+
+namespace xiloader
+{
+    /**
+     * @brief Milliseconds elapsed since a point in time.
+     */
+    static double since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief Reads a registry value from HKEY_LOCAL_MACHINE.
+     *
+     * @param path      The key path.
+     * @param name      The value name.
+     * @param view      KEY_WOW64_32KEY or KEY_WOW64_64KEY.
+     * @param type      The expected value type.
+     * @param data      Receives the value.
+     * @param size      The size of the data buffer.
+     *
+     * @return True if the value exists with the expected type, false otherwise.
+     */
+    static bool readvalue(const char* path, const char* name, REGSAM view, DWORD type, void* data, DWORD size)
+    {
+        HKEY hKey = NULL;
+        if (::RegOpenKeyExA(HKEY_LOCAL_MACHINE, path, 0, KEY_QUERY_VALUE | view, &hKey) != ERROR_SUCCESS)
+            return false;
+
+        DWORD dwRegType = 0;
+        auto found = ::RegQueryValueExA(hKey, name, NULL, &dwRegType, (LPBYTE)data, &size) == ERROR_SUCCESS && dwRegType == type;
+        ::RegCloseKey(hKey);
+        return found;
+    }
+
+    /**
+     * @brief Reads the PlayOnline install folder of a language.
+     *
+     * GetRegistryPlayOnlineInstallFolder shares one buffer between callers, so
+     * the probes read the value themselves.
+     *
+     * @param lang      The language id.
+     * @param folder    Receives the folder.
+     *
+     * @return True if the folder is registered, false otherwise.
+     */
+    static bool installfolder(int lang, char (&folder)[MAX_PATH])
+    {
+        char szRegistryPath[MAX_PATH];
+        sprintf_s(szRegistryPath, MAX_PATH, "%s\\InstallFolder", functions::GetRegistryPlayOnlineKey(lang));
+
+        memset(folder, 0x00, sizeof(folder));
+        return readvalue(szRegistryPath, "1000", KEY_WOW64_32KEY, REG_SZ, folder, sizeof(folder) - 1) && folder[0] != '\0';
+    }
+
+    /**
+     * @brief Probes the PlayOnline registry keys of a language.
+     *
+     * @param lang      The language id.
+     * @param current   The language the loader was started with; only its keys are required.
+     *
+     * @return The probe result.
+     */
+    static diagnosticprobe registry(int lang, int current)
+    {
+        static const char* names[3] = { "registry.jp", "registry.us", "registry.eu" };
+
+        auto start = std::chrono::steady_clock::now();
+        diagnosticprobe probe = { names[lang], diagnosticstatus::ok, 0, "" };
+
+        char folder[MAX_PATH];
+        std::string key = std::string("HKLM\\") + functions::GetRegistryPlayOnlineKey(lang);
+        if (installfolder(lang, folder))
+        {
+            probe.Detail = key + " language " + std::to_string(functions::GetRegistryPlayOnlineLanguage(lang));
+        }
+        else
+        {
+            probe.Status = lang == current ? diagnosticstatus::fail : diagnosticstatus::skip;
+            probe.Detail = key + "\\InstallFolder not found";
+        }
+
+        probe.Elapsed = since(start);
+        return probe;
+    }
+
+    /**
+     * @brief Probes the FINAL FANTASY XI install folder of the language the loader was started with.
+     *
+     * @param lang      The language id.
+     *
+     * @return The probe result.
+     */
+    static diagnosticprobe install(int lang)
+    {
+        auto start = std::chrono::steady_clock::now();
+        diagnosticprobe probe = { "install", diagnosticstatus::ok, 0, "" };
+
+        char folder[MAX_PATH];
+        if (!functions::GetRegistryFFXIInstallFolder(lang, folder, sizeof(folder)))
+        {
+            probe.Status = diagnosticstatus::fail;
+            probe.Detail = "not registered";
+        }
+        else
+        {
+            /* The game is only usable with its DAT index; --sync refuses folders without it too.. */
+            auto attributes = ::GetFileAttributesA(folder);
+            auto table = std::string(folder) + "\\VTABLE.DAT";
+            if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+            {
+                probe.Status = diagnosticstatus::fail;
+                probe.Detail = std::string(folder) + " does not exist";
+            }
+            else if (::GetFileAttributesA(table.c_str()) == INVALID_FILE_ATTRIBUTES)
+            {
+                probe.Status = diagnosticstatus::fail;
+                probe.Detail = std::string(folder) + " has no VTABLE.DAT";
+            }
+            else
+                probe.Detail = folder;
+        }
+
+        probe.Elapsed = since(start);
+        return probe;
+    }
+
+    /**
+     * @brief Probes for DirectPlay, which the game needs to start.
+     *
+     * @return The probe result.
+     */
+    static diagnosticprobe directplay(void)
+    {
+        auto start = std::chrono::steady_clock::now();
+        diagnosticprobe probe = { "directplay", diagnosticstatus::ok, 0, "" };
+
+        /* Windows 8 and later list it as an optional feature; older versions simply ship the library.. */
+        DWORD selection = 0;
+        char library[MAX_PATH] = { 0 };
+        auto length = ::GetSystemDirectoryA(library, MAX_PATH);
+        if (length > 0 && length < MAX_PATH)
+            strcat_s(library, MAX_PATH, "\\dplayx.dll");
+
+        if (readvalue(DIAGNOSTICS_DIRECTPLAY_KEY, "Selection", KEY_WOW64_64KEY, REG_DWORD, &selection, sizeof(selection)) && selection != 0)
+            probe.Detail = "optional feature enabled";
+        else if (length > 0 && ::GetFileAttributesA(library) != INVALID_FILE_ATTRIBUTES)
+            probe.Detail = library;
+        else
+        {
+            probe.Status = diagnosticstatus::fail;
+            probe.Detail = "not installed; turn it on under Windows Features";
+        }
+
+        probe.Elapsed = since(start);
+        return probe;
+    }
+
+    /**
+     * @brief Probes whether the local lobby port is free to listen on.
+     *
+     * @param port      The port the loader listens on.
+     *
+     * @return The probe result.
+     */
+    static diagnosticprobe listener(const std::string& port)
+    {
+        auto start = std::chrono::steady_clock::now();
+        diagnosticprobe probe = { "listen." + port, diagnosticstatus::ok, 0, "port free" };
+
+        struct sockaddr_in local;
+        memset(&local, 0x00, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_port = htons(static_cast<u_short>(atoi(port.c_str())));
+        local.sin_addr.s_addr = INADDR_ANY;
+
+        /* Exclusive use makes a socket already bound to the port fail the probe.. */
+        BOOL exclusive = TRUE;
+        auto sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET ||
+            setsockopt(sock, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&exclusive, sizeof(exclusive)) == SOCKET_ERROR ||
+            bind(sock, (struct sockaddr*)&local, sizeof(local)) == SOCKET_ERROR)
+        {
+            auto error = WSAGetLastError();
+            probe.Status = diagnosticstatus::fail;
+            probe.Detail = error == WSAEADDRINUSE || error == WSAEACCES ? "port in use" : "socket error " + std::to_string(error);
+        }
+
+        if (sock != INVALID_SOCKET)
+            closesocket(sock);
+
+        probe.Elapsed = since(start);
+        return probe;
+    }
+
+    /**
+     * @brief Resolves the server and probes its ports, all connects sharing one budget.
+     *
+     * @param host      The server.
+     * @param ports     The ports to probe.
+     * @param probes    Receives the name probe followed by one probe per port.
+     */
+    static void server(const std::string& host, const std::vector<std::string>& ports, std::vector<diagnosticprobe>& probes)
+    {
+        auto start = std::chrono::steady_clock::now();
+        diagnosticprobe lookup = { "dns", diagnosticstatus::ok, 0, "" };
+
+        ULONG address = 0;
+        auto resolved = xiloader::network::ResolveHostname(host.c_str(), &address);
+        lookup.Elapsed = since(start);
+        if (resolved)
+            lookup.Detail = host + " " + inet_ntoa(*((struct in_addr*)&address));
+        else
+        {
+            lookup.Status = diagnosticstatus::fail;
+            lookup.Detail = host + " not resolved";
+        }
+        probes.push_back(lookup);
+
+        /* Start a non-blocking connect to every port.. */
+        auto first = probes.size();
+        std::vector<SOCKET> sockets(ports.size(), INVALID_SOCKET);
+        for (size_t x = 0; x < ports.size(); x++)
+        {
+            diagnosticprobe probe = { "tcp." + ports[x], diagnosticstatus::fail, 0, resolved ? "no answer" : "not resolved" };
+            probes.push_back(probe);
+            if (!resolved)
+                continue;
+
+            struct sockaddr_in remote;
+            memset(&remote, 0x00, sizeof(remote));
+            remote.sin_family = AF_INET;
+            remote.sin_port = htons(static_cast<u_short>(atoi(ports[x].c_str())));
+            remote.sin_addr.s_addr = address;
+
+            u_long nonblocking = 1;
+            auto sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (sock == INVALID_SOCKET || ioctlsocket(sock, FIONBIO, &nonblocking) == SOCKET_ERROR ||
+                (::connect(sock, (struct sockaddr*)&remote, sizeof(remote)) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+            {
+                probes.back().Detail = "socket error " + std::to_string(WSAGetLastError());
+                if (sock != INVALID_SOCKET)
+                    closesocket(sock);
+                continue;
+            }
+            sockets[x] = sock;
+        }
+
+        /* Collect the connects as they complete.. */
+        start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::milliseconds(DIAGNOSTICS_CONNECT_BUDGET);
+        for (;;)
+        {
+            fd_set writable, failed;
+            FD_ZERO(&writable);
+            FD_ZERO(&failed);
+            for (auto sock : sockets)
+            {
+                if (sock != INVALID_SOCKET)
+                {
+                    FD_SET(sock, &writable);
+                    FD_SET(sock, &failed);
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (writable.fd_count == 0 || now >= deadline)
+                break;
+
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            timeval timeout = { static_cast<long>(remaining / 1000000), static_cast<long>(remaining % 1000000) };
+            if (select(0, NULL, &writable, &failed, &timeout) <= 0)
+                break;
+
+            auto elapsed = since(start);
+            for (size_t x = 0; x < sockets.size(); x++)
+            {
+                if (sockets[x] == INVALID_SOCKET || (!FD_ISSET(sockets[x], &writable) && !FD_ISSET(sockets[x], &failed)))
+                    continue;
+
+                int error = 0;
+                int length = sizeof(error);
+                auto& probe = probes[first + x];
+                probe.Elapsed = elapsed;
+                if (FD_ISSET(sockets[x], &writable) && getsockopt(sockets[x], SOL_SOCKET, SO_ERROR, (char*)&error, &length) == 0 && error == 0)
+                {
+                    char rtt[32];
+                    sprintf_s(rtt, sizeof(rtt), "rtt %.1f ms", elapsed);
+                    probe.Status = diagnosticstatus::ok;
+                    probe.Detail = rtt;
+                }
+                else
+                    probe.Detail = "refused";
+
+                closesocket(sockets[x]);
+                sockets[x] = INVALID_SOCKET;
+            }
+        }
+
+        /* Whatever is left did not answer within the budget.. */
+        for (size_t x = 0; x < sockets.size(); x++)
+        {
+            if (sockets[x] == INVALID_SOCKET)
+                continue;
+
+            probes[first + x].Elapsed = since(start);
+            closesocket(sockets[x]);
+        }
+    }
+
+    /**
+     * @brief Runs every probe and prints the report.
+     *
+     * @param session   The session holding the server, port and language to check.
+     *
+     * @return XILOADER_EXIT_SUCCESS if no probe failed, XILOADER_EXIT_ERROR otherwise.
+     */
+    int diagnostics::run(const xiloader::session* session)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto lang = static_cast<int>(session->Language);
+
+        /* The local probes run on the workers while this thread waits on the network.. */
+        std::vector<xiloader::future<diagnosticprobe>> local;
+        for (auto x = 0; x < 3; x++)
+            local.push_back(xiloader::scheduler::run([x, lang]() { return registry(x, lang); }));
+        local.push_back(xiloader::scheduler::run([lang]() { return install(lang); }));
+        local.push_back(xiloader::scheduler::run([]() { return directplay(); }));
+        auto port = session->ServerPort;
+        local.push_back(xiloader::scheduler::run([port]() { return listener(port); }));
+
+        /* The lobby port is the loader's own listener; the server does not answer on it.. */
+        std::vector<diagnosticprobe> probes;
+        server(session->ServerAddress, { "54231", "54230" }, probes);
+        for (auto& probe : local)
+            probes.push_back(probe.get());
+
+        auto elapsed = since(start);
+
+        /* Print the report in one piece after anything the logger still holds.. */
+        static const char* statuses[3] = { "ok", "skip", "fail" };
+        uint32_t counts[3] = { 0 };
+        xiloader::console::flush();
+        for (auto& probe : probes)
+        {
+            counts[static_cast<int>(probe.Status)]++;
+            printf("check %-12s %-4s %7.1f ms %s\n", probe.Name.c_str(), statuses[static_cast<int>(probe.Status)], probe.Elapsed, probe.Detail.c_str());
+        }
+
+        auto failed = counts[static_cast<int>(diagnosticstatus::fail)] != 0;
+        printf("check %-12s %-4s %7.1f ms %u ok, %u skipped, %u failed\n", "total", failed ? "fail" : "ok", elapsed,
+            counts[static_cast<int>(diagnosticstatus::ok)], counts[static_cast<int>(diagnosticstatus::skip)], counts[static_cast<int>(diagnosticstatus::fail)]);
+        fflush(stdout);
+
+        return failed ? XILOADER_EXIT_ERROR : XILOADER_EXIT_SUCCESS;
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,89 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_DIAGNOSTICS_H_INCLUDED__
+#define __XILOADER_DIAGNOSTICS_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "session.h"
+
+#include <string>
+
+/* Time the port probes share to connect, in milliseconds. */
+#define DIAGNOSTICS_CONNECT_BUDGET  500
+
+namespace xiloader
+{
+    /**
+     * @brief Outcome of a single probe.
+     */
+    enum class diagnosticstatus
+    {
+        ok,     // The probe passed.
+        skip,   // The probe does not apply, e.g. a language that is not installed.
+        fail    // The probe failed; the game will not start or connect.
+    };
+
+    /**
+     * @brief Result of a single environment probe.
+     */
+    typedef struct diagnosticprobe_t
+    {
+        std::string Name;           // The probe name; one word, e.g. "tcp.54231".
+        diagnosticstatus Status;    // The outcome.
+        double Elapsed;             // The time the probe took, in milliseconds.
+        std::string Detail;         // What was found.
+    } diagnosticprobe;
+
+    /**
+     * @brief Checks the environment the loader and the game need, replacing xi_checker.bat.
+     *
+     * Every probe runs at the same time: the registry keys of every language,
+     * the install folder, DirectPlay, the server name, the server ports and
+     * the local listen port. The report has one line per probe, so support
+     * scripts can split it on whitespace:
+     *
+     *      check <probe> <ok|skip|fail> <milliseconds> ms <detail>
+     *
+     * followed by a "check total" line.
+     */
+    class diagnostics
+    {
+    public:
+
+        /**
+         * @brief Runs every probe and prints the report.
+         *
+         * @param session   The session holding the server, port and language to check.
+         *
+         * @return XILOADER_EXIT_SUCCESS if no probe failed, XILOADER_EXIT_ERROR otherwise.
+         */
+        static int run(const xiloader::session* session);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_DIAGNOSTICS_H_INCLUDED__
@@ -0,0 +1,346 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "dnscache.h"
+#include "scheduler.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <strings.h>
+#define _stricmp strcasecmp
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace xiloader
+{
+    /**
+     * @brief Cached answer for a single name.
+     */
+    typedef struct dnsentry_t
+    {
+        std::vector<uint32_t> Addresses; // Empty if the name did not resolve.
+        std::chrono::steady_clock::time_point Resolved;
+        bool Refreshing;
+    } dnsentry;
+
+    /**
+     * @brief Thread-local storage behind the host entries returned by host().
+     */
+    typedef struct dnshost_t
+    {
+        struct hostent Host;
+        char Name[256];
+        uint32_t Addresses[DNSCACHE_MAX_ADDRESSES];
+        char* List[DNSCACHE_MAX_ADDRESSES + 1];
+        char* Aliases[1];
+    } dnshost;
+
+    /**
+     * @brief Result list handed out by addrinfo(); freed as one block.
+     */
+    typedef struct dnsresult_t
+    {
+        struct addrinfo Info[DNSCACHE_MAX_ADDRESSES];
+        struct sockaddr_in Addresses[DNSCACHE_MAX_ADDRESSES];
+    } dnsresult;
+
+    static dnscache::resolvefn s_Resolve = nullptr;
+    static dnscache::releasefn s_Release = nullptr;
+    static std::mutex s_Lock;
+    static std::unordered_map<std::string, dnsentry> s_Entries;
+    static std::unordered_set<const void*> s_Results;
+    static std::atomic<uint64_t> s_Hits(0);
+    static std::atomic<uint64_t> s_Misses(0);
+
+    /**
+     * @brief Queries the system resolver for the IPv4 addresses of a name.
+     *
+     * @param name          The name to resolve.
+     * @param addresses     Receives the addresses in network byte order.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool query(const std::string& name, std::vector<uint32_t>& addresses)
+    {
+        if (s_Resolve == nullptr)
+            return false;
+
+        struct addrinfo hints;
+        memset(&hints, 0x00, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo* info = nullptr;
+        if (s_Resolve(name.c_str(), nullptr, &hints, &info) != 0)
+            return false;
+
+        addresses.clear();
+        for (auto ptr = info; ptr != nullptr && addresses.size() < DNSCACHE_MAX_ADDRESSES; ptr = ptr->ai_next)
+        {
+            auto address = reinterpret_cast<struct sockaddr_in*>(ptr->ai_addr)->sin_addr.s_addr;
+            if (std::find(addresses.begin(), addresses.end(), address) == addresses.end())
+                addresses.push_back(address);
+        }
+
+        s_Release(info);
+        return !addresses.empty();
+    }
+
+    /**
+     * @brief Refreshes a cached answer; runs on the scheduler.
+     *
+     * @param key           The cache key of the name.
+     */
+    static void refresh(const std::string& key)
+    {
+        std::vector<uint32_t> addresses;
+        auto resolved = query(key, addresses);
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        auto& entry = s_Entries[key];
+        entry.Refreshing = false;
+
+        /* Keep serving the old answer when the refresh fails; retry on a later lookup.
+           A failure that still fails waits another DNSCACHE_RETRY.. */
+        if (resolved || entry.Addresses.empty())
+        {
+            entry.Addresses.swap(addresses);
+            entry.Resolved = std::chrono::steady_clock::now();
+        }
+    }
+
+    /**
+     * @brief Sets the system resolver; must be the undetoured getaddrinfo and freeaddrinfo.
+     *
+     * @param resolve       The system getaddrinfo.
+     * @param release       The system freeaddrinfo.
+     */
+    void dnscache::resolver(resolvefn resolve, releasefn release)
+    {
+        s_Resolve = resolve;
+        s_Release = release;
+    }
+
+    /**
+     * @brief Obtains the IPv4 addresses of a name, from the cache when possible.
+     *
+     * @param name          The name to resolve; numeric addresses are parsed directly.
+     * @param addresses     Receives the addresses in network byte order.
+     *
+     * @return True on success, false if the name does not resolve.
+     */
+    bool dnscache::lookup(const char* name, std::vector<uint32_t>& addresses)
+    {
+        addresses.clear();
+        if (name == nullptr || *name == '\0')
+            return false;
+
+        /* Numeric addresses need no lookup.. */
+        auto numeric = inet_addr(name);
+        if (numeric != INADDR_NONE)
+        {
+            addresses.push_back(numeric);
+            return true;
+        }
+
+        std::string key(name);
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            auto entry = s_Entries.find(key);
+            if (entry != s_Entries.end())
+            {
+                addresses = entry->second.Addresses;
+                s_Hits++;
+
+                /* Serve the stale answer or failure and refresh it in the background.. */
+                auto age = std::chrono::steady_clock::now() - entry->second.Resolved;
+                auto limit = std::chrono::milliseconds(addresses.empty() ? DNSCACHE_RETRY : DNSCACHE_REFRESH);
+                if (age > limit && !entry->second.Refreshing)
+                {
+                    entry->second.Refreshing = true;
+                    xiloader::scheduler::post([key]() { refresh(key); });
+                }
+                return !addresses.empty();
+            }
+        }
+
+        /* First lookup of the name; only this one waits on the resolver.. */
+        s_Misses++;
+        auto resolved = query(key, addresses);
+
+        /* Failures are cached too, unless there is no resolver to retry with.. */
+        if (!resolved && s_Resolve == nullptr)
+            return false;
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        auto& entry = s_Entries[key];
+        entry.Addresses = addresses;
+        entry.Resolved = std::chrono::steady_clock::now();
+        entry.Refreshing = false;
+        return resolved;
+    }
+
+    /**
+     * @brief Answers a gethostbyname call.
+     *
+     * The result lives in storage of the calling thread until its next call,
+     * as with the system gethostbyname.
+     *
+     * @param name          The name to resolve.
+     *
+     * @return The host entry, nullptr if the name does not resolve.
+     */
+    struct hostent* dnscache::host(const char* name)
+    {
+        static thread_local dnshost storage;
+
+        std::vector<uint32_t> addresses;
+        if (!lookup(name, addresses))
+            return nullptr;
+
+        memset(&storage, 0x00, sizeof(storage));
+        strncpy(storage.Name, name, sizeof(storage.Name) - 1);
+        for (size_t x = 0; x < addresses.size(); x++)
+        {
+            storage.Addresses[x] = addresses[x];
+            storage.List[x] = reinterpret_cast<char*>(&storage.Addresses[x]);
+        }
+
+        storage.Host.h_name = storage.Name;
+        storage.Host.h_aliases = storage.Aliases;
+        storage.Host.h_addrtype = AF_INET;
+        storage.Host.h_length = sizeof(uint32_t);
+        storage.Host.h_addr_list = storage.List;
+        return &storage.Host;
+    }
+
+    /**
+     * @brief Answers a getaddrinfo call when the cache can.
+     *
+     * Only IPv4 lookups of a name with a numeric or empty service and no
+     * special flags are answered; everything else is left to the system.
+     *
+     * @param node          The name to resolve.
+     * @param service       The service; a port number or nullptr.
+     * @param hints         The lookup hints; may be nullptr.
+     * @param result        Receives the result list; release it with release().
+     *
+     * @return 0 on success, an EAI_ error code on failure, -1 if the system should answer.
+     */
+    int dnscache::addrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** result)
+    {
+        if (node == nullptr || result == nullptr)
+            return -1;
+        if (hints != nullptr && ((hints->ai_family != AF_INET && hints->ai_family != AF_UNSPEC) || hints->ai_flags != 0))
+            return -1;
+
+        char* end = nullptr;
+        auto port = service != nullptr ? strtoul(service, &end, 10) : 0;
+        if (service != nullptr && (*service == '\0' || *end != '\0' || port > 65535))
+            return -1;
+
+        std::vector<uint32_t> addresses;
+        if (!lookup(node, addresses))
+            return EAI_NONAME;
+
+        auto block = new dnsresult();
+        memset(block, 0x00, sizeof(dnsresult));
+        for (size_t x = 0; x < addresses.size(); x++)
+        {
+            auto& address = block->Addresses[x];
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(port));
+            address.sin_addr.s_addr = addresses[x];
+
+            auto& info = block->Info[x];
+            info.ai_family = AF_INET;
+            info.ai_socktype = hints != nullptr ? hints->ai_socktype : 0;
+            info.ai_protocol = hints != nullptr ? hints->ai_protocol : 0;
+            info.ai_addrlen = sizeof(address);
+            info.ai_addr = reinterpret_cast<struct sockaddr*>(&address);
+            info.ai_next = x + 1 < addresses.size() ? &block->Info[x + 1] : nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            s_Results.insert(block);
+        }
+
+        *result = &block->Info[0];
+        return 0;
+    }
+
+    /**
+     * @brief Releases a result list returned by addrinfo().
+     *
+     * @param info          The result list.
+     *
+     * @return True if the list came from the cache, false if it belongs to the system.
+     */
+    bool dnscache::release(struct addrinfo* info)
+    {
+        /* The list head is the first member of its block.. */
+        auto block = reinterpret_cast<dnsresult*>(info);
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            if (s_Results.erase(block) == 0)
+                return false;
+        }
+
+        delete block;
+        return true;
+    }
+
+    /**
+     * @brief Obtains the number of lookups answered from the cache.
+     *
+     * @return The hit count.
+     */
+    uint64_t dnscache::hits()
+    {
+        return s_Hits.load();
+    }
+
+    /**
+     * @brief Obtains the number of lookups that waited on the system resolver.
+     *
+     * @return The miss count.
+     */
+    uint64_t dnscache::misses()
+    {
+        return s_Misses.load();
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,140 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_DNSCACHE_H_INCLUDED__
+#define __XILOADER_DNSCACHE_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#define DNSCACHE_CALL WSAAPI
+#else
+#include <netdb.h>
+#define DNSCACHE_CALL
+#endif
+
+#include <cstdint>
+#include <vector>
+
+/* Age, in milliseconds, after which a cached answer is refreshed in the background. */
+#define DNSCACHE_REFRESH        60000
+
+/* Age, in milliseconds, after which a cached failure is retried in the background. */
+#define DNSCACHE_RETRY          5000
+
+/* Maximum number of addresses kept per name. */
+#define DNSCACHE_MAX_ADDRESSES  8
+
+namespace xiloader
+{
+    /**
+     * @brief Resolver answer cache shared by the gethostbyname and getaddrinfo detours.
+     *
+     * Only the first lookup of a name waits on the system resolver. Later
+     * lookups are answered from the cache at once; answers older than
+     * DNSCACHE_REFRESH are still served while a scheduler job refreshes them,
+     * and are kept if the refresh fails. Names that do not resolve are cached
+     * as failures the same way and retried after DNSCACHE_RETRY.
+     */
+    class dnscache
+    {
+    public:
+        typedef int (DNSCACHE_CALL *resolvefn)(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** result);
+        typedef void (DNSCACHE_CALL *releasefn)(struct addrinfo* info);
+
+        /**
+         * @brief Sets the system resolver; must be the undetoured getaddrinfo and freeaddrinfo.
+         *
+         * @param resolve       The system getaddrinfo.
+         * @param release       The system freeaddrinfo.
+         */
+        static void resolver(resolvefn resolve, releasefn release);
+
+        /**
+         * @brief Obtains the IPv4 addresses of a name, from the cache when possible.
+         *
+         * @param name          The name to resolve; numeric addresses are parsed directly.
+         * @param addresses     Receives the addresses in network byte order.
+         *
+         * @return True on success, false if the name does not resolve.
+         */
+        static bool lookup(const char* name, std::vector<uint32_t>& addresses);
+
+        /**
+         * @brief Answers a gethostbyname call.
+         *
+         * The result lives in storage of the calling thread until its next call,
+         * as with the system gethostbyname.
+         *
+         * @param name          The name to resolve.
+         *
+         * @return The host entry, nullptr if the name does not resolve.
+         */
+        static struct hostent* host(const char* name);
+
+        /**
+         * @brief Answers a getaddrinfo call when the cache can.
+         *
+         * Only IPv4 lookups of a name with a numeric or empty service and no
+         * special flags are answered; everything else is left to the system.
+         *
+         * @param node          The name to resolve.
+         * @param service       The service; a port number or nullptr.
+         * @param hints         The lookup hints; may be nullptr.
+         * @param result        Receives the result list; release it with release().
+         *
+         * @return 0 on success, an EAI_ error code on failure, -1 if the system should answer.
+         */
+        static int addrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** result);
+
+        /**
+         * @brief Releases a result list returned by addrinfo().
+         *
+         * @param info          The result list.
+         *
+         * @return True if the list came from the cache, false if it belongs to the system.
+         */
+        static bool release(struct addrinfo* info);
+
+        /**
+         * @brief Obtains the number of lookups answered from the cache.
+         *
+         * @return The hit count.
+         */
+        static uint64_t hits();
+
+        /**
+         * @brief Obtains the number of lookups that waited on the system resolver.
+         *
+         * @return The miss count.
+         */
+        static uint64_t misses();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_DNSCACHE_H_INCLUDED__
@@ -0,0 +1,228 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "flightrecorder.h"
+#include "logger.h"
+#include "mappedfile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#endif
+
+namespace xiloader
+{
+    /* Flight recorder state; s_Header is null while not recording. */
+    static mappedfile s_File;
+    static std::string s_Path;
+    static std::atomic<flightheader*> s_Header(nullptr);
+
+    /**
+     * @brief Log sink copying warnings and errors into the flight recorder.
+     */
+    class flightsink : public xiloader::logsink
+    {
+    public:
+        flightsink()
+            : logsink(xiloader::loglevel::warning, true)
+        {}
+
+        void write(const xiloader::logrecord* record, const std::string& message) override
+        {
+            xiloader::flightrecorder::record(xiloader::flightevent::error, record->level, message.c_str());
+        }
+    };
+
+    static flightsink s_Sink;
+
+    /**
+     * @brief Stops recording before the mapping and sink are destroyed at exit.
+     */
+    static struct flightguard
+    {
+        ~flightguard()
+        {
+            xiloader::flightrecorder::close(true);
+        }
+    } s_Guard;
+
+    /**
+     * @brief Obtains an identifier of the calling thread.
+     *
+     * @return The thread id.
+     */
+    static uint32_t threadid()
+    {
+#ifdef _WIN32
+        return static_cast<uint32_t>(::GetCurrentThreadId());
+#else
+        return static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+    }
+
+    /**
+     * @brief Creates the flight recorder file and starts recording.
+     *
+     * @param path      The path of the file; nullptr for a per-process file in the temp folder.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool flightrecorder::open(const char* path)
+    {
+        close(true);
+
+#ifdef _WIN32
+        auto processid = static_cast<uint32_t>(::GetCurrentProcessId());
+#else
+        auto processid = static_cast<uint32_t>(::getpid());
+#endif
+
+        if (path != nullptr)
+        {
+            s_Path = path;
+        }
+        else
+        {
+            char folder[260] = { 0 };
+#ifdef _WIN32
+            if (::GetTempPathA(sizeof(folder), folder) == 0)
+                return false;
+#else
+            strcpy(folder, "/tmp/");
+#endif
+            char filename[64];
+            snprintf(filename, sizeof filename, "xiloader.%u.flight", processid);
+            s_Path = std::string(folder) + filename;
+        }
+
+        if (!s_File.create(s_Path.c_str(), sizeof(flightheader) + FLIGHT_SLOTS * sizeof(flightslot)))
+        {
+            s_Path.clear();
+            return false;
+        }
+
+        /* The file is zero filled, so every slot starts out empty.. */
+        auto header = reinterpret_cast<flightheader*>(s_File.data());
+        memcpy(header->magic, FLIGHT_MAGIC, sizeof(header->magic));
+        header->version = FLIGHT_VERSION;
+        header->headersize = sizeof(flightheader);
+        header->slotcount = FLIGHT_SLOTS;
+        header->slotsize = sizeof(flightslot);
+        header->processid = processid;
+        header->head.store(0, std::memory_order_relaxed);
+        header->created = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        s_Header.store(header, std::memory_order_release);
+        xiloader::logger::attach(&s_Sink);
+
+        record(flightevent::start, processid, nullptr);
+        return true;
+    }
+
+    /**
+     * @brief Stops recording and closes the file.
+     *
+     * Events recorded concurrently with the close may be lost; the file is
+     * only closed once the proxy threads have been shut down.
+     *
+     * @param keep      "false" to delete the file; used after a clean shutdown.
+     */
+    void flightrecorder::close(bool keep)
+    {
+        if (s_Header.load() == nullptr)
+            return;
+
+        record(flightevent::stop, 0, nullptr);
+
+        xiloader::logger::detach(&s_Sink);
+        s_Header.store(nullptr);
+
+        s_File.flush();
+        s_File.close();
+
+        if (!keep)
+            remove(s_Path.c_str());
+        s_Path.clear();
+    }
+
+    /**
+     * @brief Records a single event.
+     *
+     * Wait-free: the slot is claimed with one atomic increment and written
+     * without locks or retries. A writer lapped by FLIGHT_SLOTS newer events
+     * while writing can leave a torn slot, which readers detect and skip.
+     *
+     * @param event     The event type.
+     * @param value     Event specific value.
+     * @param text      Event specific text, truncated to fit; may be nullptr.
+     */
+    void flightrecorder::record(xiloader::flightevent event, uint64_t value, const char* text)
+    {
+        auto header = s_Header.load(std::memory_order_acquire);
+        if (header == nullptr)
+            return;
+
+        auto index = header->head.fetch_add(1, std::memory_order_relaxed);
+        auto slot = reinterpret_cast<flightslot*>(reinterpret_cast<uint8_t*>(header) + sizeof(flightheader)) + (index & (FLIGHT_SLOTS - 1));
+
+        /* Mark the slot as being written before touching its contents.. */
+        slot->sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->thread = threadid();
+        slot->timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        slot->value = value;
+        slot->event = static_cast<uint16_t>(event);
+        slot->reserved = 0;
+
+        size_t length = 0;
+        if (text != nullptr)
+        {
+            while (length < FLIGHT_TEXT_SIZE - 1 && text[length] != '\0')
+                length++;
+            memcpy(slot->text, text, length);
+        }
+        slot->text[length] = '\0';
+
+        slot->sequence.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Obtains the path of the open flight recorder file.
+     *
+     * @return The path, an empty string if not recording.
+     */
+    const char* flightrecorder::path()
+    {
+        return s_Path.c_str();
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,171 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_FLIGHTRECORDER_H_INCLUDED__
+#define __XILOADER_FLIGHTRECORDER_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <atomic>
+#include <cstdint>
+
+/* Flight recorder file identification. */
+#define FLIGHT_MAGIC            "XIFLIGHT"
+#define FLIGHT_VERSION          1
+
+/* Number of event slots in the ring (must be a power of two). */
+#define FLIGHT_SLOTS            8192
+
+/* Number of text bytes stored with each event, including the terminator. */
+#define FLIGHT_TEXT_SIZE        40
+
+namespace xiloader
+{
+    /**
+     * @brief Flight recorder event types.
+     */
+    enum class flightevent : uint16_t
+    {
+        none = 0,
+        start = 1,          // Loader started; value = process id.
+        stop = 2,           // Loader is shutting down cleanly.
+        connect = 3,        // Socket connected or accepted; value = port.
+        disconnect = 4,     // Socket closed; value = port.
+        detour = 5,         // Detour hit; text = the looked up name, or the translated address of a NAT mapped connect.
+        patch = 6,          // Code patch applied; value = address.
+        handshake = 7,      // Handshake step; value = packet or step id.
+        error = 8,          // Warning or error message; value = log level.
+        zone = 9            // Zone change step; value = microseconds the step took, text = the step.
+    };
+
+    /**
+     * @brief Header at the start of the flight recorder file.
+     */
+    struct flightheader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headersize;
+        uint32_t slotcount;
+        uint32_t slotsize;
+        uint32_t processid;
+        std::atomic<uint32_t> head;     // Number of events claimed so far (wraps).
+        int64_t created;                // Microseconds since the unix epoch.
+    };
+
+    /**
+     * @brief Single event slot within the ring.
+     *
+     * The sequence is 0 while the slot is being written and n + 1 once event
+     * number n is complete; readers copy a slot and discard it unless the
+     * sequence was the same, and non-zero, before and after the copy.
+     */
+    struct flightslot
+    {
+        std::atomic<uint32_t> sequence;
+        uint32_t thread;
+        int64_t timestamp;              // Microseconds since the unix epoch.
+        uint64_t value;
+        uint16_t event;
+        uint16_t reserved;
+        char text[FLIGHT_TEXT_SIZE];
+        uint32_t padding;
+    };
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "flight recorder atomics must match their plain layout");
+    static_assert(sizeof(flightheader) == 40 && sizeof(flightslot) == 72, "flight recorder layout changed");
+
+    /**
+     * @brief Post-mortem event recorder backed by a shared memory-mapped file.
+     *
+     * Events are written into a fixed ring of slots within a file mapping, so
+     * an external reader (tools/xiflight) can follow them while the game runs
+     * and the last events survive a crash or hang. Recording claims a slot with
+     * a single atomic increment and never waits; it is safe to call from the
+     * detours and proxy threads at any time, and is a no-op until opened.
+     */
+    class flightrecorder
+    {
+    public:
+        /**
+         * @brief Creates the flight recorder file and starts recording.
+         *
+         * @param path      The path of the file; nullptr for a per-process file in the temp folder.
+         *
+         * @return True on success, false otherwise.
+         */
+        static bool open(const char* path);
+
+        /**
+         * @brief Stops recording and closes the file.
+         *
+         * @param keep      "false" to delete the file; used after a clean shutdown.
+         */
+        static void close(bool keep);
+
+        /**
+         * @brief Records a single event.
+         *
+         * @param event     The event type.
+         * @param value     Event specific value.
+         * @param text      Event specific text, truncated to fit; may be nullptr.
+         */
+        static void record(xiloader::flightevent event, uint64_t value, const char* text);
+
+        /**
+         * @brief Obtains the name of an event type.
+         *
+         * @param event     The event type.
+         *
+         * @return The event name.
+         */
+        static const char* name(xiloader::flightevent event)
+        {
+            switch (event)
+            {
+            case flightevent::start: return "start";
+            case flightevent::stop: return "stop";
+            case flightevent::connect: return "connect";
+            case flightevent::disconnect: return "disconnect";
+            case flightevent::detour: return "detour";
+            case flightevent::patch: return "patch";
+            case flightevent::handshake: return "handshake";
+            case flightevent::error: return "error";
+            case flightevent::zone: return "zone";
+            default: return "unknown";
+            }
+        }
+
+        /**
+         * @brief Obtains the path of the open flight recorder file.
+         *
+         * @return The path, an empty string if not recording.
+         */
+        static const char* path();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_FLIGHTRECORDER_H_INCLUDED__
@@ -160,4 +160,43 @@ namespace xiloader
         return InstallFolder;
     }
 
+    /**
+     * @brief Obtains the FINAL FANTASY XI folder from the system registry.
+     *  "C:\Program Files\PlayOnline\SquareEnix\FINAL FANTASY XI"
+     *
+     * @param lang      The language id the loader was started with.
+     * @param folder    Receives the installation folder path; empty if not found.
+     * @param size      The size of the folder buffer.
+     *
+     * @return True if the folder was found, false otherwise.
+     */
+    bool functions::GetRegistryFFXIInstallFolder(int lang, char* folder, DWORD size)
+    {
+        char  szRegistryPath[MAX_PATH];
+        sprintf_s(szRegistryPath, MAX_PATH, "%s\\InstallFolder", functions::GetRegistryPlayOnlineKey(lang));
+
+        HKEY  hKey = NULL;
+        DWORD dwRegSize = size;
+        DWORD dwRegType = REG_SZ;
+        bool  found = false;
+
+        if (::RegOpenKeyExA(HKEY_LOCAL_MACHINE, szRegistryPath, 0, KEY_QUERY_VALUE | KEY_WOW64_32KEY, &hKey) == ERROR_SUCCESS)
+        {
+            if (::RegQueryValueExA(hKey, "0001", NULL, &dwRegType, (LPBYTE)folder, &dwRegSize) == ERROR_SUCCESS)
+            {
+                if (dwRegType == REG_SZ && dwRegSize > 0 && dwRegSize < size)
+                {
+                    folder[dwRegSize] = '\0';
+                    found = true;
+                }
+            }
+            ::RegCloseKey(hKey);
+        }
+
+        if (found == false && size > 0)
+            folder[0] = '\0';
+
+        return found;
+    }
+
 }; // namespace xiloader
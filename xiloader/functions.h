@@ -95,6 +95,18 @@ namespace xiloader
          * @return installation folder path.
          */
         static const char* GetRegistryPlayOnlineInstallFolder(int lang);
+
+        /**
+         * @brief Obtains the FINAL FANTASY XI folder from the system registry.
+         *  "C:\Program Files\PlayOnline\SquareEnix\FINAL FANTASY XI"
+         *
+         * @param lang      The language id the loader was started with.
+         * @param folder    Receives the installation folder path; empty if not found.
+         * @param size      The size of the folder buffer.
+         *
+         * @return True if the folder was found, false otherwise.
+         */
+        static bool GetRegistryFFXIInstallFolder(int lang, char* folder, DWORD size);
     };
 
 }; // namespace xiloader
@@ -0,0 +1,829 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "loader.h"
+
+#include "console.h"
+#include "datcache.h"
+#include "datindex.h"
+#include "dnscache.h"
+#include "flightrecorder.h"
+#include "functions.h"
+#include "nattable.h"
+#include "network.h"
+#include "prefetcher.h"
+#include "scheduler.h"
+#include "zonetrace.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+/* Global Variables */
+xiloader::session* g_Session = NULL; // The session the gethostbyname detour redirects the game servers of.
+bool g_Hide = false; // Determines whether or not to hide the console window after FFXI starts.
+std::string g_DatFolder; // The install folder the prefetcher resolves DAT files in.
+
+/* Hairpin Fix Variables */
+DWORD g_NewServerAddress; // Hairpin server address to be overriden with.
+DWORD g_HairpinReturnAddress; // Hairpin return address to allow the code cave to return properly.
+HMODULE g_HairpinModule = NULL; // The FFXiMain module the zone patches were applied to.
+
+/* Zone Change Variables */
+DWORD g_ZoneChangeAddress = 0; // The zone change IP store routed through the zone change cave.
+DWORD g_ZoneChangeTarget; // The address of the pointer the game stores the zone server address through.
+DWORD g_ZoneChangeReturnAddress; // Zone change return address to allow the code cave to return properly.
+bool g_ZoneChangeKeep = false; // Determines whether the game keeps the hairpin address instead of storing the zone server address.
+
+/**
+ * @brief Detour function definitions.
+ */
+extern "C"
+{
+    hostent* (WINAPI __stdcall * Real_gethostbyname)(const char* name) = gethostbyname;
+    INT (WSAAPI * Real_getaddrinfo)(PCSTR node, PCSTR service, const ADDRINFOA* hints, PADDRINFOA* result) = getaddrinfo;
+    VOID (WSAAPI * Real_freeaddrinfo)(PADDRINFOA info) = freeaddrinfo;
+    int (WSAAPI * Real_connect)(SOCKET s, const sockaddr* name, int namelen) = connect;
+    int (WSAAPI * Real_sendto)(SOCKET s, const char* buf, int len, int flags, const sockaddr* to, int tolen) = sendto;
+    int (WSAAPI * Real_recvfrom)(SOCKET s, char* buf, int len, int flags, sockaddr* from, int* fromlen) = recvfrom;
+    int (WSAAPI * Real_WSAConnect)(SOCKET s, const sockaddr* name, int namelen, LPWSABUF lpCallerData, LPWSABUF lpCalleeData, LPQOS lpSQOS, LPQOS lpGQOS) = WSAConnect;
+}
+
+/**
+ * @brief Hairpin fix codecave.
+ */
+__declspec(naked) void HairpinFixCave(void)
+{
+    __asm mov eax, g_NewServerAddress
+    __asm mov [edx + 0x012E90], eax
+    __asm mov [edx], eax
+    __asm jmp g_HairpinReturnAddress
+}
+
+/**
+ * @brief Zone change callback; performs the zone IP store the code cave replaced.
+ *
+ * @param target        The pointer the game stores the zone server address through.
+ * @param address       The new zone server address.
+ */
+static void __cdecl ZoneChanged(DWORD** target, DWORD address)
+{
+    /* The hairpin fix keeps the game on the hairpin address.. */
+    if (g_ZoneChangeKeep)
+        address = g_NewServerAddress;
+    else
+        **target = address;
+
+    /* The DAT reads that follow load the zone being entered.. */
+    xiloader::prefetcher::zonechange();
+    if (xiloader::zonetrace::enabled())
+        xiloader::zonetrace::written(address);
+}
+
+/**
+ * @brief Zone change codecave.
+ */
+__declspec(naked) void ZoneChangeCave(void)
+{
+    __asm pushad
+    __asm pushfd
+    __asm push eax
+    __asm push g_ZoneChangeTarget
+    __asm call ZoneChanged
+    __asm add esp, 8
+    __asm popfd
+    __asm popad
+    __asm mov ecx, g_ZoneChangeTarget
+    __asm mov ecx, [ecx]
+    __asm jmp g_ZoneChangeReturnAddress
+}
+
+/**
+ * @brief Applies the hairpin fix and routes the zone change through the zone change cave.
+ *
+ * Runs on the scheduler; until FFXiMain is loaded the job re-queues itself
+ * every 100ms, unless the game closes first.
+ *
+ * @param session       The session object.
+ * @param hairpin       Should the hairpin fix be applied?
+ */
+static void ApplyZonePatches(xiloader::session* session, bool hairpin)
+{
+    if (WaitForSingleObject(session->ShutdownEvent, 0) == WAIT_OBJECT_0)
+        return;
+
+    auto module = GetModuleHandleA("FFXiMain.dll");
+    if (module == NULL)
+    {
+        xiloader::scheduler::post([session, hairpin]() { ApplyZonePatches(session, hairpin); }, 100);
+        return;
+    }
+
+    /* A relaunched game may still use the module patched for the previous one.. */
+    auto patched = module == g_HairpinModule;
+    auto hairpinDone = !hairpin || (patched && g_HairpinReturnAddress != 0 && *(BYTE*)(g_HairpinReturnAddress - 0x08) == 0xE9);
+    auto zoneChangeDone = patched && g_ZoneChangeAddress != 0 && *(BYTE*)g_ZoneChangeAddress == 0xE9;
+    if (hairpinDone && zoneChangeDone)
+        return;
+
+    /* Convert server address.. */
+    xiloader::network::ResolveHostname(session->ServerAddress.c_str(), &g_NewServerAddress);
+
+    // Locate the main hairpin location..
+    //
+    // As of 07.08.2013:
+    //      8B 82 902E0100        - mov eax, [edx+00012E90]
+    //      89 02                 - mov [edx], eax <-- edit this
+
+    auto hairpinScan = xiloader::scheduler::run([hairpinDone]() { return !hairpinDone ? xiloader::functions::FindPattern("FFXiMain.dll", (BYTE*)"\x8B\x82\xFF\xFF\xFF\xFF\x89\x02\x8B\x0D", "xx????xxxx") : 0; });
+
+    // Locate zoning IP change address..
+    // 
+    // As of 07.08.2013
+    //      74 08                 - je FFXiMain.dll+E5E72
+    //      8B 0D 68322B03        - mov ecx, [FFXiMain.dll+463268]
+    //      89 01                 - mov [ecx], eax <-- edit this
+    //      8B 46 0C              - mov eax, [esi+0C]
+    //      85 C0                 - test eax, eax
+
+    auto zoneChangeScan = xiloader::scheduler::run([zoneChangeDone]() { return !zoneChangeDone ? xiloader::functions::FindPattern("FFXiMain.dll", (BYTE*)"\x8B\x0D\xFF\xFF\xFF\xFF\x89\x01\x8B\x46", "xx????xxxx") : 0; });
+
+    /* Both scans run in parallel; waiting here lets this worker help.. */
+    auto hairpinAddress = hairpinScan.get();
+    if (!hairpinDone && hairpinAddress == 0)
+    {
+        XILOADER_ERROR("Failed to locate main hairpin hack address!");
+        return;
+    }
+
+    auto zoneChangeAddress = zoneChangeScan.get();
+    if (!zoneChangeDone && zoneChangeAddress == 0)
+    {
+        XILOADER_ERROR("Failed to locate zone change hairpin address!");
+        return;
+    }
+
+    g_HairpinModule = module;
+    g_ZoneChangeKeep = hairpin;
+
+    /* Apply the hairpin fix.. */
+    if (!hairpinDone)
+    {
+        auto caveDest = ((int)HairpinFixCave - ((int)hairpinAddress)) - 5;
+        g_HairpinReturnAddress = hairpinAddress + 0x08;
+
+        *(BYTE*)(hairpinAddress + 0x00) = 0xE9; // jmp
+        *(UINT*)(hairpinAddress + 0x01) = caveDest;
+        *(BYTE*)(hairpinAddress + 0x05) = 0x90; // nop
+        *(BYTE*)(hairpinAddress + 0x06) = 0x90; // nop
+        *(BYTE*)(hairpinAddress + 0x07) = 0x90; // nop
+
+        xiloader::flightrecorder::record(xiloader::flightevent::patch, hairpinAddress, "hairpin");
+    }
+
+    /* Route the zone ip change through the cave; it performs or skips the store itself.. */
+    if (!zoneChangeDone)
+    {
+        auto caveDest = ((int)ZoneChangeCave - ((int)zoneChangeAddress)) - 5;
+        g_ZoneChangeAddress = zoneChangeAddress;
+        g_ZoneChangeTarget = *(DWORD*)(zoneChangeAddress + 0x02);
+        g_ZoneChangeReturnAddress = zoneChangeAddress + 0x08;
+
+        *(BYTE*)(zoneChangeAddress + 0x00) = 0xE9; // jmp
+        *(UINT*)(zoneChangeAddress + 0x01) = caveDest;
+        *(BYTE*)(zoneChangeAddress + 0x05) = 0x90; // nop
+        *(BYTE*)(zoneChangeAddress + 0x06) = 0x90; // nop
+        *(BYTE*)(zoneChangeAddress + 0x07) = 0x90; // nop
+
+        xiloader::flightrecorder::record(xiloader::flightevent::patch, zoneChangeAddress, "zone change");
+    }
+
+    if (xiloader::zonetrace::enabled())
+        xiloader::console::output(xiloader::color::success, "Zone trace attached!");
+
+    if (hairpin)
+        xiloader::console::output(xiloader::color::success, "Hairpin fix applied!");
+}
+
+/**
+ * @brief Maps the PlayOnline server names onto the servers of the running session.
+ *
+ * @param name      The hostname the game asked for.
+ *
+ * @return The hostname to resolve instead.
+ */
+static const char* RedirectHost(const char* name)
+{
+    if (!strcmp("ffxi00.pol.com", name))
+        return g_Session->ServerAddress.c_str();
+    if (!strcmp("pp000.pol.com", name))
+        return "127.0.0.1";
+
+    return name;
+}
+
+/**
+ * @brief gethostbyname detour callback.
+ *
+ * @param name      The hostname to obtain information of.
+ *
+ * @return Hostname information object.
+ */
+static hostent* __stdcall Mine_gethostbyname(const char* name)
+{
+    xiloader::flightrecorder::record(xiloader::flightevent::detour, 0, name);
+
+    /* Only the game servers are redirected, and only while a game runs.. */
+    if (g_Session == NULL || name == NULL)
+        return Real_gethostbyname(name);
+
+	if (!g_Session->Silent)
+	{
+		XILOADER_DEBUG(xiloader::color::debug, "Resolving host: %s", name);
+	}
+
+    /* Answer from the resolver cache; only the first lookup of a name waits on DNS.. */
+    auto host = xiloader::dnscache::host(RedirectHost(name));
+    if (host == NULL)
+        WSASetLastError(WSAHOST_NOT_FOUND);
+
+    return host;
+}
+
+/**
+ * @brief getaddrinfo detour callback.
+ *
+ * @param node      The hostname to obtain information of.
+ * @param service   The service name or port number.
+ * @param hints     The lookup hints.
+ * @param result    Receives the address information list.
+ *
+ * @return 0 on success, a Winsock error code otherwise.
+ */
+static INT WSAAPI Mine_getaddrinfo(PCSTR node, PCSTR service, const ADDRINFOA* hints, PADDRINFOA* result)
+{
+    if (g_Session == NULL || node == NULL)
+        return Real_getaddrinfo(node, service, hints, result);
+
+    xiloader::flightrecorder::record(xiloader::flightevent::detour, 1, node);
+
+    /* Share the gethostbyname cache; lookups it cannot answer go to the system.. */
+    auto target = RedirectHost(node);
+    auto ret = xiloader::dnscache::addrinfo(target, service, hints, result);
+    if (ret == -1)
+        return Real_getaddrinfo(target, service, hints, result);
+
+    return ret;
+}
+
+/**
+ * @brief freeaddrinfo detour callback.
+ *
+ * @param info      The address information list to free.
+ */
+static VOID WSAAPI Mine_freeaddrinfo(PADDRINFOA info)
+{
+    /* Lists from the resolver cache are not the system's to free.. */
+    if (info != NULL && !xiloader::dnscache::release(info))
+        Real_freeaddrinfo(info);
+}
+
+/**
+ * @brief connect detour callback.
+ *
+ * @param s         The socket to connect.
+ * @param name      The address to connect to.
+ * @param namelen   The length of the address.
+ *
+ * @return 0 on success, SOCKET_ERROR otherwise.
+ */
+static int WSAAPI Mine_connect(SOCKET s, const sockaddr* name, int namelen)
+{
+    /* Destinations without a NAT mapping pass through untouched.. */
+    struct sockaddr_in translated;
+    if (!xiloader::nattable::translate(name, namelen, &translated))
+        return Real_connect(s, name, namelen);
+
+    xiloader::flightrecorder::record(xiloader::flightevent::detour, 2, inet_ntoa(translated.sin_addr));
+    return Real_connect(s, (const sockaddr*)&translated, sizeof(translated));
+}
+
+/**
+ * @brief sendto detour callback.
+ *
+ * @param s         The socket to send on.
+ * @param buf       The datagram.
+ * @param len       The length of the datagram.
+ * @param flags     The send flags.
+ * @param to        The address to send to.
+ * @param tolen     The length of the address.
+ *
+ * @return The number of bytes sent, SOCKET_ERROR otherwise.
+ */
+static int WSAAPI Mine_sendto(SOCKET s, const char* buf, int len, int flags, const sockaddr* to, int tolen)
+{
+    /* Runs for every zone packet; no logging here.. */
+    xiloader::zonetrace::sent(to, tolen);
+
+    struct sockaddr_in translated;
+    if (!xiloader::nattable::translate(to, tolen, &translated))
+        return Real_sendto(s, buf, len, flags, to, tolen);
+
+    return Real_sendto(s, buf, len, flags, (const sockaddr*)&translated, sizeof(translated));
+}
+
+/**
+ * @brief recvfrom detour callback.
+ *
+ * @param s         The socket to receive on.
+ * @param buf       Receives the datagram.
+ * @param len       The size of the buffer.
+ * @param flags     The receive flags.
+ * @param from      Receives the address of the sender; may be NULL.
+ * @param fromlen   The length of the address.
+ *
+ * @return The number of bytes received, SOCKET_ERROR otherwise.
+ */
+static int WSAAPI Mine_recvfrom(SOCKET s, char* buf, int len, int flags, sockaddr* from, int* fromlen)
+{
+    auto result = Real_recvfrom(s, buf, len, flags, from, fromlen);
+    if (result >= 0 && fromlen != NULL)
+    {
+        /* Replies from a translated destination appear to come from the address the game sent to;
+           the zone trace compares them with that address too.. */
+        xiloader::nattable::untranslate(from, *fromlen);
+        xiloader::zonetrace::received(from, *fromlen);
+    }
+
+    return result;
+}
+
+/**
+ * @brief WSAConnect detour callback.
+ *
+ * @param s             The socket to connect.
+ * @param name          The address to connect to.
+ * @param namelen       The length of the address.
+ * @param lpCallerData  The data sent to the peer while connecting.
+ * @param lpCalleeData  Receives the data the peer sent while connecting.
+ * @param lpSQOS        The flow specs of the socket.
+ * @param lpGQOS        Reserved.
+ *
+ * @return 0 on success, SOCKET_ERROR otherwise.
+ */
+static int WSAAPI Mine_WSAConnect(SOCKET s, const sockaddr* name, int namelen, LPWSABUF lpCallerData, LPWSABUF lpCalleeData, LPQOS lpSQOS, LPQOS lpGQOS)
+{
+    struct sockaddr_in translated;
+    if (!xiloader::nattable::translate(name, namelen, &translated))
+        return Real_WSAConnect(s, name, namelen, lpCallerData, lpCalleeData, lpSQOS, lpGQOS);
+
+    xiloader::flightrecorder::record(xiloader::flightevent::detour, 3, inet_ntoa(translated.sin_addr));
+    return Real_WSAConnect(s, (const sockaddr*)&translated, sizeof(translated), lpCallerData, lpCalleeData, lpSQOS, lpGQOS);
+}
+
+/**
+ * @brief Locates the INET mutex function call inside of polcore.dll
+ *
+ * @param language      The language of the loaded polcore.
+ *
+ * @return The pointer to the function call.
+ */
+static DWORD FindINETMutex(xiloader::Language language)
+{
+    const char* module = (language == xiloader::Language::European) ? "polcoreeu.dll" : "polcore.dll";
+    auto result = (DWORD)xiloader::functions::FindPattern(module, (BYTE*)"\x8B\x56\x2C\x8B\x46\x28\x8B\x4E\x24\x52\x50\x51", "xxxxxxxxxxxx");
+    return (*(DWORD*)(result - 4) + (result));
+}
+
+/**
+ * @brief Locates the PlayOnline connection object inside of polcore.dll
+ *
+ * @param language      The language of the loaded polcore.
+ *
+ * @return Pointer to the pol connection object.
+ */
+static DWORD FindPolConn(xiloader::Language language)
+{
+    const char* module = (language == xiloader::Language::European) ? "polcoreeu.dll" : "polcore.dll";
+    auto result = (DWORD)xiloader::functions::FindPattern(module, (BYTE*)"\x81\xC6\x38\x03\x00\x00\x83\xC4\x04\x81\xFE", "xxxxxxxxxxx");
+    return (*(DWORD*)(result - 10));
+}
+
+/**
+ * @brief Locates the current character information block.
+ *
+ * @return Pointer to the character information table.
+ */
+static LPVOID FindCharacters(void** commFuncs)
+{
+    LPVOID lpCharTable = NULL;
+    memcpy(&lpCharTable, (char*)commFuncs[0xD3] + 31, sizeof(lpCharTable));
+    return lpCharTable;
+}
+
+/**
+ * @brief Asks whether to start another game instance once the game has closed.
+ *
+ * Headless sessions relaunch on their own, unless the game closed within
+ * RELAUNCH_MIN_RUNTIME; such a client cannot start and would only loop.
+ *
+ * @param session       The session object.
+ * @param runtime       How long the game ran, in milliseconds.
+ *
+ * @return True to relaunch the game, false to exit.
+ */
+static bool WaitForRelaunch(xiloader::session* session, int64_t runtime)
+{
+    if (session->Headless)
+    {
+        if (runtime < RELAUNCH_MIN_RUNTIME)
+        {
+            XILOADER_ERROR("The game closed after %lld ms; not relaunching.", runtime);
+            return false;
+        }
+
+        xiloader::console::output(xiloader::color::warning, "The game closed after %lld ms; relaunching..", runtime);
+        return true;
+    }
+
+    std::string input;
+    xiloader::console::flush();
+    std::cout << "\nThe game has closed. Relaunch it? y/n: ";
+    std::cin >> input;
+    return input == "y";
+}
+
+/**
+ * @brief Prepares a warm relaunch of the game.
+ *
+ * The detours, lobby server, polcore instance and signature scan results
+ * are kept; only the data server connection is restored. The server closes
+ * it once a character is in game, so the stored credentials are used to
+ * log in again without prompting.
+ *
+ * @param session       The session object.
+ * @param hFFXiServer   The data server thread; replaced when it has exited.
+ * @param hairpin       Should the hairpin fix be applied to the new game?
+ *
+ * @return True if the game can be started, false otherwise.
+ */
+static bool PrepareRelaunch(xiloader::session* session, HANDLE* hFFXiServer, bool hairpin)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (*hFFXiServer == NULL || WaitForSingleObject(*hFFXiServer, 0) == WAIT_OBJECT_0)
+    {
+        if (*hFFXiServer != NULL)
+            CloseHandle(*hFFXiServer);
+
+        *hFFXiServer = NULL;
+        if (xiloader::network::LoginHeadless(session) != XILOADER_EXIT_SUCCESS)
+            return false;
+
+        *hFFXiServer = CreateThread(NULL, 0, xiloader::network::FFXiServer, session, 0, NULL);
+    }
+
+    xiloader::scheduler::post([session, hairpin]() { ApplyZonePatches(session, hairpin); });
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    xiloader::flightrecorder::record(xiloader::flightevent::start, static_cast<uint64_t>(elapsed * 1000), "relaunch (us)");
+    XILOADER_DEBUG(xiloader::color::debug, "Relaunch prepared in %.1f ms.", elapsed);
+
+    if (session->Notify)
+        session->Notify(xiloader::loaderstage::relaunch, static_cast<uint64_t>(elapsed));
+    return true;
+}
+
+/**
+ * @brief Maps the DAT tables of the install folder and hands them to the prefetcher.
+ *
+ * @param folder        The FINAL FANTASY XI install folder.
+ */
+static void IndexDatFiles(const char* folder)
+{
+    /* Another launch of the same installation keeps its tables.. */
+    if (g_DatFolder == folder)
+        return;
+
+    if (*folder == '\0')
+    {
+        XILOADER_WARNING("Failed to locate the FINAL FANTASY XI install folder; DAT files will not be prefetched.");
+        return;
+    }
+
+    auto index = std::make_shared<xiloader::datindex>();
+    if (!index->open(folder))
+    {
+        XILOADER_WARNING("Failed to map the DAT tables of %s; DAT files will not be prefetched.", folder);
+        return;
+    }
+
+    /* The resolver owns the index; lookups in flight keep a replaced one alive.. */
+    g_DatFolder = folder;
+    xiloader::prefetcher::resolver([index](uint16_t fileNo, std::string& path)
+    {
+        char buffer[MAX_PATH];
+        auto length = index->path(fileNo, buffer, sizeof(buffer));
+        path.assign(buffer, length);
+        return length != 0;
+    });
+
+    XILOADER_DEBUG(xiloader::color::debug, "Mapped the DAT tables of %u files.", index->count());
+}
+
+namespace xiloader
+{
+    /* Registry settings read ahead of the launch; kept for later launches in the same language. */
+    static std::mutex s_PreloadLock;
+    static int s_PreloadLanguage = -1;
+    static xiloader::future<int> s_RegistryLanguage;
+    static xiloader::future<const char*> s_InstallFolder;
+    static xiloader::future<std::string> s_DatFolder;
+
+    /* Set while a game runs; polcore and FFXiMain allow one per process. */
+    static std::atomic<bool> s_Running(false);
+
+    /**
+     * @brief Initializes Winsock and COM for the calling thread and attaches the resolver and socket detours.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool loader::Initialize()
+    {
+        /* Initialize Winsock */
+        WSADATA wsaData = { 0 };
+        auto ret = WSAStartup(MAKEWORD(2, 2), &wsaData);
+        if (ret != 0)
+        {
+            XILOADER_ERROR("Failed to initialize winsock, error code: %d", ret);
+            return false;
+        }
+
+        /* Initialize COM */
+        auto hResult = CoInitialize(NULL);
+        if (hResult != S_OK && hResult != S_FALSE)
+        {
+            /* Cleanup Winsock */
+            WSACleanup();
+
+            XILOADER_ERROR("Failed to initialize COM, error code: %d", hResult);
+            return false;
+        }
+
+        /* Attach the resolver and socket detours; the cache resolves through the originals.. */
+        xiloader::dnscache::resolver(Real_getaddrinfo, Real_freeaddrinfo);
+        DetourTransactionBegin();
+        DetourUpdateThread(GetCurrentThread());
+        DetourAttach(&(PVOID&)Real_gethostbyname, Mine_gethostbyname);
+        DetourAttach(&(PVOID&)Real_getaddrinfo, Mine_getaddrinfo);
+        DetourAttach(&(PVOID&)Real_freeaddrinfo, Mine_freeaddrinfo);
+        DetourAttach(&(PVOID&)Real_connect, Mine_connect);
+        DetourAttach(&(PVOID&)Real_sendto, Mine_sendto);
+        DetourAttach(&(PVOID&)Real_recvfrom, Mine_recvfrom);
+        DetourAttach(&(PVOID&)Real_WSAConnect, Mine_WSAConnect);
+        if (DetourTransactionCommit() != NO_ERROR)
+        {
+            /* Cleanup COM and Winsock */
+            CoUninitialize();
+            WSACleanup();
+
+            XILOADER_ERROR("Failed to detour the resolver and socket functions. Cannot continue!");
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Detaches the resolver and socket detours and releases Winsock and COM.
+     */
+    void loader::Uninitialize()
+    {
+        /* Detach the resolver and socket detours. */
+        DetourTransactionBegin();
+        DetourUpdateThread(GetCurrentThread());
+        DetourDetach(&(PVOID&)Real_gethostbyname, Mine_gethostbyname);
+        DetourDetach(&(PVOID&)Real_getaddrinfo, Mine_getaddrinfo);
+        DetourDetach(&(PVOID&)Real_freeaddrinfo, Mine_freeaddrinfo);
+        DetourDetach(&(PVOID&)Real_connect, Mine_connect);
+        DetourDetach(&(PVOID&)Real_sendto, Mine_sendto);
+        DetourDetach(&(PVOID&)Real_recvfrom, Mine_recvfrom);
+        DetourDetach(&(PVOID&)Real_WSAConnect, Mine_WSAConnect);
+        DetourTransactionCommit();
+
+        /* Cleanup COM and Winsock */
+        CoUninitialize();
+        WSACleanup();
+    }
+
+    /**
+     * @brief Starts reading the PlayOnline registry settings in the background.
+     *
+     * The results are kept, so later launches in the same language do not read them again.
+     *
+     * @param language      The language of the installation to read.
+     */
+    void loader::Preload(xiloader::Language language)
+    {
+        std::lock_guard<std::mutex> guard(s_PreloadLock);
+        if (s_PreloadLanguage == language)
+            return;
+
+        s_PreloadLanguage = language;
+        s_RegistryLanguage = xiloader::scheduler::run([language]() { return xiloader::functions::GetRegistryPlayOnlineLanguage(language); });
+        s_InstallFolder = xiloader::scheduler::run([language]() { return xiloader::functions::GetRegistryPlayOnlineInstallFolder(language); });
+        s_DatFolder = xiloader::scheduler::run([language]()
+        {
+            char folder[MAX_PATH];
+            xiloader::functions::GetRegistryFFXIInstallFolder(language, folder, sizeof(folder));
+            return std::string(folder);
+        });
+    }
+
+    /**
+     * @brief Starts the network threads and runs the game until it closes.
+     *
+     * The session must already be logged in.
+     *
+     * @param session       The session to run the game for.
+     * @param hairpin       Should the hairpin fix be applied?
+     * @param relaunch      Should a new game instance be started on request once the game closes?
+     *
+     * @return XILOADER_EXIT_SUCCESS once the game closed, another XILOADER_EXIT_ code on failure.
+     */
+    int loader::Launch(xiloader::session* session, bool hairpin, bool relaunch)
+    {
+        auto expected = false;
+        if (!s_Running.compare_exchange_strong(expected, true))
+        {
+            XILOADER_ERROR("A game is already running in this process.");
+            return XILOADER_EXIT_ERROR;
+        }
+
+        /* The launch may run on a thread of the host's choosing.. */
+        auto hResult = CoInitialize(NULL);
+
+        int exitCode = XILOADER_EXIT_SUCCESS;
+        auto language = session->Language;
+        g_Session = session;
+        Preload(language);
+
+        xiloader::future<int> registryLanguage;
+        xiloader::future<const char*> installFolder;
+        xiloader::future<std::string> datFolder;
+        {
+            std::lock_guard<std::mutex> guard(s_PreloadLock);
+            registryLanguage = s_RegistryLanguage;
+            installFolder = s_InstallFolder;
+            datFolder = s_DatFolder;
+        }
+
+        /* Start the zone patch job; the zone change feeds the prefetcher and the zone trace, and the hairpin hack if required.. */
+        xiloader::scheduler::post([session, hairpin]() { ApplyZonePatches(session, hairpin); });
+
+        /* Create listen servers.. */
+        ResetEvent(session->ShutdownEvent);
+        session->IsRunning = true;
+        HANDLE hFFXiServer = CreateThread(NULL, 0, xiloader::network::FFXiServer, session, 0, NULL);
+        HANDLE hPolServer = session->UseLobby ? CreateThread(NULL, 0, xiloader::network::PolServer, session, 0, NULL) : NULL;
+
+        /* Attempt to create polcore instance..*/
+        IPOLCoreCom* polcore = NULL;
+        if (CoCreateInstance(xiloader::CLSID_POLCoreCom[language], NULL, 0x17, xiloader::IID_IPOLCoreCom[language], (LPVOID*)&polcore) != S_OK)
+        {
+            XILOADER_ERROR("Failed to initialize instance of polcore!");
+            exitCode = XILOADER_EXIT_ERROR;
+        }
+        else
+        {
+            /* Invoke the setup functions for polcore.. */
+            polcore->SetAreaCode(language);
+            polcore->SetParamInit(GetModuleHandle(NULL), " /game eAZcFcB -net 3");
+
+            /* Obtain the common function table.. */
+            void * (**lpCommandTable)(...);
+            polcore->GetCommonFunctionTable((unsigned long**)&lpCommandTable);
+
+            /* Scan polcore for the inet mutex function and the pol connection in parallel.. */
+            auto mutexScan = xiloader::scheduler::run([language]() { return FindINETMutex(language); });
+            auto polConnScan = xiloader::scheduler::run([language]() { return FindPolConn(language); });
+
+            /* Invoke the inet mutex function.. */
+            auto findMutex = (void * (*)(...))mutexScan.get();
+            findMutex();
+
+            /* Locate the pol connection; it is prepared before every launch.. */
+            auto polConnection = (char*)polConnScan.get();
+            auto enc = (char*)malloc(0x1000);
+
+            /* Locate the character storage buffer.. */
+            session->CharacterList = (char*)FindCharacters((void **)lpCommandTable);
+
+            /* Invoke the setup functions for polcore.. */
+            lpCommandTable[POLFUNC_REGISTRY_LANG](language);
+            lpCommandTable[POLFUNC_FFXI_LANG](registryLanguage.get());
+            lpCommandTable[POLFUNC_REGISTRY_KEY](xiloader::functions::GetRegistryPlayOnlineKey(language));
+            lpCommandTable[POLFUNC_INSTALL_FOLDER](installFolder.get());
+            auto ffxiFolder = datFolder.get();
+            IndexDatFiles(ffxiFolder.c_str());
+            lpCommandTable[POLFUNC_INET_MUTEX]();
+
+            /* Start the game; in relaunch mode everything above is kept for the next instance.. */
+            for (auto launch = 0; launch == 0 || PrepareRelaunch(session, &hFFXiServer, hairpin); launch++)
+            {
+                memset(polConnection, 0x00, 0x68);
+                memset(enc, 0x00, 0x1000);
+                memcpy(polConnection + 0x48, &enc, sizeof(char**));
+
+                /* Attempt to create FFXi instance..*/
+                IFFXiEntry* ffxi = NULL;
+                if (CoCreateInstance(xiloader::CLSID_FFXiEntry, NULL, 0x17, xiloader::IID_IFFXiEntry, (LPVOID*)&ffxi) != S_OK)
+                {
+                    XILOADER_ERROR("Failed to initialize instance of FFxi!");
+                    exitCode = XILOADER_EXIT_ERROR;
+                    break;
+                }
+
+                /* Serve repeated DAT file reads from memory; the vtable is patched once per module.. */
+                IFxFileManager* files = NULL;
+                if (ffxi->get_FxFileManager(&files) == S_OK && files != NULL)
+                {
+                    xiloader::datcache::attach(files);
+                    files->Release();
+                }
+
+                session->Launches++;
+                if (session->Notify)
+                    session->Notify(xiloader::loaderstage::gamestart, launch + 1);
+
+                /* Attempt to start Final Fantasy.. */
+                IUnknown* message = NULL;
+                auto started = std::chrono::steady_clock::now();
+                xiloader::console::hide();
+                ffxi->GameStart(polcore, &message);
+                xiloader::console::show();
+                ffxi->Release();
+
+                auto runtime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+                XILOADER_DEBUG(xiloader::color::debug, "DAT cache: %lld hits, %lld misses, %lld KB held.", static_cast<int64_t>(xiloader::datcache::hits()),
+                    static_cast<int64_t>(xiloader::datcache::misses()), static_cast<int64_t>(xiloader::datcache::size() / 1024));
+                XILOADER_DEBUG(xiloader::color::debug, "DAT prefetch: %lld files read ahead, %lld used by the game.", static_cast<int64_t>(xiloader::prefetcher::prefetched()),
+                    static_cast<int64_t>(xiloader::prefetcher::useful()));
+                xiloader::nattable::report();
+                xiloader::zonetrace::report();
+                if (session->Notify)
+                    session->Notify(xiloader::loaderstage::gameclose, static_cast<uint64_t>(runtime));
+
+                if (!relaunch || !WaitForRelaunch(session, runtime))
+                    break;
+            }
+
+            /* Cleanup polcore object.. */
+            polcore->Release();
+            free(enc);
+        }
+
+        /* Cleanup threads.. */
+        HANDLE threads[] = { hFFXiServer, hPolServer };
+        xiloader::network::Shutdown(session, threads, 2, 2000);
+
+        g_Session = NULL;
+        if (hResult == S_OK || hResult == S_FALSE)
+            CoUninitialize();
+
+        s_Running = false;
+        return exitCode;
+    }
+
+    /**
+     * @brief Obtains the address the gethostbyname detour forwards to; used to record the detour.
+     *
+     * @return The address of the real gethostbyname.
+     */
+    DWORD loader::DetourTarget()
+    {
+        return (DWORD)Real_gethostbyname;
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,93 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_LOADER_H_INCLUDED__
+#define __XILOADER_LOADER_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "session.h"
+
+/* Shortest game runtime, in milliseconds, after which a headless session relaunches. */
+#define RELAUNCH_MIN_RUNTIME 10000
+
+namespace xiloader
+{
+    /**
+     * @brief Game start logic shared by the loader executable and the loader core library.
+     *
+     * Owns the resolver and socket detours, the hairpin fix, the zone trace patch and
+     * the polcore signature scans. polcore and FFXiMain keep their state in module globals, so only
+     * one game can run per process at a time.
+     */
+    class loader
+    {
+    public:
+
+        /**
+         * @brief Initializes Winsock and COM for the calling thread and attaches the resolver and socket detours.
+         *
+         * @return True on success, false otherwise.
+         */
+        static bool Initialize();
+
+        /**
+         * @brief Detaches the resolver and socket detours and releases Winsock and COM.
+         */
+        static void Uninitialize();
+
+        /**
+         * @brief Starts reading the PlayOnline registry settings in the background.
+         *
+         * The results are kept, so later launches in the same language do not read them again.
+         *
+         * @param language      The language of the installation to read.
+         */
+        static void Preload(xiloader::Language language);
+
+        /**
+         * @brief Starts the network threads and runs the game until it closes.
+         *
+         * The session must already be logged in.
+         *
+         * @param session       The session to run the game for.
+         * @param hairpin       Should the hairpin fix be applied?
+         * @param relaunch      Should a new game instance be started on request once the game closes?
+         *
+         * @return XILOADER_EXIT_SUCCESS once the game closed, another XILOADER_EXIT_ code on failure.
+         */
+        static int Launch(xiloader::session* session, bool hairpin, bool relaunch);
+
+        /**
+         * @brief Obtains the address the gethostbyname detour forwards to; used to record the detour.
+         *
+         * @return The address of the real gethostbyname.
+         */
+        static DWORD DetourTarget();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_LOADER_H_INCLUDED__
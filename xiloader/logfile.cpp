@@ -0,0 +1,305 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "logfile.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace xiloader
+{
+    /**
+     * @brief Builds the path of a file within the rotation.
+     *
+     * @param path      The base path of the log files.
+     * @param index     The index of the file within the rotation.
+     *
+     * @return The path of the file.
+     */
+    static std::string filename(const std::string& path, uint32_t index)
+    {
+        char suffix[32];
+        snprintf(suffix, sizeof suffix, ".%u.xlog", index);
+        return path + suffix;
+    }
+
+    binarysink::binarysink()
+        : logsink(static_cast<xiloader::loglevel>(XILOADER_LOG_LEVEL), false), m_Sequence(0), m_Offset(0)
+    {
+        m_Scratch.reserve(LOGGER_PAYLOAD_SIZE);
+    }
+
+    binarysink::~binarysink()
+    {
+        close();
+    }
+
+    /**
+     * @brief Opens the binary log.
+     *
+     * The rotation continues after the newest file left by a previous session,
+     * so its history is kept until the rotation wraps around.
+     *
+     * @param path      The base path of the log files; ".N.xlog" is appended.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool binarysink::open(const char* path)
+    {
+        close();
+        m_Path = path;
+        m_Sequence = 0;
+
+        /* Locate the newest file of a previous session.. */
+        for (uint32_t x = 0; x < LOGFILE_COUNT; x++)
+        {
+            xiloader::mappedfile existing;
+            if (!existing.open(filename(m_Path, x).c_str(), false) || existing.size() < sizeof(logfileheader))
+                continue;
+
+            auto header = reinterpret_cast<const logfileheader*>(existing.data());
+            if (memcmp(header->magic, LOGFILE_MAGIC, sizeof(header->magic)) == 0 && header->sequence + 1 > m_Sequence)
+                m_Sequence = header->sequence + 1;
+        }
+
+        return rotate();
+    }
+
+    /**
+     * @brief Flushes and closes the binary log.
+     */
+    void binarysink::close()
+    {
+        m_File.flush();
+        m_File.close();
+        m_Formats.clear();
+        m_Offset = 0;
+    }
+
+    /**
+     * @brief Opens the next file of the rotation.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool binarysink::rotate()
+    {
+        m_File.flush();
+        m_File.close();
+        m_Formats.clear();
+
+        auto sequence = m_Sequence++;
+        if (!m_File.create(filename(m_Path, sequence % LOGFILE_COUNT).c_str(), LOGFILE_SIZE))
+            return false;
+
+        auto header = reinterpret_cast<logfileheader*>(m_File.data());
+        memcpy(header->magic, LOGFILE_MAGIC, sizeof(header->magic));
+        header->version = LOGFILE_VERSION;
+        header->headersize = sizeof(logfileheader);
+        header->capacity = LOGFILE_SIZE;
+        header->used = 0;
+        header->sequence = sequence;
+        header->processid = static_cast<uint32_t>(getpid());
+        header->created = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        m_Offset = sizeof(logfileheader);
+        return true;
+    }
+
+    /**
+     * @brief Makes room for a record, rotating to the next file when required.
+     *
+     * @param length    The size of the record in bytes.
+     *
+     * @return Pointer to the space reserved for the record, nullptr on failure.
+     */
+    uint8_t* binarysink::reserve(size_t length)
+    {
+        if (length > LOGFILE_SIZE - sizeof(logfileheader))
+            return nullptr;
+
+        if (m_File.data() == nullptr || m_Offset + length > m_File.size())
+        {
+            if (m_Path.empty() || !rotate())
+                return nullptr;
+        }
+
+        return m_File.data() + m_Offset;
+    }
+
+    /**
+     * @brief Publishes the bytes reserved for a record.
+     *
+     * The used size in the header is updated last so a reader never sees a
+     * partially written record, even if the process dies mid-write.
+     *
+     * @param length    The size of the record in bytes.
+     */
+    void binarysink::commit(size_t length)
+    {
+        m_Offset += length;
+
+        std::atomic_thread_fence(std::memory_order_release);
+        reinterpret_cast<logfileheader*>(m_File.data())->used = static_cast<uint32_t>(m_Offset - sizeof(logfileheader));
+    }
+
+    /**
+     * @brief Obtains the id of a format, defining it in the current file if required.
+     *
+     * @param format    The format to look up.
+     *
+     * @return The format id, 0 on failure.
+     */
+    uint32_t binarysink::formatid(const char* format)
+    {
+        auto found = m_Formats.find(format);
+        if (found != m_Formats.end())
+            return found->second;
+
+        auto length = strlen(format);
+        if (length > 0xFFFF)
+            length = 0xFFFF;
+
+        /* Reserving may rotate to a new file, which clears the table.. */
+        auto record = reserve(sizeof(logfileformat) + length);
+        if (record == nullptr)
+            return 0;
+
+        logfileformat definition;
+        definition.type = static_cast<uint8_t>(logfilerecord::format);
+        definition.reserved = 0;
+        definition.length = static_cast<uint16_t>(length);
+        definition.id = static_cast<uint32_t>(m_Formats.size() + 1);
+
+        memcpy(record, &definition, sizeof(definition));
+        memcpy(record + sizeof(definition), format, length);
+        commit(sizeof(definition) + length);
+
+        m_Formats[format] = definition.id;
+        return definition.id;
+    }
+
+    /**
+     * @brief Writes a single record.
+     *
+     * Heap copies of oversized strings are written inline, so the payload
+     * stored in the file never refers to memory of the logging process.
+     *
+     * @param record    The record to write.
+     * @param message   Unused; the binary sink never needs text.
+     */
+    void binarysink::write(const xiloader::logrecord* record, const std::string& message)
+    {
+        (void)message;
+
+        /* Copy the payload, converting heap strings to inline strings.. */
+        m_Scratch.clear();
+        for (size_t offset = 0; offset < record->size;)
+        {
+            auto tag = static_cast<logarg>(record->payload[offset]);
+            size_t length = 0;
+
+            switch (tag)
+            {
+            case logarg::int32:
+            case logarg::uint32:
+                length = 4;
+                break;
+            case logarg::int64:
+            case logarg::uint64:
+            case logarg::float64:
+            case logarg::pointer:
+                length = 8;
+                break;
+            case logarg::string:
+            {
+                uint16_t count = 0;
+                memcpy(&count, record->payload + offset + 1, sizeof(count));
+                length = sizeof(count) + count;
+                break;
+            }
+            case logarg::heapstring:
+            {
+                const char* value = nullptr;
+                memcpy(&value, record->payload + offset + 1, sizeof(value));
+
+                auto count = static_cast<uint16_t>(strlen(value) > 0xFFFF ? 0xFFFF : strlen(value));
+                m_Scratch.push_back(static_cast<uint8_t>(logarg::string));
+                m_Scratch.insert(m_Scratch.end(), reinterpret_cast<uint8_t*>(&count), reinterpret_cast<uint8_t*>(&count) + sizeof(count));
+                m_Scratch.insert(m_Scratch.end(), value, value + count);
+                offset += 1 + sizeof(value);
+                continue;
+            }
+            default:
+                offset = record->size;
+                continue;
+            }
+
+            m_Scratch.insert(m_Scratch.end(), record->payload + offset, record->payload + offset + 1 + length);
+            offset += 1 + length;
+        }
+
+        if (m_Scratch.size() > 0xFFFF)
+            return;
+
+        /* Look up the format before reserving; defining it may rotate the file.. */
+        auto format = formatid(record->format);
+        if (format == 0)
+            return;
+
+        auto output = reserve(sizeof(logfileentry) + m_Scratch.size());
+        if (output == nullptr)
+            return;
+
+        /* The entry did not fit; the new file needs the format again.. */
+        if (m_Formats.empty())
+        {
+            format = formatid(record->format);
+            output = reserve(sizeof(logfileentry) + m_Scratch.size());
+            if (format == 0 || output == nullptr)
+                return;
+        }
+
+        logfileentry entry;
+        entry.type = static_cast<uint8_t>(logfilerecord::entry);
+        entry.level = record->level;
+        entry.color = record->color;
+        entry.format = format;
+        entry.timestamp = record->timestamp;
+        entry.argc = record->argc;
+        entry.reserved = 0;
+        entry.size = static_cast<uint16_t>(m_Scratch.size());
+
+        memcpy(output, &entry, sizeof(entry));
+        if (!m_Scratch.empty())
+            memcpy(output + sizeof(entry), m_Scratch.data(), m_Scratch.size());
+        commit(sizeof(entry) + m_Scratch.size());
+    }
+
+}; // namespace xiloader
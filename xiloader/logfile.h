@@ -0,0 +1,181 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_LOGFILE_H_INCLUDED__
+#define __XILOADER_LOGFILE_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "logger.h"
+#include "mappedfile.h"
+
+/* Binary log file identification. */
+#define LOGFILE_MAGIC           "XILOGBIN"
+#define LOGFILE_VERSION         1
+
+/* Size of a single log file and number of files kept before the oldest is reused. */
+#define LOGFILE_SIZE            (4 * 1024 * 1024)
+#define LOGFILE_COUNT           4
+
+namespace xiloader
+{
+    /**
+     * @brief Binary log record types.
+     */
+    enum class logfilerecord : uint8_t
+    {
+        end = 0,        // Unused space; the file is zero filled on creation.
+        format = 1,     // Defines the format string of a format id.
+        entry = 2       // A logged message.
+    };
+
+#pragma pack(push, 1)
+
+    /**
+     * @brief Header at the start of every binary log file.
+     */
+    struct logfileheader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headersize;
+        uint32_t capacity;      // Size of the whole file in bytes.
+        uint32_t used;          // Bytes of records written after the header.
+        uint32_t sequence;      // Increments every time the log rotates to a new file.
+        uint32_t processid;
+        int64_t created;        // Microseconds since the unix epoch.
+    };
+
+    /**
+     * @brief Format definition record; followed by the format characters.
+     */
+    struct logfileformat
+    {
+        uint8_t type;
+        uint8_t reserved;
+        uint16_t length;
+        uint32_t id;
+    };
+
+    /**
+     * @brief Message record; followed by the tagged argument payload.
+     */
+    struct logfileentry
+    {
+        uint8_t type;
+        uint8_t level;
+        uint16_t color;
+        uint32_t format;
+        int64_t timestamp;
+        uint8_t argc;
+        uint8_t reserved;
+        uint16_t size;
+    };
+
+#pragma pack(pop)
+
+    /**
+     * @brief Log sink writing raw records to memory-mapped, rotating log files.
+     *
+     * Only the format id, timestamp and captured arguments are written; the
+     * format string itself is stored once per file. Files are decoded offline
+     * with tools/xilogdump.
+     */
+    class binarysink : public xiloader::logsink
+    {
+        xiloader::mappedfile m_File;
+        std::string m_Path;
+        uint32_t m_Sequence;
+        size_t m_Offset;
+        std::unordered_map<const char*, uint32_t> m_Formats;
+        std::vector<uint8_t> m_Scratch;
+
+        /**
+         * @brief Opens the next file of the rotation.
+         *
+         * @return True on success, false otherwise.
+         */
+        bool rotate();
+
+        /**
+         * @brief Makes room for a record, rotating to the next file when required.
+         *
+         * @param length    The size of the record in bytes.
+         *
+         * @return Pointer to the space reserved for the record, nullptr on failure.
+         */
+        uint8_t* reserve(size_t length);
+
+        /**
+         * @brief Publishes the bytes reserved for a record.
+         *
+         * @param length    The size of the record in bytes.
+         */
+        void commit(size_t length);
+
+        /**
+         * @brief Obtains the id of a format, defining it in the current file if required.
+         *
+         * @param format    The format to look up.
+         *
+         * @return The format id, 0 on failure.
+         */
+        uint32_t formatid(const char* format);
+
+    public:
+        binarysink();
+        ~binarysink();
+
+        /**
+         * @brief Opens the binary log.
+         *
+         * @param path      The base path of the log files; ".N.xlog" is appended.
+         *
+         * @return True on success, false otherwise.
+         */
+        bool open(const char* path);
+
+        /**
+         * @brief Flushes and closes the binary log.
+         */
+        void close();
+
+        /**
+         * @brief Writes a single record.
+         *
+         * @param record    The record to write.
+         * @param message   Unused; the binary sink never needs text.
+         */
+        void write(const xiloader::logrecord* record, const std::string& message) override;
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_LOGFILE_H_INCLUDED__
@@ -0,0 +1,274 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "logformat.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace xiloader
+{
+    /**
+     * @brief Formats a message from its format and captured arguments.
+     *
+     * Every conversion of the format is handed to snprintf on its own with the
+     * captured argument, so messages are not limited to a fixed buffer.
+     *
+     * @param format    The format of the message.
+     * @param payload   The tagged arguments of the message.
+     * @param size      The size of the payload in bytes.
+     * @param argc      The number of arguments held by the payload.
+     * @param output    The string to append the message to.
+     */
+    void logformatter::render(const char* format, const uint8_t* payload, size_t size, uint32_t argc, std::string& output)
+    {
+        size_t offset = 0;
+        uint32_t consumed = 0;
+
+        /* Appends a single formatted value to the output.. */
+        auto append = [&output](const char* spec, auto value)
+        {
+            auto length = snprintf(nullptr, 0, spec, value);
+            if (length <= 0)
+                return;
+
+            auto current = output.size();
+            output.resize(current + length + 1);
+            snprintf(&output[current], length + 1, spec, value);
+            output.resize(current + length);
+        };
+
+        /* Reads the next argument tag from the payload.. */
+        auto next = [&]() -> logarg
+        {
+            if (consumed >= argc || offset >= size)
+                return static_cast<logarg>(0);
+            consumed++;
+            return static_cast<logarg>(payload[offset++]);
+        };
+
+        /* Reads the next argument as an integer (used for '*' width and precision).. */
+        auto integer = [&]() -> int
+        {
+            int32_t value = 0;
+            auto tag = next();
+            if ((tag == logarg::int32 || tag == logarg::uint32) && offset + 4 <= size)
+            {
+                memcpy(&value, payload + offset, 4);
+                offset += 4;
+            }
+            return value;
+        };
+
+        while (*format)
+        {
+            if (*format != '%')
+            {
+                auto start = format;
+                while (*format && *format != '%')
+                    format++;
+                output.append(start, format - start);
+                continue;
+            }
+
+            if (format[1] == '%')
+            {
+                output.push_back('%');
+                format += 2;
+                continue;
+            }
+
+            /* Copy the flags, width and precision of the conversion.. */
+            char spec[32] = { '%' };
+            size_t length = 1;
+            auto cursor = format + 1;
+
+            while (*cursor && strchr("-+ #0", *cursor) && length < 16)
+                spec[length++] = *cursor++;
+
+            if (*cursor == '*')
+            {
+                length += snprintf(spec + length, sizeof(spec) - length, "%d", integer());
+                cursor++;
+            }
+            while (*cursor >= '0' && *cursor <= '9' && length < 24)
+                spec[length++] = *cursor++;
+
+            if (*cursor == '.')
+            {
+                spec[length++] = *cursor++;
+                if (*cursor == '*')
+                {
+                    length += snprintf(spec + length, sizeof(spec) - length, "%d", integer());
+                    cursor++;
+                }
+                while (*cursor >= '0' && *cursor <= '9' && length < 28)
+                    spec[length++] = *cursor++;
+            }
+
+            /* Skip any length modifiers; the captured type decides the width.. */
+            while (*cursor && strchr("hlLqjzt", *cursor))
+                cursor++;
+
+            auto conversion = *cursor;
+            if (conversion == '\0')
+                break;
+            format = cursor + 1;
+
+            /* Reject arguments that run past the end of the payload.. */
+            auto tag = next();
+            size_t needed = 0;
+            switch (tag)
+            {
+            case logarg::int32: case logarg::uint32: needed = 4; break;
+            case logarg::int64: case logarg::uint64: case logarg::float64: case logarg::pointer: needed = 8; break;
+            case logarg::string: needed = sizeof(uint16_t); break;
+            case logarg::heapstring: needed = sizeof(char*); break;
+            default: break;
+            }
+            if (offset + needed > size)
+            {
+                tag = static_cast<logarg>(0);
+                offset = size;
+            }
+
+            switch (tag)
+            {
+            case logarg::int32:
+            case logarg::uint32:
+            {
+                int32_t value = 0;
+                memcpy(&value, payload + offset, 4);
+                offset += 4;
+
+                if (strchr("diouxXc", conversion) == nullptr)
+                {
+                    output.append("<?>");
+                    break;
+                }
+
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                if (tag == logarg::int32)
+                    append(spec, value);
+                else
+                    append(spec, static_cast<uint32_t>(value));
+                break;
+            }
+            case logarg::int64:
+            case logarg::uint64:
+            {
+                int64_t value = 0;
+                memcpy(&value, payload + offset, 8);
+                offset += 8;
+
+                if (strchr("diouxX", conversion) == nullptr)
+                {
+                    output.append("<?>");
+                    break;
+                }
+
+                spec[length++] = 'l';
+                spec[length++] = 'l';
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                if (tag == logarg::int64)
+                    append(spec, static_cast<long long>(value));
+                else
+                    append(spec, static_cast<unsigned long long>(value));
+                break;
+            }
+            case logarg::float64:
+            {
+                double value = 0;
+                memcpy(&value, payload + offset, 8);
+                offset += 8;
+
+                if (strchr("fFeEgGaA", conversion) == nullptr)
+                {
+                    output.append("<?>");
+                    break;
+                }
+
+                spec[length++] = conversion;
+                spec[length] = '\0';
+                append(spec, value);
+                break;
+            }
+            case logarg::pointer:
+            {
+                uint64_t value = 0;
+                memcpy(&value, payload + offset, 8);
+                offset += 8;
+
+                if (conversion == 's')
+                {
+                    output.append("<?>");
+                    break;
+                }
+
+                spec[length++] = 'p';
+                spec[length] = '\0';
+                append(spec, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+                break;
+            }
+            case logarg::string:
+            case logarg::heapstring:
+            {
+                std::string value;
+                if (tag == logarg::string)
+                {
+                    uint16_t count = 0;
+                    memcpy(&count, payload + offset, sizeof(count));
+                    if (offset + sizeof(count) + count > size)
+                        count = static_cast<uint16_t>(size - offset - sizeof(count));
+                    value.assign(reinterpret_cast<const char*>(payload + offset + sizeof(count)), count);
+                    offset += sizeof(count) + count;
+                }
+                else
+                {
+                    const char* pointer = nullptr;
+                    memcpy(&pointer, payload + offset, sizeof(pointer));
+                    value = pointer;
+                    offset += sizeof(pointer);
+                }
+
+                if (conversion != 's')
+                {
+                    output.append("<?>");
+                    break;
+                }
+
+                spec[length++] = 's';
+                spec[length] = '\0';
+                append(spec, value.c_str());
+                break;
+            }
+            default:
+                output.append("<?>");
+                break;
+            }
+        }
+    }
+
+}; // namespace xiloader
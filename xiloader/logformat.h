@@ -0,0 +1,178 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_LOGFORMAT_H_INCLUDED__
+#define __XILOADER_LOGFORMAT_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace xiloader
+{
+    /**
+     * @brief Type tags written in front of every captured log argument.
+     */
+    enum class logarg : uint8_t
+    {
+        int32 = 1,
+        uint32 = 2,
+        int64 = 3,
+        uint64 = 4,
+        float64 = 5,
+        string = 6,
+        pointer = 7,
+        heapstring = 8
+    };
+
+    /**
+     * @brief Printf category of a log argument type.
+     *
+     * 'i' integral, 'f' floating point, 's' string, 'p' pointer, '?' unsupported.
+     */
+    template<typename T>
+    struct logcategory
+    {
+        static constexpr char value =
+            std::is_floating_point<T>::value ? 'f' :
+            (std::is_integral<T>::value || std::is_enum<T>::value) ? 'i' :
+            std::is_pointer<T>::value ? 'p' : '?';
+    };
+
+    template<> struct logcategory<char*> { static constexpr char value = 's'; };
+    template<> struct logcategory<const char*> { static constexpr char value = 's'; };
+
+    /**
+     * @brief Compile-time validation of a format string against its argument types.
+     */
+    template<typename Tuple>
+    struct logformat;
+
+    template<typename... Args>
+    struct logformat<std::tuple<Args...>>
+    {
+        /**
+         * @brief Checks that every conversion of the format matches an argument.
+         *
+         * @param format    The format to check.
+         *
+         * @return True if the conversions and arguments agree, false otherwise.
+         */
+        static constexpr bool valid(const char* format)
+        {
+            const char categories[] = { logcategory<Args>::value..., '\0' };
+            size_t index = 0;
+
+            for (auto p = format; *p; ++p)
+            {
+                if (*p != '%')
+                    continue;
+                if (*++p == '%')
+                    continue;
+
+                while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+                    ++p;
+
+                if (*p == '*')
+                {
+                    if (categories[index] != 'i')
+                        return false;
+                    ++index;
+                    ++p;
+                }
+                while (*p >= '0' && *p <= '9')
+                    ++p;
+
+                if (*p == '.')
+                {
+                    if (*++p == '*')
+                    {
+                        if (categories[index] != 'i')
+                            return false;
+                        ++index;
+                        ++p;
+                    }
+                    while (*p >= '0' && *p <= '9')
+                        ++p;
+                }
+
+                while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' || *p == 'j' || *p == 'z' || *p == 't')
+                    ++p;
+
+                auto category = categories[index];
+                switch (*p)
+                {
+                case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+                    if (category != 'i')
+                        return false;
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    if (category != 'f')
+                        return false;
+                    break;
+                case 's':
+                    if (category != 's')
+                        return false;
+                    break;
+                case 'p':
+                    if (category != 'p' && category != 's')
+                        return false;
+                    break;
+                default:
+                    return false;
+                }
+                ++index;
+            }
+
+            return categories[index] == '\0';
+        }
+    };
+
+    /**
+     * @brief Formats messages from a format and its tagged arguments.
+     */
+    class logformatter
+    {
+    public:
+
+        /**
+         * @brief Formats a message from its format and captured arguments.
+         *
+         * @param format    The format of the message.
+         * @param payload   The tagged arguments of the message.
+         * @param size      The size of the payload in bytes.
+         * @param argc      The number of arguments held by the payload.
+         * @param output    The string to append the message to.
+         */
+        static void render(const char* format, const uint8_t* payload, size_t size, uint32_t argc, std::string& output);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_LOGFORMAT_H_INCLUDED__
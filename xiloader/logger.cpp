@@ -0,0 +1,466 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "logger.h"
+#include "console.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+
+/* The module this code is linked into; differs from the process image inside xiloadercore.dll. */
+extern "C" IMAGE_DOS_HEADER __ImageBase;
+#endif
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace xiloader
+{
+    /* Logger state; the ring sequences are initialized on first use. */
+    static logrecord s_Ring[LOGGER_RING_SIZE];
+    static std::atomic<uint32_t> s_Head(0);
+    static std::atomic<uint32_t> s_Tail(0);
+    static std::atomic<uint32_t> s_Dropped(0);
+    static std::atomic<int> s_State(0); // 0 = idle, 1 = running, 2 = stopped
+    static std::atomic<bool> s_Sleeping(false);
+    static std::atomic<bool> s_Drained(false); // Set once the writer wrote its last record after a stop.
+    static thread_local bool s_IsWriter = false;
+    static std::once_flag s_StartFlag;
+    static std::mutex s_WakeLock;
+    static std::condition_variable s_Wake;
+    static std::thread s_Writer;
+    static std::atomic<logsink*> s_Sinks[LOGGER_MAX_SINKS];
+
+    /**
+     * @brief Stops the writer thread when the process exits.
+     */
+    static struct loggerguard
+    {
+        ~loggerguard()
+        {
+#ifdef _WIN32
+            /* Inside a DLL this runs under the loader lock, where joining a thread deadlocks; xiloader_uninitialize stops it there.. */
+            if (reinterpret_cast<HMODULE>(&__ImageBase) != GetModuleHandleA(NULL))
+                return;
+#endif
+            xiloader::logger::stop();
+        }
+    } s_Guard;
+
+    /**
+     * @brief Releases heap copies of oversized string arguments held by a record.
+     *
+     * @param record    The record to release.
+     */
+    static void release(logrecord* record)
+    {
+        for (uint16_t offset = 0; offset < record->size;)
+        {
+            auto tag = static_cast<logarg>(record->payload[offset++]);
+            switch (tag)
+            {
+            case logarg::int32:
+            case logarg::uint32:
+                offset += 4;
+                break;
+            case logarg::int64:
+            case logarg::uint64:
+            case logarg::float64:
+            case logarg::pointer:
+                offset += 8;
+                break;
+            case logarg::string:
+            {
+                uint16_t length = 0;
+                memcpy(&length, record->payload + offset, sizeof(length));
+                offset += sizeof(length) + length;
+                break;
+            }
+            case logarg::heapstring:
+            {
+                char* value = nullptr;
+                memcpy(&value, record->payload + offset, sizeof(value));
+                delete[] value;
+                offset += sizeof(value);
+                break;
+            }
+            default:
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Obtains the current time in microseconds since the unix epoch.
+     *
+     * @return The current timestamp.
+     */
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Hands a single record to every interested sink.
+     *
+     * The message is formatted at most once, and only if a sink that wants
+     * text accepts the record's level.
+     *
+     * @param record    The record to write.
+     * @param buffer    Scratch string reused between records.
+     */
+    static void writerecord(logrecord* record, std::string& buffer)
+    {
+        auto rendered = false;
+        buffer.clear();
+
+        for (auto& slot : s_Sinks)
+        {
+            auto sink = slot.load(std::memory_order_acquire);
+            if (sink == nullptr || record->level < sink->Threshold.load(std::memory_order_relaxed))
+                continue;
+
+            if (sink->Text && !rendered)
+            {
+                xiloader::logger::render(record, buffer);
+                rendered = true;
+            }
+
+            sink->write(record, buffer);
+        }
+
+        release(record);
+    }
+
+    /**
+     * @brief Writer thread; drains the ring buffer until the logger is stopped.
+     */
+    static void writer()
+    {
+        std::string buffer;
+        buffer.reserve(1024);
+        s_IsWriter = true;
+
+        uint32_t tail = s_Tail.load(std::memory_order_relaxed);
+        uint32_t reported = 0;
+        for (;;)
+        {
+            auto record = &s_Ring[tail & (LOGGER_RING_SIZE - 1)];
+            auto sequence = record->sequence.load(std::memory_order_acquire);
+
+            if (static_cast<int32_t>(sequence - (tail + 1)) < 0)
+            {
+                /* Report any messages lost while the ring was full.. */
+                auto dropped = s_Dropped.load();
+                if (dropped != reported)
+                {
+                    logrecord notice;
+                    notice.timestamp = now();
+                    notice.format = "Logger dropped %u message(s).";
+                    notice.color = static_cast<uint16_t>(xiloader::color::warning);
+                    notice.level = static_cast<uint8_t>(xiloader::loglevel::warning);
+
+                    logpacker packer(&notice);
+                    packer.pack(dropped - reported);
+                    writerecord(&notice, buffer);
+                    reported = dropped;
+                }
+
+                /* Once stopped, wait only for records that were already claimed.. */
+                if (s_State.load() != 1)
+                {
+                    if (s_Head.load() == tail)
+                    {
+                        s_Drained.store(true);
+                        break;
+                    }
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                /* Sleep until a producer wakes us or the timeout elapses.. */
+                std::unique_lock<std::mutex> lock(s_WakeLock);
+                s_Sleeping.store(true);
+                if (static_cast<int32_t>(record->sequence.load() - (tail + 1)) < 0 && s_State.load() == 1)
+                    s_Wake.wait_for(lock, std::chrono::milliseconds(50));
+                s_Sleeping.store(false);
+                continue;
+            }
+
+            /* Records claimed while stopping carry no message; it was written synchronously.. */
+            if (record->format != nullptr)
+                writerecord(record, buffer);
+
+            record->sequence.store(tail + LOGGER_RING_SIZE, std::memory_order_release);
+            s_Tail.store(++tail, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Initializes the ring buffer and starts the writer thread.
+     */
+    static void start()
+    {
+        auto sink = static_cast<logsink*>(nullptr);
+        s_Sinks[0].compare_exchange_strong(sink, xiloader::console::sink());
+
+        for (uint32_t x = 0; x < LOGGER_RING_SIZE; x++)
+            s_Ring[x].sequence.store(x, std::memory_order_relaxed);
+
+        auto expected = 0;
+        if (s_State.compare_exchange_strong(expected, 1))
+            s_Writer = std::thread(writer);
+    }
+
+    /**
+     * @brief Serializes a string argument into the record payload.
+     *
+     * Strings that do not fit inline are copied to the heap and released
+     * by the writer thread once the record has been formatted.
+     *
+     * @param value     The string to serialize.
+     */
+    void logpacker::pack_string(const char* value)
+    {
+        if (value == nullptr)
+            value = "(null)";
+
+        auto length = strlen(value);
+        auto available = LOGGER_PAYLOAD_SIZE - m_Record->size;
+        if (1 + sizeof(uint16_t) + length <= static_cast<size_t>(available))
+        {
+            uint16_t length16 = static_cast<uint16_t>(length);
+            m_Record->payload[m_Record->size++] = static_cast<uint8_t>(logarg::string);
+            memcpy(m_Record->payload + m_Record->size, &length16, sizeof(length16));
+            memcpy(m_Record->payload + m_Record->size + sizeof(length16), value, length);
+            m_Record->size += static_cast<uint16_t>(sizeof(length16) + length);
+            m_Record->argc++;
+            return;
+        }
+
+        if (1 + sizeof(char*) > static_cast<size_t>(available))
+            return;
+
+        auto copy = new char[length + 1];
+        memcpy(copy, value, length + 1);
+        put(logarg::heapstring, &copy, sizeof(copy));
+    }
+
+    /**
+     * @brief Claims a free record within the ring buffer.
+     *
+     * @param position  Receives the ring position of the claimed record.
+     *
+     * @return The claimed record, nullptr if the ring is full or the logger is stopped.
+     */
+    logrecord* logger::claim(uint32_t* position)
+    {
+        std::call_once(s_StartFlag, start);
+        if (s_State.load(std::memory_order_relaxed) != 1)
+            return nullptr;
+
+        auto head = s_Head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto record = &s_Ring[head & (LOGGER_RING_SIZE - 1)];
+            auto sequence = record->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<int32_t>(sequence - head);
+
+            if (diff == 0)
+            {
+                if (s_Head.compare_exchange_weak(head, head + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    /* The writer may have seen the ring empty and exited after a stop; leave it an
+                       empty record in case it is still draining and write the message synchronously.. */
+                    if (s_State.load() != 1)
+                    {
+                        record->format = nullptr;
+                        record->size = 0;
+                        commit(record, head);
+                        return nullptr;
+                    }
+
+                    *position = head;
+                    return record;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                head = s_Head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Publishes a claimed record to the writer thread.
+     *
+     * @param record    The record to publish.
+     * @param position  The ring position returned by claim.
+     */
+    void logger::commit(logrecord* record, uint32_t position)
+    {
+        record->sequence.store(position + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (s_Sleeping.load(std::memory_order_relaxed))
+            s_Wake.notify_one();
+    }
+
+    /**
+     * @brief Writes a record that could not be queued.
+     *
+     * Once the logger is stopped records are written synchronously, after the
+     * writer drained the ring, otherwise the ring is full and the record is
+     * counted as dropped.
+     *
+     * @param record    The record to write.
+     */
+    void logger::overflow(logrecord* record)
+    {
+        if (s_State.load() == 2)
+        {
+            /* The sinks are not shared with a writer still draining; a sink logging from the writer goes straight through.. */
+            while (!s_Drained.load() && !s_IsWriter)
+                std::this_thread::yield();
+
+            static std::mutex lock;
+            std::lock_guard<std::mutex> guard(lock);
+
+            std::string buffer;
+            writerecord(record, buffer);
+            return;
+        }
+
+        release(record);
+        s_Dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Formats the message held by a record.
+     *
+     * @param record    The record to format.
+     * @param output    The string to append the message to.
+     */
+    void logger::render(const logrecord* record, std::string& output)
+    {
+        xiloader::logformatter::render(record->format, record->payload, record->size, record->argc, output);
+    }
+
+    /**
+     * @brief Attaches a sink to the logger.
+     *
+     * @param sink      The sink to attach.
+     *
+     * @return True on success, false if every sink slot is in use.
+     */
+    bool logger::attach(xiloader::logsink* sink)
+    {
+        std::call_once(s_StartFlag, start);
+
+        for (auto& slot : s_Sinks)
+        {
+            auto expected = static_cast<logsink*>(nullptr);
+            if (slot.compare_exchange_strong(expected, sink))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Detaches a sink after writing every message queued for it.
+     *
+     * @param sink      The sink to detach.
+     */
+    void logger::detach(xiloader::logsink* sink)
+    {
+        flush();
+
+        for (auto& slot : s_Sinks)
+        {
+            auto expected = sink;
+            slot.compare_exchange_strong(expected, nullptr);
+        }
+
+        /* Wait for the writer to finish any record it was handing to the sink.. */
+        flush();
+    }
+
+    /**
+     * @brief Blocks until every message queued before the call has been written.
+     */
+    void logger::flush()
+    {
+        if (s_State.load() != 1 || s_Writer.get_id() == std::this_thread::get_id())
+            return;
+
+        auto target = s_Head.load(std::memory_order_acquire);
+        while (static_cast<int32_t>(s_Tail.load(std::memory_order_acquire) - target) < 0 && s_State.load() == 1)
+        {
+            s_Wake.notify_one();
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief Drains the ring buffer and stops the writer thread.
+     *
+     * Messages pushed afterwards are written synchronously.
+     */
+    void logger::stop()
+    {
+        auto expected = 1;
+        if (!s_State.compare_exchange_strong(expected, 2))
+        {
+            /* Never started; make later messages synchronous.. */
+            expected = 0;
+            if (s_State.compare_exchange_strong(expected, 2))
+                s_Drained.store(true);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(s_WakeLock);
+            s_Wake.notify_one();
+        }
+
+        if (s_Writer.joinable())
+            s_Writer.join();
+    }
+
+    /**
+     * @brief Obtains the number of messages dropped because the ring was full.
+     *
+     * @return The dropped message count.
+     */
+    uint32_t logger::dropped()
+    {
+        return s_Dropped.load();
+    }
+
+}; // namespace xiloader
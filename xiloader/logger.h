@@ -0,0 +1,360 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_LOGGER_H_INCLUDED__
+#define __XILOADER_LOGGER_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "logformat.h"
+
+/* Number of records held by the logger ring buffer (must be a power of two). */
+#define LOGGER_RING_SIZE        4096
+
+/* Number of payload bytes available to the arguments of a single record. */
+#define LOGGER_PAYLOAD_SIZE     200
+
+/* Maximum number of sinks attached to the logger at once. */
+#define LOGGER_MAX_SINKS        4
+
+/* Log level values; usable in preprocessor conditions. */
+#define XILOADER_LEVEL_TRACE    0
+#define XILOADER_LEVEL_DEBUG    1
+#define XILOADER_LEVEL_INFO     2
+#define XILOADER_LEVEL_WARNING  3
+#define XILOADER_LEVEL_ERROR    4
+
+/* Lowest level compiled into the loader; calls below it generate no code. */
+#ifndef XILOADER_LOG_LEVEL
+#ifdef _DEBUG
+#define XILOADER_LOG_LEVEL      XILOADER_LEVEL_DEBUG
+#else
+#define XILOADER_LOG_LEVEL      XILOADER_LEVEL_INFO
+#endif
+#endif
+
+namespace xiloader
+{
+    /**
+     * @brief Log level enumeration.
+     */
+    enum class loglevel : uint8_t
+    {
+        trace = XILOADER_LEVEL_TRACE,
+        debug = XILOADER_LEVEL_DEBUG,
+        info = XILOADER_LEVEL_INFO,
+        warning = XILOADER_LEVEL_WARNING,
+        error = XILOADER_LEVEL_ERROR
+    };
+
+    /**
+     * @brief Single entry within the logger ring buffer.
+     *
+     * The payload holds the raw arguments of the message, each one prefixed
+     * with its logarg tag. Strings are copied inline (uint16 length + bytes)
+     * so the caller's buffers may be released as soon as the call returns.
+     */
+    struct logrecord
+    {
+        std::atomic<uint32_t> sequence;
+        int64_t timestamp;
+        const char* format;
+        uint16_t color;
+        uint8_t argc;
+        uint8_t level;
+        uint16_t size;
+        uint8_t payload[LOGGER_PAYLOAD_SIZE];
+    };
+
+    /**
+     * @brief Destination for records drained from the logger ring.
+     */
+    class logsink
+    {
+    public:
+        logsink(loglevel threshold, bool text)
+            : Threshold(static_cast<uint8_t>(threshold)), Text(text)
+        {}
+
+        virtual ~logsink() {}
+
+        /**
+         * @brief Writes a single record.
+         *
+         * @param record    The record to write.
+         * @param message   The formatted message; empty for sinks that do not want text.
+         */
+        virtual void write(const logrecord* record, const std::string& message) = 0;
+
+        std::atomic<uint8_t> Threshold; // Lowest level written by this sink.
+        const bool Text; // Does the sink need the formatted message?
+    };
+
+    /**
+     * @brief Serializes variadic log arguments into a record payload.
+     */
+    class logpacker
+    {
+        logrecord* m_Record;
+
+        void put(logarg tag, const void* data, size_t length)
+        {
+            if (m_Record->size + 1 + length > LOGGER_PAYLOAD_SIZE)
+                return;
+
+            m_Record->payload[m_Record->size++] = static_cast<uint8_t>(tag);
+            memcpy(m_Record->payload + m_Record->size, data, length);
+            m_Record->size += static_cast<uint16_t>(length);
+            m_Record->argc++;
+        }
+
+        template<typename T>
+        void pack_integral(T value, std::true_type /* signed */)
+        {
+            if (sizeof(T) <= 4)
+            {
+                int32_t v = static_cast<int32_t>(value);
+                put(logarg::int32, &v, sizeof(v));
+            }
+            else
+            {
+                int64_t v = static_cast<int64_t>(value);
+                put(logarg::int64, &v, sizeof(v));
+            }
+        }
+
+        template<typename T>
+        void pack_integral(T value, std::false_type /* unsigned */)
+        {
+            if (sizeof(T) <= 4)
+            {
+                uint32_t v = static_cast<uint32_t>(value);
+                put(logarg::uint32, &v, sizeof(v));
+            }
+            else
+            {
+                uint64_t v = static_cast<uint64_t>(value);
+                put(logarg::uint64, &v, sizeof(v));
+            }
+        }
+
+        template<typename T>
+        void pack_one(T value, std::true_type /* arithmetic */)
+        {
+            pack_arithmetic(value, std::is_floating_point<T>());
+        }
+
+        template<typename T>
+        void pack_one(T value, std::false_type /* pointer / enum */)
+        {
+            pack_other(value, std::is_enum<T>());
+        }
+
+        template<typename T>
+        void pack_arithmetic(T value, std::true_type /* floating */)
+        {
+            double v = static_cast<double>(value);
+            put(logarg::float64, &v, sizeof(v));
+        }
+
+        template<typename T>
+        void pack_arithmetic(T value, std::false_type /* integral */)
+        {
+            pack_integral(value, std::is_signed<T>());
+        }
+
+        template<typename T>
+        void pack_other(T value, std::true_type /* enum */)
+        {
+            typedef typename std::underlying_type<T>::type underlying;
+            pack_integral(static_cast<underlying>(value), std::is_signed<underlying>());
+        }
+
+        template<typename T>
+        void pack_other(T value, std::false_type /* pointer */)
+        {
+            uint64_t v = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value));
+            put(logarg::pointer, &v, sizeof(v));
+        }
+
+        void pack_string(const char* value);
+
+    public:
+        explicit logpacker(logrecord* record)
+            : m_Record(record)
+        {
+            m_Record->argc = 0;
+            m_Record->size = 0;
+        }
+
+        void pack() {}
+
+        template<typename T, typename... Args>
+        void pack(T value, Args... args)
+        {
+            pack_one(value, std::is_arithmetic<T>());
+            pack(args...);
+        }
+
+        template<typename... Args>
+        void pack(char* value, Args... args)
+        {
+            pack_string(value);
+            pack(args...);
+        }
+
+        template<typename... Args>
+        void pack(const char* value, Args... args)
+        {
+            pack_string(value);
+            pack(args...);
+        }
+    };
+
+    /**
+     * @brief Asynchronous console logger.
+     *
+     * Callers claim a slot in a lock-free multi-producer ring buffer, store the
+     * timestamp, color and raw arguments of the message and return immediately.
+     * A single background thread formats the records and writes them out.
+     */
+    class logger
+    {
+        /**
+         * @brief Claims a free record within the ring buffer.
+         *
+         * @param position  Receives the ring position of the claimed record.
+         *
+         * @return The claimed record, nullptr if the ring is full or the logger is stopped.
+         */
+        static logrecord* claim(uint32_t* position);
+
+        /**
+         * @brief Publishes a claimed record to the writer thread.
+         *
+         * @param record    The record to publish.
+         * @param position  The ring position returned by claim.
+         */
+        static void commit(logrecord* record, uint32_t position);
+
+        /**
+         * @brief Writes a record that could not be queued.
+         *
+         * @param record    The record to write.
+         */
+        static void overflow(logrecord* record);
+
+    public:
+
+        /**
+         * @brief Queues a message for the writer thread.
+         *
+         * Only the raw arguments are captured; formatting is deferred until a
+         * sink that wants text receives the record.
+         *
+         * @param level     The level of the message.
+         * @param color     The console color to print the message with.
+         * @param format    The format of the message to print.
+         * @param args      The arguments to fill the format.
+         */
+        template<typename... Args>
+        static void push(xiloader::loglevel level, uint16_t color, char const* format, Args... args)
+        {
+            uint32_t position = 0;
+            logrecord local;
+
+            auto record = claim(&position);
+            auto queued = record != nullptr;
+            if (!queued)
+                record = &local;
+
+            record->timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            record->format = format;
+            record->color = color;
+            record->level = static_cast<uint8_t>(level);
+
+            logpacker packer(record);
+            packer.pack(args...);
+
+            if (queued)
+                commit(record, position);
+            else
+                overflow(record);
+        }
+
+        /**
+         * @brief Formats the message held by a record.
+         *
+         * @param record    The record to format.
+         * @param output    The string to append the message to.
+         */
+        static void render(const logrecord* record, std::string& output);
+
+        /**
+         * @brief Attaches a sink to the logger.
+         *
+         * @param sink      The sink to attach.
+         *
+         * @return True on success, false if every sink slot is in use.
+         */
+        static bool attach(xiloader::logsink* sink);
+
+        /**
+         * @brief Detaches a sink after writing every message queued for it.
+         *
+         * @param sink      The sink to detach.
+         */
+        static void detach(xiloader::logsink* sink);
+
+        /**
+         * @brief Blocks until every message queued before the call has been written.
+         */
+        static void flush();
+
+        /**
+         * @brief Drains the ring buffer and stops the writer thread.
+         *
+         * Messages pushed afterwards are written synchronously.
+         */
+        static void stop();
+
+        /**
+         * @brief Obtains the number of messages dropped because the ring was full.
+         *
+         * @return The dropped message count.
+         */
+        static uint32_t dropped();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_LOGGER_H_INCLUDED__
@@ -24,172 +24,26 @@ This file is part of DarkStar-server source code.
 #include "defines.h"
 
 #include "console.h"
+#include "datcache.h"
+#include "datmanifest.h"
+#include "datsync.h"
+#include "diagnostics.h"
+#include "flightrecorder.h"
 #include "functions.h"
+#include "loader.h"
+#include "logfile.h"
+#include "nattable.h"
 #include "network.h"
+#include "prefetcher.h"
+#include "scheduler.h"
+#include "serverlist.h"
+#include "session.h"
+#include "supervisor.h"
+#include "udprelay.h"
+#include "zonetrace.h"
 
-/* Global Variables */
-xiloader::Language g_Language = xiloader::Language::English; // The language of the loader to be used for polcore.
-std::string g_ServerAddress = "127.0.0.1"; // The server address to connect to.
-std::string g_ServerPort = "51220"; // The server lobby server port to connect to.
-std::string g_Username = ""; // The username being logged in with.
-std::string g_Password = ""; // The password being logged in with.
-std::string g_NewPassword = ""; // The password for resetting.
-std::string g_ConfirmPassword = ""; // The password for confirmation.
-std::string g_Email = ""; // The email address.
-std::string g_SecurityQuestionAnswer = ""; // The security question answer
-std::string g_SecurityQuestionID = ""; // Security question id
-UINT32 g_SecurityQuestionIDRecieved = 0; // Security question id recieved
-char* g_CharacterList = NULL; // Pointer to the character list data being sent from the server.
-bool g_IsRunning = false; // Flag to determine if the network threads should hault.
-bool g_Hide = false; // Determines whether or not to hide the console window after FFXI starts.
-bool g_Silent = false; // Should we log connection info on reset?
-
-/* Hairpin Fix Variables */
-DWORD g_NewServerAddress; // Hairpin server address to be overriden with.
-DWORD g_HairpinReturnAddress; // Hairpin return address to allow the code cave to return properly.
-
-/**
- * @brief Detour function definitions.
- */
-extern "C"
-{
-    hostent* (WINAPI __stdcall * Real_gethostbyname)(const char* name) = gethostbyname;
-}
-
-/**
- * @brief Hairpin fix codecave.
- */
-__declspec(naked) void HairpinFixCave(void)
-{
-    __asm mov eax, g_NewServerAddress
-    __asm mov [edx + 0x012E90], eax
-    __asm mov [edx], eax
-    __asm jmp g_HairpinReturnAddress
-}
-
-/**
- * @brief Applies the hairpin fix modifications.
- *
- * @param lpParam       Thread param object.
- *
- * @return Non-important return.
- */
-DWORD ApplyHairpinFixThread(LPVOID lpParam)
-{
-    UNREFERENCED_PARAMETER(lpParam);
-
-    do
-    {
-        /* Sleep until we find FFXiMain loaded.. */
-        Sleep(100);
-    } while (GetModuleHandleA("FFXiMain.dll") == NULL);
-
-    /* Convert server address.. */
-    xiloader::network::ResolveHostname(g_ServerAddress.c_str(), &g_NewServerAddress);
-
-    // Locate the main hairpin location..
-    //
-    // As of 07.08.2013:
-    //      8B 82 902E0100        - mov eax, [edx+00012E90]
-    //      89 02                 - mov [edx], eax <-- edit this
-
-    auto hairpinAddress = (DWORD)xiloader::functions::FindPattern("FFXiMain.dll", (BYTE*)"\x8B\x82\xFF\xFF\xFF\xFF\x89\x02\x8B\x0D", "xx????xxxx");
-    if (hairpinAddress == 0)
-    {
-        xiloader::console::output(xiloader::color::error, "Failed to locate main hairpin hack address!");
-        return 0;
-    }
-
-    // Locate zoning IP change address..
-    // 
-    // As of 07.08.2013
-    //      74 08                 - je FFXiMain.dll+E5E72
-    //      8B 0D 68322B03        - mov ecx, [FFXiMain.dll+463268]
-    //      89 01                 - mov [ecx], eax <-- edit this
-    //      8B 46 0C              - mov eax, [esi+0C]
-    //      85 C0                 - test eax, eax
-
-    auto zoneChangeAddress = (DWORD)xiloader::functions::FindPattern("FFXiMain.dll", (BYTE*)"\x8B\x0D\xFF\xFF\xFF\xFF\x89\x01\x8B\x46", "xx????xxxx");
-    if (zoneChangeAddress == 0)
-    {
-        xiloader::console::output(xiloader::color::error, "Failed to locate zone change hairpin address!");
-        return 0;
-    }
-
-    /* Apply the hairpin fix.. */
-    auto caveDest = ((int)HairpinFixCave - ((int)hairpinAddress)) - 5;
-    g_HairpinReturnAddress = hairpinAddress + 0x08;
-
-    *(BYTE*)(hairpinAddress + 0x00) = 0xE9; // jmp
-    *(UINT*)(hairpinAddress + 0x01) = caveDest;
-    *(BYTE*)(hairpinAddress + 0x05) = 0x90; // nop
-    *(BYTE*)(hairpinAddress + 0x06) = 0x90; // nop
-    *(BYTE*)(hairpinAddress + 0x07) = 0x90; // nop
-
-    /* Apply zone ip change patch.. */
-    memset((LPVOID)(zoneChangeAddress + 0x06), 0x90, 2);
-
-    xiloader::console::output(xiloader::color::success, "Hairpin fix applied!");
-    return 0;
-}
-
-/**
- * @brief gethostbyname detour callback.
- *
- * @param name      The hostname to obtain information of.
- *
- * @return Hostname information object.
- */
-hostent* __stdcall Mine_gethostbyname(const char* name)
-{
-	if (!g_Silent)
-	{
-		xiloader::console::output(xiloader::color::debug, "Resolving host: %s", name);
-	}
-
-    if (!strcmp("ffxi00.pol.com", name))
-        return Real_gethostbyname(g_ServerAddress.c_str());
-    if (!strcmp("pp000.pol.com", name))
-        return Real_gethostbyname("127.0.0.1");
-
-    return Real_gethostbyname(name);
-}
-
-/**
- * @brief Locates the INET mutex function call inside of polcore.dll
- *
- * @return The pointer to the function call.
- */
-inline DWORD FindINETMutex(void)
-{
-    const char* module = (g_Language == xiloader::Language::European) ? "polcoreeu.dll" : "polcore.dll";
-    auto result = (DWORD)xiloader::functions::FindPattern(module, (BYTE*)"\x8B\x56\x2C\x8B\x46\x28\x8B\x4E\x24\x52\x50\x51", "xxxxxxxxxxxx");
-    return (*(DWORD*)(result - 4) + (result));
-}
-
-/**
- * @brief Locates the PlayOnline connection object inside of polcore.dll
- *
- * @return Pointer to the pol connection object.
- */
-inline DWORD FindPolConn(void)
-{
-    const char* module = (g_Language == xiloader::Language::European) ? "polcoreeu.dll" : "polcore.dll";
-    auto result = (DWORD)xiloader::functions::FindPattern(module, (BYTE*)"\x81\xC6\x38\x03\x00\x00\x83\xC4\x04\x81\xFE", "xxxxxxxxxxx");
-    return (*(DWORD*)(result - 10));
-}
-
-/**
- * @brief Locates the current character information block.
- *
- * @return Pointer to the character information table.
- */
-inline LPVOID FindCharacters(void** commFuncs)
-{
-    LPVOID lpCharTable = NULL;
-    memcpy(&lpCharTable, (char*)commFuncs[0xD3] + 31, sizeof(lpCharTable));
-    return lpCharTable;
-}
+/* Determines whether or not to hide the console window after FFXI starts. */
+extern bool g_Hide;
 
 /**
  * @brief Main program entrypoint.
@@ -202,6 +56,20 @@ inline LPVOID FindCharacters(void** commFuncs)
 int __cdecl main(int argc, char* argv[])
 {
     bool bUseHairpinFix = false;
+    bool bRelaunch = false;
+    bool bCheck = false;
+    int instances = 0;
+    int relayPort = 0;
+    int exitCode = XILOADER_EXIT_SUCCESS;
+    xiloader::binarysink logfile;
+    const char* flightPath = nullptr;
+    const char* prefetchPath = nullptr;
+    const char* verifyManifest = nullptr;
+    const char* syncMirror = nullptr;
+    std::vector<std::string> servers;
+    xiloader::udprelay relay;
+
+    xiloader::session session;
 
     /* Output the DarkStar banner.. */
     xiloader::console::output(xiloader::color::lightred, "==========================================================");
@@ -210,68 +78,69 @@ int __cdecl main(int argc, char* argv[])
     xiloader::console::output(xiloader::color::lightpurple, "Git Repo   : https://github.com/DarkstarProject/darkstar");
     xiloader::console::output(xiloader::color::lightred, "==========================================================");
 
-    /* Initialize Winsock */
-    WSADATA wsaData = { 0 };
-    auto ret = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (ret != 0)
-    {
-        xiloader::console::output(xiloader::color::error, "Failed to initialize winsock, error code: %d", ret);
-        return 1;
-    }
-
-    /* Initialize COM */
-    auto hResult = CoInitialize(NULL);
-    if (hResult != S_OK && hResult != S_FALSE)
-    {
-        /* Cleanup Winsock */
-        WSACleanup();
-
-        xiloader::console::output(xiloader::color::error, "Failed to initialize COM, error code: %d", hResult);
-        return 1;
-    }
-
-    /* Attach detour for gethostbyname.. */
-    DetourTransactionBegin();
-    DetourUpdateThread(GetCurrentThread());
-    DetourAttach(&(PVOID&)Real_gethostbyname, Mine_gethostbyname);
-    if (DetourTransactionCommit() != NO_ERROR)
-    {
-        /* Cleanup COM and Winsock */
-        CoUninitialize();
-        WSACleanup();
-
-        xiloader::console::output(xiloader::color::error, "Failed to detour function 'gethostbyname'. Cannot continue!");
-        return 1;
-    }
+    /* Initialize Winsock, COM and the resolver detours.. */
+    if (!xiloader::loader::Initialize())
+        return XILOADER_EXIT_ERROR;
 
     /* Read Command Arguments */
     for (auto x = 1; x < argc; ++x)
     {
-        /* Server Address Argument */
+        /* Environment Check Argument; probes the registry, DirectPlay and the server instead of starting the game */
+        if (!_strnicmp(argv[x], "--check", 7))
+        {
+            bCheck = true;
+            continue;
+        }
+
+        /* Server List File Argument */
+        if (!_strnicmp(argv[x], "--serverlist", 12))
+        {
+            if (!xiloader::serverlist::load(argv[++x], servers))
+                XILOADER_WARNING("Failed to read server list: %s", argv[x]);
+            continue;
+        }
+
+        /* Server Address Argument; may be repeated */
         if (!_strnicmp(argv[x], "--server", 8))
         {
-            g_ServerAddress = argv[++x];
+            servers.push_back(argv[++x]);
             continue;
         }
 
         /* Server Port Argument */
         if (!_strnicmp(argv[x], "--port", 6))
         {
-            g_ServerPort = argv[++x];
+            session.ServerPort = argv[++x];
             continue;
         }
 
         /* Username Argument */
         if (!_strnicmp(argv[x], "--user", 6))
         {
-            g_Username = argv[++x];
+            session.Username = argv[++x];
             continue;
         }
 
         /* Password Argument */
         if (!_strnicmp(argv[x], "--pass", 6))
         {
-            g_Password = argv[++x];
+            session.Password = argv[++x];
+            continue;
+        }
+
+        /* Headless Login Argument */
+        if (!_strnicmp(argv[x], "--headless", 10))
+        {
+            session.Headless = true;
+            continue;
+        }
+
+        /* Credentials File Argument; implies a headless login */
+        if (!_strnicmp(argv[x], "--credfile", 10))
+        {
+            session.Headless = true;
+            if (!xiloader::network::LoadCredentials(&session, argv[++x]))
+                XILOADER_WARNING("Failed to read credentials: %s", argv[x]);
             continue;
         }
 
@@ -281,15 +150,45 @@ int __cdecl main(int argc, char* argv[])
             std::string language = argv[++x];
 
             if (!_strnicmp(language.c_str(), "JP", 2) || !_strnicmp(language.c_str(), "0", 1))
-                g_Language = xiloader::Language::Japanese;
+                session.Language = xiloader::Language::Japanese;
             if (!_strnicmp(language.c_str(), "US", 2) || !_strnicmp(language.c_str(), "1", 1))
-                g_Language = xiloader::Language::English;
+                session.Language = xiloader::Language::English;
             if (!_strnicmp(language.c_str(), "EU", 2) || !_strnicmp(language.c_str(), "2", 1))
-                g_Language = xiloader::Language::European;
+                session.Language = xiloader::Language::European;
 
             continue;
         }
 
+        /* Warm Relaunch Argument */
+        if (!_strnicmp(argv[x], "--relaunch", 10))
+        {
+            bRelaunch = true;
+            continue;
+        }
+
+        /* NAT Mapping File Argument */
+        if (!_strnicmp(argv[x], "--natmap", 8))
+        {
+            if (!xiloader::nattable::load(argv[++x]))
+                XILOADER_WARNING("Failed to read NAT mappings: %s", argv[x]);
+            continue;
+        }
+
+        /* NAT Mapping Argument; may be repeated, e.g. --nat 203.0.113.5=192.168.1.20 */
+        if (!_strnicmp(argv[x], "--nat", 5))
+        {
+            if (!xiloader::nattable::add(argv[++x]))
+                XILOADER_WARNING("Ignoring NAT mapping: %s", argv[x]);
+            continue;
+        }
+
+        /* UDP Relay Argument; relays the game traffic of other clients on this port to the server */
+        if (!_strnicmp(argv[x], "--udprelay", 10))
+        {
+            relayPort = atoi(argv[++x]);
+            continue;
+        }
+
         /* Hairpin Argument */
         if (!_strnicmp(argv[x], "--hairpin", 9))
         {
@@ -297,6 +196,13 @@ int __cdecl main(int argc, char* argv[])
             continue;
         }
 
+        /* Zone Trace Argument; times every zone change */
+        if (!_strnicmp(argv[x], "--zonetrace", 11))
+        {
+            xiloader::zonetrace::enable(true);
+            continue;
+        }
+
         /* Hide Argument */
         if (!_strnicmp(argv[x], "--hide", 6))
         {
@@ -304,121 +210,191 @@ int __cdecl main(int argc, char* argv[])
             continue;
         }
 
-        xiloader::console::output(xiloader::color::warning, "Found unknown command argument: %s", argv[x]);
+        /* Binary Log Argument */
+        if (!_strnicmp(argv[x], "--logfile", 9))
+        {
+            if (!logfile.open(argv[++x]) || !xiloader::logger::attach(&logfile))
+                XILOADER_WARNING("Failed to open binary log: %s", argv[x]);
+            continue;
+        }
+
+        /* Multi-Instance Argument */
+        if (!_strnicmp(argv[x], "--instances", 11))
+        {
+            instances = atoi(argv[++x]);
+            continue;
+        }
+
+        /* Supervised Client Argument; the supervisor hosts the lobby server */
+        if (!_strnicmp(argv[x], "--nolobby", 9))
+        {
+            session.UseLobby = false;
+            continue;
+        }
+
+        /* DAT Cache Size Argument; in megabytes, 0 disables the cache */
+        if (!_strnicmp(argv[x], "--datcache", 10))
+        {
+            xiloader::datcache::capacity(static_cast<uint32_t>(atoi(argv[++x])));
+            continue;
+        }
+
+        /* Installation Check Argument; verifies the DAT files against a manifest instead of starting the game */
+        if (!_strnicmp(argv[x], "--verify-install", 16))
+        {
+            verifyManifest = argv[++x];
+            continue;
+        }
+
+        /* Mirror Sync Argument; updates the DAT files from a LAN mirror instead of starting the game */
+        if (!_strnicmp(argv[x], "--sync", 6))
+        {
+            syncMirror = argv[++x];
+            continue;
+        }
+
+        /* Prefetch Trace Database Argument */
+        if (!_strnicmp(argv[x], "--prefetch", 10))
+        {
+            prefetchPath = argv[++x];
+            continue;
+        }
+
+        /* Flight Recorder Argument */
+        if (!_strnicmp(argv[x], "--flight", 8))
+        {
+            flightPath = argv[++x];
+            continue;
+        }
+
+        XILOADER_WARNING("Found unknown command argument: %s", argv[x]);
     }
 
-    /* Attempt to resolve the server address.. */
+    /* Start the flight recorder; it is kept for post-mortem analysis unless we exit cleanly.. */
+    if (xiloader::flightrecorder::open(flightPath))
+        xiloader::flightrecorder::record(xiloader::flightevent::patch, xiloader::loader::DetourTarget(), "gethostbyname detour");
+    else
+        XILOADER_WARNING("Failed to create the flight recorder.");
+
+    /* Load the zone load traces the DAT prefetcher learned in earlier sessions.. */
+    if (!xiloader::prefetcher::open(prefetchPath))
+        XILOADER_WARNING("Failed to read the prefetch traces; starting over.");
+
+    /* Probe the servers when several were given; the fastest one is used.. */
+    std::vector<xiloader::serverprobe> ranked;
+    if (servers.size() > 1)
+        xiloader::serverlist::rank(servers, "54231", ranked);
+    if (!ranked.empty())
+        session.ServerAddress = ranked.front().Address;
+    else if (!servers.empty())
+        session.ServerAddress = servers.front();
+
+    /* Check the environment or the installation instead of starting the game when asked.. */
     ULONG ulAddress = 0;
-    if (xiloader::network::ResolveHostname(g_ServerAddress.c_str(), &ulAddress))
+    if (bCheck)
+    {
+        exitCode = xiloader::diagnostics::run(&session);
+    }
+
+    else if (verifyManifest != nullptr)
+    {
+        char folder[MAX_PATH];
+        xiloader::functions::GetRegistryFFXIInstallFolder(session.Language, folder, sizeof(folder));
+        if (xiloader::datmanifest::check(folder, verifyManifest) != 0)
+            exitCode = XILOADER_EXIT_ERROR;
+    }
+
+    /* Bring the installation up to date with a mirror instead of starting the game when asked.. */
+    else if (syncMirror != nullptr)
+    {
+        char folder[MAX_PATH];
+        xiloader::functions::GetRegistryFFXIInstallFolder(session.Language, folder, sizeof(folder));
+        if (xiloader::datsync::run(syncMirror, folder) != 0)
+            exitCode = XILOADER_EXIT_ERROR;
+    }
+
+    /* Headless mode never falls back to prompting for missing credentials.. */
+    else if (session.Headless && instances == 0 && (session.Username.empty() || session.Password.empty()))
+    {
+        XILOADER_ERROR("Headless login requires --user and --pass, or --credfile.");
+        exitCode = XILOADER_EXIT_CREDENTIALS;
+    }
+
+    /* Attempt to resolve the server address.. */
+    else if (xiloader::network::ResolveHostname(session.ServerAddress.c_str(), &ulAddress))
     {
-        g_ServerAddress = inet_ntoa(*((struct in_addr*)&ulAddress));
+        session.ServerAddress = inet_ntoa(*((struct in_addr*)&ulAddress));
+
+        /* Relay the zone traffic of clients that cannot reach the server themselves.. */
+        if (relayPort > 0 && relayPort <= 0xFFFF)
+        {
+            if (relay.open(INADDR_ANY, static_cast<uint16_t>(relayPort), ulAddress, static_cast<uint16_t>(relayPort)))
+                xiloader::console::output(xiloader::color::info, "Relaying UDP port %d to %s.", relayPort, session.ServerAddress.c_str());
+            else
+                XILOADER_WARNING("Failed to open UDP relay port %d.", relayPort);
+        }
+
+        /* Launch and supervise several clients if requested.. */
+        if (instances > 0)
+        {
+            exitCode = xiloader::supervisor::run(&session, instances, argc, argv);
+        }
 
         /* Attempt to create socket to server..*/
-        xiloader::datasocket sock;
-        if (xiloader::network::CreateConnection(&sock, "54231"))
+        else if (!xiloader::serverlist::connect(&session, ranked))
         {
+            exitCode = XILOADER_EXIT_CONNECT;
+        }
+
+        /* Log in straight away with the supplied credentials when headless.. */
+        else if (session.Headless && (exitCode = xiloader::network::LoginHeadless(&session)) != XILOADER_EXIT_SUCCESS)
+        {
+            XILOADER_ERROR("Headless login failed; exiting with code %d.", exitCode);
+        }
+        else
+        {
+            /* Pre-warm the next account server connection while the user is at the menu.. */
+            if (!session.Headless)
+                session.AccountPool.open(session.ServerAddress, "54231");
+
+            /* Read the PlayOnline registry settings while the user logs in.. */
+            xiloader::loader::Preload(session.Language);
+
             /* Attempt to verify the users account info.. */
-            while (!xiloader::network::VerifyAccount(&sock))
+            while (!session.Headless && !xiloader::network::VerifyAccount(&session))
                 Sleep(10);
+            session.AccountPool.close();
 
-            /* Start hairpin hack thread if required.. */
-            if (bUseHairpinFix)
-            {
-                CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ApplyHairpinFixThread, NULL, 0, NULL);
-            }
-
-            /* Create listen servers.. */
-            g_IsRunning = true;
-            HANDLE hFFXiServer = CreateThread(NULL, 0, xiloader::network::FFXiServer, &sock, 0, NULL);
-            HANDLE hPolServer = CreateThread(NULL, 0, xiloader::network::PolServer, NULL, 0, NULL);
-
-            /* Attempt to create polcore instance..*/
-            IPOLCoreCom* polcore = NULL;
-            if (CoCreateInstance(xiloader::CLSID_POLCoreCom[g_Language], NULL, 0x17, xiloader::IID_IPOLCoreCom[g_Language], (LPVOID*)&polcore) != S_OK)
-            {
-                xiloader::console::output(xiloader::color::error, "Failed to initialize instance of polcore!");
-            }
-            else
-            {
-                /* Invoke the setup functions for polcore.. */
-                polcore->SetAreaCode(g_Language);
-                polcore->SetParamInit(GetModuleHandle(NULL), " /game eAZcFcB -net 3");
-
-                /* Obtain the common function table.. */
-                void * (**lpCommandTable)(...);
-                polcore->GetCommonFunctionTable((unsigned long**)&lpCommandTable);
-
-                /* Invoke the inet mutex function.. */
-                auto findMutex = (void * (*)(...))FindINETMutex();
-                findMutex();
-
-                /* Locate and prepare the pol connection.. */
-                auto polConnection = (char*)FindPolConn();
-                memset(polConnection, 0x00, 0x68);
-                auto enc = (char*)malloc(0x1000);
-                memset(enc, 0x00, 0x1000);
-                memcpy(polConnection + 0x48, &enc, sizeof(char**));
-
-                /* Locate the character storage buffer.. */
-                g_CharacterList = (char*)FindCharacters((void **)lpCommandTable);
-
-                /* Invoke the setup functions for polcore.. */
-                lpCommandTable[POLFUNC_REGISTRY_LANG](g_Language);
-                lpCommandTable[POLFUNC_FFXI_LANG](xiloader::functions::GetRegistryPlayOnlineLanguage(g_Language));
-                lpCommandTable[POLFUNC_REGISTRY_KEY](xiloader::functions::GetRegistryPlayOnlineKey(g_Language));
-                lpCommandTable[POLFUNC_INSTALL_FOLDER](xiloader::functions::GetRegistryPlayOnlineInstallFolder(g_Language));
-                lpCommandTable[POLFUNC_INET_MUTEX]();
-
-                /* Attempt to create FFXi instance..*/
-                IFFXiEntry* ffxi = NULL;
-                if (CoCreateInstance(xiloader::CLSID_FFXiEntry, NULL, 0x17, xiloader::IID_IFFXiEntry, (LPVOID*)&ffxi) != S_OK)
-                {
-                    xiloader::console::output(xiloader::color::error, "Failed to initialize instance of FFxi!");
-                }
-                else
-                {
-                    /* Attempt to start Final Fantasy.. */
-                    IUnknown* message = NULL;
-                    xiloader::console::hide();
-                    ffxi->GameStart(polcore, &message);
-                    xiloader::console::show();
-                    ffxi->Release();
-                }
-
-                /* Cleanup polcore object.. */
-                if (polcore != NULL)
-                    polcore->Release();
-            }
-
-            /* Cleanup threads.. */
-            g_IsRunning = false;    
-            TerminateThread(hFFXiServer, 0);
-            TerminateThread(hPolServer, 0);
-
-            WaitForSingleObject(hFFXiServer, 1000);
-            WaitForSingleObject(hPolServer, 1000);
-
-            CloseHandle(hFFXiServer);
-            CloseHandle(hPolServer);
+            /* Run the game until it closes.. */
+            exitCode = xiloader::loader::Launch(&session, bUseHairpinFix, bRelaunch);
         }
     }
     else
     {
-        xiloader::console::output(xiloader::color::error, "Failed to resolve server hostname.");
+        XILOADER_ERROR("Failed to resolve server hostname.");
+        exitCode = XILOADER_EXIT_CONNECT;
+    }
+
+    /* Stop the UDP relay before Winsock goes away.. */
+    xiloader::udprelaystats relayStats;
+    relay.stats(&relayStats);
+    relay.close();
+    if (relayStats.Packets > 0)
+    {
+        XILOADER_DEBUG(xiloader::color::debug, "UDP relay: %lld datagrams, %lld dropped, %.1f us average, %.1f us max.", static_cast<int64_t>(relayStats.Packets),
+            static_cast<int64_t>(relayStats.Dropped), relayStats.LatencyTotal / 1000.0 / relayStats.Packets, relayStats.LatencyMax / 1000.0);
     }
 
-    /* Detach detour for gethostbyname. */
-    DetourTransactionBegin();
-    DetourUpdateThread(GetCurrentThread());
-    DetourDetach(&(PVOID&)Real_gethostbyname, Mine_gethostbyname);
-    DetourTransactionCommit();
+    /* Finish the background jobs; they may still use the session and sockets.. */
+    xiloader::scheduler::stop();
+    xiloader::prefetcher::close();
 
-    /* Cleanup COM and Winsock */
-    CoUninitialize();
-    WSACleanup();
+    /* Detach the detour and cleanup COM and Winsock.. */
+    xiloader::loader::Uninitialize();
 
     xiloader::console::output(xiloader::color::error, "Closing...");
-    Sleep(2000);
+    xiloader::flightrecorder::close(flightPath != nullptr);
+    xiloader::logger::detach(&logfile);
 
-    return ERROR_SUCCESS;
+    return exitCode;
 }
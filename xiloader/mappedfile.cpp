@@ -0,0 +1,271 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace xiloader
+{
+    mappedfile::mappedfile()
+        : m_Data(nullptr), m_Size(0), m_Writable(false),
+#ifdef _WIN32
+        m_File(INVALID_HANDLE_VALUE), m_Mapping(nullptr)
+#else
+        m_File(-1)
+#endif
+    {}
+
+    mappedfile::~mappedfile()
+    {
+        close();
+    }
+
+#ifdef _WIN32
+
+    /**
+     * @brief Maps an open file handle.
+     *
+     * @param file      The file handle to map.
+     * @param size      The size of the mapping, 0 for the whole file.
+     * @param writable  "true" to map the file for writing, "false" for read-only.
+     * @param mapping   Receives the file mapping handle.
+     * @param data      Receives the start of the mapped view.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool map(HANDLE file, size_t size, bool writable, HANDLE* mapping, uint8_t** data)
+    {
+        *mapping = ::CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, static_cast<DWORD>(size), NULL);
+        if (*mapping == NULL)
+            return false;
+
+        *data = static_cast<uint8_t*>(::MapViewOfFile(*mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+        if (*data == nullptr)
+        {
+            ::CloseHandle(*mapping);
+            *mapping = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Creates (or truncates) a file of the given size and maps it writable.
+     *
+     * @param path      The path of the file to create.
+     * @param size      The size of the file in bytes.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool mappedfile::create(const char* path, size_t size)
+    {
+        close();
+
+        m_File = ::CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_File == INVALID_HANDLE_VALUE)
+            return false;
+
+        HANDLE mapping = NULL;
+        if (!map(m_File, size, true, &mapping, &m_Data))
+        {
+            close();
+            return false;
+        }
+
+        m_Mapping = mapping;
+        m_Size = size;
+        m_Writable = true;
+        return true;
+    }
+
+    /**
+     * @brief Maps an existing file.
+     *
+     * @param path      The path of the file to map.
+     * @param writable  "true" to map the file for writing, "false" for read-only.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool mappedfile::open(const char* path, bool writable)
+    {
+        close();
+
+        m_File = ::CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_File == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(m_File, &size) || size.QuadPart == 0 || static_cast<uint64_t>(size.QuadPart) > SIZE_MAX)
+        {
+            close();
+            return false;
+        }
+
+        HANDLE mapping = NULL;
+        if (!map(m_File, 0, writable, &mapping, &m_Data))
+        {
+            close();
+            return false;
+        }
+
+        m_Mapping = mapping;
+        m_Size = static_cast<size_t>(size.QuadPart);
+        m_Writable = writable;
+        return true;
+    }
+
+    /**
+     * @brief Unmaps and closes the file.
+     */
+    void mappedfile::close()
+    {
+        if (m_Data != nullptr)
+            ::UnmapViewOfFile(m_Data);
+        if (m_Mapping != nullptr)
+            ::CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            ::CloseHandle(m_File);
+
+        m_Data = nullptr;
+        m_Mapping = nullptr;
+        m_File = INVALID_HANDLE_VALUE;
+        m_Size = 0;
+    }
+
+    /**
+     * @brief Asks the system to write dirty pages back to the file.
+     */
+    void mappedfile::flush()
+    {
+        if (m_Data != nullptr && m_Writable)
+            ::FlushViewOfFile(m_Data, m_Size);
+    }
+
+#else
+
+    /**
+     * @brief Creates (or truncates) a file of the given size and maps it writable.
+     *
+     * @param path      The path of the file to create.
+     * @param size      The size of the file in bytes.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool mappedfile::create(const char* path, size_t size)
+    {
+        close();
+
+        m_File = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (m_File < 0)
+            return false;
+
+        if (::ftruncate(m_File, static_cast<off_t>(size)) != 0)
+        {
+            close();
+            return false;
+        }
+
+        auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0);
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+
+        m_Data = static_cast<uint8_t*>(data);
+        m_Size = size;
+        m_Writable = true;
+        return true;
+    }
+
+    /**
+     * @brief Maps an existing file.
+     *
+     * @param path      The path of the file to map.
+     * @param writable  "true" to map the file for writing, "false" for read-only.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool mappedfile::open(const char* path, bool writable)
+    {
+        close();
+
+        m_File = ::open(path, writable ? O_RDWR : O_RDONLY);
+        if (m_File < 0)
+            return false;
+
+        struct stat info;
+        if (::fstat(m_File, &info) != 0 || info.st_size == 0)
+        {
+            close();
+            return false;
+        }
+
+        auto data = ::mmap(nullptr, static_cast<size_t>(info.st_size), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_File, 0);
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+
+        m_Data = static_cast<uint8_t*>(data);
+        m_Size = static_cast<size_t>(info.st_size);
+        m_Writable = writable;
+        return true;
+    }
+
+    /**
+     * @brief Unmaps and closes the file.
+     */
+    void mappedfile::close()
+    {
+        if (m_Data != nullptr)
+            ::munmap(m_Data, m_Size);
+        if (m_File >= 0)
+            ::close(m_File);
+
+        m_Data = nullptr;
+        m_File = -1;
+        m_Size = 0;
+    }
+
+    /**
+     * @brief Asks the system to write dirty pages back to the file.
+     */
+    void mappedfile::flush()
+    {
+        if (m_Data != nullptr && m_Writable)
+            ::msync(m_Data, m_Size, MS_ASYNC);
+    }
+
+#endif
+
+}; // namespace xiloader
@@ -0,0 +1,106 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_MAPPEDFILE_H_INCLUDED__
+#define __XILOADER_MAPPEDFILE_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xiloader
+{
+    /**
+     * @brief File mapped into memory; portable between Windows and POSIX.
+     */
+    class mappedfile
+    {
+        uint8_t* m_Data;
+        size_t m_Size;
+        bool m_Writable;
+
+#ifdef _WIN32
+        void* m_File;
+        void* m_Mapping;
+#else
+        int m_File;
+#endif
+
+        mappedfile(const mappedfile&) = delete;
+        mappedfile& operator=(const mappedfile&) = delete;
+
+    public:
+        mappedfile();
+        ~mappedfile();
+
+        /**
+         * @brief Creates (or truncates) a file of the given size and maps it writable.
+         *
+         * @param path      The path of the file to create.
+         * @param size      The size of the file in bytes.
+         *
+         * @return True on success, false otherwise.
+         */
+        bool create(const char* path, size_t size);
+
+        /**
+         * @brief Maps an existing file.
+         *
+         * @param path      The path of the file to map.
+         * @param writable  "true" to map the file for writing, "false" for read-only.
+         *
+         * @return True on success, false otherwise.
+         */
+        bool open(const char* path, bool writable);
+
+        /**
+         * @brief Unmaps and closes the file.
+         */
+        void close();
+
+        /**
+         * @brief Asks the system to write dirty pages back to the file.
+         */
+        void flush();
+
+        /**
+         * @brief Obtains the start of the mapping.
+         *
+         * @return Pointer to the mapped bytes, nullptr if nothing is mapped.
+         */
+        uint8_t* data() const { return m_Data; }
+
+        /**
+         * @brief Obtains the size of the mapping.
+         *
+         * @return The size of the mapped file in bytes.
+         */
+        size_t size() const { return m_Size; }
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_MAPPEDFILE_H_INCLUDED__
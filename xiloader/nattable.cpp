@@ -0,0 +1,373 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "nattable.h"
+#include "console.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace xiloader
+{
+    /**
+     * @brief A slot of a translation table; empty while its key is 0.
+     */
+    typedef struct natslot_t
+    {
+        std::atomic<uint64_t> Key;
+        uint32_t To;
+        uint16_t ToPort;
+        std::atomic<uint64_t> Hits;
+    } natslot;
+
+    static natslot s_Slots[NATTABLE_SLOTS];     // Destinations to the addresses they are sent to.
+    static natslot s_Reverse[NATTABLE_SLOTS];   // Translated senders back to the destinations the game used.
+    static std::atomic<uint32_t> s_Count(0);
+    static std::mutex s_Lock;
+
+    /**
+     * @brief Builds the table key of a destination; never 0.
+     *
+     * @param address   The address, in network byte order.
+     * @param port      The port, in network byte order; 0 for any port.
+     *
+     * @return The key.
+     */
+    static uint64_t makekey(uint32_t address, uint16_t port)
+    {
+        return (1ull << 48) | (static_cast<uint64_t>(address) << 16) | port;
+    }
+
+    /**
+     * @brief Obtains the slot a key is probed from.
+     *
+     * @param key       The key.
+     *
+     * @return The index of the first slot to probe.
+     */
+    static uint32_t home(uint64_t key)
+    {
+        return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (NATTABLE_SLOTS - 1);
+    }
+
+    /**
+     * @brief Finds the slot of a key.
+     *
+     * @param table     The table to search.
+     * @param key       The key.
+     *
+     * @return The slot, nullptr if the key is not mapped.
+     */
+    static natslot* find(natslot* table, uint64_t key)
+    {
+        auto index = home(key);
+        for (uint32_t x = 0; x < NATTABLE_SLOTS; x++)
+        {
+            auto& slot = table[(index + x) & (NATTABLE_SLOTS - 1)];
+            auto current = slot.Key.load(std::memory_order_acquire);
+            if (current == key)
+                return &slot;
+            if (current == 0)
+                return nullptr;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Inserts a key into a table; the caller holds s_Lock.
+     *
+     * @param table     The table to insert into.
+     * @param key       The key.
+     * @param to        The address the key translates to, in network byte order.
+     * @param toPort    The port the key translates to, in network byte order; 0 keeps the port.
+     *
+     * @return True on success, false if the table is full.
+     */
+    static bool insert(natslot* table, uint64_t key, uint32_t to, uint16_t toPort)
+    {
+        auto index = home(key);
+        for (uint32_t x = 0; x < NATTABLE_SLOTS; x++)
+        {
+            auto& slot = table[(index + x) & (NATTABLE_SLOTS - 1)];
+            if (slot.Key.load(std::memory_order_relaxed) != 0)
+                continue;
+
+            /* Fill the slot before publishing its key; readers never see it half written.. */
+            slot.To = to;
+            slot.ToPort = toPort;
+            slot.Hits.store(0, std::memory_order_relaxed);
+            slot.Key.store(key, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Looks up an address, first with its port, then as a whole address.
+     *
+     * @param table     The table to search.
+     * @param address   The address to look up.
+     *
+     * @return The slot, nullptr if the address is not mapped.
+     */
+    static natslot* lookup(natslot* table, const struct sockaddr_in* address)
+    {
+        auto slot = find(table, makekey(address->sin_addr.s_addr, address->sin_port));
+        return slot != nullptr ? slot : find(table, makekey(address->sin_addr.s_addr, 0));
+    }
+
+    /**
+     * @brief Parses an endpoint.
+     *
+     * @param text      The endpoint as "address[:port]".
+     * @param address   Receives the address, in network byte order.
+     * @param port      Receives the port, in network byte order; 0 if none was given.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool endpoint(const std::string& text, uint32_t* address, uint16_t* port)
+    {
+        auto colon = text.find(':');
+        auto host = text.substr(0, colon);
+
+        *port = 0;
+        if (colon != std::string::npos)
+        {
+            char* end = nullptr;
+            auto value = strtoul(text.c_str() + colon + 1, &end, 10);
+            if (end == text.c_str() + colon + 1 || *end != '\0' || value == 0 || value > 0xFFFF)
+                return false;
+            *port = htons(static_cast<uint16_t>(value));
+        }
+
+        /* Numeric addresses only; 255.255.255.255 is not a destination worth mapping.. */
+        *address = inet_addr(host.c_str());
+        return !host.empty() && *address != INADDR_NONE;
+    }
+
+    /**
+     * @brief Formats an endpoint as "address[:port]".
+     */
+    static std::string format(uint32_t address, uint16_t port)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&address);
+        char buffer[32];
+        if (port != 0)
+            snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u:%u", bytes[0], bytes[1], bytes[2], bytes[3], static_cast<uint32_t>(ntohs(port)));
+        else
+            snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return buffer;
+    }
+
+    /**
+     * @brief Adds a mapping.
+     *
+     * @param mapping   The mapping as "address[:port]=address[:port]", e.g. "203.0.113.5=192.168.1.20".
+     *
+     * @return True on success, false if the mapping is malformed, already mapped or the table is full.
+     */
+    bool nattable::add(const char* mapping)
+    {
+        if (mapping == nullptr)
+            return false;
+
+        std::string text;
+        for (auto ptr = mapping; *ptr != '\0'; ptr++)
+        {
+            if (*ptr != ' ' && *ptr != '\t' && *ptr != '\r')
+                text += *ptr;
+        }
+
+        auto equals = text.find('=');
+        if (equals == std::string::npos)
+            return false;
+
+        uint32_t from = 0, to = 0;
+        uint16_t fromPort = 0, toPort = 0;
+        if (!endpoint(text.substr(0, equals), &from, &fromPort) || !endpoint(text.substr(equals + 1), &to, &toPort))
+            return false;
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        auto key = makekey(from, fromPort);
+        if (s_Count.load() >= NATTABLE_MAX_MAPPINGS || find(s_Slots, key) != nullptr)
+            return false;
+
+        /* Replies come from the translated endpoint; a port kept by the mapping is the one the game sent to.
+           When several destinations share a translation, replies are reported as coming from the first.. */
+        auto reverseKey = makekey(to, toPort != 0 ? toPort : fromPort);
+        if (find(s_Reverse, reverseKey) == nullptr)
+            insert(s_Reverse, reverseKey, from, toPort != 0 ? fromPort : 0);
+
+        if (!insert(s_Slots, key, to, toPort))
+            return false;
+
+        s_Count.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Adds the mappings of a file; one mapping per line, '#' starts a comment.
+     *
+     * @param path      The path of the mapping file.
+     *
+     * @return True if every mapping was added, false otherwise.
+     */
+    bool nattable::load(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+
+        auto added = true;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+
+            if (!nattable::add(line.c_str()))
+            {
+                XILOADER_WARNING("Ignoring NAT mapping: %s", line.c_str());
+                added = false;
+            }
+        }
+
+        return added;
+    }
+
+    /**
+     * @brief Translates a destination address.
+     *
+     * @param address       The destination given to the socket call.
+     * @param length        The length of the destination.
+     * @param translated    Receives the translated destination.
+     *
+     * @return True if the destination was translated, false if it is sent as is.
+     */
+    bool nattable::translate(const struct sockaddr* address, int length, struct sockaddr_in* translated)
+    {
+        /* Nothing to look up in the common case of an empty table.. */
+        if (s_Count.load(std::memory_order_acquire) == 0 || address == nullptr || length < static_cast<int>(sizeof(struct sockaddr_in)) || address->sa_family != AF_INET)
+            return false;
+
+        auto destination = reinterpret_cast<const struct sockaddr_in*>(address);
+        auto slot = lookup(s_Slots, destination);
+        if (slot == nullptr)
+            return false;
+
+        *translated = *destination;
+        translated->sin_addr.s_addr = slot->To;
+        if (slot->ToPort != 0)
+            translated->sin_port = slot->ToPort;
+
+        slot->Hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Translates the sender of a reply back to the destination the game sent to.
+     *
+     * @param address       The sender returned by the socket call; rewritten in place.
+     * @param length        The length of the sender.
+     *
+     * @return True if the sender was translated, false if it is left as is.
+     */
+    bool nattable::untranslate(struct sockaddr* address, int length)
+    {
+        if (s_Count.load(std::memory_order_acquire) == 0 || address == nullptr || length < static_cast<int>(sizeof(struct sockaddr_in)) || address->sa_family != AF_INET)
+            return false;
+
+        auto sender = reinterpret_cast<struct sockaddr_in*>(address);
+        auto slot = lookup(s_Reverse, sender);
+        if (slot == nullptr)
+            return false;
+
+        sender->sin_addr.s_addr = slot->To;
+        if (slot->ToPort != 0)
+            sender->sin_port = slot->ToPort;
+        return true;
+    }
+
+    /**
+     * @brief Obtains the number of mappings.
+     *
+     * @return The number of mappings.
+     */
+    uint32_t nattable::count()
+    {
+        return s_Count.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Obtains every mapping with its counter.
+     *
+     * @param mappings  Receives the mappings.
+     */
+    void nattable::mappings(std::vector<natmapping>& mappings)
+    {
+        mappings.clear();
+        for (auto& slot : s_Slots)
+        {
+            auto key = slot.Key.load(std::memory_order_acquire);
+            if (key == 0)
+                continue;
+
+            natmapping mapping;
+            mapping.From = static_cast<uint32_t>(key >> 16);
+            mapping.FromPort = static_cast<uint16_t>(key);
+            mapping.To = slot.To;
+            mapping.ToPort = slot.ToPort;
+            mapping.Hits = slot.Hits.load(std::memory_order_relaxed);
+            mappings.push_back(mapping);
+        }
+    }
+
+    /**
+     * @brief Logs the counter of every mapping.
+     */
+    void nattable::report()
+    {
+        std::vector<natmapping> list;
+        nattable::mappings(list);
+        for (auto& mapping : list)
+        {
+            XILOADER_DEBUG(xiloader::color::debug, "NAT %s -> %s: %lld translated.", format(mapping.From, mapping.FromPort).c_str(),
+                format(mapping.To, mapping.ToPort).c_str(), static_cast<int64_t>(mapping.Hits));
+        }
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,142 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_NATTABLE_H_INCLUDED__
+#define __XILOADER_NATTABLE_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <cstdint>
+#include <vector>
+
+/* Number of slots in the translation table; a power of two. */
+#define NATTABLE_SLOTS          256
+
+/* Maximum number of mappings; keeps the table at most half full so probes stay short. */
+#define NATTABLE_MAX_MAPPINGS   (NATTABLE_SLOTS / 2)
+
+namespace xiloader
+{
+    /**
+     * @brief A single address translation and its counter.
+     */
+    typedef struct natmapping_t
+    {
+        uint32_t From;      // The destination address to rewrite, in network byte order.
+        uint16_t FromPort;  // The destination port to rewrite, in network byte order; 0 matches any port.
+        uint32_t To;        // The address to send to instead, in network byte order.
+        uint16_t ToPort;    // The port to send to instead, in network byte order; 0 keeps the port.
+        uint64_t Hits;      // The connects and datagrams translated so far.
+    } natmapping;
+
+    /**
+     * @brief Destination address translation for the socket detours.
+     *
+     * An alternative to the hairpin patch that works for any number of
+     * servers: connect, WSAConnect and sendto rewrite their destination
+     * through a many-to-many map, e.g. the public addresses of clustered
+     * zone servers to their LAN addresses behind the same NAT.
+     *
+     * Mappings are added before the game starts and are never removed, so
+     * the detours look them up without a lock: the table is open addressed,
+     * and a slot is published by storing its key last. A destination with a
+     * port is looked up first with the port, then as a whole address.
+     *
+     * A second table of the same kind maps the translated endpoints back, so
+     * recvfrom reports replies as coming from the address the game sent to.
+     */
+    class nattable
+    {
+    public:
+
+        /**
+         * @brief Adds a mapping.
+         *
+         * @param mapping   The mapping as "address[:port]=address[:port]", e.g. "203.0.113.5=192.168.1.20".
+         *
+         * @return True on success, false if the mapping is malformed, already mapped or the table is full.
+         */
+        static bool add(const char* mapping);
+
+        /**
+         * @brief Adds the mappings of a file; one mapping per line, '#' starts a comment.
+         *
+         * @param path      The path of the mapping file.
+         *
+         * @return True if every mapping was added, false otherwise.
+         */
+        static bool load(const char* path);
+
+        /**
+         * @brief Translates a destination address.
+         *
+         * @param address       The destination given to the socket call.
+         * @param length        The length of the destination.
+         * @param translated    Receives the translated destination.
+         *
+         * @return True if the destination was translated, false if it is sent as is.
+         */
+        static bool translate(const struct sockaddr* address, int length, struct sockaddr_in* translated);
+
+        /**
+         * @brief Translates the sender of a reply back to the destination the game sent to.
+         *
+         * @param address       The sender returned by the socket call; rewritten in place.
+         * @param length        The length of the sender.
+         *
+         * @return True if the sender was translated, false if it is left as is.
+         */
+        static bool untranslate(struct sockaddr* address, int length);
+
+        /**
+         * @brief Obtains the number of mappings.
+         *
+         * @return The number of mappings.
+         */
+        static uint32_t count();
+
+        /**
+         * @brief Obtains every mapping with its counter.
+         *
+         * @param mappings  Receives the mappings.
+         */
+        static void mappings(std::vector<natmapping>& mappings);
+
+        /**
+         * @brief Logs the counter of every mapping.
+         */
+        static void report();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_NATTABLE_H_INCLUDED__
@@ -23,37 +23,29 @@ This file is part of DarkStar-server source code.
 
 #include "network.h"
 
-using namespace std;
-
-/* Externals */
-extern std::string g_ServerAddress;
-extern std::string g_ServerPort;
+#include <mstcpip.h>
 
-extern std::string g_Username;
-extern std::string g_Password;
-extern std::string g_NewPassword;
-extern std::string g_ConfirmPassword;
-extern std::string g_Email;
-extern std::string g_SecurityQuestionAnswer;
-extern std::string g_SecurityQuestionID;
-extern UINT32 g_SecurityQuestionIDRecieved;
-
-extern char* g_CharacterList;
-extern bool g_IsRunning;
-extern bool g_Silent;
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
 
+using namespace std;
 
 namespace xiloader
 {
     /**
-     * @brief Creates a connection on the given port.
+     * @brief Connects a new socket to the given server.
      *
-     * @param sock      The datasocket object to store information within.
-     * @param port      The port to create the connection on.
+     * @param address   The server address to connect to.
+     * @param port      The port to connect to.
+     * @param report    Should failures be logged?
      *
-     * @return True on success, false otherwise.
+     * @return The connected socket, INVALID_SOCKET on failure.
      */
-    bool network::CreateConnection(datasocket* sock, const char* port)
+    SOCKET network::Connect(const char* address, const char* port, bool report)
     {
         struct addrinfo hints;
         memset(&hints, 0x00, sizeof(hints));
@@ -64,55 +56,82 @@ namespace xiloader
 
         /* Attempt to get the server information. */
         struct addrinfo* addr = NULL;
-        if (getaddrinfo(g_ServerAddress.c_str(), port, &hints, &addr))
+        if (getaddrinfo(address, port, &hints, &addr))
         {
-            xiloader::console::output(xiloader::color::error, "Failed to obtain remote server information.");
-            return 0;
+            if (report)
+                XILOADER_ERROR("Failed to obtain remote server information.");
+            return INVALID_SOCKET;
         }
 
         /* Determine which address is valid to connect.. */
-        for (auto ptr = addr; ptr != NULL; ptr->ai_next)
+        auto sock = INVALID_SOCKET;
+        for (auto ptr = addr; ptr != NULL && sock == INVALID_SOCKET; ptr = ptr->ai_next)
         {
             /* Attempt to create the socket.. */
-            sock->s = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-            if (sock->s == INVALID_SOCKET)
-            {
-                xiloader::console::output(xiloader::color::error, "Failed to create socket.");
-
-                freeaddrinfo(addr);
-                return 0;
-            }
+            sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+            if (sock == INVALID_SOCKET)
+                continue;
 
             /* Attempt to connect to the server.. */
-            if (connect(sock->s, ptr->ai_addr, ptr->ai_addrlen) == SOCKET_ERROR)
+            if (connect(sock, ptr->ai_addr, (int)ptr->ai_addrlen) == SOCKET_ERROR)
             {
-                xiloader::console::output(xiloader::color::error, "Failed to connect to server!");
-
-                closesocket(sock->s);
-                sock->s = INVALID_SOCKET;
-                return 0;
+                closesocket(sock);
+                sock = INVALID_SOCKET;
             }
-
-			if (!g_Silent)
-			{
-				xiloader::console::output(xiloader::color::info, "Connected to server!");
-			}
-            break;
         }
 
-        std::string localAddress = "";
+        freeaddrinfo(addr);
+
+        if (sock == INVALID_SOCKET && report)
+            XILOADER_ERROR("Failed to connect to server!");
+        return sock;
+    }
 
-        /* Attempt to locate the client address.. */
-        char hostname[1024] = { 0 };
-        if (gethostname(hostname, sizeof(hostname)) == 0)
+    /**
+     * @brief Creates a connection on the given port.
+     *
+     * Account server connections are taken from the session's pre-warmed pool
+     * when one is available.
+     *
+     * @param session   The session whose socket stores the connection.
+     * @param port      The port to create the connection on.
+     *
+     * @return True on success, false otherwise.
+     */
+    bool network::CreateConnection(xiloader::session* session, const char* port)
+    {
+        auto sock = &session->Socket;
+
+        sock->s = INVALID_SOCKET;
+        if (session->AccountPool.serves(port))
+            sock->s = session->AccountPool.acquire();
+        if (sock->s == INVALID_SOCKET)
+            sock->s = Connect(session->ServerAddress.c_str(), port, true);
+        if (sock->s == INVALID_SOCKET)
+            return 0;
+
+        if (!session->Silent)
         {
-            PHOSTENT hostent = NULL;
-            if ((hostent = gethostbyname(hostname)) != NULL)
-                localAddress = inet_ntoa(*(struct in_addr*)*hostent->h_addr_list);
+            xiloader::console::output(xiloader::color::info, "Connected to server!");
         }
+        xiloader::flightrecorder::record(xiloader::flightevent::connect, atoi(port), session->ServerAddress.c_str());
+
+        /* Attempt to locate the client address once per session.. */
+        if (sock->LocalAddress == (ULONG)-1)
+        {
+            std::string localAddress = "";
 
-        sock->LocalAddress = inet_addr(localAddress.c_str());
-        sock->ServerAddress = inet_addr(g_ServerAddress.c_str());
+            char hostname[1024] = { 0 };
+            if (gethostname(hostname, sizeof(hostname)) == 0)
+            {
+                PHOSTENT hostent = NULL;
+                if ((hostent = gethostbyname(hostname)) != NULL)
+                    localAddress = inet_ntoa(*(struct in_addr*)*hostent->h_addr_list);
+            }
+
+            sock->LocalAddress = inet_addr(localAddress.c_str());
+        }
+        sock->ServerAddress = inet_addr(session->ServerAddress.c_str());
 
         return 1;
     }
@@ -140,7 +159,7 @@ namespace xiloader
         struct addrinfo* addr = NULL;
         if (getaddrinfo(NULL, port, &hints, &addr))
         {
-            xiloader::console::output(xiloader::color::error, "Failed to obtain local address information.");
+            XILOADER_ERROR("Failed to obtain local address information.");
             return false;
         }
 
@@ -148,7 +167,7 @@ namespace xiloader
         *sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
         if (*sock == INVALID_SOCKET)
         {
-            xiloader::console::output(xiloader::color::error, "Failed to create listening socket.");
+            XILOADER_ERROR("Failed to create listening socket.");
 
             freeaddrinfo(addr);
             return false;
@@ -157,7 +176,7 @@ namespace xiloader
         /* Bind to the local address.. */
         if (bind(*sock, addr->ai_addr, (int)addr->ai_addrlen) == SOCKET_ERROR)
         {
-            xiloader::console::output(xiloader::color::error, "Failed to bind to listening socket.");
+            XILOADER_ERROR("Failed to bind to listening socket.");
 
             freeaddrinfo(addr);
             closesocket(*sock);
@@ -172,7 +191,7 @@ namespace xiloader
         {
             if (listen(*sock, SOMAXCONN) == SOCKET_ERROR)
             {
-                xiloader::console::output(xiloader::color::error, "Failed to listen for connections.");
+                XILOADER_ERROR("Failed to listen for connections.");
 
                 closesocket(*sock);
                 *sock = INVALID_SOCKET;
@@ -210,15 +229,101 @@ namespace xiloader
         return true;
     }
 
+    /**
+     * @brief Logs in with the session credentials without prompting and goes straight to play.
+     *
+     * @param session   The session to log in; its username and password must be set.
+     *
+     * @return XILOADER_EXIT_SUCCESS on success, XILOADER_EXIT_LOGIN if the credentials were
+     *         rejected, XILOADER_EXIT_CONNECT if the server could not be reached.
+     */
+    int network::LoginHeadless(xiloader::session* session)
+    {
+        auto sock = &session->Socket;
+        char recvBuffer[1024] = { 0 };
+        char sendBuffer[1024] = { 0 };
+
+        /* Create connection if required.. */
+        if (sock->s == INVALID_SOCKET && !xiloader::network::CreateConnection(session, "54231"))
+            return XILOADER_EXIT_CONNECT;
+
+        session->Silent = true;
+
+        sendBuffer[0x82] = LOGIN_ATTEMPT;
+        memcpy(sendBuffer + 0x00, session->Username.c_str(), std::min<size_t>(session->Username.size(), 16));
+        memcpy(sendBuffer + 0x10, session->Password.c_str(), std::min<size_t>(session->Password.size(), 16));
+
+        /* Send info to server and obtain response.. */
+        auto received = send(sock->s, sendBuffer, 131, 0) == SOCKET_ERROR ? SOCKET_ERROR : recv(sock->s, recvBuffer, 32, 0);
+        closesocket(sock->s);
+        sock->s = INVALID_SOCKET;
+
+        if (received <= 0)
+        {
+            XILOADER_ERROR("The account server did not answer the login request.");
+            return XILOADER_EXIT_CONNECT;
+        }
+
+        xiloader::flightrecorder::record(xiloader::flightevent::handshake, recvBuffer[0], "account server reply");
+
+        if (recvBuffer[0] != SUCCESS_LOGIN)
+        {
+            XILOADER_ERROR("Failed to login as %s. Invalid username or password.", session->Username.c_str());
+            return XILOADER_EXIT_LOGIN;
+        }
+
+        xiloader::console::output(xiloader::color::success, "Successfully logged in as %s!", session->Username.c_str());
+        sock->AccountId = *(UINT32*)(recvBuffer + 0x01);
+        return XILOADER_EXIT_SUCCESS;
+    }
+
+    /**
+     * @brief Reads the username and password from a credentials file; one per line.
+     *
+     * @param session   The session to store the credentials in.
+     * @param path      The path of the file; "-" reads from standard input.
+     *
+     * @return True on success, false if the file could not be read or is incomplete.
+     */
+    bool network::LoadCredentials(xiloader::session* session, const char* path)
+    {
+        std::ifstream file;
+        std::istream* input = &std::cin;
+        if (strcmp(path, "-") != 0)
+        {
+            file.open(path);
+            if (!file)
+                return false;
+            input = &file;
+        }
+
+        std::string username, password;
+        if (!std::getline(*input, username) || !std::getline(*input, password))
+            return false;
+
+        /* Tolerate files saved with CRLF line endings.. */
+        if (!username.empty() && username.back() == '\r')
+            username.pop_back();
+        if (!password.empty() && password.back() == '\r')
+            password.pop_back();
+        if (username.empty() || password.empty())
+            return false;
+
+        session->Username = username;
+        session->Password = password;
+        return true;
+    }
+
     /**
      * @brief Verifies the players login information; also handles account management.
      *
-     * @param sock      The datasocket object with the connection socket.
+     * @param session   The session to log in.
      *
      * @return True on success, false otherwise.
      */
-	bool network::VerifyAccount(datasocket* sock)
+	bool network::VerifyAccount(xiloader::session* session)
 	{
+		auto sock = &session->Socket;
 		char recvBuffer[1024] = { 0 };
 		char sendBuffer[1024] = { 0 };
 		std::string input;
@@ -228,11 +333,11 @@ namespace xiloader
 		/* Create connection if required.. */
 		if (sock->s == NULL || sock->s == INVALID_SOCKET)
 		{
-			if (!xiloader::network::CreateConnection(sock, "54231"))
+			if (!xiloader::network::CreateConnection(session, "54231"))
 				return false;
 		}
 
-		g_Silent = true;
+		session->Silent = true;
 
 		login_menu:
 
@@ -243,6 +348,7 @@ namespace xiloader
 		xiloader::console::output("   2.) Create Account");
 		xiloader::console::output("   3.) Forgot Password");
 		xiloader::console::output("==========================================================");
+		xiloader::console::flush();
 		printf("\nEnter a selection: ");
 
 		std::cin >> input;
@@ -262,36 +368,38 @@ namespace xiloader
 		if (input == "1")
 		{
 			xiloader::console::output("Please enter your login information.");
+			xiloader::console::flush();
 			std::cout << "\nUsername: ";
-			std::cin >> g_Username;
-			PromptForPassword();
+			std::cin >> session->Username;
+			PromptForPassword(session);
 			std::cout << std::endl;
 
 			sendBuffer[0x82] = LOGIN_ATTEMPT;
-			memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-			memcpy(sendBuffer + 0x10, g_Password.c_str(), 16);
-			memcpy(sendBuffer + 0x20, g_Email.c_str(), 32);
+			memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+			memcpy(sendBuffer + 0x10, session->Password.c_str(), 16);
+			memcpy(sendBuffer + 0x20, session->Email.c_str(), 32);
 		}
 		else if (input == "2")
 		{
 
 		create_account:
 			xiloader::console::output("Please enter your desired login information.");
+			xiloader::console::flush();
 			std::cout << "\nUsername (3-15 characters): ";
-			std::cin >> g_Username;
+			std::cin >> session->Username;
 			std::cout << "Password (6-15 characters): ";
-			std::cin >> g_Password;
+			std::cin >> session->Password;
 			std::cout << "Repeat Password           : ";
 			std::cin >> input;
 
-			if (input != g_Password)
+			if (input != session->Password)
 			{
 				xiloader::console::output(xiloader::color::error, "Passwords did not match! Please try again.");
 				goto create_account;
 			}
 
 			std::cout << "Email: ";
-			std::cin >> g_Email;
+			std::cin >> session->Email;
 			std::cout << std::endl;
 
 			std::cout << "Would you like to setup a security question? y/n: ";
@@ -300,38 +408,39 @@ namespace xiloader
 
 			if (input == "y") 
 			{ 
-				ChangeSecurityQuestion(); 
+				ChangeSecurityQuestion(session); 
 			}
 
 			xiloader::console::output(xiloader::color::green, "Please review your information:");
-			std::cout << "Username:  " + g_Username;
-			std::cout << "\nPassword:  " + g_Password;
-			std::cout << "\nEmail:  " + g_Email;
+			xiloader::console::flush();
+			std::cout << "Username:  " + session->Username;
+			std::cout << "\nPassword:  " + session->Password;
+			std::cout << "\nEmail:  " + session->Email;
 
-			if (g_SecurityQuestionAnswer != "")
+			if (session->SecurityQuestionAnswer != "")
 			{
-				if (g_SecurityQuestionID == "1")
+				if (session->SecurityQuestionID == "1")
 				{
 					std::cout << "\nQuestion: What is your pets name?";
 				}
-				else if (g_SecurityQuestionID == "2")
+				else if (session->SecurityQuestionID == "2")
 				{
 					std::cout << "\nQuestion: In what year was your father born?";
 				}
-				else if (g_SecurityQuestionID == "3")
+				else if (session->SecurityQuestionID == "3")
 				{
 					std::cout << "\nQuestion: In what town or city was your first full time job?";
 				}
-				else if (g_SecurityQuestionID == "4")
+				else if (session->SecurityQuestionID == "4")
 				{
 					std::cout << "\nQuestion: What are the last five digits of your drivers licence number?";
 				}
-				else if (g_SecurityQuestionID == "5")
+				else if (session->SecurityQuestionID == "5")
 				{
 					std::cout << "\nQuestion: What is your spouse or partners mothers maiden name?";
 				}
 
-				std::cout << "\nAnswer:  " + g_SecurityQuestionAnswer;
+				std::cout << "\nAnswer:  " + session->SecurityQuestionAnswer;
 			}
 			else
 			{
@@ -341,6 +450,7 @@ namespace xiloader
 			    xiloader::console::output(xiloader::color::info, "** You may set one at anytime after account has been created.\n");
 			}
 
+			xiloader::console::flush();
 			std::cout << "\nIs this correct? y/n";
 
 			std::cin >> input;
@@ -349,11 +459,11 @@ namespace xiloader
 			if (input == "y")
 			{
 				sendBuffer[0x82] = LOGIN_CREATE;
-				memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-				memcpy(sendBuffer + 0x10, g_Password.c_str(), 16);
-				memcpy(sendBuffer + 0x20, g_Email.c_str(), 32);
-				memcpy(sendBuffer + 0x40, g_SecurityQuestionAnswer.c_str(), 64);
-				memcpy(sendBuffer + 0x80, g_SecurityQuestionID.c_str(), 2);
+				memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+				memcpy(sendBuffer + 0x10, session->Password.c_str(), 16);
+				memcpy(sendBuffer + 0x20, session->Email.c_str(), 32);
+				memcpy(sendBuffer + 0x40, session->SecurityQuestionAnswer.c_str(), 64);
+				memcpy(sendBuffer + 0x80, session->SecurityQuestionID.c_str(), 2);
 			}
 			else
 			{
@@ -363,11 +473,12 @@ namespace xiloader
 		else if (input == "3")
 		{
 			xiloader::console::output("Please enter your username.");
+			xiloader::console::flush();
 			std::cout << "\nPlease enter your username: ";
-			std::cin >> g_Username;
+			std::cin >> session->Username;
 
 			sendBuffer[0x82] = LOGIN_RECOVER;
-			memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
+			memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
 
 			send(sock->s, sendBuffer, 131, 0);
 			recv(sock->s, recvBuffer, 32, 0);
@@ -376,9 +487,9 @@ namespace xiloader
 			{
 			case SUCCESS_USERFOUND: 
 
-				g_SecurityQuestionIDRecieved = *(UINT32*)(recvBuffer + 0x10);
+				session->SecurityQuestionIDRecieved = *(UINT32*)(recvBuffer + 0x10);
 
-				if (g_SecurityQuestionIDRecieved == 0)
+				if (session->SecurityQuestionIDRecieved == 0)
 				{
 					xiloader::console::output(xiloader::color::error, "** A security question was not setup.");
 					xiloader::console::output(xiloader::color::error, "** Please contact an admin.");
@@ -389,40 +500,41 @@ namespace xiloader
 
 				closesocket(sock->s);
 				sock->s = INVALID_SOCKET;
-			    if (!xiloader::network::CreateConnection(sock, "54231"))
+			    if (!xiloader::network::CreateConnection(session, "54231"))
 					return false;
 
 				xiloader::console::output("Please answer the security question to reset your password.");
 
-				if (g_SecurityQuestionIDRecieved == 1)
+				xiloader::console::flush();
+				if (session->SecurityQuestionIDRecieved == 1)
 				{
 					std::cout << "Question: What is your pets name?";
 				}
-				else if (g_SecurityQuestionIDRecieved == 2)
+				else if (session->SecurityQuestionIDRecieved == 2)
 				{
 					std::cout << "Question: In what year was your father born?";
 				}
-				else if (g_SecurityQuestionIDRecieved == 3)
+				else if (session->SecurityQuestionIDRecieved == 3)
 				{
 					std::cout << "Question: In what town or city was your first full time job?";
 				}
-				else if (g_SecurityQuestionIDRecieved == 4)
+				else if (session->SecurityQuestionIDRecieved == 4)
 				{
 					std::cout << "Question: What are the last five digits of your drivers licence number?";
 				}
-				else if (g_SecurityQuestionIDRecieved == 5)
+				else if (session->SecurityQuestionIDRecieved == 5)
 				{
 					std::cout << "Question: What is your spouse or partners mothers maiden name?";
 				}
 
 				std::cout << "\nYour Answer: ";
-				std::getline(std::cin >> std::ws, g_SecurityQuestionAnswer);
+				std::getline(std::cin >> std::ws, session->SecurityQuestionAnswer);
 
 
 				sendBuffer[0x82] = LOGIN_SQATTEMPT;
-				memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-				memcpy(sendBuffer + 0x40, g_SecurityQuestionAnswer.c_str(), 64);
-			    memcpy(sendBuffer + 0x80, std::to_string(g_SecurityQuestionIDRecieved).c_str(), 2);
+				memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+				memcpy(sendBuffer + 0x40, session->SecurityQuestionAnswer.c_str(), 64);
+			    memcpy(sendBuffer + 0x80, std::to_string(session->SecurityQuestionIDRecieved).c_str(), 2);
 
 				
 				send(sock->s, sendBuffer, 131, 0);
@@ -434,27 +546,28 @@ namespace xiloader
 
 					closesocket(sock->s);
 					sock->s = INVALID_SOCKET;
-					if (!xiloader::network::CreateConnection(sock, "54231"))
+					if (!xiloader::network::CreateConnection(session, "54231"))
 						return false;
 
 					xiloader::console::output(xiloader::color::green, "Verified! Enter your new password below.");
 				sq_password_change:
 
+					xiloader::console::flush();
 					std::cout << "\nNew Password (6-15 characters): ";
-					std::cin >> g_NewPassword;
+					std::cin >> session->NewPassword;
 					std::cout << "Repeat New Password           : ";
 					std::cin >> input;
 
-					if (input != g_NewPassword)
+					if (input != session->NewPassword)
 					{
 						xiloader::console::output(xiloader::color::error, "Passwords did not match! Please try again.");
 						goto sq_password_change;
 					}
 
 					sendBuffer[0x82] = LOGIN_PASS;
-					memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-					memcpy(sendBuffer + 0x10, g_Password.c_str(), 16);
-					memcpy(sendBuffer + 0x20, g_NewPassword.c_str(), 16); // We use the email field (as 16)
+					memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+					memcpy(sendBuffer + 0x10, session->Password.c_str(), 16);
+					memcpy(sendBuffer + 0x20, session->NewPassword.c_str(), 16); // We use the email field (as 16)
 
 					send(sock->s, sendBuffer, 131, 0);
 					recv(sock->s, recvBuffer, 32, 0);
@@ -501,11 +614,13 @@ namespace xiloader
 		send(sock->s, sendBuffer, 131, 0);
 		recv(sock->s, recvBuffer, 32, 0);
 
+		xiloader::flightrecorder::record(xiloader::flightevent::handshake, recvBuffer[0], "account server reply");
+
 		/* Handle the obtained result.. */
 		switch (recvBuffer[0])
 		{
 		case SUCCESS_LOGIN: // Success (Login)
-			xiloader::console::output(xiloader::color::success, "Successfully logged in as %s!", g_Username.c_str());
+			xiloader::console::output(xiloader::color::success, "Successfully logged in as %s!", session->Username.c_str());
 			sock->AccountId = *(UINT32*)(recvBuffer + 0x01);
 			closesocket(sock->s);
 			sock->s = INVALID_SOCKET;
@@ -534,7 +649,7 @@ namespace xiloader
 
 		closesocket(sock->s);
 		sock->s = INVALID_SOCKET;
-		if (!xiloader::network::CreateConnection(sock, "54231"))
+		if (!xiloader::network::CreateConnection(session, "54231"))
 			return false;
 
 		xiloader::console::output(" ");
@@ -547,6 +662,7 @@ namespace xiloader
 		xiloader::console::output("   4.) Setup Security Question");
 		xiloader::console::output("   5.) Logout");
 		xiloader::console::output("==========================================================");
+		xiloader::console::flush();
 		printf("\nEnter a selection: ");
 
 		std::cin >> input;
@@ -573,9 +689,9 @@ namespace xiloader
 		{
 			xiloader::console::output("Verify your password then tell us what your new email should be?");
 
-			PromptForConfirmPassword();
+			PromptForConfirmPassword(session);
 
-			if (g_ConfirmPassword != g_Password)
+			if (session->ConfirmPassword != session->Password)
 			{
 				std::cout << std::endl;
 				xiloader::console::output(xiloader::color::error, "Failed to verify password..");
@@ -584,22 +700,22 @@ namespace xiloader
 			else
 			{ 
 				std::cout << "\nNew Email: ";
-				std::cin >> g_Email;
+				std::cin >> session->Email;
 				std::cout << std::endl;
 
 				sendBuffer[0x82] = LOGIN_EMAIL;
-				memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-				memcpy(sendBuffer + 0x10, g_Password.c_str(), 16);
-				memcpy(sendBuffer + 0x20, g_Email.c_str(), 32);
+				memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+				memcpy(sendBuffer + 0x10, session->Password.c_str(), 16);
+				memcpy(sendBuffer + 0x20, session->Email.c_str(), 32);
 			}
 		}
 		else if (input == "3")
 		{
 			xiloader::console::output("Verify your password then tell us what your new password should be?");
 
-			PromptForConfirmPassword();
+			PromptForConfirmPassword(session);
 
-			if (g_ConfirmPassword != g_Password)
+			if (session->ConfirmPassword != session->Password)
 			{
 				std::cout << std::endl;
 				xiloader::console::output(xiloader::color::error, "Failed to verify password..");
@@ -609,30 +725,31 @@ namespace xiloader
 			{
 				password_change:
 
+				xiloader::console::flush();
 				std::cout << "\nNew Password (6-15 characters): ";
-				std::cin >> g_NewPassword;
+				std::cin >> session->NewPassword;
 				std::cout << "Repeat New Password           : ";
 				std::cin >> input;
 
-				if (input != g_NewPassword)
+				if (input != session->NewPassword)
 				{
 					xiloader::console::output(xiloader::color::error, "Passwords did not match! Please try again.");
 					goto password_change;
 				}
 
 				sendBuffer[0x82] = LOGIN_PASS;
-				memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-				memcpy(sendBuffer + 0x10, g_Password.c_str(), 16);
-				memcpy(sendBuffer + 0x20, g_NewPassword.c_str(), 16); // We use the email field (as 16)
+				memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+				memcpy(sendBuffer + 0x10, session->Password.c_str(), 16);
+				memcpy(sendBuffer + 0x20, session->NewPassword.c_str(), 16); // We use the email field (as 16)
 			}
 		}
 		else if (input == "4")
 		{
 			xiloader::console::output("Verify your password first.");
 
-			PromptForConfirmPassword();
+			PromptForConfirmPassword(session);
 
-			if (g_ConfirmPassword != g_Password)
+			if (session->ConfirmPassword != session->Password)
 			{
 				std::cout << std::endl;
 				xiloader::console::output(xiloader::color::error, "Failed to verify password..");
@@ -642,6 +759,7 @@ namespace xiloader
 			{
 			    choose_ques:
 
+				xiloader::console::flush();
 				std::cout << std::endl;
 
 				xiloader::console::output("What do you want your security question to be?");
@@ -650,13 +768,14 @@ namespace xiloader
 				xiloader::console::output("   3.) In what town or city was your first full time job?");
 				xiloader::console::output("   4.) What are the last five digits of your drivers licence number?");
 				xiloader::console::output("   5.) What is your spouse or partners mothers maiden name?");
+				xiloader::console::flush();
 				printf("\nEnter a selection: ");
 
-				std::cin >> g_SecurityQuestionID;
+				std::cin >> session->SecurityQuestionID;
 				std::cout << std::endl;
 
 				// Convert to int
-				stringstream sq_id_con(g_SecurityQuestionID);
+				stringstream sq_id_con(session->SecurityQuestionID);
 				int sq_id_i = 0;
 				sq_id_con >> sq_id_i;
 
@@ -667,13 +786,13 @@ namespace xiloader
 				}
 
 				std::cout << "\nYour Answer: ";
-				std::getline(std::cin >> std::ws, g_SecurityQuestionAnswer);
+				std::getline(std::cin >> std::ws, session->SecurityQuestionAnswer);
 
 				sendBuffer[0x82] = LOGIN_SEC_CODE;
-				memcpy(sendBuffer + 0x00, g_Username.c_str(), 16);
-				memcpy(sendBuffer + 0x10, g_Password.c_str(), 16);
-				memcpy(sendBuffer + 0x40, g_SecurityQuestionAnswer.c_str(), 64);
-				memcpy(sendBuffer + 0x80, g_SecurityQuestionID.c_str(), 2);
+				memcpy(sendBuffer + 0x00, session->Username.c_str(), 16);
+				memcpy(sendBuffer + 0x10, session->Password.c_str(), 16);
+				memcpy(sendBuffer + 0x40, session->SecurityQuestionAnswer.c_str(), 64);
+				memcpy(sendBuffer + 0x80, session->SecurityQuestionID.c_str(), 2);
 			}
 		}
 		else if (input == "5")
@@ -733,14 +852,15 @@ namespace xiloader
 	/**
 	* @brief Gets user's password
 	*
-	* @param null
+	* @param session   The session to store the password in.
 	*
 	* @return null
 	*/
-	void network::PromptForPassword()
+	void network::PromptForPassword(xiloader::session* session)
 	{
+		xiloader::console::flush();
 		std::cout << "Password: ";
-		g_Password.clear();
+		session->Password.clear();
 
 		/* Read in each char and instead of displaying it. display a "*" */
 		char ch;
@@ -750,15 +870,15 @@ namespace xiloader
 				continue;
 			else if (ch == '\b')
 			{
-				if (g_Password.size())
+				if (session->Password.size())
 				{
-					g_Password.pop_back();
+					session->Password.pop_back();
 					std::cout << "\b \b";
 				}
 			}
 			else
 			{
-				g_Password.push_back(ch);
+				session->Password.push_back(ch);
 				std::cout << '*';
 			}
 		}
@@ -767,14 +887,15 @@ namespace xiloader
 	/**
 	* @brief Gets user's password
 	*
-	* @param null
+	* @param session   The session to store the password in.
 	*
 	* @return null
 	*/
-	void network::PromptForConfirmPassword()
+	void network::PromptForConfirmPassword(xiloader::session* session)
 	{
+		xiloader::console::flush();
 		std::cout << "Verify Your Password: ";
-		g_ConfirmPassword.clear();
+		session->ConfirmPassword.clear();
 
 		/* Read in each char and instead of displaying it. display a "*" */
 		char ch;
@@ -784,15 +905,15 @@ namespace xiloader
 				continue;
 			else if (ch == '\b')
 			{
-				if (g_ConfirmPassword.size())
+				if (session->ConfirmPassword.size())
 				{
-					g_ConfirmPassword.pop_back();
+					session->ConfirmPassword.pop_back();
 					std::cout << "\b \b";
 				}
 			}
 			else
 			{
-				g_ConfirmPassword.push_back(ch);
+				session->ConfirmPassword.push_back(ch);
 				std::cout << '*';
 			}
 		}
@@ -802,13 +923,14 @@ namespace xiloader
 	/**
 	* @brief Change security question prompt
 	*
-	* @param null
+	* @param session   The session to store the question and answer in.
 	*
 	* @return null
 	*/
-	void network::ChangeSecurityQuestion()
+	void network::ChangeSecurityQuestion(xiloader::session* session)
 	{
 	choose_ques:
+		xiloader::console::flush();
 		std::cout << "\n";
 		xiloader::console::output("==========================================================");
 		xiloader::console::output("Question Choice");
@@ -818,13 +940,14 @@ namespace xiloader
 		xiloader::console::output("   4.) What are the last five digits of your drivers licence number?");
 		xiloader::console::output("   5.) What is your spouse or partners mothers maiden name?");
 		xiloader::console::output("==========================================================");
+		xiloader::console::flush();
 		printf("\nEnter a selection: ");
 
-		std::cin >> g_SecurityQuestionID;
+		std::cin >> session->SecurityQuestionID;
 		std::cout << std::endl;
 
 		// Convert to int
-		stringstream sq_id_con(g_SecurityQuestionID);
+		stringstream sq_id_con(session->SecurityQuestionID);
 		UINT32 sq_id_i = 0;
 		sq_id_con >> sq_id_i;
 
@@ -835,33 +958,140 @@ namespace xiloader
 		}
 
 		std::cout << "\nYour Answer: ";
-		std::getline(std::cin >> std::ws, g_SecurityQuestionAnswer);
+		std::getline(std::cin >> std::ws, session->SecurityQuestionAnswer);
 	
 		std::cout << std::endl;
 	}
 
+    /**
+     * @brief Waits for network events on a socket or for the session to shut down.
+     *
+     * @param session   The session the socket belongs to.
+     * @param sock      The socket to wait on.
+     * @param event     The event associated with the socket through WSAEventSelect.
+     * @param timeout   The maximum time to wait, in milliseconds.
+     *
+     * @return True once the socket has events pending, false on shutdown, timeout (WSAETIMEDOUT) or error.
+     */
+    bool network::WaitForSocket(xiloader::session* session, SOCKET sock, WSAEVENT event, DWORD timeout)
+    {
+        HANDLE handles[] = { session->ShutdownEvent, event };
+        auto result = WaitForMultipleObjects(2, handles, FALSE, timeout);
+        if (result != WAIT_OBJECT_0 + 1)
+        {
+            WSASetLastError(result == WAIT_TIMEOUT ? WSAETIMEDOUT : 0);
+            return false;
+        }
+
+        /* Reset the socket event; the pending events are picked up by recv/accept.. */
+        WSANETWORKEVENTS events;
+        return WSAEnumNetworkEvents(sock, event, &events) != SOCKET_ERROR;
+    }
+
+    /**
+     * @brief Enables fast keepalive probing on a socket so a dead peer is detected in seconds.
+     *
+     * @param sock      The socket to enable keepalive on.
+     */
+    void network::EnableKeepAlive(SOCKET sock)
+    {
+        struct tcp_keepalive keepalive;
+        keepalive.onoff = 1;
+        keepalive.keepalivetime = DATACOMM_KEEPALIVE_TIME;
+        keepalive.keepaliveinterval = DATACOMM_KEEPALIVE_INTERVAL;
+
+        DWORD returned = 0;
+        if (WSAIoctl(sock, SIO_KEEPALIVE_VALS, &keepalive, sizeof(keepalive), NULL, 0, &returned, NULL, NULL) == SOCKET_ERROR)
+            XILOADER_WARNING("Failed to enable keepalive on the data connection (%d).", WSAGetLastError());
+    }
+
+    /**
+     * @brief Reconnects the data channel with jittered exponential backoff.
+     *
+     * The server resumes the session from the account id already held by the
+     * session socket, so no new login is needed.
+     *
+     * @param session   The session whose data connection was lost.
+     *
+     * @return True once reconnected, false on shutdown or when every attempt failed.
+     */
+    bool network::ReconnectDataServer(xiloader::session* session)
+    {
+        static thread_local std::mt19937 random(std::random_device{}());
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t attempt = 1; attempt <= DATACOMM_RECONNECT_ATTEMPTS; attempt++)
+        {
+            /* Wait a random part of the backoff window so clients do not reconnect in lockstep.. */
+            auto window = std::min<uint32_t>(DATACOMM_BACKOFF_MAX, DATACOMM_BACKOFF_BASE << (attempt - 1));
+            auto delay = std::uniform_int_distribution<uint32_t>(window / 2, window)(random);
+
+            XILOADER_INFO(xiloader::color::warning, "Reconnecting to the data server in %u ms (attempt %u of %u)..", delay, attempt, DATACOMM_RECONNECT_ATTEMPTS);
+            if (WaitForSingleObject(session->ShutdownEvent, delay) == WAIT_OBJECT_0)
+                return false;
+
+            if (xiloader::network::CreateConnection(session, "54230"))
+            {
+                auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                XILOADER_INFO(xiloader::color::success, "Data server connection restored after %u attempt(s) in %.1f ms.", attempt, elapsed);
+                session->Reconnects++;
+                xiloader::flightrecorder::record(xiloader::flightevent::connect, static_cast<uint64_t>(elapsed), "data server resumed (ms)");
+                return true;
+            }
+        }
+
+        XILOADER_ERROR("Failed to reconnect to the data server after %u attempts.", DATACOMM_RECONNECT_ATTEMPTS);
+        return false;
+    }
+
     /**
      * @brief Data communication between the local client and the game server.
      *
-     * @param lpParam   Thread param object.
+     * The connection counts as lost when it is reset, when keepalive finds the
+     * server unreachable, or when the server misses the read deadline for the
+     * request following an answered one. A graceful close ends the session.
      *
-     * @return Non-important return.
+     * @param session   The session object.
+     *
+     * @return True if the connection was lost and should be re-established, false otherwise.
      */
-    DWORD __stdcall network::FFXiDataComm(LPVOID lpParam)
+    bool network::FFXiDataComm(xiloader::session* session)
     {
-        auto sock = (xiloader::datasocket*)lpParam;
+        auto sock = &session->Socket;
 
         int sendSize = 0;
         char recvBuffer[4096] = { 0 };
         char sendBuffer[4096] = { 0 };
+        auto lost = false;
+        auto deadline = static_cast<DWORD>(INFINITE);
+
+        auto event = WSACreateEvent();
+        WSAEventSelect(sock->s, event, FD_READ | FD_CLOSE);
 
-        while (g_IsRunning)
+        while (session->IsRunning)
         {
+            /* Wait for incoming data, the read deadline or shutdown.. */
+            if (!xiloader::network::WaitForSocket(session, sock->s, event, deadline))
+            {
+                lost = WSAGetLastError() == WSAETIMEDOUT;
+                break;
+            }
+
             /* Attempt to receive the incoming data.. */
             struct sockaddr_in client;
             unsigned int socksize = sizeof(client);
-            if (recvfrom(sock->s, recvBuffer, sizeof(recvBuffer), 0, (struct sockaddr*)&client, (int*)&socksize) <= 0)
+            auto received = recvfrom(sock->s, recvBuffer, sizeof(recvBuffer), 0, (struct sockaddr*)&client, (int*)&socksize);
+            if (received == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK)
                 continue;
+            if (received <= 0)
+            {
+                lost = received == SOCKET_ERROR;
+                break;
+            }
+
+            deadline = INFINITE;
+
+            xiloader::flightrecorder::record(xiloader::flightevent::handshake, recvBuffer[0], "data server request");
 
             switch (recvBuffer[0])
             {
@@ -869,30 +1099,31 @@ namespace xiloader
                 sendBuffer[0] = 0xA1u;
                 memcpy(sendBuffer + 0x01, &sock->AccountId, 4);
                 memcpy(sendBuffer + 0x05, &sock->ServerAddress, 4);
-                xiloader::console::output(xiloader::color::warning, "Sending account id..");
+                XILOADER_DEBUG(xiloader::color::warning, "Sending account id..");
+                deadline = DATACOMM_READ_DEADLINE;
                 sendSize = 9;
                 break;
 
             case 0x0002:
             case 0x0015:
                 memcpy(sendBuffer, (char*)"\xA2\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x58\xE0\x5D\xAD\x00\x00\x00\x00", 25);
-                xiloader::console::output(xiloader::color::warning, "Sending key..");
+                XILOADER_DEBUG(xiloader::color::warning, "Sending key..");
                 sendSize = 25;
                 break;
 
             case 0x0003:
-                xiloader::console::output(xiloader::color::warning, "Receiving character list..");
+                XILOADER_DEBUG(xiloader::color::warning, "Receiving character list..");
                 for (auto x = 0; x <= recvBuffer[1]; x++)
                 {
-                    g_CharacterList[0x00 + (x * 0x68)] = 1;
-                    g_CharacterList[0x02 + (x * 0x68)] = 1;
-                    g_CharacterList[0x10 + (x * 0x68)] = (char)x;
-                    g_CharacterList[0x11 + (x * 0x68)] = 0x80u;
-                    g_CharacterList[0x18 + (x * 0x68)] = 0x20;
-                    g_CharacterList[0x28 + (x * 0x68)] = 0x20;
-
-                    memcpy(g_CharacterList + 0x04 + (x * 0x68), recvBuffer + 0x14 * (x + 1), 4); // Character Id
-                    memcpy(g_CharacterList + 0x08 + (x * 0x68), recvBuffer + 0x10 * (x + 1), 4); // Content Id
+                    session->CharacterList[0x00 + (x * 0x68)] = 1;
+                    session->CharacterList[0x02 + (x * 0x68)] = 1;
+                    session->CharacterList[0x10 + (x * 0x68)] = (char)x;
+                    session->CharacterList[0x11 + (x * 0x68)] = 0x80u;
+                    session->CharacterList[0x18 + (x * 0x68)] = 0x20;
+                    session->CharacterList[0x28 + (x * 0x68)] = 0x20;
+
+                    memcpy(session->CharacterList + 0x04 + (x * 0x68), recvBuffer + 0x14 * (x + 1), 4); // Character Id
+                    memcpy(session->CharacterList + 0x08 + (x * 0x68), recvBuffer + 0x10 * (x + 1), 4); // Content Id
                 }
                 sendSize = 0;
                 break;
@@ -909,45 +1140,75 @@ namespace xiloader
                 closesocket(sock->s);
                 sock->s = INVALID_SOCKET;
 
+                xiloader::flightrecorder::record(xiloader::flightevent::disconnect, 54230, "data server");
                 xiloader::console::output("Server connection done; disconnecting!");
-                return 0;
+                break;
             }
 
             sendSize = 0;
-            Sleep(100);
+            if (WaitForSingleObject(session->ShutdownEvent, 100) == WAIT_OBJECT_0)
+                break;
         }
 
-        return 0;
+        WSACloseEvent(event);
+
+        if (lost && session->IsRunning)
+        {
+            XILOADER_WARNING("Lost the data server connection (%d).", WSAGetLastError());
+            xiloader::flightrecorder::record(xiloader::flightevent::disconnect, 54230, "data server lost");
+        }
+
+        /* Close the connection if we are shutting down before the server finished.. */
+        if (sock->s != INVALID_SOCKET)
+        {
+            closesocket(sock->s);
+            sock->s = INVALID_SOCKET;
+        }
+
+        return lost;
     }
 
     /**
      * @brief Data communication between the local client and the lobby server.
      *
-     * @param lpParam   Thread param object.
-     *
-     * @return Non-important return.
+     * @param session   The session hosting the lobby server.
+     * @param client    The accepted client socket; closed on return.
      */
-    DWORD __stdcall network::PolDataComm(LPVOID lpParam)
+    void network::PolDataComm(xiloader::session* session, SOCKET client)
     {
-        SOCKET client = *(SOCKET*)lpParam;
         unsigned char recvBuffer[1024] = { 0 };
         int result = 0, x = 0;
         time_t t = 0;
         bool bIsNewChar = false;
 
+        /* Replace the accept event inherited from the listening socket.. */
+        auto event = WSACreateEvent();
+        WSAEventSelect(client, event, FD_READ | FD_CLOSE);
+
         do
         {
+            /* Wait for incoming data or shutdown.. */
+            if (!xiloader::network::WaitForSocket(session, client, event))
+                break;
+
             /* Attempt to receive incoming data.. */
             result = recv(client, (char*)recvBuffer, sizeof(recvBuffer), 0);
+            if (result == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK)
+            {
+                result = 1;
+                continue;
+            }
             if (result <= 0)
             {
-                xiloader::console::output(xiloader::color::error, "Client recv failed: %d", WSAGetLastError());
+                XILOADER_ERROR("Client recv failed: %d", WSAGetLastError());
                 break;
             }
 
             char temp = recvBuffer[0x04];
             memset(recvBuffer, 0x00, 32);
 
+            xiloader::flightrecorder::record(xiloader::flightevent::handshake, x, "lobby client step");
+
             switch (x)
             {
             case 0:
@@ -972,7 +1233,7 @@ namespace xiloader
             /* Echo back the buffer to the server.. */
             if (send(client, (char*)recvBuffer, result, 0) == SOCKET_ERROR)
             {
-                xiloader::console::output(xiloader::color::error, "Client send failed: %d", WSAGetLastError());
+                XILOADER_ERROR("Client send failed: %d", WSAGetLastError());
                 break;
             }
 
@@ -985,66 +1246,177 @@ namespace xiloader
 
         /* Shutdown the client socket.. */
         if (shutdown(client, SD_SEND) == SOCKET_ERROR)
-            xiloader::console::output(xiloader::color::error, "Client shutdown failed: %d", WSAGetLastError());
+            XILOADER_ERROR("Client shutdown failed: %d", WSAGetLastError());
         closesocket(client);
+        WSACloseEvent(event);
 
-        return 0;
+        xiloader::flightrecorder::record(xiloader::flightevent::disconnect, client, "lobby client");
     }
 
     /**
-     * @brief Starts the data communication between the client and server.
+     * @brief Connects to the data server and runs the data communication until shutdown.
      *
-     * @param lpParam   Thread param object.
+     * @param lpParam   The session object.
      *
      * @return Non-important return.
      */
     DWORD __stdcall network::FFXiServer(LPVOID lpParam)
     {
+        auto session = (xiloader::session*)lpParam;
+
         /* Attempt to create connection to the server.. */
-        if (!xiloader::network::CreateConnection((xiloader::datasocket*)lpParam, "54230"))
+        if (!xiloader::network::CreateConnection(session, "54230"))
             return 1;
 
-        /* Attempt to start data communication with the server.. */
-        CreateThread(NULL, 0, xiloader::network::FFXiDataComm, lpParam, 0, NULL);
-        Sleep(200);
+        /* Run the data communication, resuming the session whenever the connection drops.. */
+        for (;;)
+        {
+            xiloader::network::EnableKeepAlive(session->Socket.s);
+            if (!xiloader::network::FFXiDataComm(session) || !session->IsRunning)
+                return 0;
 
+            if (!xiloader::network::ReconnectDataServer(session))
+                return 1;
+        }
+    }
+
+    /**
+     * @brief A lobby client handed to its handler thread.
+     */
+    typedef struct polclient_t
+    {
+        xiloader::session* Session; // The session hosting the lobby server.
+        SOCKET Client;              // The accepted client socket.
+    } polclient;
+
+    /**
+     * @brief Runs the data communication of a single lobby client.
+     *
+     * @param lpParam   The polclient object; deleted on return.
+     *
+     * @return Non-important return.
+     */
+    static DWORD __stdcall PolClient(LPVOID lpParam)
+    {
+        std::unique_ptr<polclient> client(static_cast<polclient*>(lpParam));
+        xiloader::network::PolDataComm(client->Session, client->Client);
         return 0;
     }
 
     /**
      * @brief Starts the local listen server to lobby server communications.
      *
-     * @param lpParam   Thread param object.
+     * @param lpParam   The session object.
      *
      * @return Non-important return.
      */
     DWORD __stdcall network::PolServer(LPVOID lpParam)
     {
-        UNREFERENCED_PARAMETER(lpParam);
-
+        auto session = (xiloader::session*)lpParam;
         SOCKET sock, client;
 
         /* Attempt to create listening server.. */
-        if (!xiloader::network::CreateListenServer(&sock, IPPROTO_TCP, g_ServerPort.c_str()))
+        if (!xiloader::network::CreateListenServer(&sock, IPPROTO_TCP, session->ServerPort.c_str()))
             return 1;
 
-        while (g_IsRunning)
+        auto event = WSACreateEvent();
+        WSAEventSelect(sock, event, FD_ACCEPT);
+
+        DWORD result = 0;
+        std::vector<HANDLE> handlers;
+
+        while (session->IsRunning)
         {
+            /* Wait for incoming connections or shutdown.. */
+            if (!xiloader::network::WaitForSocket(session, sock, event))
+                break;
+
             /* Attempt to accept incoming connections.. */
             if ((client = accept(sock, NULL, NULL)) == INVALID_SOCKET)
             {
-                xiloader::console::output(xiloader::color::error, "Accept failed: %d", WSAGetLastError());
+                if (WSAGetLastError() == WSAEWOULDBLOCK)
+                    continue;
 
-                closesocket(sock);
-                return 1;
+                XILOADER_ERROR("Accept failed: %d", WSAGetLastError());
+                result = 1;
+                break;
             }
 
-            /* Start data communication for this client.. */
-            CreateThread(NULL, 0, xiloader::network::PolDataComm, &client, 0, NULL);
+            xiloader::flightrecorder::record(xiloader::flightevent::connect, client, "lobby client");
+
+            /* Forget the handlers that already finished.. */
+            handlers.erase(std::remove_if(handlers.begin(), handlers.end(), [](HANDLE handler)
+            {
+                if (WaitForSingleObject(handler, 0) != WAIT_OBJECT_0)
+                    return false;
+                CloseHandle(handler);
+                return true;
+            }), handlers.end());
+
+            /* Run the data communication for this client on its own thread; it blocks for the whole conversation.. */
+            auto handler = CreateThread(NULL, 0, PolClient, new polclient{ session, client }, 0, NULL);
+            if (handler == NULL)
+            {
+                XILOADER_ERROR("Failed to start the lobby client handler: %d", GetLastError());
+                closesocket(client);
+                continue;
+            }
+            handlers.push_back(handler);
         }
 
         closesocket(sock);
-        return 0;
+        WSACloseEvent(event);
+
+        /* Wait for the client handlers; they exit as soon as the shutdown event is set.. */
+        for (auto handler : handlers)
+        {
+            WaitForSingleObject(handler, INFINITE);
+            CloseHandle(handler);
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Signals the network threads of a session to exit and joins them.
+     *
+     * Threads are never killed; a thread that does not exit in time is left
+     * to the process exit and reported.
+     *
+     * @param session   The session to shut down.
+     * @param threads   The threads to join; NULL entries are skipped.
+     * @param count     The number of threads.
+     * @param timeout   The maximum time to wait, in milliseconds.
+     *
+     * @return True if every thread exited in time, false otherwise.
+     */
+    bool network::Shutdown(xiloader::session* session, HANDLE* threads, DWORD count, DWORD timeout)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        session->IsRunning = false;
+        SetEvent(session->ShutdownEvent);
+
+        std::vector<HANDLE> handles;
+        for (DWORD x = 0; x < count; x++)
+        {
+            if (threads[x] != NULL)
+                handles.push_back(threads[x]);
+        }
+
+        auto stopped = handles.empty() || WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), TRUE, timeout) != WAIT_TIMEOUT;
+        for (auto handle : handles)
+            CloseHandle(handle);
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        xiloader::flightrecorder::record(xiloader::flightevent::stop, static_cast<uint64_t>(elapsed * 1000), "network threads (us)");
+
+        if (stopped)
+            XILOADER_DEBUG(xiloader::color::debug, "Network threads stopped in %.1f ms.", elapsed);
+        else
+            XILOADER_WARNING("Network threads did not stop within %u ms.", timeout);
+
+        return stopped;
     }
 
 }; // namespace xiloader
@@ -37,6 +37,8 @@ This file is part of DarkStar-server source code.
 #include <sstream> 
 
 #include "console.h"
+#include "flightrecorder.h"
+#include "session.h"
 
 #define LOGIN_ATTEMPT      0x10
 #define LOGIN_CREATE       0x20
@@ -66,56 +68,95 @@ This file is part of DarkStar-server source code.
 
 #define SHUTDOWN           0x15
 
-namespace xiloader
-{
-    /**
-     * @brief Socket object used to hold various important information.
-     */
-    typedef struct datasocket_t
-    {
-        datasocket_t() : s(INVALID_SOCKET), AccountId(0), LocalAddress((ULONG)-1), ServerAddress((ULONG)-1)
-        {}
+/* Keepalive idle time and probe interval of the data channel, in milliseconds. */
+#define DATACOMM_KEEPALIVE_TIME     10000
+#define DATACOMM_KEEPALIVE_INTERVAL 1000
+
+/* Time the data server has to send its next request once one was answered. */
+#define DATACOMM_READ_DEADLINE      10000
 
-        SOCKET s;
-        UINT32 AccountId;
-        ULONG LocalAddress;
-        ULONG ServerAddress;
-    } datasocket;
+/* Data channel reconnect attempts and their backoff bounds, in milliseconds. */
+#define DATACOMM_RECONNECT_ATTEMPTS 8
+#define DATACOMM_BACKOFF_BASE       250
+#define DATACOMM_BACKOFF_MAX        8000
 
+namespace xiloader
+{
     /**
      * @brief Network class containing functions related to networking.
      */
     class network
     {
+        /**
+         * @brief Waits for network events on a socket or for the session to shut down.
+         *
+         * @param session       The session the socket belongs to.
+         * @param sock          The socket to wait on.
+         * @param event         The event associated with the socket through WSAEventSelect.
+         * @param timeout       The maximum time to wait, in milliseconds.
+         *
+         * @return True once the socket has events pending, false on shutdown, timeout (WSAETIMEDOUT) or error.
+         */
+        static bool WaitForSocket(xiloader::session* session, SOCKET sock, WSAEVENT event, DWORD timeout = INFINITE);
+
+        /**
+         * @brief Enables fast keepalive probing on a socket so a dead peer is detected in seconds.
+         *
+         * @param sock          The socket to enable keepalive on.
+         */
+        static void EnableKeepAlive(SOCKET sock);
+
+        /**
+         * @brief Reconnects the data channel with jittered exponential backoff.
+         *
+         * @param session       The session whose data connection was lost.
+         *
+         * @return True once reconnected, false on shutdown or when every attempt failed.
+         */
+        static bool ReconnectDataServer(xiloader::session* session);
+
         /**
          * @brief Data communication between the local client and the game server.
          *
-         * @param lpParam       Thread param object.
+         * @param session       The session object.
          *
-         * @return Non-important return.
+         * @return True if the connection was lost and should be re-established, false otherwise.
          */
-        static DWORD __stdcall FFXiDataComm(LPVOID lpParam);
+        static bool FFXiDataComm(xiloader::session* session);
 
         /**
          * @brief Data communication between the local client and the lobby server.
          *
-         * @param lpParam       Thread param object.
-         *
-         * @return Non-important return.
+         * @param session       The session hosting the lobby server.
+         * @param client        The accepted client socket; closed on return.
          */
-        static DWORD __stdcall PolDataComm(LPVOID lpParam);
+        static void PolDataComm(xiloader::session* session, SOCKET client);
         
     public:
 
+        /**
+         * @brief Connects a new socket to the given server.
+         *
+         * @param address       The server address to connect to.
+         * @param port          The port to connect to.
+         * @param report        Should failures be logged?
+         *
+         * @return The connected socket, INVALID_SOCKET on failure.
+         */
+        static SOCKET Connect(const char* address, const char* port, bool report);
+
         /**
          * @brief Creates a connection on the given port.
          *
-         * @param sock          The datasocket object to store information within.
+         * Account server connections are taken from the session's pre-warmed pool
+         * when one is available.
+         *
+         * @param session       The session whose socket stores the connection.
          * @param port          The port to create the connection on.
          *
          * @return True on success, false otherwise.
          */
-        static bool CreateConnection(datasocket* sock, const char* port);
+        static bool CreateConnection(xiloader::session* session, const char* port);
 
         /**
          * @brief Creates a listening server on the given port and protocol.
@@ -141,43 +182,63 @@ namespace xiloader
         /**
          * @brief Verifies the players login information; also handles creating new accounts.
          *
-         * @param sock          The datasocket object with the connection socket.
+         * @param session       The session to log in.
          *
          * @return True on success, false otherwise.
          */
-        static bool VerifyAccount(datasocket* sock);
+        static bool VerifyAccount(xiloader::session* session);
+
+        /**
+         * @brief Logs in with the session credentials without prompting and goes straight to play.
+         *
+         * @param session       The session to log in; its username and password must be set.
+         *
+         * @return XILOADER_EXIT_SUCCESS on success, XILOADER_EXIT_LOGIN if the credentials were
+         *         rejected, XILOADER_EXIT_CONNECT if the server could not be reached.
+         */
+        static int LoginHeadless(xiloader::session* session);
+
+        /**
+         * @brief Reads the username and password from a credentials file; one per line.
+         *
+         * @param session       The session to store the credentials in.
+         * @param path          The path of the file; "-" reads from standard input.
+         *
+         * @return True on success, false if the file could not be read or is incomplete.
+         */
+        static bool LoadCredentials(xiloader::session* session, const char* path);
 
 		/**
 		* @brief Gets user's password
 		*
-		* @param null
+		* @param session       The session to store the password in.
 		*
 		* @return null
 		*/
-		static void PromptForPassword();
+		static void PromptForPassword(xiloader::session* session);
 
 		/**
 		* @brief Gets user's password
 		*
-		* @param null
+		* @param session       The session to store the password in.
 		*
 		* @return null
 		*/
-		static void PromptForConfirmPassword();
+		static void PromptForConfirmPassword(xiloader::session* session);
 
 		/**
 		* @brief Change security question prompt
 		*
-		* @param null
+		* @param session       The session to store the question and answer in.
 		*
 		* @return null
 		*/
-		static void ChangeSecurityQuestion();
+		static void ChangeSecurityQuestion(xiloader::session* session);
         
         /**
-         * @brief Starts the data communication between the client and server.
+         * @brief Connects to the data server and runs the data communication until shutdown.
          *
-         * @param lpParam       Thread param object.
+         * @param lpParam       The session object.
          *
          * @return Non-important return.
          */
@@ -186,11 +247,23 @@ namespace xiloader
         /**
          * @brief Starts the local listen server to lobby server communications.
          *
-         * @param lpParam       Thread param object.
+         * @param lpParam       The session object.
          *
          * @return Non-important return.
          */
         static DWORD __stdcall PolServer(LPVOID lpParam);
+
+        /**
+         * @brief Signals the network threads of a session to exit and joins them.
+         *
+         * @param session       The session to shut down.
+         * @param threads       The threads to join; NULL entries are skipped.
+         * @param count         The number of threads.
+         * @param timeout       The maximum time to wait, in milliseconds.
+         *
+         * @return True if every thread exited in time, false otherwise.
+         */
+        static bool Shutdown(xiloader::session* session, HANDLE* threads, DWORD count, DWORD timeout);
     };
 
 }; // namespace xiloader
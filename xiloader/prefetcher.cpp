@@ -0,0 +1,405 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "prefetcher.h"
+#include "console.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+/* Trace database identification. */
+#define PREFETCH_MAGIC          "XIPF"
+#define PREFETCH_VERSION        1
+
+namespace xiloader
+{
+    /* Prefetcher state; guarded by s_Lock unless atomic. */
+    static std::mutex s_Lock;
+    static std::condition_variable s_Wake;
+    static std::thread s_Thread;
+    static std::string s_Path;
+    static bool s_Running = false;
+    static bool s_Dirty = false;
+    static prefetcher::resolvefn s_Resolve;
+    static std::unordered_map<uint16_t, std::vector<uint16_t>> s_Traces; // Keyed by the first file of the load.
+    static std::vector<uint16_t> s_Current; // Files of the load in progress, in read order.
+    static std::unordered_set<uint16_t> s_CurrentSet;
+    static std::deque<uint16_t> s_Queue; // Files predicted for the load in progress.
+    static std::unordered_set<uint16_t> s_Warmed; // Files prefetched for the load in progress.
+    static bool s_ZonePending = false; // A zone change was reported; the next read starts its load.
+    static bool s_ZoneDriven = false; // Zone changes are reported; pauses no longer start loads.
+    static std::atomic<uint32_t> s_Generation(0); // Bumped when a new load starts.
+    static std::atomic<int64_t> s_LastRead(0); // Time of the last game read, in ms.
+    static std::atomic<uint64_t> s_Prefetched(0);
+    static std::atomic<uint64_t> s_Useful(0);
+
+    /**
+     * @brief Obtains a monotonic timestamp.
+     *
+     * @return The time in milliseconds.
+     */
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Stores the load in progress in the trace database; the lock must be held.
+     */
+    static void commit()
+    {
+        if (s_Current.size() >= PREFETCH_MIN_FILES && (s_Traces.size() < PREFETCH_MAX_TRACES || s_Traces.count(s_Current.front()) != 0))
+        {
+            s_Traces[s_Current.front()] = s_Current;
+            s_Dirty = true;
+        }
+
+        s_Current.clear();
+        s_CurrentSet.clear();
+        s_Queue.clear();
+        s_Warmed.clear();
+    }
+
+    /**
+     * @brief Reads the trace database.
+     *
+     * @param path      The path of the database.
+     *
+     * @return True on success or if there is no database yet, false otherwise.
+     */
+    static bool load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return true;
+
+        char magic[4] = { 0 };
+        uint32_t version = 0, count = 0;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || memcmp(magic, PREFETCH_MAGIC, sizeof(magic)) != 0 || version != PREFETCH_VERSION || count > PREFETCH_MAX_TRACES)
+            return false;
+
+        for (uint32_t x = 0; x < count; x++)
+        {
+            uint16_t length = 0;
+            file.read(reinterpret_cast<char*>(&length), sizeof(length));
+            if (!file || length == 0 || length > PREFETCH_MAX_FILES)
+                return false;
+
+            std::vector<uint16_t> trace(length);
+            file.read(reinterpret_cast<char*>(trace.data()), length * sizeof(uint16_t));
+            if (!file)
+                return false;
+
+            s_Traces[trace.front()].swap(trace);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Writes the trace database; replaces the previous one only once it is complete.
+     *
+     * @param path      The path of the database.
+     *
+     * @return True on success, false otherwise.
+     */
+    static bool save(const std::string& path)
+    {
+        auto temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                return false;
+
+            uint32_t version = PREFETCH_VERSION;
+            uint32_t count = static_cast<uint32_t>(s_Traces.size());
+            file.write(PREFETCH_MAGIC, 4);
+            file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+            file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+            for (auto& trace : s_Traces)
+            {
+                auto length = static_cast<uint16_t>(trace.second.size());
+                file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                file.write(reinterpret_cast<const char*>(trace.second.data()), length * sizeof(uint16_t));
+            }
+
+            if (!file)
+                return false;
+        }
+
+        remove(path.c_str());
+        return rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    /**
+     * @brief Reads a file into the system file cache, staying off the disk while the game reads.
+     *
+     * @param path          The path of the file.
+     * @param generation    The load the file was predicted for.
+     * @param buffer        Scratch buffer of PREFETCH_CHUNK bytes.
+     *
+     * @return True if the whole file was read, false otherwise.
+     */
+    static bool warm(const std::string& path, uint32_t generation, std::vector<char>& buffer)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        for (;;)
+        {
+            /* Foreground reads always go first.. */
+            while (now() - s_LastRead.load() < PREFETCH_YIELD)
+                std::this_thread::sleep_for(std::chrono::milliseconds(PREFETCH_YIELD));
+
+            /* Give up on files of a load that is no longer in progress.. */
+            if (s_Generation.load() != generation)
+                return false;
+
+            file.read(buffer.data(), buffer.size());
+            if (file.gcount() < static_cast<std::streamsize>(buffer.size()))
+                return file.eof();
+        }
+    }
+
+    /**
+     * @brief Prefetch thread; reads the predicted files in order.
+     */
+    static void worker()
+    {
+#ifdef _WIN32
+        /* Background mode also lowers the I/O priority of the thread; it needs Vista or later.. */
+#ifdef THREAD_MODE_BACKGROUND_BEGIN
+        if (!::SetThreadPriority(::GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN))
+#endif
+            ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#endif
+
+        std::vector<char> buffer(PREFETCH_CHUNK);
+        std::unique_lock<std::mutex> lock(s_Lock);
+        while (s_Running)
+        {
+            if (s_Queue.empty())
+            {
+                s_Wake.wait(lock);
+                continue;
+            }
+
+            auto fileNo = s_Queue.front();
+            s_Queue.pop_front();
+
+            /* The game got there first.. */
+            if (s_CurrentSet.count(fileNo) != 0)
+                continue;
+
+            auto generation = s_Generation.load();
+            auto resolve = s_Resolve;
+            lock.unlock();
+
+            std::string path;
+            auto warmed = resolve && resolve(fileNo, path) && warm(path, generation, buffer);
+
+            lock.lock();
+            if (warmed && s_Generation.load() == generation)
+            {
+                s_Warmed.insert(fileNo);
+                s_Prefetched++;
+            }
+        }
+    }
+
+    /**
+     * @brief Loads the trace database and starts the prefetch thread.
+     *
+     * @param path      The path of the database; nullptr for xiloader.prefetch in the temp folder.
+     *
+     * @return True on success, false if the database could not be read; prefetching still starts.
+     */
+    bool prefetcher::open(const char* path)
+    {
+        close();
+
+        std::string database;
+        if (path != nullptr)
+        {
+            database = path;
+        }
+        else
+        {
+            char folder[260] = { 0 };
+#ifdef _WIN32
+            if (::GetTempPathA(sizeof(folder), folder) == 0)
+                return false;
+#else
+            strcpy(folder, "/tmp/");
+#endif
+            database = std::string(folder) + "xiloader.prefetch";
+        }
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        s_Path = database;
+        s_ZonePending = false;
+        s_ZoneDriven = false;
+        s_Traces.clear();
+        auto loaded = load(s_Path);
+        if (!loaded)
+            s_Traces.clear();
+        else
+            XILOADER_DEBUG(xiloader::color::debug, "Loaded %u zone load traces.", static_cast<uint32_t>(s_Traces.size()));
+
+        s_Running = true;
+        s_Thread = std::thread(worker);
+        return loaded;
+    }
+
+    /**
+     * @brief Saves the trace database and stops the prefetch thread.
+     */
+    void prefetcher::close()
+    {
+        {
+            std::lock_guard<std::mutex> guard(s_Lock);
+            if (!s_Running)
+                return;
+
+            commit();
+            s_Running = false;
+            s_Generation++;
+            s_Wake.notify_all();
+        }
+
+        s_Thread.join();
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (s_Dirty && !save(s_Path))
+            XILOADER_WARNING("Failed to save the prefetch traces: %s", s_Path.c_str());
+        s_Dirty = false;
+    }
+
+    /**
+     * @brief Sets how file numbers are mapped onto DAT paths; files that do not resolve are not prefetched.
+     *
+     * @param resolve   The resolver.
+     */
+    void prefetcher::resolver(resolvefn resolve)
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        s_Resolve = resolve;
+    }
+
+    /**
+     * @brief Records a DAT read of the game.
+     *
+     * @param fileNo    The file number being read.
+     */
+    void prefetcher::observe(uint16_t fileNo)
+    {
+        auto time = now();
+        auto last = s_LastRead.exchange(time);
+
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (!s_Running)
+            return;
+
+        /* A pause in the reads ends the load in progress.. */
+        if (!s_Current.empty() && time - last > PREFETCH_BURST_GAP)
+            commit();
+
+        /* A new load; queue what followed its first file last time.. */
+        if (s_Current.empty())
+        {
+            /* Once zone changes are reported, other reads are the game's ordinary traffic.. */
+            if (s_ZoneDriven && !s_ZonePending)
+                return;
+
+            s_ZonePending = false;
+            s_Generation++;
+            auto trace = s_Traces.find(fileNo);
+            if (trace != s_Traces.end())
+            {
+                s_Queue.assign(trace->second.begin() + 1, trace->second.end());
+                s_Wake.notify_one();
+            }
+        }
+
+        if (s_Current.size() < PREFETCH_MAX_FILES && s_CurrentSet.insert(fileNo).second)
+            s_Current.push_back(fileNo);
+
+        if (s_Warmed.erase(fileNo) != 0)
+            s_Useful++;
+    }
+
+    /**
+     * @brief Ends the load in progress; the next DAT read starts the load of the zone being entered.
+     */
+    void prefetcher::zonechange()
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (!s_Running)
+            return;
+
+        commit();
+        s_Generation++;
+        s_ZonePending = true;
+        s_ZoneDriven = true;
+    }
+
+    /**
+     * @brief Obtains the number of files read ahead of the game.
+     *
+     * @return The prefetch count.
+     */
+    uint64_t prefetcher::prefetched()
+    {
+        return s_Prefetched.load();
+    }
+
+    /**
+     * @brief Obtains the number of prefetched files the game went on to read.
+     *
+     * @return The useful prefetch count.
+     */
+    uint64_t prefetcher::useful()
+    {
+        return s_Useful.load();
+    }
+
+}; // namespace xiloader
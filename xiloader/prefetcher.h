@@ -0,0 +1,126 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_PREFETCHER_H_INCLUDED__
+#define __XILOADER_PREFETCHER_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/* Time without DAT reads, in milliseconds, that ends a zone load. */
+#define PREFETCH_BURST_GAP      3000
+
+/* Loads reading fewer files than this are not recorded. */
+#define PREFETCH_MIN_FILES      8
+
+/* Largest number of files recorded per zone load. */
+#define PREFETCH_MAX_FILES      1024
+
+/* Largest number of zone loads kept in the trace database. */
+#define PREFETCH_MAX_TRACES     1024
+
+/* Time, in milliseconds, the prefetcher stays off the disk after a game read. */
+#define PREFETCH_YIELD          10
+
+/* Size of a single prefetch read. */
+#define PREFETCH_CHUNK          65536
+
+namespace xiloader
+{
+    /**
+     * @brief Predicts and prefetches the DAT files of a zone load.
+     *
+     * Every DAT read of the game is observed. A zone load starts when the
+     * zone change patch reports a zone change and lasts until the reads pause
+     * for PREFETCH_BURST_GAP; it is keyed by its first file number, which is
+     * the zone's own DAT. Reads outside a zone load are not recorded. Until
+     * the first zone change is reported, e.g. when the patch is missing, a
+     * pause in the reads starts a load instead.
+     *
+     * The file order of each load is kept in a trace database that persists
+     * across sessions. When a load starts with a known file, a background
+     * thread reads the files that followed it last time into the system file
+     * cache. The thread runs at background priority and backs off whenever
+     * the game itself reads.
+     */
+    class prefetcher
+    {
+    public:
+        typedef std::function<bool(uint16_t fileNo, std::string& path)> resolvefn;
+
+        /**
+         * @brief Loads the trace database and starts the prefetch thread.
+         *
+         * @param path      The path of the database; nullptr for xiloader.prefetch in the temp folder.
+         *
+         * @return True on success, false if the database could not be read; prefetching still starts.
+         */
+        static bool open(const char* path);
+
+        /**
+         * @brief Saves the trace database and stops the prefetch thread.
+         */
+        static void close();
+
+        /**
+         * @brief Sets how file numbers are mapped onto DAT paths; files that do not resolve are not prefetched.
+         *
+         * @param resolve   The resolver.
+         */
+        static void resolver(resolvefn resolve);
+
+        /**
+         * @brief Records a DAT read of the game.
+         *
+         * @param fileNo    The file number being read.
+         */
+        static void observe(uint16_t fileNo);
+
+        /**
+         * @brief Ends the load in progress; the next DAT read starts the load of the zone being entered.
+         */
+        static void zonechange();
+
+        /**
+         * @brief Obtains the number of files read ahead of the game.
+         *
+         * @return The prefetch count.
+         */
+        static uint64_t prefetched();
+
+        /**
+         * @brief Obtains the number of prefetched files the game went on to read.
+         *
+         * @return The useful prefetch count.
+         */
+        static uint64_t useful();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_PREFETCHER_H_INCLUDED__
@@ -0,0 +1,331 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "scheduler.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+
+/* The module this code is linked into; differs from the process image inside xiloadercore.dll. */
+extern "C" IMAGE_DOS_HEADER __ImageBase;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <queue>
+#include <thread>
+
+namespace xiloader
+{
+    /**
+     * @brief Job queue owned by a single worker.
+     */
+    struct workerqueue
+    {
+        std::mutex Lock;
+        std::deque<std::function<void()>> Jobs;
+    };
+
+    /**
+     * @brief Job waiting for its delay to elapse.
+     */
+    struct delayedjob
+    {
+        std::chrono::steady_clock::time_point Due;
+        std::function<void()> Job;
+
+        bool operator<(const delayedjob& other) const
+        {
+            return Due > other.Due; // Earliest first in a priority_queue.
+        }
+    };
+
+    /* Scheduler state; the workers are started on first use. */
+    static workerqueue s_Queues[SCHEDULER_MAX_WORKERS];
+    static std::thread s_Workers[SCHEDULER_MAX_WORKERS];
+    static uint32_t s_WorkerCount = 0;
+    static std::atomic<uint32_t> s_NextQueue(0);
+    static std::atomic<uint32_t> s_Pending(0);
+    static std::atomic<uint64_t> s_Stolen(0);
+    static std::atomic<int> s_State(0); // 0 = idle, 1 = running, 2 = stopped
+    static std::once_flag s_StartFlag;
+    static std::mutex s_SleepLock;
+    static std::condition_variable s_Wake;
+    static std::priority_queue<delayedjob> s_Delayed;
+    static thread_local int t_Worker = -1;
+
+    /**
+     * @brief Joins the workers when the process exits.
+     */
+    static struct schedulerguard
+    {
+        ~schedulerguard()
+        {
+#ifdef _WIN32
+            /* Inside a DLL this runs under the loader lock, where joining a thread deadlocks; xiloader_uninitialize stops it there.. */
+            if (reinterpret_cast<HMODULE>(&__ImageBase) != GetModuleHandleA(NULL))
+                return;
+#endif
+            xiloader::scheduler::stop();
+        }
+    } s_Guard;
+
+    /**
+     * @brief Takes a job for the given worker; its own newest job, else another worker's oldest.
+     *
+     * @param worker    The index of the worker, -1 for a thread outside the pool.
+     * @param job       Receives the job.
+     *
+     * @return True if a job was taken, false if every queue is empty.
+     */
+    static bool take(int worker, std::function<void()>& job)
+    {
+        if (worker >= 0)
+        {
+            auto& own = s_Queues[worker];
+            std::lock_guard<std::mutex> guard(own.Lock);
+            if (!own.Jobs.empty())
+            {
+                job = std::move(own.Jobs.back());
+                own.Jobs.pop_back();
+                s_Pending.fetch_sub(1);
+                return true;
+            }
+        }
+
+        auto start = worker >= 0 ? static_cast<uint32_t>(worker) + 1 : 0;
+        for (uint32_t x = 0; x < s_WorkerCount; x++)
+        {
+            auto victim = (start + x) % s_WorkerCount;
+            if (static_cast<int>(victim) == worker)
+                continue;
+
+            auto& queue = s_Queues[victim];
+            std::lock_guard<std::mutex> guard(queue.Lock);
+            if (!queue.Jobs.empty())
+            {
+                job = std::move(queue.Jobs.front());
+                queue.Jobs.pop_front();
+                s_Pending.fetch_sub(1);
+                if (worker >= 0)
+                    s_Stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Pushes a job onto a worker queue and wakes a sleeping worker.
+     *
+     * @param job       The job to queue.
+     */
+    static void enqueue(std::function<void()> job)
+    {
+        auto index = t_Worker >= 0 ? static_cast<uint32_t>(t_Worker) : s_NextQueue.fetch_add(1) % s_WorkerCount;
+        {
+            std::lock_guard<std::mutex> guard(s_Queues[index].Lock);
+            s_Queues[index].Jobs.push_back(std::move(job));
+            s_Pending.fetch_add(1);
+        }
+
+        std::lock_guard<std::mutex> guard(s_SleepLock);
+        s_Wake.notify_one();
+    }
+
+    /**
+     * @brief Worker thread; runs jobs until the scheduler is stopped and drained.
+     *
+     * @param index     The index of the worker.
+     */
+    static void worker(int index)
+    {
+        t_Worker = index;
+
+        std::function<void()> job;
+        for (;;)
+        {
+            if (take(index, job))
+            {
+                job();
+                job = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(s_SleepLock);
+
+            /* Move delayed jobs that are due onto our queue.. */
+            auto now = std::chrono::steady_clock::now();
+            auto moved = false;
+            while (!s_Delayed.empty() && s_Delayed.top().Due <= now && s_State.load() == 1)
+            {
+                std::lock_guard<std::mutex> guard(s_Queues[index].Lock);
+                s_Queues[index].Jobs.push_back(s_Delayed.top().Job);
+                s_Pending.fetch_add(1);
+                s_Delayed.pop();
+                moved = true;
+            }
+            if (moved || s_Pending.load() != 0)
+                continue;
+
+            if (s_State.load() != 1)
+                break;
+
+            /* Sleep until a job is queued or the next delayed job is due.. */
+            if (s_Delayed.empty())
+                s_Wake.wait(lock);
+            else
+                s_Wake.wait_until(lock, s_Delayed.top().Due);
+        }
+    }
+
+    /**
+     * @brief Starts the worker threads.
+     */
+    static void start()
+    {
+        auto cores = std::thread::hardware_concurrency();
+        s_WorkerCount = std::min<uint32_t>(std::max<uint32_t>(cores, 2), SCHEDULER_MAX_WORKERS);
+
+        auto expected = 0;
+        if (!s_State.compare_exchange_strong(expected, 1))
+            return;
+
+        for (uint32_t x = 0; x < s_WorkerCount; x++)
+            s_Workers[x] = std::thread(worker, static_cast<int>(x));
+    }
+
+    /**
+     * @brief Queues a job.
+     *
+     * Once the scheduler is stopped jobs run synchronously on the caller.
+     *
+     * @param job       The job to run.
+     */
+    void scheduler::post(std::function<void()> job)
+    {
+        std::call_once(s_StartFlag, start);
+        if (s_State.load() != 1)
+        {
+            job();
+            return;
+        }
+
+        enqueue(std::move(job));
+    }
+
+    /**
+     * @brief Queues a job to run after a delay.
+     *
+     * Delayed jobs still pending when the scheduler stops are discarded.
+     *
+     * @param job       The job to run.
+     * @param delay     The delay in milliseconds.
+     */
+    void scheduler::post(std::function<void()> job, uint32_t delay)
+    {
+        std::call_once(s_StartFlag, start);
+        if (s_State.load() != 1)
+            return;
+
+        std::lock_guard<std::mutex> guard(s_SleepLock);
+        s_Delayed.push(delayedjob{ std::chrono::steady_clock::now() + std::chrono::milliseconds(delay), std::move(job) });
+        s_Wake.notify_one();
+    }
+
+    /**
+     * @brief Runs a single queued job on the calling thread, if there is one.
+     *
+     * @return True if a job was run, false otherwise.
+     */
+    bool scheduler::runone()
+    {
+        std::function<void()> job;
+        if (s_State.load() == 0 || !take(t_Worker, job))
+            return false;
+
+        job();
+        return true;
+    }
+
+    /**
+     * @brief Determines if the calling thread is a scheduler worker.
+     *
+     * @return True on a worker thread, false otherwise.
+     */
+    bool scheduler::onworker()
+    {
+        return t_Worker >= 0;
+    }
+
+    /**
+     * @brief Obtains the number of worker threads.
+     *
+     * @return The worker count.
+     */
+    uint32_t scheduler::workers()
+    {
+        std::call_once(s_StartFlag, start);
+        return s_WorkerCount;
+    }
+
+    /**
+     * @brief Obtains the number of jobs taken from another worker's queue.
+     *
+     * @return The steal count.
+     */
+    uint64_t scheduler::stolen()
+    {
+        return s_Stolen.load();
+    }
+
+    /**
+     * @brief Runs every queued job and joins the workers.
+     */
+    void scheduler::stop()
+    {
+        auto expected = 1;
+        if (!s_State.compare_exchange_strong(expected, 2))
+        {
+            /* Never started; make later jobs synchronous.. */
+            expected = 0;
+            s_State.compare_exchange_strong(expected, 2);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(s_SleepLock);
+            while (!s_Delayed.empty())
+                s_Delayed.pop();
+            s_Wake.notify_all();
+        }
+
+        for (uint32_t x = 0; x < s_WorkerCount; x++)
+        {
+            if (s_Workers[x].joinable() && s_Workers[x].get_id() != std::this_thread::get_id())
+                s_Workers[x].join();
+        }
+    }
+
+}; // namespace xiloader
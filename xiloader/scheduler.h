@@ -0,0 +1,340 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_SCHEDULER_H_INCLUDED__
+#define __XILOADER_SCHEDULER_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Upper bound of scheduler worker threads, whatever the core count. */
+#define SCHEDULER_MAX_WORKERS   4
+
+namespace xiloader
+{
+    template<typename T>
+    class future;
+
+    /**
+     * @brief Fixed-size work-stealing pool for loader background jobs.
+     *
+     * Every worker owns a job queue: it pops its own newest job first and
+     * steals the oldest job of another worker when its queue runs dry. Jobs
+     * posted from outside the pool are spread over the queues round-robin.
+     * The worker count follows the core count but never exceeds
+     * SCHEDULER_MAX_WORKERS; the workers start on first use.
+     *
+     * Jobs should be short. Long-lived loops (the data and lobby proxies)
+     * keep dedicated threads so they cannot starve the pool.
+     */
+    class scheduler
+    {
+    public:
+
+        /**
+         * @brief Queues a job.
+         *
+         * Once the scheduler is stopped jobs run synchronously on the caller.
+         *
+         * @param job       The job to run.
+         */
+        static void post(std::function<void()> job);
+
+        /**
+         * @brief Queues a job to run after a delay.
+         *
+         * Delayed jobs still pending when the scheduler stops are discarded.
+         *
+         * @param job       The job to run.
+         * @param delay     The delay in milliseconds.
+         */
+        static void post(std::function<void()> job, uint32_t delay);
+
+        /**
+         * @brief Queues a job and obtains a future for its result.
+         *
+         * @param job       The job to run.
+         *
+         * @return The future receiving the result of the job.
+         */
+        template<typename F>
+        static auto run(F job) -> xiloader::future<decltype(job())>;
+
+        /**
+         * @brief Runs a single queued job on the calling thread, if there is one.
+         *
+         * Used by futures waited on from inside a job, so a capped pool keeps
+         * making progress instead of deadlocking.
+         *
+         * @return True if a job was run, false otherwise.
+         */
+        static bool runone();
+
+        /**
+         * @brief Determines if the calling thread is a scheduler worker.
+         *
+         * @return True on a worker thread, false otherwise.
+         */
+        static bool onworker();
+
+        /**
+         * @brief Obtains the number of worker threads.
+         *
+         * @return The worker count.
+         */
+        static uint32_t workers();
+
+        /**
+         * @brief Obtains the number of jobs taken from another worker's queue.
+         *
+         * @return The steal count.
+         */
+        static uint64_t stolen();
+
+        /**
+         * @brief Runs every queued job and joins the workers.
+         */
+        static void stop();
+    };
+
+    /**
+     * @brief Shared state of a future; completed once by the job producing it.
+     */
+    template<typename T>
+    class taskstate
+    {
+    public:
+        /* Void jobs complete with "true". */
+        typedef typename std::conditional<std::is_void<T>::value, bool, T>::type value_type;
+
+        taskstate() : Done(false), Value() {}
+
+        /**
+         * @brief Stores the result and queues the continuations.
+         */
+        void complete()
+        {
+            std::vector<std::function<void()>> continuations;
+            {
+                std::lock_guard<std::mutex> guard(Lock);
+                Done = true;
+                continuations.swap(Continuations);
+            }
+            Ready.notify_all();
+
+            for (auto& continuation : continuations)
+                xiloader::scheduler::post(std::move(continuation));
+        }
+
+        std::mutex Lock;
+        std::condition_variable Ready;
+        bool Done;
+        value_type Value;
+        std::exception_ptr Error;
+        std::vector<std::function<void()>> Continuations;
+    };
+
+    /**
+     * @brief Runs a job and stores its result, or its exception, in a task state.
+     */
+    template<typename T>
+    struct taskrunner
+    {
+        template<typename F>
+        static void run(F& job, taskstate<T>& state)
+        {
+            try
+            {
+                state.Value = job();
+            }
+            catch (...)
+            {
+                state.Error = std::current_exception();
+            }
+            state.complete();
+        }
+    };
+
+    template<>
+    struct taskrunner<void>
+    {
+        template<typename F>
+        static void run(F& job, taskstate<void>& state)
+        {
+            try
+            {
+                job();
+                state.Value = true;
+            }
+            catch (...)
+            {
+                state.Error = std::current_exception();
+            }
+            state.complete();
+        }
+    };
+
+    /**
+     * @brief Result of a scheduled job.
+     */
+    template<typename T>
+    class future
+    {
+        std::shared_ptr<taskstate<T>> m_State;
+
+    public:
+        typedef typename taskstate<T>::value_type value_type;
+
+        future() {}
+        explicit future(std::shared_ptr<taskstate<T>> state) : m_State(std::move(state)) {}
+
+        /**
+         * @brief Determines if the future refers to a job.
+         *
+         * @return True if valid, false for a default constructed future.
+         */
+        bool valid() const
+        {
+            return m_State != nullptr;
+        }
+
+        /**
+         * @brief Determines if the job has completed.
+         *
+         * @return True if completed, false otherwise.
+         */
+        bool ready() const
+        {
+            std::lock_guard<std::mutex> guard(m_State->Lock);
+            return m_State->Done;
+        }
+
+        /**
+         * @brief Blocks until the job has completed.
+         *
+         * Workers run other queued jobs while they wait.
+         */
+        void wait() const
+        {
+            if (xiloader::scheduler::onworker())
+            {
+                while (!ready())
+                {
+                    if (!xiloader::scheduler::runone())
+                    {
+                        std::unique_lock<std::mutex> lock(m_State->Lock);
+                        m_State->Ready.wait_for(lock, std::chrono::milliseconds(1), [this]() { return m_State->Done; });
+                    }
+                }
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(m_State->Lock);
+            m_State->Ready.wait(lock, [this]() { return m_State->Done; });
+        }
+
+        /**
+         * @brief Blocks until the job has completed and obtains its result.
+         *
+         * Rethrows the exception thrown by the job, if any.
+         *
+         * @return The result of the job.
+         */
+        value_type get() const
+        {
+            wait();
+            if (m_State->Error)
+                std::rethrow_exception(m_State->Error);
+            return m_State->Value;
+        }
+
+        /**
+         * @brief Queues a continuation to run once the job has completed.
+         *
+         * @param continuation  Callable receiving this (completed) future.
+         *
+         * @return The future receiving the result of the continuation.
+         */
+        template<typename F>
+        auto then(F continuation) -> xiloader::future<decltype(continuation(std::declval<future<T>>()))>
+        {
+            typedef decltype(continuation(std::declval<future<T>>())) result_type;
+
+            auto next = std::make_shared<taskstate<result_type>>();
+            auto state = m_State;
+            std::function<void()> job = [state, next, continuation]() mutable
+            {
+                future<T> completed(state);
+                auto bound = [&]() { return continuation(completed); };
+                taskrunner<result_type>::run(bound, *next);
+            };
+
+            {
+                std::unique_lock<std::mutex> lock(m_State->Lock);
+                if (!m_State->Done)
+                {
+                    m_State->Continuations.push_back(std::move(job));
+                    return future<result_type>(next);
+                }
+            }
+
+            xiloader::scheduler::post(std::move(job));
+            return future<result_type>(next);
+        }
+    };
+
+    /**
+     * @brief Queues a job and obtains a future for its result.
+     *
+     * @param job       The job to run.
+     *
+     * @return The future receiving the result of the job.
+     */
+    template<typename F>
+    auto scheduler::run(F job) -> xiloader::future<decltype(job())>
+    {
+        typedef decltype(job()) result_type;
+
+        auto state = std::make_shared<taskstate<result_type>>();
+        post([state, job]() mutable
+        {
+            taskrunner<result_type>::run(job, *state);
+        });
+        return future<result_type>(state);
+    }
+
+}; // namespace xiloader
+
+#endif // __XILOADER_SCHEDULER_H_INCLUDED__
@@ -0,0 +1,256 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "serverlist.h"
+#include "network.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace xiloader
+{
+    /**
+     * @brief State of a single in-flight probe.
+     */
+    typedef struct probestate_t
+    {
+        size_t Index;
+        SOCKET Socket;
+        std::chrono::steady_clock::time_point Started;
+        bool Done;
+    } probestate;
+
+    /**
+     * @brief Reads a server list file; one server per line, '#' starts a comment.
+     *
+     * @param path      The path of the list file.
+     * @param servers   The list to append the servers to.
+     *
+     * @return True on success, false if the file could not be read.
+     */
+    bool serverlist::load(const char* path, std::vector<std::string>& servers)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+
+            auto first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos)
+                continue;
+
+            auto last = line.find_last_not_of(" \t\r");
+            servers.push_back(line.substr(first, last - first + 1));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Probes the servers concurrently and ranks them.
+     *
+     * Reachable servers come first, fastest first; the others follow in the
+     * order they were given so they can still be tried as a fallback.
+     *
+     * @param servers   The servers to probe.
+     * @param port      The port to probe.
+     * @param ranked    Receives the ranked servers; servers that do not resolve are left out.
+     */
+    void serverlist::rank(const std::vector<std::string>& servers, const char* port, std::vector<xiloader::serverprobe>& ranked)
+    {
+        ranked.clear();
+
+        auto count = std::min<size_t>(servers.size(), SERVERLIST_MAX_SERVERS);
+        if (count < servers.size())
+            XILOADER_WARNING("Only the first %d servers are probed.", SERVERLIST_MAX_SERVERS);
+
+        /* Resolve every server at once; a slow name lookup must not hold up the others.. */
+        std::vector<xiloader::future<ULONG>> lookups;
+        for (size_t x = 0; x < count; x++)
+        {
+            auto host = servers[x];
+            lookups.push_back(xiloader::scheduler::run([host]()
+            {
+                ULONG address = INADDR_NONE;
+                if (!xiloader::network::ResolveHostname(host.c_str(), &address))
+                    return static_cast<ULONG>(INADDR_NONE);
+                return address;
+            }));
+        }
+
+        /* Start a non-blocking connect to every resolved server.. */
+        std::vector<probestate> probes;
+        for (size_t x = 0; x < count; x++)
+        {
+            auto address = lookups[x].get();
+            if (address == INADDR_NONE)
+            {
+                XILOADER_WARNING("Failed to resolve server: %s", servers[x].c_str());
+                continue;
+            }
+
+            serverprobe probe;
+            probe.Host = servers[x];
+            probe.Address = inet_ntoa(*((struct in_addr*)&address));
+            probe.Reachable = false;
+            probe.Rtt = 0;
+            ranked.push_back(probe);
+
+            struct sockaddr_in remote;
+            memset(&remote, 0x00, sizeof(remote));
+            remote.sin_family = AF_INET;
+            remote.sin_port = htons(static_cast<u_short>(atoi(port)));
+            remote.sin_addr.s_addr = address;
+
+            u_long nonblocking = 1;
+            auto sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (sock == INVALID_SOCKET || ioctlsocket(sock, FIONBIO, &nonblocking) == SOCKET_ERROR)
+            {
+                if (sock != INVALID_SOCKET)
+                    closesocket(sock);
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (::connect(sock, (struct sockaddr*)&remote, sizeof(remote)) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK)
+            {
+                closesocket(sock);
+                continue;
+            }
+
+            probestate state = { ranked.size() - 1, sock, now, false };
+            probes.push_back(state);
+        }
+
+        /* Collect the connects as they complete, all sharing one budget.. */
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SERVERLIST_PROBE_BUDGET);
+        auto pending = probes.size();
+        while (pending > 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                break;
+
+            fd_set writable, failed;
+            FD_ZERO(&writable);
+            FD_ZERO(&failed);
+            for (auto& probe : probes)
+            {
+                if (!probe.Done)
+                {
+                    FD_SET(probe.Socket, &writable);
+                    FD_SET(probe.Socket, &failed);
+                }
+            }
+
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            timeval timeout = { static_cast<long>(remaining / 1000000), static_cast<long>(remaining % 1000000) };
+            if (select(0, NULL, &writable, &failed, &timeout) <= 0)
+                break;
+
+            now = std::chrono::steady_clock::now();
+            for (auto& probe : probes)
+            {
+                if (probe.Done)
+                    continue;
+
+                int error = 0;
+                int length = sizeof(error);
+                if (FD_ISSET(probe.Socket, &writable) && getsockopt(probe.Socket, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == 0 && error == 0)
+                {
+                    auto& result = ranked[probe.Index];
+                    result.Reachable = true;
+                    result.Rtt = std::chrono::duration<double, std::milli>(now - probe.Started).count();
+
+                    /* Servers slower than twice the fastest one are not worth waiting for.. */
+                    auto cutoff = now + (now - probe.Started);
+                    if (cutoff < deadline)
+                        deadline = cutoff;
+                }
+                else if (!FD_ISSET(probe.Socket, &writable) && !FD_ISSET(probe.Socket, &failed))
+                    continue;
+
+                probe.Done = true;
+                pending--;
+            }
+        }
+
+        for (auto& probe : probes)
+            closesocket(probe.Socket);
+
+        /* Fastest reachable server first; unreachable ones keep their order.. */
+        std::stable_sort(ranked.begin(), ranked.end(), [](const serverprobe& a, const serverprobe& b)
+        {
+            if (a.Reachable != b.Reachable)
+                return a.Reachable;
+            return a.Reachable && a.Rtt < b.Rtt;
+        });
+
+        for (auto& probe : ranked)
+        {
+            if (probe.Reachable)
+                XILOADER_DEBUG(xiloader::color::debug, "Server %s (%s): %.1f ms", probe.Host.c_str(), probe.Address.c_str(), probe.Rtt);
+            else
+                XILOADER_DEBUG(xiloader::color::debug, "Server %s (%s): no answer", probe.Host.c_str(), probe.Address.c_str());
+        }
+    }
+
+    /**
+     * @brief Connects the session to the account server, falling back through the ranked servers.
+     *
+     * @param session   The session to connect; its server address is set to the server used.
+     * @param ranked    The ranked servers; when empty the session address is used as is.
+     *
+     * @return True on success, false if no server accepted the connection.
+     */
+    bool serverlist::connect(xiloader::session* session, const std::vector<xiloader::serverprobe>& ranked)
+    {
+        if (ranked.empty())
+            return xiloader::network::CreateConnection(session, "54231");
+
+        for (auto& probe : ranked)
+        {
+            session->ServerAddress = probe.Address;
+            if (probe.Reachable)
+                xiloader::console::output(xiloader::color::info, "Using server %s (%.1f ms).", probe.Host.c_str(), probe.Rtt);
+            else
+                xiloader::console::output(xiloader::color::info, "Using server %s.", probe.Host.c_str());
+
+            if (xiloader::network::CreateConnection(session, "54231"))
+                return true;
+
+            XILOADER_WARNING("Server %s is unavailable; trying the next one.", probe.Host.c_str());
+        }
+
+        return false;
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,101 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_SERVERLIST_H_INCLUDED__
+#define __XILOADER_SERVERLIST_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "session.h"
+
+#include <string>
+#include <vector>
+
+/* Maximum number of servers probed at once. */
+#define SERVERLIST_MAX_SERVERS  32
+
+/* Time every probe shares to connect, in milliseconds. */
+#define SERVERLIST_PROBE_BUDGET 1500
+
+namespace xiloader
+{
+    /**
+     * @brief Result of probing a single server.
+     */
+    typedef struct serverprobe_t
+    {
+        std::string Host;       // The server as given on the command line or in the list file.
+        std::string Address;    // The resolved numeric address; empty if resolving failed.
+        bool Reachable;         // Did the probe connect within the budget?
+        double Rtt;             // The connect round trip time, in milliseconds.
+    } serverprobe;
+
+    /**
+     * @brief Picks the fastest server out of several.
+     *
+     * Every server is probed at the same time with a non-blocking connect to
+     * the account port, so probing takes one shared budget rather than one
+     * timeout per server.
+     */
+    class serverlist
+    {
+    public:
+
+        /**
+         * @brief Reads a server list file; one server per line, '#' starts a comment.
+         *
+         * @param path          The path of the list file.
+         * @param servers       The list to append the servers to.
+         *
+         * @return True on success, false if the file could not be read.
+         */
+        static bool load(const char* path, std::vector<std::string>& servers);
+
+        /**
+         * @brief Probes the servers concurrently and ranks them.
+         *
+         * Reachable servers come first, fastest first; the others follow in the
+         * order they were given so they can still be tried as a fallback.
+         *
+         * @param servers       The servers to probe.
+         * @param port          The port to probe.
+         * @param ranked        Receives the ranked servers; servers that do not resolve are left out.
+         */
+        static void rank(const std::vector<std::string>& servers, const char* port, std::vector<xiloader::serverprobe>& ranked);
+
+        /**
+         * @brief Connects the session to the account server, falling back through the ranked servers.
+         *
+         * @param session       The session to connect; its server address is set to the server used.
+         * @param ranked        The ranked servers; when empty the session address is used as is.
+         *
+         * @return True on success, false if no server accepted the connection.
+         */
+        static bool connect(xiloader::session* session, const std::vector<xiloader::serverprobe>& ranked);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_SERVERLIST_H_INCLUDED__
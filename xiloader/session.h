@@ -0,0 +1,112 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_SESSION_H_INCLUDED__
+#define __XILOADER_SESSION_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "defines.h"
+#include "connectionpool.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+namespace xiloader
+{
+    /**
+     * @brief Socket object used to hold various important information.
+     */
+    typedef struct datasocket_t
+    {
+        datasocket_t() : s(INVALID_SOCKET), AccountId(0), LocalAddress((ULONG)-1), ServerAddress((ULONG)-1)
+        {}
+
+        SOCKET s;
+        UINT32 AccountId;
+        ULONG LocalAddress;
+        ULONG ServerAddress;
+    } datasocket;
+
+    /**
+     * @brief Progress of a session through login and the game, reported through session::Notify.
+     */
+    enum class loaderstage : int
+    {
+        connected = 1,  // Connected to the account server; value is the connect time in ms.
+        loggedin = 2,   // Logged in; value is the account id.
+        gamestart = 3,  // A game instance is starting; value is the launch number.
+        gameclose = 4,  // The game closed; value is its runtime in ms.
+        relaunch = 5    // A warm relaunch was prepared; value is the preparation time in ms.
+    };
+
+    /**
+     * @brief State of a single game client session.
+     *
+     * Everything the login, lobby and data server code needs for one client
+     * lives here instead of in process-wide globals, so the network threads of
+     * a session only ever see their own account and character list.
+     */
+    typedef struct session_t
+    {
+        session_t() : Language(xiloader::Language::English), ServerAddress("127.0.0.1"), ServerPort("51220"),
+            SecurityQuestionIDRecieved(0), CharacterList(NULL), IsRunning(false), Silent(false), UseLobby(true), Headless(false), Reconnects(0), Launches(0),
+            ShutdownEvent(::CreateEventA(NULL, TRUE, FALSE, NULL))
+        {}
+
+        ~session_t()
+        {
+            if (ShutdownEvent != NULL)
+                ::CloseHandle(ShutdownEvent);
+        }
+
+        xiloader::Language Language;        // The language of the loader to be used for polcore.
+        std::string ServerAddress;          // The server address to connect to.
+        std::string ServerPort;             // The local lobby port the client connects to.
+        std::string Username;               // The username being logged in with.
+        std::string Password;               // The password being logged in with.
+        std::string NewPassword;            // The password for resetting.
+        std::string ConfirmPassword;        // The password for confirmation.
+        std::string Email;                  // The email address.
+        std::string SecurityQuestionAnswer; // The security question answer.
+        std::string SecurityQuestionID;     // Security question id.
+        UINT32 SecurityQuestionIDRecieved;  // Security question id recieved.
+        char* CharacterList;                // Pointer to the character list data being sent from the server.
+        std::atomic<bool> IsRunning;        // Flag to determine if the network threads should hault.
+        bool Silent;                        // Should we log connection info on reset?
+        bool UseLobby;                      // Should this session host the local lobby listen server?
+        bool Headless;                      // Should the session log in with the supplied credentials without prompting?
+        HANDLE ShutdownEvent;               // Manual reset event set when the network threads must exit.
+        datasocket Socket;                  // Connection to the account and data servers.
+        connectionpool AccountPool;         // Pre-warmed connections to the account server.
+        std::atomic<uint32_t> Reconnects;   // Number of times the data channel was restored.
+        std::atomic<uint32_t> Launches;     // Number of game instances started.
+        std::function<void(xiloader::loaderstage, uint64_t)> Notify; // Optional progress callback.
+    } session;
+
+}; // namespace xiloader
+
+#endif // __XILOADER_SESSION_H_INCLUDED__
@@ -0,0 +1,191 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "supervisor.h"
+#include "console.h"
+#include "flightrecorder.h"
+#include "network.h"
+
+#include <vector>
+
+namespace xiloader
+{
+    /**
+     * @brief Appends a single argument to a command line, quoting it when required.
+     *
+     * @param commandLine   The command line to append to.
+     * @param argument      The argument to append.
+     */
+    static void appendargument(std::string& commandLine, const std::string& argument)
+    {
+        if (!commandLine.empty())
+            commandLine += ' ';
+
+        if (!argument.empty() && argument.find_first_of(" \t\"") == std::string::npos)
+        {
+            commandLine += argument;
+            return;
+        }
+
+        /* Quote the argument; backslashes only need escaping before a quote.. */
+        commandLine += '"';
+        size_t backslashes = 0;
+        for (auto c : argument)
+        {
+            if (c == '\\')
+            {
+                backslashes++;
+                continue;
+            }
+
+            commandLine.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+            commandLine += c;
+            backslashes = 0;
+        }
+        commandLine.append(backslashes * 2, '\\');
+        commandLine += '"';
+    }
+
+    /**
+     * @brief Builds the command line of a supervised client.
+     *
+     * @param session       The supervisor session.
+     * @param index         The index of the client.
+     * @param argc          The count of arguments the loader was launched with.
+     * @param argv          The arguments the loader was launched with.
+     *
+     * @return The client command line.
+     */
+    static std::string clientcommand(xiloader::session* session, int index, int argc, char* argv[])
+    {
+        char path[MAX_PATH] = { 0 };
+        ::GetModuleFileNameA(NULL, path, sizeof(path));
+
+        std::string commandLine;
+        appendargument(commandLine, path);
+
+        for (auto x = 1; x < argc; ++x)
+        {
+            /* Arguments the supervisor handles, or replaces, itself.. */
+            if (!_strnicmp(argv[x], "--instances", 11) || !_strnicmp(argv[x], "--server", 8) || !_strnicmp(argv[x], "--flight", 8))
+            {
+                x++;
+                continue;
+            }
+
+            /* Every client writes a binary log of its own.. */
+            if (!_strnicmp(argv[x], "--logfile", 9) && x + 1 < argc)
+            {
+                appendargument(commandLine, argv[x]);
+                appendargument(commandLine, std::string(argv[++x]) + "." + std::to_string(index));
+                continue;
+            }
+
+            appendargument(commandLine, argv[x]);
+        }
+
+        appendargument(commandLine, "--server");
+        appendargument(commandLine, session->ServerAddress);
+        appendargument(commandLine, "--nolobby");
+        return commandLine;
+    }
+
+    /**
+     * @brief Launches the clients and waits for all of them to exit.
+     *
+     * @param session       The supervisor session; its server address must already be resolved.
+     * @param count         The number of clients to launch.
+     * @param argc          The count of arguments the loader was launched with.
+     * @param argv          The arguments the loader was launched with; forwarded to the clients.
+     *
+     * @return 0 if every client exited cleanly, 1 otherwise.
+     */
+    int supervisor::run(xiloader::session* session, int count, int argc, char* argv[])
+    {
+        /* Host the lobby server every client connects to.. */
+        session->IsRunning = true;
+        auto hPolServer = ::CreateThread(NULL, 0, xiloader::network::PolServer, session, 0, NULL);
+
+        std::vector<HANDLE> processes;
+        std::vector<int> indexes;
+
+        for (auto x = 0; x < count && x < MAXIMUM_WAIT_OBJECTS; ++x)
+        {
+            auto commandLine = clientcommand(session, x + 1, argc, argv);
+
+            STARTUPINFOA si = { sizeof(si) };
+            PROCESS_INFORMATION pi = { 0 };
+            if (!::CreateProcessA(NULL, &commandLine[0], NULL, NULL, FALSE, CREATE_NEW_CONSOLE, NULL, NULL, &si, &pi))
+            {
+                XILOADER_ERROR("Failed to start client %d, error code: %u", x + 1, ::GetLastError());
+                continue;
+            }
+
+            ::CloseHandle(pi.hThread);
+            processes.push_back(pi.hProcess);
+            indexes.push_back(x + 1);
+
+            xiloader::flightrecorder::record(xiloader::flightevent::start, pi.dwProcessId, "client");
+            xiloader::console::output(xiloader::color::success, "Started client %d (process %u).", x + 1, pi.dwProcessId);
+        }
+
+        if (count > MAXIMUM_WAIT_OBJECTS)
+            XILOADER_WARNING("Only %d clients can be supervised at once.", MAXIMUM_WAIT_OBJECTS);
+
+        /* Wait for the clients to exit.. */
+        auto result = processes.size() == static_cast<size_t>(count) ? 0 : 1;
+        while (!processes.empty())
+        {
+            auto wait = ::WaitForMultipleObjects(static_cast<DWORD>(processes.size()), processes.data(), FALSE, INFINITE);
+            if (wait >= WAIT_OBJECT_0 + processes.size())
+            {
+                XILOADER_ERROR("Failed to wait for clients, error code: %u", ::GetLastError());
+                result = 1;
+                break;
+            }
+
+            auto slot = wait - WAIT_OBJECT_0;
+            DWORD exitCode = 0;
+            ::GetExitCodeProcess(processes[slot], &exitCode);
+            ::CloseHandle(processes[slot]);
+
+            if (exitCode != 0)
+                result = 1;
+
+            xiloader::flightrecorder::record(xiloader::flightevent::stop, exitCode, "client");
+            xiloader::console::output(exitCode == 0 ? xiloader::color::info : xiloader::color::warning, "Client %d exited with code %u.", indexes[slot], exitCode);
+
+            processes.erase(processes.begin() + slot);
+            indexes.erase(indexes.begin() + slot);
+        }
+
+        for (auto process : processes)
+            ::CloseHandle(process);
+
+        /* Stop the lobby server.. */
+        xiloader::network::Shutdown(session, &hPolServer, 1, 2000);
+
+        return result;
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,63 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_SUPERVISOR_H_INCLUDED__
+#define __XILOADER_SUPERVISOR_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "session.h"
+
+namespace xiloader
+{
+    /**
+     * @brief Launches and supervises several game clients.
+     *
+     * polcore and FFXiMain keep their state in module globals, so every game
+     * client needs a process of its own. The supervisor resolves the server
+     * once, hosts the single local lobby listen server all clients connect to
+     * and starts one loader process per client with its own session; clients
+     * receive the resolved address and skip DNS and the lobby port entirely.
+     */
+    class supervisor
+    {
+    public:
+
+        /**
+         * @brief Launches the clients and waits for all of them to exit.
+         *
+         * @param session       The supervisor session; its server address must already be resolved.
+         * @param count         The number of clients to launch.
+         * @param argc          The count of arguments the loader was launched with.
+         * @param argv          The arguments the loader was launched with; forwarded to the clients.
+         *
+         * @return 0 if every client exited cleanly, 1 otherwise.
+         */
+        static int run(xiloader::session* session, int count, int argc, char* argv[]);
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_SUPERVISOR_H_INCLUDED__
@@ -0,0 +1,553 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifdef _WIN32
+/* select() waits on the listener and every flow socket at once.. */
+#define FD_SETSIZE (UDPRELAY_MAX_FLOWS + 1)
+#endif
+
+#include "udprelay.h"
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET  (-1)
+#define closesocket     ::close
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace xiloader
+{
+    /**
+     * @brief A datagram buffer; allocated once per batch slot.
+     */
+    typedef struct udppacket_t
+    {
+        struct sockaddr_in Address;
+        uint32_t Length;
+        uint8_t Data[UDPRELAY_PACKET_SIZE];
+    } udppacket;
+
+    /**
+     * @brief A relayed client and its socket to the server.
+     */
+    typedef struct udpflow_t
+    {
+        struct sockaddr_in Client;
+        SOCKET Socket;
+        std::chrono::steady_clock::time_point LastSeen;
+    } udpflow;
+
+    /**
+     * @brief State of a relay; kept out of the header so it needs no socket headers.
+     */
+    struct udprelaystate
+    {
+        SOCKET Listener;
+        struct sockaddr_in Server;
+        std::vector<udpflow> Flows;
+        std::vector<uint32_t> Free;
+        std::unordered_map<uint64_t, uint32_t> Lookup;
+        std::vector<udppacket> Packets;
+        udppacket* Outgoing[UDPRELAY_BATCH];
+        uint32_t FlowOf[UDPRELAY_BATCH];
+#ifndef _WIN32
+        int Epoll;
+        struct mmsghdr Headers[UDPRELAY_BATCH];
+        struct iovec Vectors[UDPRELAY_BATCH];
+#endif
+        std::atomic<uint64_t> Relayed;
+        std::atomic<uint64_t> Bytes;
+        std::atomic<uint64_t> Dropped;
+        std::atomic<uint32_t> FlowCount;
+        std::atomic<uint64_t> LatencyTotal;
+        std::atomic<uint64_t> LatencyMax;
+    };
+
+    /* Marks the listener in the epoll data; flows use their index. */
+    static const uint32_t s_ListenerTag = UDPRELAY_MAX_FLOWS;
+
+    /* Marks a datagram that has no flow and is dropped. */
+    static const uint32_t s_NoFlow = UINT32_MAX;
+
+    /**
+     * @brief Makes a socket non-blocking.
+     */
+    static bool nonblocking(SOCKET sock)
+    {
+#ifdef _WIN32
+        u_long enable = 1;
+        return ioctlsocket(sock, FIONBIO, &enable) == 0;
+#else
+        return fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+    }
+
+    /**
+     * @brief Receives a batch of datagrams.
+     *
+     * @param state     The relay state.
+     * @param sock      The socket to receive from.
+     *
+     * @return The number of datagrams received into the packet buffers.
+     */
+    static uint32_t receive(udprelaystate& state, SOCKET sock)
+    {
+#ifdef _WIN32
+        /* No batched receive before Windows 8's registered I/O; drain the socket instead.. */
+        uint32_t count = 0;
+        while (count < UDPRELAY_BATCH)
+        {
+            auto& packet = state.Packets[count];
+            int length = sizeof(packet.Address);
+            auto received = recvfrom(sock, (char*)packet.Data, sizeof(packet.Data), 0, (struct sockaddr*)&packet.Address, &length);
+            if (received == SOCKET_ERROR)
+            {
+                /* An ICMP port unreachable for an earlier send; nothing to read.. */
+                if (WSAGetLastError() == WSAECONNRESET)
+                    continue;
+                break;
+            }
+
+            packet.Length = static_cast<uint32_t>(received);
+            count++;
+        }
+        return count;
+#else
+        for (uint32_t x = 0; x < UDPRELAY_BATCH; x++)
+        {
+            state.Vectors[x].iov_base = state.Packets[x].Data;
+            state.Vectors[x].iov_len = sizeof(state.Packets[x].Data);
+            memset(&state.Headers[x], 0x00, sizeof(state.Headers[x]));
+            state.Headers[x].msg_hdr.msg_name = &state.Packets[x].Address;
+            state.Headers[x].msg_hdr.msg_namelen = sizeof(state.Packets[x].Address);
+            state.Headers[x].msg_hdr.msg_iov = &state.Vectors[x];
+            state.Headers[x].msg_hdr.msg_iovlen = 1;
+        }
+
+        auto count = recvmmsg(sock, state.Headers, UDPRELAY_BATCH, MSG_DONTWAIT, nullptr);
+        if (count <= 0)
+            return 0;
+
+        for (auto x = 0; x < count; x++)
+            state.Packets[x].Length = state.Headers[x].msg_len;
+        return static_cast<uint32_t>(count);
+#endif
+    }
+
+    /**
+     * @brief Sends the datagrams queued in the outgoing list.
+     *
+     * @param state     The relay state.
+     * @param sock      The socket to send on.
+     * @param count     The number of queued datagrams.
+     * @param addressed True to send every datagram to its own address, false for a connected socket.
+     *
+     * @return The number of datagrams sent; the rest are dropped.
+     */
+    static uint32_t transmit(udprelaystate& state, SOCKET sock, uint32_t count, bool addressed)
+    {
+#ifdef _WIN32
+        uint32_t sent = 0;
+        for (; sent < count; sent++)
+        {
+            auto packet = state.Outgoing[sent];
+            auto result = addressed ? sendto(sock, (const char*)packet->Data, packet->Length, 0, (const struct sockaddr*)&packet->Address, sizeof(packet->Address))
+                : send(sock, (const char*)packet->Data, packet->Length, 0);
+            if (result == SOCKET_ERROR)
+                break;
+        }
+        return sent;
+#else
+        for (uint32_t x = 0; x < count; x++)
+        {
+            auto packet = state.Outgoing[x];
+            state.Vectors[x].iov_base = packet->Data;
+            state.Vectors[x].iov_len = packet->Length;
+            memset(&state.Headers[x], 0x00, sizeof(state.Headers[x]));
+            state.Headers[x].msg_hdr.msg_name = addressed ? &packet->Address : nullptr;
+            state.Headers[x].msg_hdr.msg_namelen = addressed ? sizeof(packet->Address) : 0;
+            state.Headers[x].msg_hdr.msg_iov = &state.Vectors[x];
+            state.Headers[x].msg_hdr.msg_iovlen = 1;
+        }
+
+        uint32_t sent = 0;
+        while (sent < count)
+        {
+            auto result = sendmmsg(sock, state.Headers + sent, count - sent, MSG_DONTWAIT);
+            if (result <= 0)
+                break;
+            sent += static_cast<uint32_t>(result);
+        }
+        return sent;
+#endif
+    }
+
+    /**
+     * @brief Builds the flow table key of a client.
+     */
+    static uint64_t flowkey(const struct sockaddr_in& address)
+    {
+        return (static_cast<uint64_t>(address.sin_addr.s_addr) << 16) | address.sin_port;
+    }
+
+    /**
+     * @brief Finds the flow of a client, opening one for a new client.
+     *
+     * @param state     The relay state.
+     * @param client    The client address.
+     *
+     * @return The flow index, s_NoFlow if the table is full or the socket could not be opened.
+     */
+    static uint32_t flow(udprelaystate& state, const struct sockaddr_in& client)
+    {
+        auto key = flowkey(client);
+        auto found = state.Lookup.find(key);
+        if (found != state.Lookup.end())
+            return found->second;
+
+        if (state.Free.empty())
+            return s_NoFlow;
+
+        /* A connected socket only hears its own server, so answers need no lookup.. */
+        auto sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET || !nonblocking(sock) || connect(sock, (const struct sockaddr*)&state.Server, sizeof(state.Server)) != 0)
+        {
+            if (sock != INVALID_SOCKET)
+                closesocket(sock);
+            return s_NoFlow;
+        }
+
+        auto index = state.Free.back();
+#ifndef _WIN32
+        struct epoll_event event;
+        memset(&event, 0x00, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        if (epoll_ctl(state.Epoll, EPOLL_CTL_ADD, sock, &event) != 0)
+        {
+            closesocket(sock);
+            return s_NoFlow;
+        }
+#endif
+
+        state.Free.pop_back();
+        state.Flows[index].Client = client;
+        state.Flows[index].Socket = sock;
+        state.Lookup[key] = index;
+        state.FlowCount++;
+        return index;
+    }
+
+    /**
+     * @brief Closes a flow.
+     */
+    static void unflow(udprelaystate& state, uint32_t index)
+    {
+        auto& entry = state.Flows[index];
+        closesocket(entry.Socket);
+        entry.Socket = INVALID_SOCKET;
+        state.Lookup.erase(flowkey(entry.Client));
+        state.Free.push_back(index);
+        state.FlowCount--;
+    }
+
+    /**
+     * @brief Adds datagrams that were just sent, and the time since they were received, to the counters.
+     */
+    static void account(udprelaystate& state, std::chrono::steady_clock::time_point received, uint32_t sent, uint64_t bytes)
+    {
+        auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - received).count());
+        state.Relayed.fetch_add(sent, std::memory_order_relaxed);
+        state.Bytes.fetch_add(bytes, std::memory_order_relaxed);
+        state.LatencyTotal.fetch_add(elapsed * sent, std::memory_order_relaxed);
+        if (elapsed > state.LatencyMax.load(std::memory_order_relaxed))
+            state.LatencyMax.store(elapsed, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Forwards a batch of client datagrams to the server.
+     */
+    static void fromclients(udprelaystate& state)
+    {
+        auto count = receive(state, state.Listener);
+        if (count == 0)
+            return;
+
+        auto received = std::chrono::steady_clock::now();
+        for (uint32_t x = 0; x < count; x++)
+        {
+            state.FlowOf[x] = flow(state, state.Packets[x].Address);
+            if (state.FlowOf[x] == s_NoFlow)
+                state.Dropped++;
+            else
+                state.Flows[state.FlowOf[x]].LastSeen = received;
+        }
+
+        /* Every flow has its own socket; send each flow's datagrams with one call.. */
+        for (uint32_t x = 0; x < count; x++)
+        {
+            auto index = state.FlowOf[x];
+            if (index == s_NoFlow)
+                continue;
+
+            uint32_t queued = 0;
+            for (auto y = x; y < count; y++)
+            {
+                if (state.FlowOf[y] != index)
+                    continue;
+                state.Outgoing[queued++] = &state.Packets[y];
+                state.FlowOf[y] = s_NoFlow;
+            }
+
+            auto sent = transmit(state, state.Flows[index].Socket, queued, false);
+            uint64_t bytes = 0;
+            for (uint32_t y = 0; y < sent; y++)
+                bytes += state.Outgoing[y]->Length;
+            state.Dropped += queued - sent;
+            account(state, received, sent, bytes);
+        }
+    }
+
+    /**
+     * @brief Forwards a batch of server datagrams to the client of a flow.
+     */
+    static void fromserver(udprelaystate& state, uint32_t index)
+    {
+        auto& entry = state.Flows[index];
+        auto count = receive(state, entry.Socket);
+        if (count == 0)
+            return;
+
+        auto received = std::chrono::steady_clock::now();
+        for (uint32_t x = 0; x < count; x++)
+        {
+            state.Packets[x].Address = entry.Client;
+            state.Outgoing[x] = &state.Packets[x];
+        }
+
+        auto sent = transmit(state, state.Listener, count, true);
+        uint64_t bytes = 0;
+        for (uint32_t x = 0; x < sent; x++)
+            bytes += state.Packets[x].Length;
+        state.Dropped += count - sent;
+        account(state, received, sent, bytes);
+    }
+
+    udprelay::udprelay()
+        : m_Running(false)
+    {}
+
+    udprelay::~udprelay()
+    {
+        this->close();
+    }
+
+    /**
+     * @brief Starts relaying.
+     *
+     * @param bind          The local address to receive the clients on, in network byte order.
+     * @param port          The local port to receive the clients on.
+     * @param server        The server address, in network byte order.
+     * @param serverPort    The server port.
+     *
+     * @return True on success, false if the port could not be opened.
+     */
+    bool udprelay::open(uint32_t bind, uint16_t port, uint32_t server, uint16_t serverPort)
+    {
+        this->close();
+
+        std::unique_ptr<udprelaystate> state(new udprelaystate());
+        state->Listener = INVALID_SOCKET;
+        memset(&state->Server, 0x00, sizeof(state->Server));
+        state->Server.sin_family = AF_INET;
+        state->Server.sin_port = htons(serverPort);
+        state->Server.sin_addr.s_addr = server;
+        state->Flows.resize(UDPRELAY_MAX_FLOWS);
+        state->Packets.resize(UDPRELAY_BATCH);
+        state->Lookup.reserve(UDPRELAY_MAX_FLOWS);
+        for (uint32_t x = UDPRELAY_MAX_FLOWS; x > 0; x--)
+            state->Free.push_back(x - 1);
+        for (auto& entry : state->Flows)
+            entry.Socket = INVALID_SOCKET;
+        state->Relayed = 0;
+        state->Bytes = 0;
+        state->Dropped = 0;
+        state->FlowCount = 0;
+        state->LatencyTotal = 0;
+        state->LatencyMax = 0;
+
+        struct sockaddr_in local;
+        memset(&local, 0x00, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_port = htons(port);
+        local.sin_addr.s_addr = bind;
+
+        /* Large socket buffers absorb bursts while the relay thread is busy.. */
+        int buffer = 1 << 20;
+        state->Listener = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (state->Listener == INVALID_SOCKET)
+            return false;
+        setsockopt(state->Listener, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer, sizeof(buffer));
+        setsockopt(state->Listener, SOL_SOCKET, SO_SNDBUF, (const char*)&buffer, sizeof(buffer));
+        if (!nonblocking(state->Listener) || ::bind(state->Listener, (const struct sockaddr*)&local, sizeof(local)) != 0)
+        {
+            closesocket(state->Listener);
+            return false;
+        }
+
+#ifndef _WIN32
+        state->Epoll = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event event;
+        memset(&event, 0x00, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = s_ListenerTag;
+        if (state->Epoll < 0 || epoll_ctl(state->Epoll, EPOLL_CTL_ADD, state->Listener, &event) != 0)
+        {
+            if (state->Epoll >= 0)
+                ::close(state->Epoll);
+            closesocket(state->Listener);
+            return false;
+        }
+#endif
+
+        m_State = std::move(state);
+        m_Running = true;
+        m_Thread = std::thread(&udprelay::loop, this);
+        return true;
+    }
+
+    /**
+     * @brief Stops relaying and closes every flow.
+     */
+    void udprelay::close()
+    {
+        if (!m_Running)
+            return;
+
+        m_Running = false;
+        m_Thread.join();
+
+        for (uint32_t x = 0; x < UDPRELAY_MAX_FLOWS; x++)
+        {
+            if (m_State->Flows[x].Socket != INVALID_SOCKET)
+                unflow(*m_State, x);
+        }
+
+        closesocket(m_State->Listener);
+#ifndef _WIN32
+        ::close(m_State->Epoll);
+#endif
+    }
+
+    /**
+     * @brief Obtains the counters of the relay.
+     *
+     * @param stats         Receives the counters.
+     */
+    void udprelay::stats(udprelaystats* stats) const
+    {
+        memset(stats, 0x00, sizeof(udprelaystats));
+        if (m_State == nullptr)
+            return;
+
+        stats->Packets = m_State->Relayed.load(std::memory_order_relaxed);
+        stats->Bytes = m_State->Bytes.load(std::memory_order_relaxed);
+        stats->Dropped = m_State->Dropped.load(std::memory_order_relaxed);
+        stats->Flows = m_State->FlowCount.load(std::memory_order_relaxed);
+        stats->LatencyTotal = m_State->LatencyTotal.load(std::memory_order_relaxed);
+        stats->LatencyMax = m_State->LatencyMax.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Relays datagrams until the relay is closed; runs on the relay thread.
+     */
+    void udprelay::loop()
+    {
+        auto& state = *m_State;
+        auto expire = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+        while (m_Running)
+        {
+            /* Wake up regularly to notice close() and to expire silent clients.. */
+#ifdef _WIN32
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(state.Listener, &readable);
+            for (auto& entry : state.Flows)
+            {
+                if (entry.Socket != INVALID_SOCKET)
+                    FD_SET(entry.Socket, &readable);
+            }
+
+            timeval timeout = { 0, 100000 };
+            if (select(0, &readable, NULL, NULL, &timeout) > 0)
+            {
+                if (FD_ISSET(state.Listener, &readable))
+                    fromclients(state);
+                for (uint32_t x = 0; x < UDPRELAY_MAX_FLOWS; x++)
+                {
+                    if (state.Flows[x].Socket != INVALID_SOCKET && FD_ISSET(state.Flows[x].Socket, &readable))
+                        fromserver(state, x);
+                }
+            }
+#else
+            struct epoll_event events[UDPRELAY_BATCH];
+            auto count = epoll_wait(state.Epoll, events, UDPRELAY_BATCH, 100);
+            for (auto x = 0; x < count; x++)
+            {
+                if (events[x].data.u32 == s_ListenerTag)
+                    fromclients(state);
+                else if (state.Flows[events[x].data.u32].Socket != INVALID_SOCKET)
+                    fromserver(state, events[x].data.u32);
+            }
+#endif
+
+            auto now = std::chrono::steady_clock::now();
+            if (now < expire)
+                continue;
+
+            expire = now + std::chrono::seconds(1);
+            for (uint32_t x = 0; x < UDPRELAY_MAX_FLOWS; x++)
+            {
+                auto& entry = state.Flows[x];
+                if (entry.Socket != INVALID_SOCKET && now - entry.LastSeen > std::chrono::milliseconds(UDPRELAY_IDLE_TIMEOUT))
+                    unflow(state, x);
+            }
+        }
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,121 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_UDPRELAY_H_INCLUDED__
+#define __XILOADER_UDPRELAY_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/* Datagrams received or sent per system call. */
+#define UDPRELAY_BATCH          64
+
+/* Largest datagram relayed; game packets stay well below the Ethernet MTU. */
+#define UDPRELAY_PACKET_SIZE    2048
+
+/* Maximum number of clients relayed at once. */
+#define UDPRELAY_MAX_FLOWS      1024
+
+/* Time, in milliseconds, after which the flow of a silent client is closed. */
+#define UDPRELAY_IDLE_TIMEOUT   60000
+
+namespace xiloader
+{
+    /**
+     * @brief Counters of a relay.
+     */
+    typedef struct udprelaystats_t
+    {
+        uint64_t Packets;       // The datagrams relayed, both directions.
+        uint64_t Bytes;         // The bytes relayed, both directions.
+        uint64_t Dropped;       // The datagrams dropped because the flow table was full or a send failed.
+        uint32_t Flows;         // The clients currently relayed.
+        uint64_t LatencyTotal;  // The time every datagram spent in the relay, summed, in nanoseconds.
+        uint64_t LatencyMax;    // The longest time a datagram spent in the relay, in nanoseconds.
+    } udprelaystats;
+
+    struct udprelaystate;
+
+    /**
+     * @brief Relays the game's UDP traffic between clients and a zone server.
+     *
+     * Clients send to the relay instead of the server; every client gets its
+     * own flow with a socket connected to the server, so the server tells
+     * the clients apart and its answers find their way back. Datagrams are
+     * moved in batches of UDPRELAY_BATCH through recvmmsg and sendmmsg on
+     * Linux, or by draining the non-blocking socket on Windows, using packet
+     * buffers allocated once when the relay opens. The relay runs on its own
+     * thread and measures how long every datagram spends inside it.
+     */
+    class udprelay
+    {
+        std::unique_ptr<udprelaystate> m_State;
+        std::thread m_Thread;
+        std::atomic<bool> m_Running;
+
+        udprelay(const udprelay&) = delete;
+        udprelay& operator=(const udprelay&) = delete;
+
+        /**
+         * @brief Relays datagrams until the relay is closed; runs on the relay thread.
+         */
+        void loop();
+
+    public:
+        udprelay();
+        ~udprelay();
+
+        /**
+         * @brief Starts relaying.
+         *
+         * @param bind          The local address to receive the clients on, in network byte order.
+         * @param port          The local port to receive the clients on.
+         * @param server        The server address, in network byte order.
+         * @param serverPort    The server port.
+         *
+         * @return True on success, false if the port could not be opened.
+         */
+        bool open(uint32_t bind, uint16_t port, uint32_t server, uint16_t serverPort);
+
+        /**
+         * @brief Stops relaying and closes every flow.
+         */
+        void close();
+
+        /**
+         * @brief Obtains the counters of the relay.
+         *
+         * @param stats         Receives the counters.
+         */
+        void stats(udprelaystats* stats) const;
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_UDPRELAY_H_INCLUDED__
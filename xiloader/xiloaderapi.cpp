@@ -0,0 +1,254 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#include "xiloaderapi.h"
+
+#include "console.h"
+#include "datcache.h"
+#include "loader.h"
+#include "logger.h"
+#include "nattable.h"
+#include "network.h"
+#include "prefetcher.h"
+#include "scheduler.h"
+#include "zonetrace.h"
+
+#include <chrono>
+#include <mutex>
+
+/**
+ * @brief Session handle handed out by the C API.
+ */
+struct xiloader_session
+{
+    xiloader::session Session;
+    std::mutex Lock;
+    xiloader_event_callback Callback = nullptr;
+    void* Context = nullptr;
+    double ConnectTime = 0;
+    double LoginTime = 0;
+};
+
+namespace xiloader
+{
+    static_assert(XILOADER_EVENT_CONNECTED == static_cast<int>(loaderstage::connected), "Event ids must match the loader stages.");
+    static_assert(XILOADER_EVENT_RELAUNCH == static_cast<int>(loaderstage::relaunch), "Event ids must match the loader stages.");
+
+    /**
+     * @brief Log sink forwarding formatted messages to the host's callback.
+     */
+    class callbacksink : public logsink
+    {
+        std::mutex m_Lock;
+        xiloader_log_callback m_Callback;
+        void* m_Context;
+
+    public:
+        callbacksink()
+            : logsink(loglevel::info, true), m_Callback(nullptr), m_Context(nullptr)
+        {}
+
+        void set(xiloader_log_callback callback, void* context)
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Callback = callback;
+            m_Context = context;
+        }
+
+        void write(const logrecord* record, const std::string& message) override
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            if (m_Callback != nullptr)
+                m_Callback(m_Context, record->level, message.c_str());
+        }
+    };
+
+    static callbacksink s_LogSink;
+    static bool s_LogAttached = false;
+
+    /**
+     * @brief Reports a session event to the host.
+     *
+     * @param handle    The session handle.
+     * @param stage     The stage reached.
+     * @param value     The value of the event.
+     */
+    static void notify(xiloader_session* handle, xiloader::loaderstage stage, uint64_t value)
+    {
+        std::lock_guard<std::mutex> guard(handle->Lock);
+        if (handle->Callback != nullptr)
+            handle->Callback(handle->Context, static_cast<int>(stage), value);
+    }
+
+}; // namespace xiloader
+
+int XILOADER_CALL xiloader_version(void)
+{
+    return XILOADER_API_VERSION;
+}
+
+int XILOADER_CALL xiloader_initialize(void)
+{
+    if (!xiloader::loader::Initialize())
+        return XILOADER_EXIT_ERROR;
+
+    xiloader::prefetcher::open(nullptr);
+    return XILOADER_EXIT_SUCCESS;
+}
+
+void XILOADER_CALL xiloader_uninitialize(void)
+{
+    xiloader::scheduler::stop();
+    xiloader::prefetcher::close();
+    xiloader::loader::Uninitialize();
+
+    /* Drain and join the log writer here; the library's static destructors must not join threads.. */
+    xiloader::logger::stop();
+    xiloader_set_log_callback(nullptr, nullptr, XILOADER_LEVEL_INFO);
+}
+
+void XILOADER_CALL xiloader_set_log_callback(xiloader_log_callback callback, void* context, int level)
+{
+    if (callback == nullptr)
+    {
+        if (xiloader::s_LogAttached)
+            xiloader::logger::detach(&xiloader::s_LogSink);
+        xiloader::s_LogAttached = false;
+        xiloader::s_LogSink.set(nullptr, nullptr);
+        return;
+    }
+
+    xiloader::s_LogSink.Threshold = static_cast<uint8_t>(level);
+    xiloader::s_LogSink.set(callback, context);
+    if (!xiloader::s_LogAttached)
+        xiloader::s_LogAttached = xiloader::logger::attach(&xiloader::s_LogSink);
+}
+
+int XILOADER_CALL xiloader_nat_add(const char* mapping)
+{
+    return xiloader::nattable::add(mapping) ? XILOADER_EXIT_SUCCESS : XILOADER_EXIT_ERROR;
+}
+
+xiloader_session* XILOADER_CALL xiloader_session_create(const char* server, const char* lobby_port, int language)
+{
+    ULONG address = 0;
+    if (server == nullptr || !xiloader::network::ResolveHostname(server, &address))
+    {
+        XILOADER_ERROR("Failed to resolve server hostname.");
+        return nullptr;
+    }
+
+    auto handle = new xiloader_session();
+    handle->Session.ServerAddress = inet_ntoa(*((struct in_addr*)&address));
+    handle->Session.Language = static_cast<xiloader::Language>(language);
+    handle->Session.Headless = true;
+    handle->Session.Silent = true;
+    if (lobby_port != nullptr)
+        handle->Session.ServerPort = lobby_port;
+
+    handle->Session.Notify = [handle](xiloader::loaderstage stage, uint64_t value) { xiloader::notify(handle, stage, value); };
+
+    /* Warm the registry settings while the host logs in.. */
+    xiloader::loader::Preload(handle->Session.Language);
+    return handle;
+}
+
+void XILOADER_CALL xiloader_session_destroy(xiloader_session* session)
+{
+    delete session;
+}
+
+void XILOADER_CALL xiloader_session_set_callback(xiloader_session* session, xiloader_event_callback callback, void* context)
+{
+    std::lock_guard<std::mutex> guard(session->Lock);
+    session->Callback = callback;
+    session->Context = context;
+}
+
+int XILOADER_CALL xiloader_session_login(xiloader_session* session, const char* username, const char* password)
+{
+    if (username == nullptr || password == nullptr || *username == '\0' || *password == '\0')
+        return XILOADER_EXIT_CREDENTIALS;
+
+    session->Session.Username = username;
+    session->Session.Password = password;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!xiloader::network::CreateConnection(&session->Session, "54231"))
+        return XILOADER_EXIT_CONNECT;
+
+    auto connected = std::chrono::steady_clock::now();
+    session->ConnectTime = std::chrono::duration<double, std::milli>(connected - start).count();
+    xiloader::notify(session, xiloader::loaderstage::connected, static_cast<uint64_t>(session->ConnectTime));
+
+    auto result = xiloader::network::LoginHeadless(&session->Session);
+    session->LoginTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - connected).count();
+    if (result == XILOADER_EXIT_SUCCESS)
+        xiloader::notify(session, xiloader::loaderstage::loggedin, session->Session.Socket.AccountId);
+
+    return result;
+}
+
+int XILOADER_CALL xiloader_session_launch(xiloader_session* session, uint32_t flags)
+{
+    if (session->Session.Socket.AccountId == 0)
+        return XILOADER_EXIT_LOGIN;
+
+    if (flags & XILOADER_LAUNCH_ZONETRACE)
+        xiloader::zonetrace::enable(true);
+
+    return xiloader::loader::Launch(&session->Session, (flags & XILOADER_LAUNCH_HAIRPIN) != 0, (flags & XILOADER_LAUNCH_RELAUNCH) != 0);
+}
+
+int XILOADER_CALL xiloader_session_metrics(xiloader_session* session, xiloader_metrics* metrics)
+{
+    if (metrics == nullptr || metrics->Size < sizeof(uint32_t))
+        return XILOADER_EXIT_ERROR;
+
+    xiloader_metrics current;
+    current.Size = sizeof(current);
+    current.AccountId = session->Session.Socket.AccountId;
+    current.Launches = session->Session.Launches;
+    current.Reconnects = session->Session.Reconnects;
+    current.ConnectTime = session->ConnectTime;
+    current.LoginTime = session->LoginTime;
+    current.LogDropped = xiloader::logger::dropped();
+    current.TasksStolen = xiloader::scheduler::stolen();
+    current.DatHits = xiloader::datcache::hits();
+    current.DatMisses = xiloader::datcache::misses();
+
+    xiloader::zonetransition zone;
+    current.ZoneChanges = xiloader::zonetrace::count();
+    if (!xiloader::zonetrace::last(&zone))
+        memset(&zone, 0x00, sizeof(zone));
+    current.ZoneDatReads = zone.DatReads;
+    current.ZoneSendTime = zone.SendTime;
+    current.ZoneReplyTime = zone.ReplyTime;
+    current.ZoneDatTime = zone.DatTime;
+
+    /* Older hosts pass a smaller structure; fill only what they know.. */
+    auto size = metrics->Size < sizeof(current) ? metrics->Size : static_cast<uint32_t>(sizeof(current));
+    memcpy(metrics, &current, size);
+    metrics->Size = size;
+    return XILOADER_EXIT_SUCCESS;
+}
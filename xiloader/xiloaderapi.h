@@ -0,0 +1,138 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+
+#ifndef __XILOADER_XILOADERAPI_H_INCLUDED__
+#define __XILOADER_XILOADERAPI_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+/*
+ * C API of the loader core library (xiloadercore.dll).
+ *
+ * A launcher can host many sessions in one process: sessions log in
+ * concurrently and share the resolver, registry and signature work, but
+ * polcore and FFXiMain allow only one running game per process, so
+ * xiloader_session_launch fails while another session's game runs.
+ *
+ * Every call returns one of the XILOADER_EXIT_ codes of defines.h unless
+ * noted otherwise. Callbacks run on loader threads and must not block.
+ *
+ * The library runs background threads (log writer, scheduler, prefetcher)
+ * that cannot be joined while the DLL is being unloaded; hosts must call
+ * xiloader_uninitialize before FreeLibrary.
+ */
+
+#include <stdint.h>
+
+#ifdef XILOADER_API_EXPORTS
+#define XILOADER_API __declspec(dllexport)
+#else
+#define XILOADER_API __declspec(dllimport)
+#endif
+
+#define XILOADER_CALL __cdecl
+
+/* Version of the API; bumped on incompatible changes only. */
+#define XILOADER_API_VERSION        1
+
+/* Session events passed to xiloader_event_callback. */
+#define XILOADER_EVENT_CONNECTED    1   /* Connected to the account server; value is the connect time in ms. */
+#define XILOADER_EVENT_LOGGEDIN     2   /* Logged in; value is the account id. */
+#define XILOADER_EVENT_GAMESTART    3   /* A game instance is starting; value is the launch number. */
+#define XILOADER_EVENT_GAMECLOSE    4   /* The game closed; value is its runtime in ms. */
+#define XILOADER_EVENT_RELAUNCH     5   /* A warm relaunch was prepared; value is the preparation time in ms. */
+
+/* Launch flags passed to xiloader_session_launch. */
+#define XILOADER_LAUNCH_HAIRPIN     0x01    /* Apply the hairpin fix. */
+#define XILOADER_LAUNCH_RELAUNCH    0x02    /* Relaunch the game when it closes, unless it closed right away. */
+#define XILOADER_LAUNCH_ZONETRACE   0x04    /* Time every zone change; see the Zone fields of xiloader_metrics. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct xiloader_session xiloader_session;
+
+typedef void (XILOADER_CALL *xiloader_event_callback)(void* context, int event, uint64_t value);
+typedef void (XILOADER_CALL *xiloader_log_callback)(void* context, int level, const char* message);
+
+/* Loader metrics; set Size to sizeof(xiloader_metrics) before querying. */
+typedef struct xiloader_metrics
+{
+    uint32_t Size;          /* Size of the structure, set by the caller. */
+    uint32_t AccountId;     /* Account id of the logged in session; 0 before login. */
+    uint32_t Launches;      /* Game instances started by the session. */
+    uint32_t Reconnects;    /* Times the data channel of the session was restored. */
+    double ConnectTime;     /* Time to connect to the account server, in ms. */
+    double LoginTime;       /* Time from connecting to the login reply, in ms. */
+    uint32_t LogDropped;    /* Log messages dropped process-wide because the log ring was full. */
+    uint64_t TasksStolen;   /* Background jobs moved between scheduler workers process-wide. */
+    uint64_t DatHits;       /* DAT file reads served from memory process-wide. */
+    uint64_t DatMisses;     /* DAT file reads that went to disk process-wide. */
+    uint32_t ZoneChanges;   /* Zone changes traced process-wide; the fields below describe the last one. */
+    uint32_t ZoneDatReads;  /* DAT files read between the zone server address write and the first reply. */
+    double ZoneSendTime;    /* Time from the zone server address write to the first packet sent to it, in ms. */
+    double ZoneReplyTime;   /* Time from the first packet sent to the first packet received, in ms; -1 if none came. */
+    double ZoneDatTime;     /* Time from the zone server address write to the last DAT read, in ms. */
+} xiloader_metrics;
+
+/* Obtains XILOADER_API_VERSION of the library. */
+XILOADER_API int XILOADER_CALL xiloader_version(void);
+
+/* Initializes Winsock, COM, the resolver detours and the DAT prefetcher; call once per process. */
+XILOADER_API int XILOADER_CALL xiloader_initialize(void);
+
+/* Stops and joins the background threads and undoes xiloader_initialize; no session may be running. Call before unloading the library. */
+XILOADER_API void XILOADER_CALL xiloader_uninitialize(void);
+
+/* Forwards log messages at or above the level (0 trace .. 4 error) to the callback; NULL detaches. */
+XILOADER_API void XILOADER_CALL xiloader_set_log_callback(xiloader_log_callback callback, void* context, int level);
+
+/* Rewrites connects and datagrams to an address, "address[:port]=address[:port]"; for every session until exit. */
+XILOADER_API int XILOADER_CALL xiloader_nat_add(const char* mapping);
+
+/* Creates a session for the server; NULL if the server does not resolve. lobby_port may be NULL. */
+XILOADER_API xiloader_session* XILOADER_CALL xiloader_session_create(const char* server, const char* lobby_port, int language);
+
+/* Destroys a session that is not running a game. */
+XILOADER_API void XILOADER_CALL xiloader_session_destroy(xiloader_session* session);
+
+/* Sets the callback that receives the XILOADER_EVENT_ events of the session. */
+XILOADER_API void XILOADER_CALL xiloader_session_set_callback(xiloader_session* session, xiloader_event_callback callback, void* context);
+
+/* Logs the session in without prompting. */
+XILOADER_API int XILOADER_CALL xiloader_session_login(xiloader_session* session, const char* username, const char* password);
+
+/* Runs the game of a logged in session; blocks until the game closes. */
+XILOADER_API int XILOADER_CALL xiloader_session_launch(xiloader_session* session, uint32_t flags);
+
+/* Fills the metrics of the session. */
+XILOADER_API int XILOADER_CALL xiloader_session_metrics(xiloader_session* session, xiloader_metrics* metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __XILOADER_XILOADERAPI_H_INCLUDED__
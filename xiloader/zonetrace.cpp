@@ -0,0 +1,268 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+#include "zonetrace.h"
+#include "console.h"
+#include "flightrecorder.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+namespace xiloader
+{
+    /**
+     * @brief Progress of the zone change in flight.
+     */
+    enum class zonephase : uint32_t
+    {
+        idle = 0,       // No zone change in flight.
+        written = 1,    // The address was written; waiting for the first send.
+        sent = 2        // The first packet was sent; waiting for the reply.
+    };
+
+    static std::atomic<bool> s_Enabled(false);
+    static std::atomic<uint32_t> s_Phase(static_cast<uint32_t>(zonephase::idle));
+    static std::atomic<uint32_t> s_Address(0);
+    static std::atomic<int64_t> s_Written(0);
+    static std::atomic<int64_t> s_Sent(0);
+    static std::atomic<int64_t> s_LastRead(0);
+    static std::atomic<uint32_t> s_Reads(0);
+
+    /* The finished transitions; only touched when a zone change starts or ends. */
+    static std::mutex s_Lock;
+    static zonetransition s_Last;
+    static uint32_t s_Count = 0;
+    static uint32_t s_Replies = 0;
+    static double s_SendTotal = 0;
+    static double s_ReplyTotal = 0;
+
+    /**
+     * @brief Obtains a monotonic timestamp.
+     *
+     * @return The timestamp, in nanoseconds.
+     */
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Determines whether an address is the zone server of the transition in flight.
+     *
+     * @param address   The address given to the socket call; may be nullptr.
+     * @param length    The length of the address.
+     *
+     * @return True if it is the zone server, false otherwise.
+     */
+    static bool matches(const struct sockaddr* address, int length)
+    {
+        if (address == nullptr || length < static_cast<int>(sizeof(struct sockaddr_in)) || address->sa_family != AF_INET)
+            return false;
+
+        return reinterpret_cast<const struct sockaddr_in*>(address)->sin_addr.s_addr == s_Address.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Finishes the transition in flight; the lock must be held.
+     *
+     * @param replied   True if the server replied, false if the transition was cut short.
+     * @param end       The time of the reply.
+     */
+    static void finish(bool replied, int64_t end)
+    {
+        auto written = s_Written.load();
+        auto sent = s_Sent.load();
+        auto lastRead = s_LastRead.load();
+
+        zonetransition transition;
+        transition.Address = s_Address.load();
+        transition.DatReads = s_Reads.load();
+        transition.SendTime = sent != 0 ? (sent - written) / 1000000.0 : -1;
+        transition.ReplyTime = replied && sent != 0 ? (end - sent) / 1000000.0 : -1;
+        transition.DatTime = lastRead != 0 ? (lastRead - written) / 1000000.0 : 0;
+
+        s_Last = transition;
+        s_Count++;
+        if (transition.ReplyTime >= 0)
+        {
+            s_Replies++;
+            s_SendTotal += transition.SendTime;
+            s_ReplyTotal += transition.ReplyTime;
+        }
+
+        char text[FLIGHT_TEXT_SIZE];
+        snprintf(text, sizeof(text), "dat %u reads", transition.DatReads);
+        xiloader::flightrecorder::record(xiloader::flightevent::zone, static_cast<uint64_t>(transition.DatTime * 1000), text);
+        xiloader::flightrecorder::record(xiloader::flightevent::zone, replied ? static_cast<uint64_t>(transition.ReplyTime * 1000) : 0, replied ? "reply" : "lost");
+
+        struct in_addr address;
+        address.s_addr = transition.Address;
+        XILOADER_DEBUG(xiloader::color::debug, "Zone change to %s: first send after %.1f ms, reply after %.1f ms, %u DAT reads within %.1f ms.",
+            inet_ntoa(address), transition.SendTime, transition.ReplyTime, transition.DatReads, transition.DatTime);
+    }
+
+    /**
+     * @brief Enables or disables tracing; the zone change patch only reports to the trace while enabled.
+     *
+     * @param enabled   True to trace the zone changes of the games started from now on.
+     */
+    void zonetrace::enable(bool enabled)
+    {
+        s_Enabled = enabled;
+    }
+
+    /**
+     * @brief Determines whether tracing is enabled.
+     *
+     * @return True if enabled, false otherwise.
+     */
+    bool zonetrace::enabled()
+    {
+        return s_Enabled.load();
+    }
+
+    /**
+     * @brief Starts a transition; called by the zone change patch.
+     *
+     * A transition still waiting for its reply is finished without one.
+     *
+     * @param address   The address the game will send to, in network byte order.
+     */
+    void zonetrace::written(uint32_t address)
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (s_Phase.exchange(static_cast<uint32_t>(zonephase::idle)) != static_cast<uint32_t>(zonephase::idle))
+            finish(false, 0);
+
+        s_Address = address;
+        s_Sent = 0;
+        s_LastRead = 0;
+        s_Reads = 0;
+        s_Written = now();
+        s_Phase.store(static_cast<uint32_t>(zonephase::written), std::memory_order_release);
+
+        struct in_addr server;
+        server.s_addr = address;
+        char text[FLIGHT_TEXT_SIZE];
+        snprintf(text, sizeof(text), "write %s", inet_ntoa(server));
+        xiloader::flightrecorder::record(xiloader::flightevent::zone, 0, text);
+    }
+
+    /**
+     * @brief Observes a datagram sent by the game.
+     *
+     * @param address   The destination of the datagram.
+     * @param length    The length of the destination.
+     */
+    void zonetrace::sent(const struct sockaddr* address, int length)
+    {
+        if (s_Phase.load(std::memory_order_acquire) != static_cast<uint32_t>(zonephase::written) || !matches(address, length))
+            return;
+
+        /* Stamp before publishing the phase, so the reply never sees a missing send time.. */
+        int64_t none = 0;
+        auto stamp = now();
+        s_Sent.compare_exchange_strong(none, stamp);
+
+        auto expected = static_cast<uint32_t>(zonephase::written);
+        if (s_Phase.compare_exchange_strong(expected, static_cast<uint32_t>(zonephase::sent)))
+            xiloader::flightrecorder::record(xiloader::flightevent::zone, static_cast<uint64_t>((s_Sent.load() - s_Written.load()) / 1000), "send");
+    }
+
+    /**
+     * @brief Observes a datagram received by the game.
+     *
+     * @param address   The source of the datagram as the game sees it, after NAT translation is undone; may be nullptr.
+     * @param length    The length of the source.
+     */
+    void zonetrace::received(const struct sockaddr* address, int length)
+    {
+        if (s_Phase.load(std::memory_order_acquire) != static_cast<uint32_t>(zonephase::sent) || !matches(address, length))
+            return;
+
+        auto stamp = now();
+        std::lock_guard<std::mutex> guard(s_Lock);
+        auto expected = static_cast<uint32_t>(zonephase::sent);
+        if (s_Phase.compare_exchange_strong(expected, static_cast<uint32_t>(zonephase::idle)))
+            finish(true, stamp);
+    }
+
+    /**
+     * @brief Observes a DAT file read by the game.
+     */
+    void zonetrace::datread()
+    {
+        if (s_Phase.load(std::memory_order_relaxed) == static_cast<uint32_t>(zonephase::idle))
+            return;
+
+        s_Reads++;
+        s_LastRead = now();
+    }
+
+    /**
+     * @brief Obtains the number of finished transitions.
+     *
+     * @return The number of transitions.
+     */
+    uint32_t zonetrace::count()
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        return s_Count;
+    }
+
+    /**
+     * @brief Obtains the last finished transition.
+     *
+     * @param transition    Receives the transition.
+     *
+     * @return True on success, false if no transition finished yet.
+     */
+    bool zonetrace::last(zonetransition* transition)
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (s_Count == 0)
+            return false;
+
+        *transition = s_Last;
+        return true;
+    }
+
+    /**
+     * @brief Logs the averages of the finished transitions.
+     */
+    void zonetrace::report()
+    {
+        std::lock_guard<std::mutex> guard(s_Lock);
+        if (s_Count == 0)
+            return;
+
+        XILOADER_DEBUG(xiloader::color::debug, "Zone changes: %u traced, %u replied; first send after %.1f ms, reply after %.1f ms on average.", s_Count, s_Replies,
+            s_Replies ? s_SendTotal / s_Replies : 0.0, s_Replies ? s_ReplyTotal / s_Replies : 0.0);
+    }
+
+}; // namespace xiloader
@@ -0,0 +1,138 @@
+/*
+===========================================================================
+
+Copyright (c) 2010-2014 Darkstar Dev Teams
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see http://www.gnu.org/licenses/
+
+This file is part of DarkStar-server source code.
+
+===========================================================================
+*/
+#ifndef __XILOADER_ZONETRACE_H_INCLUDED__
+#define __XILOADER_ZONETRACE_H_INCLUDED__
+
+#if defined (_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <cstdint>
+
+namespace xiloader
+{
+    /**
+     * @brief Timing breakdown of a single zone change.
+     */
+    typedef struct zonetransition_t
+    {
+        uint32_t Address;   // The zone server the game switched to, in network byte order.
+        uint32_t DatReads;  // The DAT files read between the address write and the first reply.
+        double SendTime;    // Time from the address write to the first packet sent to the server, in ms.
+        double ReplyTime;   // Time from the first packet sent to the first packet received, in ms; -1 if none came.
+        double DatTime;     // Time from the address write to the last DAT read before the reply, in ms.
+    } zonetransition;
+
+    /**
+     * @brief Zone transition latency tracer.
+     *
+     * The zone change patch reports when the game writes the address of the
+     * next zone server, the socket detours report the first datagram sent to
+     * and received from that server, and the DAT interposers count the reads
+     * in between. The time to the first send is spent in the client, mostly
+     * loading the zone's DAT files; the time to the first reply is spent on
+     * the network and the server.
+     *
+     * The detours call in for every datagram; while no zone change is in
+     * flight that costs a single atomic load.
+     */
+    class zonetrace
+    {
+    public:
+
+        /**
+         * @brief Enables or disables tracing; the zone change patch only reports to the trace while enabled.
+         *
+         * @param enabled   True to trace the zone changes of the games started from now on.
+         */
+        static void enable(bool enabled);
+
+        /**
+         * @brief Determines whether tracing is enabled.
+         *
+         * @return True if enabled, false otherwise.
+         */
+        static bool enabled();
+
+        /**
+         * @brief Starts a transition; called by the zone change patch.
+         *
+         * A transition still waiting for its reply is finished without one.
+         *
+         * @param address   The address the game will send to, in network byte order.
+         */
+        static void written(uint32_t address);
+
+        /**
+         * @brief Observes a datagram sent by the game.
+         *
+         * @param address   The destination of the datagram.
+         * @param length    The length of the destination.
+         */
+        static void sent(const struct sockaddr* address, int length);
+
+        /**
+         * @brief Observes a datagram received by the game.
+         *
+         * @param address   The source of the datagram as the game sees it, after NAT translation is undone; may be nullptr.
+         * @param length    The length of the source.
+         */
+        static void received(const struct sockaddr* address, int length);
+
+        /**
+         * @brief Observes a DAT file read by the game.
+         */
+        static void datread();
+
+        /**
+         * @brief Obtains the number of finished transitions.
+         *
+         * @return The number of transitions.
+         */
+        static uint32_t count();
+
+        /**
+         * @brief Obtains the last finished transition.
+         *
+         * @param transition    Receives the transition.
+         *
+         * @return True on success, false if no transition finished yet.
+         */
+        static bool last(zonetransition* transition);
+
+        /**
+         * @brief Logs the averages of the finished transitions.
+         */
+        static void report();
+    };
+
+}; // namespace xiloader
+
+#endif // __XILOADER_ZONETRACE_H_INCLUDED__